@@ -75,6 +75,7 @@ OPENAFS_CROSSTOOLS
 OPENAFS_LINT
 OPENAFS_JAVA
 OPENAFS_CRYPT_CHECKS
+OPENAFS_ZLIB
 OPENAFS_C_STRUCT_LABEL_CHECK
 OPENAFS_DIRENT_CHECKS
 OPENAFS_SYS_RESOURCE_CHECKS
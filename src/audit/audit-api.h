@@ -15,6 +15,7 @@ struct osi_audit_ops {
     void (*append_msg)(const char *format, ...);
     int  (*open_file)(const char *fileName);
     void (*print_interface_stats)(FILE *out);
+    void (*flush_msgs)(void);	/* optional; after a batch of messages */
 };
 
 #endif /* _AUDIT_API_H */
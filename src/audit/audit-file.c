@@ -22,6 +22,11 @@ static void
 send_msg(void)
 {
     fprintf(auditout, "\n");
+}
+
+static void
+flush_msgs(void)
+{
     fflush(auditout);
 }
 
@@ -84,4 +89,5 @@ const struct osi_audit_ops audit_file_ops = {
     &append_msg,
     &open_file,
     &print_interface_stats,
+    &flush_msgs,
 };
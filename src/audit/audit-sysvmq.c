@@ -124,6 +124,7 @@ const struct osi_audit_ops audit_sysvmq_ops = {
     &append_msg,
     &open_file,
     &print_interface_stats,
+    NULL,
 };
 
 #endif /* HAVE_SYS_IPC_H */
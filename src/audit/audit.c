@@ -153,116 +153,277 @@ audmakebuf(char *audEvent, va_list vaList)
 }
 #endif
 
+/*
+ * Audit events are first encoded into a record, copying everything the
+ * arguments point to, and then formatted for the audit interface from
+ * the record.  In threaded servers the formatting and writing are done
+ * by a separate thread (see below), so the record must not point to
+ * anything the caller owns.
+ *
+ * A record is a struct audit_rec, the event name and, if hasName, the
+ * user name as strings, and then each argument as its one byte AUD_ type
+ * followed by its value, up to an AUD_END byte.  Strings are preceded
+ * by a byte saying whether they were NULL; so are a FID, and the FIDS
+ * of a struct AFSCBFids and then its array, which is preceded by its
+ * length.  Integers are 4 bytes in host order.  len is a multiple of 8,
+ * so records may follow each other in the ring.
+ */
+struct audit_rec {
+    afs_uint32 len;
+    afs_int32 errCode;
+    afs_int32 hostId;
+    afs_int32 threadNum;
+    afs_int64 when;
+    char hasName;
+};
+
+struct audit_enc {
+    char *buf;			/* NULL just to count the length */
+    size_t len;
+};
+
+static void
+enc_bytes(struct audit_enc *e, const void *p, size_t n)
+{
+    if (e->buf)
+	memcpy(e->buf + e->len, p, n);
+    e->len += n;
+}
+
+static void
+enc_byte(struct audit_enc *e, char c)
+{
+    enc_bytes(e, &c, 1);
+}
+
+static void
+enc_int(struct audit_enc *e, afs_int32 i)
+{
+    enc_bytes(e, &i, sizeof(i));
+}
+
 static void
-printbuf(int rec, char *audEvent, char *afsName, afs_int32 hostId,
-	 afs_int32 errCode, va_list vaList)
+enc_str(struct audit_enc *e, const char *str)
 {
+    enc_byte(e, str != NULL);
+    if (str)
+	enc_bytes(e, str, strlen(str) + 1);
+}
+
+static void
+enc_fid(struct audit_enc *e, struct AFSFid *fid)
+{
+    enc_int(e, fid->Volume);
+    enc_int(e, fid->Vnode);
+    enc_int(e, fid->Unique);
+}
+
+/* Encode an event into e->buf, or if that is NULL just find its length. */
+static void
+audit_encode(struct audit_enc *e, char *audEvent, afs_int32 errCode,
+	     char *afsName, afs_int32 hostId, va_list vaList)
+{
+    struct audit_rec hdr;
     int vaEntry;
-    int vaInt;
-    afs_int32 vaLong;
-    char *vaStr;
     struct AFSFid *vaFid;
     struct AFSCBFids *vaFids;
-    int num = LogThreadNum();
+    unsigned int i;
+
+    e->len = sizeof(hdr);
+    enc_bytes(e, audEvent, strlen(audEvent) + 1);
+    if (afsName)
+	enc_bytes(e, afsName, strlen(afsName) + 1);
+
+    vaEntry = va_arg(vaList, int);
+    while (vaEntry != AUD_END) {
+	enc_byte(e, vaEntry);
+	switch (vaEntry) {
+	case AUD_STR:
+	case AUD_NAME:
+	case AUD_ACL:
+	    enc_str(e, va_arg(vaList, char *));
+	    break;
+	case AUD_INT:
+	case AUD_ID:
+	    enc_int(e, va_arg(vaList, int));
+	    break;
+	case AUD_DATE:
+	case AUD_HOST:
+	case AUD_LONG:
+	    enc_int(e, va_arg(vaList, afs_int32));
+	    break;
+	case AUD_FID:
+	    vaFid = va_arg(vaList, struct AFSFid *);
+	    enc_byte(e, vaFid != NULL);
+	    if (vaFid)
+		enc_fid(e, vaFid);
+	    break;
+	case AUD_FIDS:
+	    vaFids = va_arg(vaList, struct AFSCBFids *);
+	    enc_byte(e, vaFids != NULL);
+	    if (vaFids) {
+		vaFid = vaFids->AFSCBFids_val;
+		enc_byte(e, vaFid != NULL);
+		if (vaFid) {
+		    enc_int(e, vaFids->AFSCBFids_len);
+		    for (i = 0; i < vaFids->AFSCBFids_len; i++)
+			enc_fid(e, &vaFid[i]);
+		}
+	    }
+	    break;
+	default:
+	    break;
+	}
+	vaEntry = va_arg(vaList, int);
+    }
+    enc_byte(e, AUD_END);
+    e->len = (e->len + 7) & ~7;
+
+    if (e->buf) {
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.len = e->len;
+	hdr.errCode = errCode;
+	hdr.hostId = hostId;
+	hdr.threadNum = LogThreadNum();
+	hdr.when = time(NULL);
+	hdr.hasName = (afsName != NULL);
+	memcpy(e->buf, &hdr, sizeof(hdr));
+    }
+}
+
+static char *
+dec_str(char **pp)
+{
+    char *str = NULL;
+
+    if (*(*pp)++) {
+	str = *pp;
+	*pp += strlen(str) + 1;
+    }
+    return str;
+}
+
+static afs_int32
+dec_int(char **pp)
+{
+    afs_int32 i;
+
+    memcpy(&i, *pp, sizeof(i));
+    *pp += sizeof(i);
+    return i;
+}
+
+static void
+dec_fid(char **pp, struct AFSFid *fid)
+{
+    fid->Volume = dec_int(pp);
+    fid->Vnode = dec_int(pp);
+    fid->Unique = dec_int(pp);
+}
+
+/* Format an encoded event for the audit interface. */
+static void
+printrec(char *rec)
+{
+    struct audit_rec hdr;
+    char *p, *audEvent, *afsName = NULL, *vaStr;
+    int vaEntry;
+    struct AFSFid vaFid;
     struct in_addr hostAddr;
     time_t currenttime;
     char tbuffer[26];
     struct tm tm;
+    afs_uint32 i, n;
+
+    memcpy(&hdr, rec, sizeof(hdr));
+    p = rec + sizeof(hdr);
+    audEvent = p;
+    p += strlen(p) + 1;
+    if (hdr.hasName) {
+	afsName = p;
+	p += strlen(p) + 1;
+    }
 
-    /* Don't print the timestamp or thread id if we recursed */
-    if (rec == 0) {
-	currenttime = time(0);
-	if (strftime(tbuffer, sizeof(tbuffer), "%a %b %d %H:%M:%S %Y ",
-		     localtime_r(&currenttime, &tm)) !=0)
-	    audit_ops->append_msg(tbuffer);
+    currenttime = hdr.when;
+    if (strftime(tbuffer, sizeof(tbuffer), "%a %b %d %H:%M:%S %Y ",
+		 localtime_r(&currenttime, &tm)) !=0)
+	audit_ops->append_msg(tbuffer);
 
-	if (num > -1)
-	    audit_ops->append_msg("[%d] ", num);
-    }
+    if (hdr.threadNum > -1)
+	audit_ops->append_msg("[%d] ", hdr.threadNum);
 
-    audit_ops->append_msg("EVENT %s CODE %d ", audEvent, errCode);
+    audit_ops->append_msg("EVENT %s CODE %d ", audEvent, hdr.errCode);
 
     if (afsName) {
-	hostAddr.s_addr = hostId;
+	hostAddr.s_addr = hdr.hostId;
 	audit_ops->append_msg("NAME %s HOST %s ", afsName, inet_ntoa(hostAddr));
     }
 
-    vaEntry = va_arg(vaList, int);
-    while (vaEntry != AUD_END) {
+    while ((vaEntry = *p++) != AUD_END) {
 	switch (vaEntry) {
 	case AUD_STR:		/* String */
-	    vaStr = (char *)va_arg(vaList, char *);
+	    vaStr = dec_str(&p);
 	    if (vaStr)
 		audit_ops->append_msg("STR %s ", vaStr);
 	    else
 		audit_ops->append_msg("STR <null>");
 	    break;
 	case AUD_NAME:		/* Name */
-	    vaStr = (char *)va_arg(vaList, char *);
+	    vaStr = dec_str(&p);
 	    if (vaStr)
 		audit_ops->append_msg("NAME %s ", vaStr);
 	    else
 		audit_ops->append_msg("NAME <null>");
 	    break;
 	case AUD_ACL:		/* ACL */
-	    vaStr = (char *)va_arg(vaList, char *);
+	    vaStr = dec_str(&p);
 	    if (vaStr)
 		audit_ops->append_msg("ACL %s ", vaStr);
 	    else
 		audit_ops->append_msg("ACL <null>");
 	    break;
 	case AUD_INT:		/* Integer */
-	    vaInt = va_arg(vaList, int);
-	    audit_ops->append_msg("INT %d ", vaInt);
+	    audit_ops->append_msg("INT %d ", dec_int(&p));
 	    break;
 	case AUD_ID:		/* ViceId */
-	    vaInt = va_arg(vaList, int);
-	    audit_ops->append_msg("ID %d ", vaInt);
+	    audit_ops->append_msg("ID %d ", dec_int(&p));
 	    break;
 	case AUD_DATE:		/* Date    */
-	    vaLong = va_arg(vaList, afs_int32);
-	    audit_ops->append_msg("DATE %u ", vaLong);
+	    audit_ops->append_msg("DATE %u ", dec_int(&p));
 	    break;
 	case AUD_HOST:		/* Host ID */
-	    vaLong = va_arg(vaList, afs_int32);
-            hostAddr.s_addr = vaLong;
+            hostAddr.s_addr = dec_int(&p);
 	    audit_ops->append_msg("HOST %s ", inet_ntoa(hostAddr));
 	    break;
 	case AUD_LONG:		/* afs_int32    */
-	    vaLong = va_arg(vaList, afs_int32);
-	    audit_ops->append_msg("LONG %d ", vaLong);
+	    audit_ops->append_msg("LONG %d ", dec_int(&p));
 	    break;
 	case AUD_FID:		/* AFSFid - contains 3 entries */
-	    vaFid = va_arg(vaList, struct AFSFid *);
-	    if (vaFid)
-		audit_ops->append_msg("FID %u:%u:%u ", vaFid->Volume, vaFid->Vnode,
-		       vaFid->Unique);
-	    else
+	    if (*p++) {
+		dec_fid(&p, &vaFid);
+		audit_ops->append_msg("FID %u:%u:%u ", vaFid.Volume, vaFid.Vnode,
+		       vaFid.Unique);
+	    } else
 		audit_ops->append_msg("FID %u:%u:%u ", 0, 0, 0);
 	    break;
 	case AUD_FIDS:		/* array of Fids */
-	    vaFids = va_arg(vaList, struct AFSCBFids *);
-
-	    if (vaFids) {
-                unsigned int i;
-
-                vaFid = vaFids->AFSCBFids_val;
-
-                if (vaFid) {
-                    audit_ops->append_msg("FIDS %u ", vaFids->AFSCBFids_len);
-                    for ( i = 1; i <= vaFids->AFSCBFids_len; i++, vaFid++ )
-                        audit_ops->append_msg("FID %u:%u:%u ", vaFid->Volume,
-                                vaFid->Vnode, vaFid->Unique);
+	    if (*p++) {
+                if (*p++) {
+		    n = dec_int(&p);
+                    audit_ops->append_msg("FIDS %u ", n);
+                    for (i = 0; i < n; i++) {
+			dec_fid(&p, &vaFid);
+                        audit_ops->append_msg("FID %u:%u:%u ", vaFid.Volume,
+                                vaFid.Vnode, vaFid.Unique);
+		    }
                 } else
                     audit_ops->append_msg("FIDS 0 FID 0:0:0 ");
-
             }
 	    break;
 	default:
 	    audit_ops->append_msg("--badval-- ");
 	    break;
 	}			/* end switch */
-	vaEntry = va_arg(vaList, int);
     }				/* end while */
 
     audit_ops->send_msg();
@@ -279,7 +440,217 @@ osi_audit_init_lock(void)
     MUTEX_INIT(&audit_lock, "audit", MUTEX_DEFAULT, 0);
     audit_lock_initialized = 1;
 }
+
+/*
+ * In threaded servers, the threads making audit events just copy their
+ * records into a ring, and a writer thread takes all the records there
+ * at once and writes them out, flushing only after each batch.
+ *
+ * When the ring is full, threads wait for the writer to make room.  But
+ * if the writer has taken nothing for AUDIT_STALL_SECS, because writing
+ * to the audit interface is stuck, events are dropped and counted rather
+ * than hanging the server.  At exit we wait for the ring to be written
+ * out, within the same limit.
+ */
+#define AUDIT_RING_SIZE		(1024 * 1024)
+#define AUDIT_STALL_SECS	10
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cv;		/* the writer waits for records */
+    pthread_cond_t space_cv;	/* others wait for the writer */
+    int running;
+    char *buf;
+    size_t head;		/* bytes ever queued */
+    size_t tail;		/* bytes ever taken by the writer */
+    size_t done;		/* bytes ever written out */
+    size_t hiwater;		/* most bytes in the ring */
+    time_t progress;		/* when the writer last took records, or
+				 * was last given some after idling */
+    afs_uint64 queued;
+    afs_uint64 written;
+    afs_uint64 batches;
+    afs_uint64 dropped;
+    afs_uint64 waits;
+} audit_ring;
+
+static void
+audit_ring_copy(char *to, size_t from, size_t len)
+{
+    size_t off = from % AUDIT_RING_SIZE;
+    size_t n = AUDIT_RING_SIZE - off;
+
+    if (n > len)
+	n = len;
+
+    memcpy(to, audit_ring.buf + off, n);
+    memcpy(to + n, audit_ring.buf, len - n);
+}
+
+static void *
+audit_writer(void *arg)
+{
+    char *batch = arg;
+    size_t len, off;
+    afs_uint64 nrecs;
+    struct audit_rec hdr;
+
+    afs_pthread_setname_self("audit writer");
+    MUTEX_ENTER(&audit_ring.lock);
+    for (;;) {
+	while (audit_ring.head == audit_ring.tail)
+	    CV_WAIT(&audit_ring.cv, &audit_ring.lock);
+	len = audit_ring.head - audit_ring.tail;
+	audit_ring_copy(batch, audit_ring.tail, len);
+	audit_ring.tail = audit_ring.head;
+	audit_ring.progress = time(NULL);
+	CV_BROADCAST(&audit_ring.space_cv);
+	MUTEX_EXIT(&audit_ring.lock);
+
+	for (off = 0, nrecs = 0; off < len; off += hdr.len, nrecs++) {
+	    memcpy(&hdr, batch + off, sizeof(hdr));
+	    printrec(batch + off);
+	}
+	if (audit_ops->flush_msgs)
+	    audit_ops->flush_msgs();
+
+	MUTEX_ENTER(&audit_ring.lock);
+	audit_ring.done += len;
+	audit_ring.written += nrecs;
+	audit_ring.batches++;
+	CV_BROADCAST(&audit_ring.space_cv);
+    }
+    AFS_UNREACHED(return NULL);
+}
+
+/* Wait for the writer to take a record, or one second. */
+static void
+audit_ring_wait(void)
+{
+    struct timespec ts;
+
+    ts.tv_sec = time(NULL) + 1;
+    ts.tv_nsec = 0;
+    CV_TIMEDWAIT(&audit_ring.space_cv, &audit_ring.lock, &ts);
+}
+
+static void
+audit_ring_drain(void)
+{
+    MUTEX_ENTER(&audit_ring.lock);
+    while (audit_ring.done != audit_ring.head
+	   && time(NULL) - audit_ring.progress <= AUDIT_STALL_SECS)
+	audit_ring_wait();
+    MUTEX_EXIT(&audit_ring.lock);
+}
+
+static void
+audit_ring_start(void)
+{
+    pthread_t tid;
+    pthread_attr_t tattr;
+    char *batch;
+
+    if (audit_ring.buf)
+	return;
+    audit_ring.buf = malloc(AUDIT_RING_SIZE);
+    batch = malloc(AUDIT_RING_SIZE);
+    if (!audit_ring.buf || !batch) {
+	free(audit_ring.buf);
+	free(batch);
+	audit_ring.buf = NULL;
+	return;
+    }
+    MUTEX_INIT(&audit_ring.lock, "audit ring", MUTEX_DEFAULT, 0);
+    CV_INIT(&audit_ring.cv, "audit ring", CV_DEFAULT, 0);
+    CV_INIT(&audit_ring.space_cv, "audit ring space", CV_DEFAULT, 0);
+    audit_ring.progress = time(NULL);
+
+    if (pthread_attr_init(&tattr) != 0
+	|| pthread_attr_setdetachstate(&tattr, PTHREAD_CREATE_DETACHED) != 0
+	|| pthread_create(&tid, &tattr, audit_writer, batch) != 0) {
+	ViceLog(0, ("Warning: cannot start the audit writer thread; "
+		    "writing audit events synchronously.\n"));
+	free(batch);
+	return;
+    }
+    atexit(audit_ring_drain);
+    audit_ring.running = 1;
+}
+
+/* Queue a record for the writer. */
+static void
+audit_ring_put(char *rec, size_t len)
+{
+    size_t off, n, used;
+
+    MUTEX_ENTER(&audit_ring.lock);
+    while (AUDIT_RING_SIZE - (audit_ring.head - audit_ring.tail) < len) {
+	if (len > AUDIT_RING_SIZE
+	    || time(NULL) - audit_ring.progress > AUDIT_STALL_SECS) {
+	    audit_ring.dropped++;
+	    MUTEX_EXIT(&audit_ring.lock);
+	    return;
+	}
+	audit_ring.waits++;
+	audit_ring_wait();
+    }
+    off = audit_ring.head % AUDIT_RING_SIZE;
+    n = AUDIT_RING_SIZE - off;
+    if (n > len)
+	n = len;
+    memcpy(audit_ring.buf + off, rec, n);
+    memcpy(audit_ring.buf, rec + n, len - n);
+    if (audit_ring.head == audit_ring.tail) {
+	/* the writer has been idle, not stalled; start its clock now */
+	audit_ring.progress = time(NULL);
+	CV_BROADCAST(&audit_ring.cv);
+    }
+    audit_ring.head += len;
+    audit_ring.queued++;
+    used = audit_ring.head - audit_ring.tail;
+    if (used > audit_ring.hiwater)
+	audit_ring.hiwater = used;
+    MUTEX_EXIT(&audit_ring.lock);
+}
+#endif /* AFS_PTHREAD_ENV */
+
+/* Record an event, and write it out or give it to the writer thread. */
+static void
+audit_record(char *audEvent, afs_int32 errCode, char *afsName,
+	     afs_int32 hostId, va_list vaList)
+{
+    struct audit_enc e;
+    char stackbuf[1024];
+    va_list countList;
+
+    e.buf = NULL;
+    va_copy(countList, vaList);
+    audit_encode(&e, audEvent, errCode, afsName, hostId, countList);
+    va_end(countList);
+
+    if (e.len <= sizeof(stackbuf))
+	e.buf = stackbuf;
+    else if ((e.buf = malloc(e.len)) == NULL)
+	return;
+    audit_encode(&e, audEvent, errCode, afsName, hostId, vaList);
+
+#ifdef AFS_PTHREAD_ENV
+    if (audit_ring.running) {
+	audit_ring_put(e.buf, e.len);
+    } else
 #endif
+    {
+	MUTEX_ENTER(&audit_lock);
+	printrec(e.buf);
+	if (audit_ops->flush_msgs)
+	    audit_ops->flush_msgs();
+	MUTEX_EXIT(&audit_lock);
+    }
+
+    if (e.buf != stackbuf)
+	free(e.buf);
+}
 
 void
 osi_audit_init(void)
@@ -346,8 +717,8 @@ osi_audit_internal(char *audEvent,	/* Event name (15 chars or less) */
     }
 #endif
 
-    MUTEX_ENTER(&audit_lock);
 #ifdef AFS_AIX32_ENV
+    MUTEX_ENTER(&audit_lock);
     bufferPtr = BUFFER;
 
     /* Put the error code into the buffer list */
@@ -355,17 +726,15 @@ osi_audit_internal(char *audEvent,	/* Event name (15 chars or less) */
     bufferPtr += sizeof(errCode);
 
     audmakebuf(audEvent, vaList);
-#endif
 
-#ifdef AFS_AIX32_ENV
     bufferLen = (int)((afs_int32) bufferPtr - (afs_int32) & BUFFER[0]);
     code = auditlog(audEvent, result, BUFFER, bufferLen);
+    MUTEX_EXIT(&audit_lock);
 #else
     if (auditout_open) {
-	printbuf(0, audEvent, afsName, hostId, errCode, vaList);
+	audit_record(audEvent, errCode, afsName, hostId, vaList);
     }
 #endif
-    MUTEX_EXIT(&audit_lock);
 
     return 0;
 }
@@ -515,6 +884,9 @@ osi_audit_file(const char *fileName)
 {
     if(!audit_ops->open_file(fileName)) {
         auditout_open = 1;
+#ifdef AFS_PTHREAD_ENV
+	audit_ring_start();
+#endif
         return 0;
     }
     return 1;
@@ -546,5 +918,21 @@ osi_audit_set_user_check(void *rock,
 void
 audit_PrintStats(FILE *out)
 {
+#ifdef AFS_PTHREAD_ENV
+    if (audit_ring.running) {
+	MUTEX_ENTER(&audit_ring.lock);
+	fprintf(out, "audit ring: %llu events queued, %llu written in %llu "
+		"batches, %llu dropped; %llu waits for room, %lu of %lu "
+		"bytes used at most\n",
+		(unsigned long long)audit_ring.queued,
+		(unsigned long long)audit_ring.written,
+		(unsigned long long)audit_ring.batches,
+		(unsigned long long)audit_ring.dropped,
+		(unsigned long long)audit_ring.waits,
+		(unsigned long)audit_ring.hiwater,
+		(unsigned long)AUDIT_RING_SIZE);
+	MUTEX_EXIT(&audit_ring.lock);
+    }
+#endif
     audit_ops->print_interface_stats(out);
 }
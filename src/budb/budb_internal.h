@@ -38,6 +38,14 @@ afs_int32 scanHashTable(struct ubik_trans *ut, struct memoryHashTable *mhtPtr,
 			int (*operationFn) (dbadr, void *, void *),
 			void *rockPtr);
 
+/* db_index.c */
+afs_int32 InitDBindex(void);
+void idx_Invalidate(void);
+afs_int32 idx_FindDump(struct ubik_trans *ut, char *volName,
+		       afs_int32 beforeDate, dbadr *tapeAddrP);
+afs_int32 idx_FindLatestDump(struct ubik_trans *ut, char *vsname,
+			     afs_int32 level, dbadr *dumpAddrP);
+
 /* db_lock.c */
 int checkLockHandle(struct ubik_trans *, afs_uint32);
 
@@ -40,7 +40,8 @@ InitDB(void)
     pollCount = 0;
 
     memset(&db, 0, sizeof(db));
-    if ((code = InitDBalloc()) || (code = InitDBhash()))
+    if ((code = InitDBalloc()) || (code = InitDBhash())
+	|| (code = InitDBindex()))
 	return code;
     return 0;
 }
@@ -199,6 +200,7 @@ UpdateCache(struct ubik_trans *ut, void *rock)
     ht_Reset(&db.tapeName);
     ht_Reset(&db.dumpName);
     ht_Reset(&db.dumpIden);
+    idx_Invalidate();
 
   error_exit:
     if (code) {
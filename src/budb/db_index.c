@@ -0,0 +1,430 @@
+/*
+ * Copyright (c) 2026 The OpenAFS Contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR `AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * In-memory indexes for the restore planning queries.
+ *
+ * FindDump has to walk every fragment ever dumped for a volume to find the
+ * newest clone before a given date, and FindLatestDump by level has to read
+ * every dump in the database.  The restore code issues these queries over
+ * and over for the same volumes and volume sets, so we keep sorted copies of
+ * the relevant fields here and answer them with a binary search.
+ *
+ * Per-volume indexes are built the first time a volume name is looked up,
+ * and kept on an LRU list bounded by IDX_MAXVOLUMES.  The dump index is
+ * built the first time a dump is looked up by level.  Everything is thrown
+ * away whenever the database changes: from UpdateCache when the ubik
+ * version moves, and from InitRPC at the start of every local write
+ * transaction.  Building an index never costs more than the scan it
+ * replaces.
+ */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+#include <afs/stds.h>
+
+#include <roken.h>
+
+#include <lock.h>
+#include <ubik.h>
+#include <afs/bubasics.h>
+#include <opr/queue.h>
+#include <opr/jhash.h>
+
+#include "budb_errs.h"
+#include "database.h"
+#include "budb_internal.h"
+#include "error_macros.h"
+
+#define IDX_MAXVOLUMES	4096	/* volume names kept indexed */
+#define IDX_HASHBITS	10
+#define IDX_HASHSIZE	(1 << IDX_HASHBITS)
+
+/* one dumped fragment of a volume */
+struct volIndexFrag {
+    afs_int32 clone;		/* clone date of the fragment */
+    afs_int32 seq;		/* position on the on-disk chains */
+    dbadr tape;			/* tape holding the fragment */
+};
+
+/* all fragments of one volume name, sorted by clone date */
+struct volIndex {
+    struct opr_queue hashq;
+    struct opr_queue lruq;
+    char name[BU_MAXNAMELEN];
+    int nfrags;
+    struct volIndexFrag *frags;
+};
+
+/* one dump, sorted by volume set, level and id */
+struct dumpIndexEntry {
+    char volumeSet[BU_MAXNAMELEN];
+    afs_int32 level;
+    afs_uint32 id;
+    dbadr addr;
+};
+
+struct dumpIndexRock {
+    struct dumpIndexEntry *entries;
+    int count;
+    int alloc;
+    afs_int32 code;
+};
+
+static struct Lock idx_lock;
+static struct opr_queue volHash[IDX_HASHSIZE];
+static struct opr_queue volLRU;
+static int nVolIndexes;
+
+static struct dumpIndexEntry *dumpIndex;
+static int nDumpIndex;
+static int dumpIndexValid;
+
+afs_int32
+InitDBindex(void)
+{
+    int i;
+
+    Lock_Init(&idx_lock);
+    for (i = 0; i < IDX_HASHSIZE; i++)
+	opr_queue_Init(&volHash[i]);
+    opr_queue_Init(&volLRU);
+    nVolIndexes = 0;
+    dumpIndex = NULL;
+    nDumpIndex = 0;
+    dumpIndexValid = 0;
+    return 0;
+}
+
+static int
+VolHash(char *name)
+{
+    return opr_jhash_opaque(name, strlen(name), 0) & (IDX_HASHSIZE - 1);
+}
+
+static void
+FreeVolIndex(struct volIndex *vi)
+{
+    opr_queue_Remove(&vi->hashq);
+    opr_queue_Remove(&vi->lruq);
+    nVolIndexes--;
+    free(vi->frags);
+    free(vi);
+}
+
+/* idx_Invalidate
+ *	discard all the indexes; called whenever the database may have
+ *	changed underneath them
+ */
+
+void
+idx_Invalidate(void)
+{
+    ObtainWriteLock(&idx_lock);
+    while (!opr_queue_IsEmpty(&volLRU))
+	FreeVolIndex(opr_queue_First(&volLRU, struct volIndex, lruq));
+    free(dumpIndex);
+    dumpIndex = NULL;
+    nDumpIndex = 0;
+    dumpIndexValid = 0;
+    ReleaseWriteLock(&idx_lock);
+}
+
+static int
+CompareFrags(const void *a, const void *b)
+{
+    const struct volIndexFrag *fa = a;
+    const struct volIndexFrag *fb = b;
+
+    if (fa->clone != fb->clone)
+	return (fa->clone < fb->clone) ? -1 : 1;
+    /* among equal dates, the first fragment on the chains sorts last */
+    if (fa->seq != fb->seq)
+	return (fa->seq > fb->seq) ? -1 : 1;
+    return 0;
+}
+
+/* BuildVolIndex
+ *	read every fragment of volume volName and return them sorted
+ * exit:
+ *	0 - *viP is the new index, or NULL if the volume is not in the db
+ */
+
+static afs_int32
+BuildVolIndex(struct ubik_trans *ut, char *volName, struct volIndex **viP)
+{
+    struct volIndex *vi;
+    struct volIndexFrag *frags = NULL, *tfrags;
+    struct volInfo volInfo;
+    struct volFragment volFragment;
+    dbadr volInfoAddr, volFragmentAddr;
+    int nfrags = 0, alloc = 0;
+    int rvoli;
+    afs_int32 code = 0;
+
+    *viP = NULL;
+
+    code =
+	ht_LookupEntry(ut, &db.volName, volName, &volInfoAddr, &volInfo);
+    if (code)
+	ERROR(code);
+    if (!volInfoAddr)
+	ERROR(0);
+
+    for (rvoli = 0; volInfoAddr;
+	 rvoli = 1, volInfoAddr = ntohl(volInfo.sameNameChain)) {
+	if (rvoli) {
+	    code = dbread(ut, volInfoAddr, &volInfo, sizeof(volInfo));
+	    if (code)
+		ERROR(code);
+	}
+
+	for (volFragmentAddr = ntohl(volInfo.firstFragment); volFragmentAddr;
+	     volFragmentAddr = ntohl(volFragment.sameNameChain)) {
+	    code =
+		dbread(ut, volFragmentAddr, &volFragment,
+		       sizeof(volFragment));
+	    if (code)
+		ERROR(code);
+
+	    if (nfrags == alloc) {
+		alloc = alloc ? alloc * 2 : 16;
+		tfrags = realloc(frags, alloc * sizeof(*frags));
+		if (!tfrags)
+		    ERROR(BUDB_NOMEM);
+		frags = tfrags;
+	    }
+	    frags[nfrags].clone = ntohl(volFragment.clone);
+	    frags[nfrags].seq = nfrags;
+	    frags[nfrags].tape = ntohl(volFragment.tape);
+	    nfrags++;
+	}
+    }
+
+    vi = calloc(1, sizeof(*vi));
+    if (!vi)
+	ERROR(BUDB_NOMEM);
+    if (nfrags > 1)
+	qsort(frags, nfrags, sizeof(*frags), CompareFrags);
+    strlcpy(vi->name, volName, sizeof(vi->name));
+    vi->nfrags = nfrags;
+    vi->frags = frags;
+    frags = NULL;
+    *viP = vi;
+
+  error_exit:
+    free(frags);
+    return code;
+}
+
+/* idx_FindDump
+ *	find the tape holding the most recent fragment of volName cloned
+ *	before beforeDate
+ * exit:
+ *	0 - *tapeAddrP is the tape's address
+ *	BUDB_NOVOLUMENAME - no such volume
+ *	BUDB_NOENT - no fragment old enough
+ */
+
+afs_int32
+idx_FindDump(struct ubik_trans *ut, char *volName, afs_int32 beforeDate,
+	     dbadr *tapeAddrP)
+{
+    struct volIndex *vi = NULL;
+    struct opr_queue *cursor;
+    int hash, lo, hi, mid;
+    afs_int32 code = 0;
+
+    *tapeAddrP = 0;
+    hash = VolHash(volName);
+
+    ObtainWriteLock(&idx_lock);
+    for (opr_queue_Scan(&volHash[hash], cursor)) {
+	struct volIndex *tvi = opr_queue_Entry(cursor, struct volIndex, hashq);
+	if (strcmp(tvi->name, volName) == 0) {
+	    vi = tvi;
+	    break;
+	}
+    }
+
+    if (vi) {
+	opr_queue_Remove(&vi->lruq);
+	opr_queue_Append(&volLRU, &vi->lruq);
+    } else {
+	code = BuildVolIndex(ut, volName, &vi);
+	if (code)
+	    ERROR(code);
+	if (!vi)
+	    ERROR(BUDB_NOVOLUMENAME);
+
+	if (nVolIndexes >= IDX_MAXVOLUMES)
+	    FreeVolIndex(opr_queue_First(&volLRU, struct volIndex, lruq));
+	opr_queue_Append(&volHash[hash], &vi->hashq);
+	opr_queue_Append(&volLRU, &vi->lruq);
+	nVolIndexes++;
+    }
+
+    /* find the first fragment cloned at or after beforeDate */
+    lo = 0;
+    hi = vi->nfrags;
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	if (vi->frags[mid].clone < beforeDate)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    /* the one before it is the answer, if it was ever cloned */
+    if (lo == 0 || vi->frags[lo - 1].clone <= 0)
+	ERROR(BUDB_NOENT);
+    *tapeAddrP = vi->frags[lo - 1].tape;
+
+  error_exit:
+    ReleaseWriteLock(&idx_lock);
+    return code;
+}
+
+static int
+CompareDumps(const void *a, const void *b)
+{
+    const struct dumpIndexEntry *d1 = a;
+    const struct dumpIndexEntry *d2 = b;
+    int cmp;
+
+    cmp = strcmp(d1->volumeSet, d2->volumeSet);
+    if (cmp)
+	return cmp;
+    if (d1->level != d2->level)
+	return (d1->level < d2->level) ? -1 : 1;
+    if (d1->id != d2->id)
+	return (d1->id < d2->id) ? -1 : 1;
+    return 0;
+}
+
+static int
+selectAllDumps(dbadr dbAddr, void *dumpParam, void *rock)
+{
+    return 1;
+}
+
+static int
+indexDump(dbadr dbAddr, void *dumpParam, void *dumpIndexRockParam)
+{
+    struct dump *diskDump = dumpParam;
+    struct dumpIndexRock *rock = dumpIndexRockParam;
+    struct dumpIndexEntry *entries, *e;
+
+    if (rock->code)
+	return 0;
+
+    if (rock->count == rock->alloc) {
+	rock->alloc = rock->alloc ? rock->alloc * 2 : 256;
+	entries = realloc(rock->entries, rock->alloc * sizeof(*entries));
+	if (!entries) {
+	    rock->code = BUDB_NOMEM;
+	    return 0;
+	}
+	rock->entries = entries;
+    }
+
+    e = &rock->entries[rock->count++];
+    strlcpy(e->volumeSet, diskDump->volumeSet, sizeof(e->volumeSet));
+    e->level = ntohl(diskDump->level);
+    e->id = ntohl(diskDump->id);
+    e->addr = dbAddr;
+    return 0;
+}
+
+static afs_int32
+BuildDumpIndex(struct ubik_trans *ut)
+{
+    struct dumpIndexRock rock;
+    afs_int32 code;
+
+    memset(&rock, 0, sizeof(rock));
+    code = scanHashTable(ut, &db.dumpIden, selectAllDumps, indexDump, &rock);
+    if (!code)
+	code = rock.code;
+    if (code) {
+	free(rock.entries);
+	return code;
+    }
+
+    if (rock.count > 1)
+	qsort(rock.entries, rock.count, sizeof(*rock.entries), CompareDumps);
+    dumpIndex = rock.entries;
+    nDumpIndex = rock.count;
+    dumpIndexValid = 1;
+    return 0;
+}
+
+/* idx_FindLatestDump
+ *	find the most recent dump of volume set vsname at the given level
+ * exit:
+ *	0 - *dumpAddrP is the dump's address
+ *	BUDB_NODUMPNAME - there is no such dump
+ */
+
+afs_int32
+idx_FindLatestDump(struct ubik_trans *ut, char *vsname, afs_int32 level,
+		   dbadr *dumpAddrP)
+{
+    struct dumpIndexEntry *e;
+    int lo, hi, mid, cmp;
+    afs_int32 code = 0;
+
+    *dumpAddrP = 0;
+
+    ObtainWriteLock(&idx_lock);
+    if (!dumpIndexValid) {
+	code = BuildDumpIndex(ut);
+	if (code)
+	    ERROR(code);
+    }
+
+    /* find the first dump past (vsname, level) */
+    lo = 0;
+    hi = nDumpIndex;
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	e = &dumpIndex[mid];
+	cmp = strcmp(e->volumeSet, vsname);
+	if (cmp < 0 || (cmp == 0 && e->level <= level))
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    if (lo == 0)
+	ERROR(BUDB_NODUMPNAME);
+    e = &dumpIndex[lo - 1];
+    if (strcmp(e->volumeSet, vsname) != 0 || e->level != level || e->id == 0)
+	ERROR(BUDB_NODUMPNAME);
+    *dumpAddrP = e->addr;
+
+  error_exit:
+    ReleaseWriteLock(&idx_lock);
+    return code;
+}
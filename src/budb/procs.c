@@ -165,19 +165,7 @@ tailCompPtr(char *pathNamePtr)
 int
 callPermitted(struct rx_call *call)
 {
-    int permitted = 0;
-    struct afsconf_dir *acdir;
-
-    acdir = afsconf_Open(AFSDIR_SERVER_ETC_DIRPATH);
-    if (!acdir)
-	return 0;
-
-    if (afsconf_SuperUser(acdir, call, NULL))
-	permitted = 1;
-
-    if (acdir)
-	afsconf_Close(acdir);
-    return (permitted);
+    return afsconf_SuperUser(BU_conf, call, NULL);
 }
 
 /* InitRPC
@@ -255,6 +243,8 @@ InitRPC(struct ubik_trans **ut,
 	    ubik_AbortTrans(*ut);
 	    return code;
 	}
+	/* this transaction may change anything the indexes describe */
+	idx_Invalidate();
     }
     lastTrans = time(0);
     return 0;
@@ -2023,15 +2013,8 @@ FindDump(struct rx_call *call, char *volumeName, afs_int32 beforeDate,
 	 struct budb_dumpEntry *deptr)
 {
     struct ubik_trans *ut;
-    dbadr volInfoAddr, volFragmentAddr;
+    dbadr tapeAddr;
     struct tape tape;
-    struct volInfo volInfo;
-    struct volFragment volFragment;
-
-    dbadr selectedDumpAddr = 0;
-    afs_int32 selectedDate = 0;
-    afs_int32 volCloned;
-    int rvoli;
     afs_int32 eval, code = 0;
 
     if (!callPermitted(call))
@@ -2041,55 +2024,20 @@ FindDump(struct rx_call *call, char *volumeName, afs_int32 beforeDate,
     if (eval)
 	return eval;
 
-    /* Find volinfo struct for volume name in hash table */
-    eval =
-	ht_LookupEntry(ut, &db.volName, volumeName, &volInfoAddr, &volInfo);
+    /* Find the most recent fragment cloned before beforeDate */
+    eval = idx_FindDump(ut, volumeName, beforeDate, &tapeAddr);
     if (eval)
 	ABORT(eval);
-    if (!volInfoAddr)
-	ABORT(BUDB_NOVOLUMENAME);
-
-    /* Step through all the volinfo structures on the same name chain.
-     * No need to read the first - we read it above.
-     */
-    for (rvoli = 0; volInfoAddr;
-	 rvoli = 1, volInfoAddr = ntohl(volInfo.sameNameChain)) {
-	if (rvoli) {		/* read the volinfo structure */
-	    eval = dbread(ut, volInfoAddr, &volInfo, sizeof(volInfo));
-	    if (eval)
-		ABORT(eval);
-	}
-
-	/* step through the volfrag structures */
-	for (volFragmentAddr = ntohl(volInfo.firstFragment); volFragmentAddr;
-	     volFragmentAddr = ntohl(volFragment.sameNameChain)) {
-	    /* read the volfrag struct */
-	    eval =
-		dbread(ut, volFragmentAddr, &volFragment,
-		       sizeof(volFragment));
-	    if (eval)
-		ABORT(eval);
 
-	    volCloned = ntohl(volFragment.clone);
-
-	    /* now we can examine the date for most recent dump */
-	    if ((volCloned > selectedDate) && (volCloned < beforeDate)) {
-		/* from the volfrag struct, read the tape struct */
-		eval =
-		    dbread(ut, ntohl(volFragment.tape), &tape, sizeof(tape));
-		if (eval)
-		    ABORT(eval);
-
-		selectedDate = volCloned;
-		selectedDumpAddr = ntohl(tape.dump);
-	    }
-	}
-    }
+    /* from the tape struct, find the dump */
+    eval = dbread(ut, tapeAddr, &tape, sizeof(tape));
+    if (eval)
+	ABORT(eval);
 
-    if (!selectedDumpAddr)
+    if (!tape.dump)
 	ABORT(BUDB_NOENT);
 
-    eval = FillDumpEntry(ut, selectedDumpAddr, deptr);
+    eval = FillDumpEntry(ut, ntohl(tape.dump), deptr);
     if (eval)
 	ABORT(eval);
 
@@ -2141,51 +2089,16 @@ FindLatestDump(struct rx_call *call, char *vsname, char *dumpPath,
 	/* Construct a database dump name */
 	strcpy(dumpName, DUMP_TAPE_NAME);
     } else if (strchr(dumpPath, '/') == 0) {
-	int level, old, length, hash;
-	struct dump hostDump, diskDump;
-	struct memoryHashTable *mht;
-	int entrySize;
-	dbadr dbAddr;
-	afs_uint32 bestDumpId = 0;
+	int level;
 
 	level = atoi(dumpPath);
 	if (level < 0) {
 	    ABORT(BUDB_BADARGUMENT);
 	}
 
-	/* Brute force search of all the dumps in the database - yuck! */
-
-	retdbaddr = 0;
-	mht = ht_GetType(HT_dumpIden_FUNCTION, &entrySize);
-	if (!mht)
-	    ABORT(BUDB_BADARGUMENT);
-
-	for (old = 0; old <= 1; old++) {	/*fo */
-	    length = (old ? mht->oldLength : mht->length);
-	    if (!length)
-		continue;
-
-	    for (hash = 0; hash < length; hash++) {
-		/*f */
-		for (dbAddr = ht_LookupBucket(ut, mht, hash, old); dbAddr;
-		     dbAddr = hostDump.idHashChain) {
-		    /*w */
-		    eval = dbread(ut, dbAddr, &diskDump, sizeof(diskDump));
-		    if (eval)
-			ABORT(eval);
-		    dump_ntoh(&diskDump, &hostDump);
-
-		    if ((strcmp(hostDump.volumeSet, vsname) == 0) &&	/* the volumeset */
-			(hostDump.level == level) &&	/* same level */
-			(hostDump.id > bestDumpId)) {	/* more recent */
-			bestDumpId = hostDump.id;
-			retdbaddr = dbAddr;
-		    }
-		}		/*w */
-	    }			/*f */
-	}			/*fo */
-	if (!retdbaddr)
-	    ABORT(BUDB_NODUMPNAME);
+	eval = idx_FindLatestDump(ut, vsname, level, &retdbaddr);
+	if (eval)
+	    ABORT(eval);
 
 	goto finished;
     } else {
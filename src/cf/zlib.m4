@@ -0,0 +1,22 @@
+dnl zlib Autoconf glue.  The volume server uses zlib to compress volume
+dnl dumps if it is available; if it's not, dumps are never compressed.  If
+dnl --with-zlib is given explicitly, zlib must be found or we bail out.
+
+AC_DEFUN([OPENAFS_ZLIB],
+[openafs_zlib=
+ LIB_z=
+ AC_ARG_WITH([zlib],
+    [AS_HELP_STRING([--without-zlib],
+        [do not use zlib to compress volume dumps
+         (defaults to using it if it is available)])],
+    [openafs_zlib="$withval"])
+
+ AS_IF([test x"$openafs_zlib" != xno],
+    [AC_CHECK_HEADER([zlib.h],
+        [AC_CHECK_LIB([z], [deflate], [LIB_z=-lz])])
+     AS_IF([test x"$LIB_z" != x],
+        [AC_DEFINE([HAVE_ZLIB], [1],
+            [define if zlib is available to compress volume dumps])],
+        [AS_IF([test x"$openafs_zlib" = xyes],
+            [AC_MSG_ERROR([zlib was requested but cannot be found])])])])
+ AC_SUBST([LIB_z])])
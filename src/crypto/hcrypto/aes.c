@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2003 Kungliga Tekniska Högskolan
+ * (Royal Institute of Technology, Stockholm, Sweden).
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * This is heimdal's hcrypto/aes.c, which OpenAFS builds in place of the
+ * upstream file for userspace.  On x86 processors with the AES
+ * instructions, the block and CBC routines use those instead of the
+ * table driven rijndael code; whether they are there is checked the
+ * first time a routine is called.  Key schedules are kept in the format
+ * the rijndael code uses, so an AES_KEY is the same whichever code fills
+ * it in.  The kernel module builds the upstream file.
+ */
+
+#include "config.h"
+
+
+#ifdef KRB5
+#include <krb5-types.h>
+#endif
+
+#include <string.h>
+
+#include "rijndael-alg-fst.h"
+#include "aes.h"
+
+#if !defined(KERNEL) && (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__clang__) || __GNUC__ > 4 || \
+     (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+# define HC_AESNI 1
+# include <cpuid.h>
+# include <tmmintrin.h>
+# include <wmmintrin.h>
+#endif
+
+#ifdef HC_AESNI
+
+#define AESNI_TARGET __attribute__((target("aes,ssse3")))
+
+static volatile int aesni_state = -1;
+
+static int
+aesni_usable(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (aesni_state < 0) {
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+	    aesni_state = (ecx & bit_AES) && (ecx & bit_SSSE3);
+	else
+	    aesni_state = 0;
+    }
+    return aesni_state;
+}
+
+/*
+ * The rijndael code keeps each round key as four big endian words in host
+ * order; the AES instructions want its bytes in order.  Its decryption
+ * schedule is already the one for the equivalent inverse cipher, which is
+ * what aesdec expects.
+ */
+static AESNI_TARGET void
+aesni_load_key(const AES_KEY *key, __m128i *rk)
+{
+    const __m128i bswap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+				       4, 5, 6, 7, 0, 1, 2, 3);
+    int i;
+
+    for (i = 0; i <= key->rounds; i++)
+	rk[i] = _mm_shuffle_epi8(
+		    _mm_loadu_si128((const __m128i *)&key->key[4 * i]), bswap);
+}
+
+static inline AESNI_TARGET __m128i
+aesni_encrypt_block(__m128i b, const __m128i *rk, int nr)
+{
+    int i;
+
+    b = _mm_xor_si128(b, rk[0]);
+    for (i = 1; i < nr; i++)
+	b = _mm_aesenc_si128(b, rk[i]);
+    return _mm_aesenclast_si128(b, rk[nr]);
+}
+
+static inline AESNI_TARGET __m128i
+aesni_decrypt_block(__m128i b, const __m128i *rk, int nr)
+{
+    int i;
+
+    b = _mm_xor_si128(b, rk[0]);
+    for (i = 1; i < nr; i++)
+	b = _mm_aesdec_si128(b, rk[i]);
+    return _mm_aesdeclast_si128(b, rk[nr]);
+}
+
+static AESNI_TARGET void
+aesni_encrypt(const unsigned char *in, unsigned char *out, const AES_KEY *key)
+{
+    __m128i rk[AES_MAXNR + 1];
+    __m128i b;
+
+    aesni_load_key(key, rk);
+    b = aesni_encrypt_block(_mm_loadu_si128((const __m128i *)in), rk,
+			    key->rounds);
+    _mm_storeu_si128((__m128i *)out, b);
+}
+
+static AESNI_TARGET void
+aesni_decrypt(const unsigned char *in, unsigned char *out, const AES_KEY *key)
+{
+    __m128i rk[AES_MAXNR + 1];
+    __m128i b;
+
+    aesni_load_key(key, rk);
+    b = aesni_decrypt_block(_mm_loadu_si128((const __m128i *)in), rk,
+			    key->rounds);
+    _mm_storeu_si128((__m128i *)out, b);
+}
+
+/*
+ * CBC encryption is serial, but each block now costs a few dozen cycles
+ * instead of a few hundred.  CBC decryption is not, so it works on four
+ * blocks at once to keep the AES unit busy.  A short last block is
+ * handled as in the rijndael version below.
+ */
+static AESNI_TARGET void
+aesni_cbc_encrypt(const unsigned char *in, unsigned char *out,
+		  unsigned long size, const AES_KEY *key,
+		  unsigned char *iv, int forward_encrypt)
+{
+    __m128i rk[AES_MAXNR + 1];
+    __m128i ivec, b, c[4], p[4];
+    unsigned char tmp[AES_BLOCK_SIZE];
+    int nr = key->rounds;
+    int i, j;
+
+    aesni_load_key(key, rk);
+    ivec = _mm_loadu_si128((const __m128i *)iv);
+
+    if (forward_encrypt) {
+	while (size >= AES_BLOCK_SIZE) {
+	    b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), ivec);
+	    ivec = aesni_encrypt_block(b, rk, nr);
+	    _mm_storeu_si128((__m128i *)out, ivec);
+	    size -= AES_BLOCK_SIZE;
+	    in += AES_BLOCK_SIZE;
+	    out += AES_BLOCK_SIZE;
+	}
+	if (size) {
+	    _mm_storeu_si128((__m128i *)tmp, ivec);
+	    for (i = 0; i < size; i++)
+		tmp[i] ^= in[i];
+	    ivec = aesni_encrypt_block(_mm_loadu_si128((const __m128i *)tmp),
+				       rk, nr);
+	    _mm_storeu_si128((__m128i *)out, ivec);
+	}
+    } else {
+	while (size >= 4 * AES_BLOCK_SIZE) {
+	    for (j = 0; j < 4; j++) {
+		c[j] = _mm_loadu_si128((const __m128i *)in + j);
+		p[j] = _mm_xor_si128(c[j], rk[0]);
+	    }
+	    for (i = 1; i < nr; i++) {
+		for (j = 0; j < 4; j++)
+		    p[j] = _mm_aesdec_si128(p[j], rk[i]);
+	    }
+	    for (j = 0; j < 4; j++)
+		p[j] = _mm_aesdeclast_si128(p[j], rk[nr]);
+	    _mm_storeu_si128((__m128i *)out, _mm_xor_si128(p[0], ivec));
+	    for (j = 1; j < 4; j++)
+		_mm_storeu_si128((__m128i *)out + j,
+				 _mm_xor_si128(p[j], c[j - 1]));
+	    ivec = c[3];
+	    size -= 4 * AES_BLOCK_SIZE;
+	    in += 4 * AES_BLOCK_SIZE;
+	    out += 4 * AES_BLOCK_SIZE;
+	}
+	while (size >= AES_BLOCK_SIZE) {
+	    c[0] = _mm_loadu_si128((const __m128i *)in);
+	    b = aesni_decrypt_block(c[0], rk, nr);
+	    _mm_storeu_si128((__m128i *)out, _mm_xor_si128(b, ivec));
+	    ivec = c[0];
+	    size -= AES_BLOCK_SIZE;
+	    in += AES_BLOCK_SIZE;
+	    out += AES_BLOCK_SIZE;
+	}
+	if (size) {
+	    c[0] = _mm_loadu_si128((const __m128i *)in);
+	    b = _mm_xor_si128(aesni_decrypt_block(c[0], rk, nr), ivec);
+	    _mm_storeu_si128((__m128i *)tmp, b);
+	    memcpy(out, tmp, size);
+	    ivec = c[0];
+	}
+    }
+    _mm_storeu_si128((__m128i *)iv, ivec);
+}
+
+#endif /* HC_AESNI */
+
+int
+AES_set_encrypt_key(const unsigned char *userkey, const int bits, AES_KEY *key)
+{
+    key->rounds = rijndaelKeySetupEnc(key->key, userkey, bits);
+    if (key->rounds == 0)
+	return -1;
+    return 0;
+}
+
+int
+AES_set_decrypt_key(const unsigned char *userkey, const int bits, AES_KEY *key)
+{
+    key->rounds = rijndaelKeySetupDec(key->key, userkey, bits);
+    if (key->rounds == 0)
+	return -1;
+    return 0;
+}
+
+void
+AES_encrypt(const unsigned char *in, unsigned char *out, const AES_KEY *key)
+{
+#ifdef HC_AESNI
+    if (aesni_usable()) {
+	aesni_encrypt(in, out, key);
+	return;
+    }
+#endif
+    rijndaelEncrypt(key->key, key->rounds, in, out);
+}
+
+void
+AES_decrypt(const unsigned char *in, unsigned char *out, const AES_KEY *key)
+{
+#ifdef HC_AESNI
+    if (aesni_usable()) {
+	aesni_decrypt(in, out, key);
+	return;
+    }
+#endif
+    rijndaelDecrypt(key->key, key->rounds, in, out);
+}
+
+void
+AES_cbc_encrypt(const unsigned char *in, unsigned char *out,
+		unsigned long size, const AES_KEY *key,
+		unsigned char *iv, int forward_encrypt)
+{
+    unsigned char tmp[AES_BLOCK_SIZE];
+    int i;
+
+#ifdef HC_AESNI
+    if (aesni_usable()) {
+	aesni_cbc_encrypt(in, out, size, key, iv, forward_encrypt);
+	return;
+    }
+#endif
+
+    if (forward_encrypt) {
+	while (size >= AES_BLOCK_SIZE) {
+	    for (i = 0; i < AES_BLOCK_SIZE; i++)
+		tmp[i] = in[i] ^ iv[i];
+	    AES_encrypt(tmp, out, key);
+	    memcpy(iv, out, AES_BLOCK_SIZE);
+	    size -= AES_BLOCK_SIZE;
+	    in += AES_BLOCK_SIZE;
+	    out += AES_BLOCK_SIZE;
+	}
+	if (size) {
+	    for (i = 0; i < size; i++)
+		tmp[i] = in[i] ^ iv[i];
+	    for (i = size; i < AES_BLOCK_SIZE; i++)
+		tmp[i] = iv[i];
+	    AES_encrypt(tmp, out, key);
+	    memcpy(iv, out, AES_BLOCK_SIZE);
+	}
+    } else {
+	while (size >= AES_BLOCK_SIZE) {
+	    memcpy(tmp, in, AES_BLOCK_SIZE);
+	    AES_decrypt(tmp, out, key);
+	    for (i = 0; i < AES_BLOCK_SIZE; i++)
+		out[i] ^= iv[i];
+	    memcpy(iv, tmp, AES_BLOCK_SIZE);
+	    size -= AES_BLOCK_SIZE;
+	    in += AES_BLOCK_SIZE;
+	    out += AES_BLOCK_SIZE;
+	}
+	if (size) {
+	    memcpy(tmp, in, AES_BLOCK_SIZE);
+	    AES_decrypt(tmp, out, key);
+	    for (i = 0; i < size; i++)
+		out[i] ^= iv[i];
+	    memcpy(iv, tmp, AES_BLOCK_SIZE);
+	}
+    }
+}
+
+void
+AES_cfb8_encrypt(const unsigned char *in, unsigned char *out,
+                 unsigned long size, const AES_KEY *key,
+                 unsigned char *iv, int forward_encrypt)
+{
+    int i;
+
+    for (i = 0; i < size; i++) {
+        unsigned char tmp[AES_BLOCK_SIZE + 1];
+
+        memcpy(tmp, iv, AES_BLOCK_SIZE);
+        AES_encrypt(iv, iv, key);
+        if (!forward_encrypt) {
+            tmp[AES_BLOCK_SIZE] = in[i];
+        }
+        out[i] = in[i] ^ iv[0];
+        if (forward_encrypt) {
+            tmp[AES_BLOCK_SIZE] = out[i];
+        }
+        memcpy(iv, &tmp[1], AES_BLOCK_SIZE);
+    }
+}
@@ -1360,7 +1360,8 @@ util_RPCStatsGetBegin(struct rx_connection *conn,
     stat->stat_list.rpcStats_len = 0;
     stat->stat_list.rpcStats_val = 0;
     stat->index = 0;
-    stat->clientVersion = RX_STATS_RETRIEVAL_VERSION;
+    /* UnmarshallRPCStats only knows the first edition */
+    stat->clientVersion = RX_STATS_RETRIEVAL_FIRST_EDITION;
 
     tst =
 	(*rpc) (conn, stat->clientVersion, &stat->serverVersion,
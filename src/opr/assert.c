@@ -12,6 +12,25 @@ opr_NTAbort(void)
 }
 #endif
 
+static void (*abortHook)(void);
+
+/*!
+ * Set a function to be called before we abort on a failed assertion or
+ * a panic, such as one which writes out buffered log messages.
+ */
+void
+opr_SetAbortHook(void (*hook)(void))
+{
+    abortHook = hook;
+}
+
+void
+opr_RunAbortHook(void)
+{
+    if (abortHook != NULL)
+	(*abortHook)();
+}
+
 #define TIMESTAMP_BUFFER_SIZE 26  /* including the null */
 void
 opr_AssertionFailed(const char *file, int line)
@@ -26,6 +45,7 @@ opr_AssertionFailed(const char *file, int line)
     fprintf(stderr, "%s Assertion failed! file %s, line %d.\n", tdate, file,
 	    line);
     fflush(stderr);
+    opr_RunAbortHook();
     opr_abort();
 }
 
@@ -37,6 +57,7 @@ opr_AssertFailU(const char *expr, const char *file, int line)
 	    expr, file, line);
     fflush(stderr);
     fflush(stdout);
+    opr_RunAbortHook();
     opr_abort();
 }
 
@@ -18,6 +18,8 @@ extern void opr_NTAbort(void);
 
 extern void opr_AssertionFailed(const char *, int) AFS_NORETURN;
 extern void opr_AssertFailU(const char *, const char *, int) AFS_NORETURN;
+extern void opr_SetAbortHook(void (*)(void));
+extern void opr_RunAbortHook(void);
 
 /* opr_Assert is designed to work in a similar way to the operating
  * system's assert function. This means that in future, it may compile
@@ -72,8 +72,14 @@ printheader(struct prheader *h)
     printf("Group     Count   = %d\n", ntohl(h->groupcount));
 /* printf("Foreign   Count   = %d\n", ntohl(h->foreigncount)); NYI */
 /* printf("Sub/super Count   = %d\n", ntohl(h->instcount));    NYI */
-    printf("Name Hash         = %d buckets\n", HASHSIZE);
-    printf("ID   Hash         = %d buckets\n", HASHSIZE);
+    if (ntohl(h->version) == PRDBVERSION_HASH) {
+	printf("Hash Table Ptr    = 0x%x\n", ntohl(h->hashTable));
+	printf("Name Hash         = %d buckets\n", ntohl(h->hashSize));
+	printf("ID   Hash         = %d buckets\n", ntohl(h->hashSize));
+    } else {
+	printf("Name Hash         = %d buckets\n", HASHSIZE);
+	printf("ID   Hash         = %d buckets\n", HASHSIZE);
+    }
     return 0;
 }
 
@@ -124,14 +130,14 @@ ReadHeader(void)
 }
 
 static afs_int32
-IDHash(afs_int32 x)
+IDHash(afs_int32 x, afs_int32 size)
 {
     /* returns hash bucket for x */
-    return ((abs(x)) % HASHSIZE);
+    return ((abs(x)) % size);
 }
 
 static afs_int32
-NameHash(char *aname)
+NameHash(char *aname, afs_int32 size)
 {
     /* returns hash bucket for aname */
     unsigned int hash = 0;
@@ -139,7 +145,7 @@ NameHash(char *aname)
 /* stolen directly from the HashString function in the vol package */
     for (i = strlen(aname), aname += i - 1; i--; aname--)
 	hash = (hash * 31) + (*(unsigned char *)aname - 31);
-    return (hash % HASHSIZE);
+    return (hash % size);
 }
 
 #define MAP_NAMEHASH 1
@@ -149,6 +155,7 @@ NameHash(char *aname)
 #define MAP_FREE 8
 #define MAP_OWNED 0x10
 #define MAP_RECREATE 0x20
+#define MAP_HASHBLOCK 0x40
 
 struct misc_data {
     int nEntries;		/* number of database entries */
@@ -269,6 +276,7 @@ PrintContError(struct misc_data *misc, afs_int32 ea, struct contentry *c, int in
 
 afs_int32
 WalkHashTable(afs_int32 hashtable[],	/* hash table to walk */
+	      afs_int32 hashsize,	/* number of buckets */
 	      int hashType,		/* hash function to use */
 	      char map[],		/* one byte per db entry */
 	      struct misc_data *misc)	/* stuff to keep track of */
@@ -286,7 +294,7 @@ WalkHashTable(afs_int32 hashtable[],	/* hash table to walk */
 
     bit = hashType;
 
-    for (hi = 0; hi < HASHSIZE; hi++) {
+    for (hi = 0; hi < hashsize; hi++) {
 	ea = 0;
 	next_ea = ntohl(hashtable[hi]);
 	while (next_ea) {
@@ -325,11 +333,11 @@ WalkHashTable(afs_int32 hashtable[],	/* hash table to walk */
 	    switch (hashType) {
 	    case MAP_NAMEHASH:
 		next_ea = ntohl(e.nextName);
-		hash = NameHash(e.name);
+		hash = NameHash(e.name, hashsize);
 		break;
 	    case MAP_IDHASH:
 		next_ea = ntohl(e.nextID);
-		hash = IDHash(id);
+		hash = IDHash(id, hashsize);
 		break;
 	    default:
 		fprintf(stderr, "unknown hash table type %d\n", hashType);
@@ -919,7 +927,13 @@ GC(char map[], struct misc_data *misc)
 	if (code)
 	    return code;
 	m = map[ei];
-	if (m == 0) {
+	if (m == 0 && ntohl(e.flags) == PRHASHBLOCK
+	    && ntohl(e.id) >= HASHSIZE && ntohl(e.id) <= PR_MAXHASHSIZE) {
+	    /* the hashSize of the block lines up with the entry's id */
+	    fprintf(stderr, "Unused hash table block at %d (%d bytes)\n", ea,
+		    (int)PR_HASHBLOCK_SIZE(ntohl(e.id)));
+	    ei += PR_HASHBLOCK_SIZE(ntohl(e.id)) / sizeof(struct prentry) - 1;
+	} else if (m == 0) {
 	    fprintf(stderr, "Unreferenced entry:");
 	    if (PrintEntryError(misc, ea, &e, 2))
 		return PRDBBAD;
@@ -1251,8 +1265,11 @@ CheckPrDatabase(struct misc_data *misc)	/* info & statistics */
 {
     afs_int32 code;
     afs_int32 eof;
-    int n;
+    int n, ei, i;
     char *map;			/* map of each entry in db */
+    afs_int32 *nameHash = cheader.nameHash, *idHash = cheader.idHash;
+    afs_int32 *tables = NULL;	/* extended hash tables, if any */
+    afs_int32 hashaddr, hashsize = HASHSIZE;
 
     eof = ntohl(cheader.eofPtr);
     eof -= sizeof(cheader);
@@ -1270,11 +1287,50 @@ CheckPrDatabase(struct misc_data *misc)	/* info & statistics */
     map = calloc(1, n);
     misc->nEntries = n;
 
+    if (ntohl(cheader.version) == PRDBVERSION_HASH) {
+	struct prhashblock hblock;
+
+	/* Read in the extended hash tables, and keep the rest of the checks
+	 * away from the entries they occupy */
+	hashaddr = ntohl(cheader.hashTable);
+	hashsize = ntohl(cheader.hashSize);
+	code = ConvertDiskAddress(hashaddr, &ei);
+	if (!code)
+	    code = pr_Read(hashaddr, (char *)&hblock, sizeof(hblock));
+	if (!code
+	    && (ntohl(hblock.flags) != PRHASHBLOCK
+		|| ntohl(hblock.hashSize) != hashsize
+		|| hashsize < HASHSIZE || hashsize > PR_MAXHASHSIZE
+		|| hashaddr + PR_HASHBLOCK_SIZE(hashsize) > ntohl(cheader.eofPtr)))
+	    code = PRDBBAD;
+	if (code) {
+	    afs_com_err(whoami, code, "bad hash table block at %d", hashaddr);
+	    goto abort;
+	}
+	tables = malloc(2 * hashsize * sizeof(afs_int32));
+	if (!tables) {
+	    afs_com_err(whoami, 0, "Unable to malloc space for hash tables");
+	    code = -1;
+	    goto abort;
+	}
+	code = pr_Read(PR_HASHBUCKET_OFFSET(hashaddr, hashsize, PR_NAMEHASH, 0),
+		       (char *)tables, 2 * hashsize * sizeof(afs_int32));
+	if (code) {
+	    afs_com_err(whoami, code, "reading hash tables");
+	    goto abort;
+	}
+	nameHash = tables + PR_NAMEHASH * hashsize;
+	idHash = tables + PR_IDHASH * hashsize;
+	for (i = 0; i < PR_HASHBLOCK_SIZE(hashsize) / sizeof(struct prentry);
+	     i++)
+	    map[ei + i] |= MAP_HASHBLOCK;
+    }
+
     if (misc->verbose) {
 	printf("\nChecking name hash table\n");
 	fflush(stdout);
     }
-    code = WalkHashTable(cheader.nameHash, MAP_NAMEHASH, map, misc);
+    code = WalkHashTable(nameHash, hashsize, MAP_NAMEHASH, map, misc);
     if (code) {
 	afs_com_err(whoami, code, "walking name hash");
 	goto abort;
@@ -1283,7 +1339,7 @@ CheckPrDatabase(struct misc_data *misc)	/* info & statistics */
 	printf("\nChecking id hash table\n");
 	fflush(stdout);
     }
-    code = WalkHashTable(cheader.idHash, MAP_IDHASH, map, misc);
+    code = WalkHashTable(idHash, hashsize, MAP_IDHASH, map, misc);
     if (code) {
 	afs_com_err(whoami, code, "walking id hash");
 	goto abort;
@@ -1382,6 +1438,7 @@ CheckPrDatabase(struct misc_data *misc)	/* info & statistics */
 	       misc->nforeigns, misc->ngroups);
     }
 
+    free(tables);
     free(map);
     return code;
 }
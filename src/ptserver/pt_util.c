@@ -67,7 +67,6 @@ struct hash_entry *hat[HASHSIZE];
 
 static struct contentry prco;
 static struct prentry pre;
-static struct prheader prh;
 static struct ubik_version uv;
 
 struct grp_list {
@@ -99,6 +98,7 @@ FILE *dfp;
 
 int nflag = 0;
 int wflag = 0;
+int hashsize = 0;
 int flags = 0;
 
 int
@@ -124,6 +124,8 @@ main(int argc, char **argv)
 		"display extra users/groups");
     cmd_AddParm(cs, "-prdb", CMD_SINGLE, CMD_OPTIONAL, "prdb file");
     cmd_AddParm(cs, "-datafile", CMD_SINGLE, CMD_OPTIONAL, "data file");
+    cmd_AddParm(cs, "-hashsize", CMD_SINGLE, CMD_OPTIONAL,
+		"resize hash tables to this many buckets");
     code = cmd_Dispatch(argc, argv);
 
     exit(code);
@@ -177,12 +179,22 @@ CommandProc(struct cmd_syndesc *a_as, void *arock)
     if (tparm[8].items) {
 	dfile = tparm[8].items->data;
     }
+    if (tparm[9].items) {
+	hashsize = atoi(tparm[9].items->data);
+	if (hashsize < HASHSIZE || hashsize > PR_MAXHASHSIZE) {
+	    fprintf(stderr, "pt_util: -hashsize must be between %d and %d\n",
+		    HASHSIZE, PR_MAXHASHSIZE);
+	    exit(1);
+	}
+	hashsize = NextPrime(hashsize);
+    }
 
     if (pfile == NULL) {
         snprintf(pbuffer, sizeof(pbuffer), "%s.DB0", pbase);
         pfile = pbuffer;
     }
-    if ((dbase_fd = open(pfile, (wflag ? O_RDWR : O_RDONLY) | O_CREAT, 0600))
+    if ((dbase_fd = open(pfile, ((wflag || hashsize) ? O_RDWR : O_RDONLY)
+			 | O_CREAT, 0600))
 	< 0) {
 	fprintf(stderr, "pt_util: cannot open %s: %s\n", pfile,
 		strerror(errno));
@@ -225,15 +237,19 @@ CommandProc(struct cmd_syndesc *a_as, void *arock)
     uv.counter = ntohl(uv.counter);
 
     fprintf(stderr, "Ubik Version is: %d.%d\n", uv.epoch, uv.counter);
-    if (read(dbase_fd, &prh, sizeof(struct prheader)) < 0) {
-	fprintf(stderr, "pt_util: error reading %s: %s\n", pfile,
-		strerror(errno));
-	exit(1);
-    }
 
     Initdb();
     initialize_PT_error_table();
 
+    if (hashsize && hashsize != HashTableSize()) {
+	code = ResizeHashTables(0, hashsize);
+	if (code) {
+	    fprintf(stderr, "pt_util: error resizing hash tables: %s\n",
+		    afs_error_message(code));
+	    exit(1);
+	}
+    }
+
     if (wflag) {
 	struct usr_list *u;
 	int seenGroup = 0, id = 0, flags = 0;
@@ -351,8 +367,15 @@ CommandProc(struct cmd_syndesc *a_as, void *arock)
 		fprintf(stderr, "Error while creating %s: %s\n", u->name,
 			afs_error_message(PRBADNAM));
     } else {
-	for (i = 0; i < HASHSIZE; i++) {
-	    upos = nflag ? ntohl(prh.nameHash[i]) : ntohl(prh.idHash[i]);
+	for (i = 0; i < HashTableSize(); i++) {
+	    afs_int32 head;
+
+	    if (GetHashHead(0, nflag ? PR_NAMEHASH : PR_IDHASH, i, &head)) {
+		fprintf(stderr, "pt_util: cannot read %s hash %d\n",
+			nflag ? "name":"id", i);
+		exit(1);
+	    }
+	    upos = head;
 	    while (upos) {
 		long newpos;
 		newpos = display_entry(upos);
@@ -457,7 +480,7 @@ display_group(int id)
     int i, offset;
     int print_grp = 0;
 
-    offset = ntohl(prh.idHash[IDHash(id)]);
+    offset = FindByID(0, id);
     while (offset) {
 	lseek(dbase_fd, offset + HDRSIZE, L_SET);
 	if (read(dbase_fd, &pre, sizeof(struct prentry)) < 0) {
@@ -563,7 +586,7 @@ id_to_name(int id)
     name = check_core(id);
     if (name)
 	return (name);
-    offset = ntohl(prh.idHash[IDHash(id)]);
+    offset = FindByID(0, id);
     while (offset) {
 	lseek(dbase_fd, offset + HDRSIZE, L_SET);
 	if (read(dbase_fd, &pre, sizeof(struct prentry)) < 0) {
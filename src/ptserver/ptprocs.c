@@ -77,6 +77,7 @@ extern int pr_noAuth;
 extern int prp_group_default;
 extern int prp_user_default;
 extern struct afsconf_dir *prdir;
+extern afs_int32 pr_hashsize;
 
 static afs_int32 iNewEntry(struct rx_call *call, char aname[], afs_int32 aid,
 			   afs_int32 oid, afs_int32 *cid);
@@ -195,8 +196,24 @@ WritePreamble(struct ubik_trans **tt)
     if (code)
 	goto out;
 
+    /* anything we cache may be changed by this transaction */
+    pt_InvalidateCaches();
+
     code = read_DbHeader(*tt);
 
+    /* Convert to the hash table size asked for with -hashsize, if any, the
+     * first time we get to write to the database */
+    if (code == 0 && pr_hashsize && pr_hashsize != HashTableSize()) {
+	ViceLog(0, ("Resizing PRDB hash tables from %d to %d buckets\n",
+		    HashTableSize(), pr_hashsize));
+	code = ResizeHashTables(*tt, pr_hashsize);
+	if (code) {
+	    ViceLog(0, ("Resizing PRDB hash tables failed (error = %d); "
+			"not trying again\n", code));
+	    pr_hashsize = 0;
+	}
+    }
+
 out:
     if (code)
 	ubik_AbortTrans(*tt);
@@ -544,14 +561,49 @@ SPR_NameToID(struct rx_call *call, namelist *aname, idlist *aid)
     return code;
 }
 
+/*
+ * Batches are translated in sorted order so that repeated names or ids are
+ * looked up only once; the answers are still returned in request order.
+ */
+struct xlateorder {
+    union {
+	afs_int32 id;
+	char *name;
+    } key;
+    afs_int32 index;
+};
+
+static int
+xlateorder_idcmp(const void *a, const void *b)
+{
+    const struct xlateorder *xa = a, *xb = b;
+
+    if (xa->key.id != xb->key.id)
+	return xa->key.id < xb->key.id ? -1 : 1;
+    return xa->index - xb->index;
+}
+
+static int
+xlateorder_namecmp(const void *a, const void *b)
+{
+    const struct xlateorder *xa = a, *xb = b;
+    int r;
+
+    r = strcmp(xa->key.name, xb->key.name);
+    if (r)
+	return r;
+    return xa->index - xb->index;
+}
+
 static afs_int32
 nameToID(struct rx_call *call, namelist *aname, idlist *aid)
 {
     afs_int32 code;
     struct ubik_trans *tt;
-    afs_int32 i;
+    afs_int32 i, j;
     int size;
     int count = 0;
+    struct xlateorder *order;
 
     /* Initialize return struct */
     aid->idlist_len = 0;
@@ -566,17 +618,37 @@ nameToID(struct rx_call *call, namelist *aname, idlist *aid)
     aid->idlist_val = malloc(size * sizeof(afs_int32));
     if (!aid->idlist_val)
 	return PRNOMEM;
+    order = malloc(size * sizeof(*order));
+    if (!order) {
+	code = PRNOMEM;
+	goto out;
+    }
+    for (i = 0; i < size; i++) {
+	aname->namelist_val[i][PR_MAXNAMELEN - 1] = '\0';
+	order[i].key.name = aname->namelist_val[i];
+	order[i].index = i;
+    }
+    qsort(order, size, sizeof(*order), xlateorder_namecmp);
 
     code = ReadPreamble(&tt);
-    if (code)
-	return code;
+    if (code) {
+	free(order);
+	goto out;
+    }
 
-    for (i = 0; i < aname->namelist_len; i++) {
+    for (i = 0; i < size; i++) {
 	char vname[256];
 	char *nameinst, *cell;
 	afs_int32 islocal = 1;
 
-	strncpy(vname, aname->namelist_val[i], sizeof(vname));
+	j = order[i].index;
+	if (i > 0 && strcmp(order[i].key.name, order[i - 1].key.name) == 0) {
+	    /* same name as the previous one; code is still its result */
+	    aid->idlist_val[j] = aid->idlist_val[order[i - 1].index];
+	    goto done;
+	}
+
+	strncpy(vname, aname->namelist_val[j], sizeof(vname));
 	vname[sizeof(vname)-1] ='\0';
 
 	nameinst = vname;
@@ -593,17 +665,19 @@ nameToID(struct rx_call *call, namelist *aname, idlist *aid)
 		     code, nameinst, cell));
 	}
 	if (islocal)
-	    code = NameToID(tt, nameinst, &aid->idlist_val[i]);
+	    code = CachedNameToID(tt, nameinst, &aid->idlist_val[j]);
 	else
-	    code = NameToID(tt, aname->namelist_val[i], &aid->idlist_val[i]);
+	    code = CachedNameToID(tt, aname->namelist_val[j],
+				  &aid->idlist_val[j]);
 
 	if (code != PRSUCCESS)
-	    aid->idlist_val[i] = ANONYMOUSID;
+	    aid->idlist_val[j] = ANONYMOUSID;
+      done:
         osi_audit(PTS_NmToIdEvent, code, AUD_STR,
-		   aname->namelist_val[i], AUD_ID, aid->idlist_val[i],
+		   aname->namelist_val[j], AUD_ID, aid->idlist_val[j],
 		   AUD_END);
 	ViceLog(125, ("PTS_NameToID: code %d aname %s aid %d\n", code,
-		      aname->namelist_val[i], aid->idlist_val[i]));
+		      aname->namelist_val[j], aid->idlist_val[j]));
 	if (count++ > 50) {
 #ifndef AFS_PTHREAD_ENV
 	    IOMGR_Poll();
@@ -612,11 +686,18 @@ nameToID(struct rx_call *call, namelist *aname, idlist *aid)
 	}
     }
     aid->idlist_len = aname->namelist_len;
+    free(order);
 
     code = ubik_EndTrans(tt);
     if (code)
 	return code;
     return PRSUCCESS;
+
+  out:
+    free(aid->idlist_val);
+    aid->idlist_val = NULL;
+    aid->idlist_len = 0;
+    return code;
 }
 
 /*
@@ -641,9 +722,10 @@ idToName(struct rx_call *call, idlist *aid, namelist *aname, afs_int32 *cid)
 {
     afs_int32 code;
     struct ubik_trans *tt;
-    afs_int32 i;
+    afs_int32 i, j;
     int size;
     int count = 0;
+    struct xlateorder *order;
 
     /* leave this first for rpc stub */
     size = aid->idlist_len;
@@ -659,25 +741,47 @@ idToName(struct rx_call *call, idlist *aid, namelist *aname, afs_int32 *cid)
 	return 0;
     if (size == 0)
 	return PRTOOMANY;	/* rxgen will probably handle this */
+    order = malloc(size * sizeof(*order));
+    if (!order)
+	return PRNOMEM;
+    for (i = 0; i < size; i++) {
+	order[i].key.id = aid->idlist_val[i];
+	order[i].index = i;
+    }
+    qsort(order, size, sizeof(*order), xlateorder_idcmp);
 
     code = ReadPreamble(&tt);
     if (code)
-	return code;
+	goto out;
 
     code = WhoIsThis(call, tt, cid);
-    if (code)
-	ABORT_WITH(tt, PRPERM);
-    if (!pr_noAuth && restrict_anonymous && *cid == ANONYMOUSID)
-	ABORT_WITH(tt, PRPERM);
+    if (code) {
+	code = PRPERM;
+	goto abort;
+    }
+    if (!pr_noAuth && restrict_anonymous && *cid == ANONYMOUSID) {
+	code = PRPERM;
+	goto abort;
+    }
 
-    for (i = 0; i < aid->idlist_len; i++) {
-	code = IDToName(tt, aid->idlist_val[i], aname->namelist_val[i]);
-	if (code != PRSUCCESS)
-	    sprintf(aname->namelist_val[i], "%d", aid->idlist_val[i]);
-        osi_audit(PTS_IdToNmEvent, code, AUD_ID, aid->idlist_val[i],
-		  AUD_STR, aname->namelist_val[i], AUD_END);
+    for (i = 0; i < size; i++) {
+	j = order[i].index;
+	if (i > 0 && order[i].key.id == order[i - 1].key.id) {
+	    /* same id as the previous one; code is still its result */
+	    if (j != order[i - 1].index)
+		strlcpy(aname->namelist_val[j],
+			aname->namelist_val[order[i - 1].index],
+			PR_MAXNAMELEN);
+	} else {
+	    code = CachedIDToName(tt, aid->idlist_val[j],
+				  aname->namelist_val[j]);
+	    if (code != PRSUCCESS)
+		sprintf(aname->namelist_val[j], "%d", aid->idlist_val[j]);
+	}
+        osi_audit(PTS_IdToNmEvent, code, AUD_ID, aid->idlist_val[j],
+		  AUD_STR, aname->namelist_val[j], AUD_END);
 	ViceLog(125, ("PTS_idToName: code %d aid %d aname %s\n", code,
-		      aid->idlist_val[i], aname->namelist_val[i]));
+		      aid->idlist_val[j], aname->namelist_val[j]));
 	if (count++ > 50) {
 #ifndef AFS_PTHREAD_ENV
 	    IOMGR_Poll();
@@ -688,9 +792,15 @@ idToName(struct rx_call *call, idlist *aid, namelist *aname, afs_int32 *cid)
     aname->namelist_len = aid->idlist_len;
 
     code = ubik_EndTrans(tt);
-    if (code)
-	return code;
-    return PRSUCCESS;
+    if (code == 0)
+	code = PRSUCCESS;
+    goto out;
+
+  abort:
+    ubik_AbortTrans(tt);
+  out:
+    free(order);
+    return code;
 }
 
 afs_int32
@@ -1130,7 +1240,7 @@ getCPS(struct rx_call *call, afs_int32 aid, prlist *alist, afs_int32 *over,
     if (!AccessOK(tt, *cid, &tentry, PRP_MEMBER_MEM, PRP_MEMBER_ANY))
 	ABORT_WITH(tt, PRPERM);
 
-    code = GetList(tt, &tentry, alist, 1);
+    code = GetCPSList(tt, &tentry, alist);
     if (code != PRSUCCESS)
 	ABORT_WITH(tt, code);
 
@@ -1268,6 +1378,11 @@ getHostCPS(struct rx_call *call, afs_uint32 ahost, prlist *alist,
     if (!pr_noAuth && restrict_anonymous && *cid == ANONYMOUSID)
 	ABORT_WITH(tt, PRPERM);
 
+    if (pt_LookupCPSCache(CPSCACHE_HOST, ahost, alist)) {
+	code = ubik_EndTrans(tt);
+	return code;
+    }
+
     code = NameToID(tt, afs_inet_ntoa_r(iaddr.s_addr, hoststr), &hostid);
     if (code == PRSUCCESS && hostid != 0) {
 	temp = FindByID(tt, hostid);
@@ -1287,6 +1402,8 @@ getHostCPS(struct rx_call *call, afs_uint32 ahost, prlist *alist,
     if (code != PRSUCCESS)
 	ABORT_WITH(tt, code);
 
+    pt_InsertCPSCache(tt, CPSCACHE_HOST, ahost, alist);
+
     code = ubik_EndTrans(tt);
     return code;
 }
@@ -1487,6 +1604,17 @@ listEntries(struct rx_call *call, afs_int32 flag, afs_int32 startindex,
 	    pollcount = 0;
 	}
 
+	if (tentry.flags == PRHASHBLOCK) {
+	    /* Skip an extended hash table block; its hashSize lines up with
+	     * the entry's id */
+	    if (tentry.id < HASHSIZE || tentry.id > PR_MAXHASHSIZE) {
+		code = PRDBBAD;
+		goto done;
+	    }
+	    i += PR_HASHBLOCK_SIZE(tentry.id) / sizeof(struct prentry) - 1;
+	    continue;
+	}
+
 	f = (tentry.flags & PRTYPE);
 	if (((flag & PRUSERS) && (f == 0)) ||	/* User  entry */
 	    ((flag & PRGROUPS) && (f & PRGRP))) {	/* Group entry */
@@ -27,7 +27,11 @@ extern afs_int32 RemoveFromSGEntry(struct ubik_trans *at, afs_int32 aid,
 extern void pt_hook_write(void);
 #endif
 
-extern afs_int32 NameHash(unsigned char *aname);
+extern afs_int32 NameHash(char *aname, afs_int32 size);
+extern afs_int32 NextPrime(afs_int32 n);
+extern afs_int32 HashTableSize(void);
+extern afs_int32 GetHashHead(struct ubik_trans *tt, int table,
+			     afs_int32 hashindex, afs_int32 *headp);
 extern afs_int32 pr_Write(struct ubik_trans *tt, afs_int32 afd, afs_int32 pos,
 			  void *buff, afs_int32 len);
 extern afs_int32 pr_Read(struct ubik_trans *tt, afs_int32 afd, afs_int32 pos,
@@ -60,6 +64,7 @@ extern afs_int32 RemoveFromNameHash(struct ubik_trans *tt, char *aname,
 				    afs_int32 *loc);
 extern afs_int32 AddToNameHash(struct ubik_trans *tt, char *aname,
 			       afs_int32 loc);
+extern afs_int32 ResizeHashTables(struct ubik_trans *tt, afs_int32 hashsize);
 extern afs_int32 AddToOwnerChain(struct ubik_trans *at, afs_int32 gid,
 				 afs_int32 oid);
 extern afs_int32 RemoveFromOwnerChain(struct ubik_trans *at, afs_int32 gid,
@@ -85,6 +90,8 @@ extern afs_int32 DeleteEntry(struct ubik_trans *at, struct prentry *tentry,
 			     afs_int32 loc);
 extern afs_int32 GetList(struct ubik_trans *at, struct prentry *tentry,
 			 prlist *alist, afs_int32 add);
+extern afs_int32 GetCPSList(struct ubik_trans *at, struct prentry *tentry,
+			    prlist *alist);
 extern afs_int32 GetList2(struct ubik_trans *at, struct prentry *tentry,
 			  struct prentry *tentry2, prlist *alist,
 			  afs_int32 add);
@@ -95,6 +102,20 @@ extern afs_int32 ChangeEntry(struct ubik_trans *at, afs_int32 aid,
 			     afs_int32 newid);
 extern afs_int32 GetOwnedChain(struct ubik_trans *ut, afs_int32 *next,
 			       prlist *alist);
+/* kinds of lists kept in the CPS cache */
+#define CPSCACHE_CPS		1	/* GetList(..., 1) of a user or group */
+#define CPSCACHE_HOST		2	/* host CPS, keyed by address */
+#define CPSCACHE_SUPERGROUPS	3	/* supergroup closure of a group */
+extern afs_int32 pt_InitCPSCache(int entries);
+extern int pt_LookupCPSCache(int kind, afs_int32 id, prlist *alist);
+extern void pt_InsertCPSCache(struct ubik_trans *at, int kind, afs_int32 id,
+			      prlist *alist);
+extern afs_int32 pt_InitNameCache(int entries);
+extern void pt_InvalidateCaches(void);
+extern afs_int32 CachedIDToName(struct ubik_trans *at, afs_int32 aid,
+				char aname[PR_MAXNAMELEN]);
+extern afs_int32 CachedNameToID(struct ubik_trans *at,
+				char aname[PR_MAXNAMELEN], afs_int32 *aid);
 extern afs_int32 AddToPRList(prlist *alist, int *sizeP, afs_int32 id);
 extern afs_int32 read_DbHeader(struct ubik_trans *tt);
 extern afs_int32 Initdb(void);
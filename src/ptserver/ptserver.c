@@ -135,6 +135,8 @@
 #include <afs/keys.h>
 #include <afs/afsutil.h>
 #include <afs/audit.h>
+#include <afs/srvtrace.h>
+#include <afs/srvmetrics.h>
 #include <afs/com_err.h>
 
 #include "ptserver.h"
@@ -152,6 +154,9 @@ extern afs_int32 depthsg;
 
 int restricted = 0;
 int restrict_anonymous = 0;
+int cpsCacheSize = 4096;
+int nameCacheSize = 16384;
+afs_int32 pr_hashsize = 0;	/* hash table size to convert to, if any */
 int rxMaxMTU = -1;
 int rxBind = 0;
 int rxkadDisableDotCheck = 0;
@@ -188,6 +193,14 @@ prp_access_mask(char *s)
     return r;
 }
 
+/* Metrics collector for the ptserver: the ubik and rx state. */
+static void
+pr_PrintMetrics(FILE *out, void *rock)
+{
+    ubik_PrintMetrics(out);
+    rx_PrintMetrics(out);
+}
+
 /* check whether caller is authorized to manage RX statistics */
 int
 pr_rxstat_userok(struct rx_call *call)
@@ -220,8 +233,13 @@ enum optionsList {
     OPT_groupdepth,
     OPT_restricted,
     OPT_restrict_anonymous,
+    OPT_cpscache,
+    OPT_namecache,
+    OPT_hashsize,
     OPT_auditlog,
     OPT_auditiface,
+    OPT_srvtrace,
+    OPT_metrics,
     OPT_config,
     OPT_debug,
     OPT_logfile,
@@ -252,6 +270,7 @@ main(int argc, char **argv)
     afs_uint32 host = htonl(INADDR_ANY);
     struct cmd_syndesc *opts;
     struct cmd_item *list;
+    int hashsize;
 
     char *pr_dbaseName;
     char *configDir;
@@ -259,6 +278,8 @@ main(int argc, char **argv)
     char *whoami = "ptserver";
 
     char *auditFileName = NULL;
+    char *traceFileName = NULL;
+    char *metricsFileName = NULL;
     char *interface = NULL;
 
 #ifdef	AFS_AIX32_ENV
@@ -327,12 +348,22 @@ main(int argc, char **argv)
 		        CMD_OPTIONAL, "enable restricted mode");
     cmd_AddParmAtOffset(opts, OPT_restrict_anonymous, "-restrict_anonymous",
 			CMD_FLAG, CMD_OPTIONAL, "enable restricted anonymous mode");
+    cmd_AddParmAtOffset(opts, OPT_cpscache, "-cpscache", CMD_SINGLE,
+			CMD_OPTIONAL, "number of membership lists to cache");
+    cmd_AddParmAtOffset(opts, OPT_namecache, "-namecache", CMD_SINGLE,
+			CMD_OPTIONAL, "number of names and ids to cache");
+    cmd_AddParmAtOffset(opts, OPT_hashsize, "-hashsize", CMD_SINGLE,
+			CMD_OPTIONAL, "number of hash table buckets");
 
     /* general server options */
     cmd_AddParmAtOffset(opts, OPT_auditlog, "-auditlog", CMD_SINGLE,
 		 	CMD_OPTIONAL, "location of audit log");
     cmd_AddParmAtOffset(opts, OPT_auditiface, "-audit-interface", CMD_SINGLE,
 		        CMD_OPTIONAL, "interface to use for audit logging");
+    cmd_AddParmAtOffset(opts, OPT_srvtrace, "-srvtrace", CMD_SINGLE,
+		        CMD_OPTIONAL, "location of binary trace file");
+    cmd_AddParmAtOffset(opts, OPT_metrics, "-metrics", CMD_SINGLE,
+		        CMD_OPTIONAL, "location of metrics file");
     cmd_AddParmAtOffset(opts, OPT_config, "-config", CMD_SINGLE,
 		        CMD_OPTIONAL, "configuration location");
     cmd_AddParmAtOffset(opts, OPT_debug, "-d", CMD_SINGLE,
@@ -390,6 +421,24 @@ main(int argc, char **argv)
 
     cmd_OptionAsFlag(opts, OPT_restricted, &restricted);
     cmd_OptionAsFlag(opts, OPT_restrict_anonymous, &restrict_anonymous);
+    if (cmd_OptionAsInt(opts, OPT_cpscache, &cpsCacheSize) == 0
+	&& cpsCacheSize < 0) {
+	fprintf(stderr, "Invalid value for -cpscache: %d\n", cpsCacheSize);
+	PT_EXIT(1);
+    }
+    if (cmd_OptionAsInt(opts, OPT_namecache, &nameCacheSize) == 0
+	&& nameCacheSize < 0) {
+	fprintf(stderr, "Invalid value for -namecache: %d\n", nameCacheSize);
+	PT_EXIT(1);
+    }
+    if (cmd_OptionAsInt(opts, OPT_hashsize, &hashsize) == 0) {
+	if (hashsize < HASHSIZE || hashsize > PR_MAXHASHSIZE) {
+	    fprintf(stderr, "Invalid -hashsize %d; must be between %d and %d\n",
+		    hashsize, HASHSIZE, PR_MAXHASHSIZE);
+	    PT_EXIT(1);
+	}
+	pr_hashsize = NextPrime(hashsize);
+    }
 
     /* general server options */
     cmd_OptionAsString(opts, OPT_auditlog, &auditFileName);
@@ -402,6 +451,18 @@ main(int argc, char **argv)
 	free(interface);
     }
 
+    if (cmd_OptionAsString(opts, OPT_srvtrace, &traceFileName) == 0) {
+	code = SrvTrace_Open(traceFileName);
+	if (code) {
+	    printf("Unable to open trace file '%s': %s\n", traceFileName,
+		   strerror(code));
+	    PT_EXIT(1);
+	}
+	free(traceFileName);
+    }
+
+    cmd_OptionAsString(opts, OPT_metrics, &metricsFileName);
+
     cmd_OptionAsString(opts, OPT_database, &pr_dbaseName);
 
     if (cmd_OptionAsInt(opts, OPT_threads, &lwps) == 0) {
@@ -525,6 +586,21 @@ main(int argc, char **argv)
      * and the header are in separate Ubik buffers then 120 buffers may be
      * required. */
     ubik_nBuffers = 120 + /*fudge */ 40;
+    if (pr_hashsize) {
+	/* Resizing the hash tables rewrites every entry, and both the old and
+	 * the new tables, in a single transaction; all of it has to fit in the
+	 * ubik buffer cache at once */
+	struct stat status;
+	char *dbfile;
+	afs_int64 bytes = PR_HASHBLOCK_SIZE(pr_hashsize);
+
+	if (asprintf(&dbfile, "%s.DB0", pr_dbaseName) >= 0) {
+	    if (stat(dbfile, &status) == 0)
+		bytes += status.st_size;
+	    free(dbfile);
+	}
+	ubik_nBuffers += bytes / 1024 + 1;	/* 1K buffers */
+    }
 
     if (rxBind) {
 	afs_int32 ccode;
@@ -571,6 +647,17 @@ main(int argc, char **argv)
     pt_hook_write();
 #endif
 
+    code = pt_InitCPSCache(cpsCacheSize);
+    if (code) {
+	afs_com_err(whoami, code, "couldn't allocate CPS cache");
+	PT_EXIT(2);
+    }
+    code = pt_InitNameCache(nameCacheSize);
+    if (code) {
+	afs_com_err(whoami, code, "couldn't allocate name cache");
+	PT_EXIT(2);
+    }
+
     afsconf_BuildServerSecurityObjects(prdir, &securityClasses, &numClasses);
 
     tservice =
@@ -611,6 +698,15 @@ main(int argc, char **argv)
 	LogDesWarning();
     }
 
+    if (metricsFileName != NULL) {
+	code = SrvMetrics_AddCollector(pr_PrintMetrics, NULL);
+	if (code == 0)
+	    code = SrvMetrics_Open(metricsFileName);
+	if (code != 0)
+	    ViceLog(0, ("Unable to write metrics file %s: %s\n",
+			metricsFileName, strerror(code)));
+    }
+
     rx_StartServer(1);
     osi_audit(PTS_FinishEvent, -1, AUD_END);
     exit(0);
@@ -29,6 +29,7 @@ extern int string_PR_IDToName(struct ubik_client *client, afs_int32 flags,
 #define	ANONYMOUSID	32766
 
 #define PRDBVERSION	0
+#define PRDBVERSION_HASH 1	/* hash tables in an extended block */
 
 struct prheader {
     afs_int32 version;		/* database version number */
@@ -44,7 +45,9 @@ struct prheader {
     afs_int32 groupcount;	/* num groups in system */
     afs_int32 foreigncount;	/* num registered foreign users NYI */
     afs_int32 instcount;	/* number of sub and super users NYI */
-    afs_int32 reserved[5];	/* just in case */
+    afs_int32 hashTable;	/* extended hash table block (version 1) */
+    afs_int32 hashSize;		/* # of buckets per extended table */
+    afs_int32 reserved[3];	/* just in case */
     afs_int32 nameHash[HASHSIZE];	/* hash table for names */
     afs_int32 idHash[HASHSIZE];	/* hash table for ids */
 };
@@ -74,6 +77,33 @@ extern struct prheader cheader;
 
 #define PRACCESS	(1<<6)	/* access checking enabled */
 #define PRQUOTA		(1<<7)	/* group creation quota checking on */
+#define PRHASHBLOCK	(1<<8)	/* extended hash table block; never combined
+				 * with any other flag */
+
+/*
+ * Extended hash tables.  A PRDBVERSION_HASH database keeps its name and id
+ * hash tables in a single block, found through the header's hashTable, instead
+ * of in the fixed size arrays of the header (which are then left empty).  This
+ * lets the number of buckets grow with the number of entries.  The block
+ * starts with an entry sized header, followed by the name table and then the
+ * id table, each hashSize buckets long, and is padded to a whole number of
+ * entries so that it can be put back on the free list when it is replaced.
+ */
+#define PR_MAXHASHSIZE	4194301	/* Largest extended table; prime */
+#define PR_NAMEHASH	0	/* Table index of the name hash */
+#define PR_IDHASH	1	/* Table index of the id hash */
+struct prhashblock {
+    afs_int32 flags;		/* PRHASHBLOCK; same position as the prentry's
+				 * flags */
+    afs_int32 hashSize;		/* # of buckets in each table; same position as
+				 * the prentry's id */
+    afs_int32 reserved[ENTRYSIZE / sizeof(afs_int32) - 2];
+};
+#define PR_HASHBLOCK_SIZE(size) \
+    (ENTRYSIZE + (2 * (size) * sizeof(afs_int32) + ENTRYSIZE - 1) \
+		 / ENTRYSIZE * ENTRYSIZE)
+#define PR_HASHBUCKET_OFFSET(base, size, table, idx) \
+    ((base) + ENTRYSIZE + ((table) * (size) + (idx)) * sizeof(afs_int32))
 
 /* define the access bits for entries, they are stored in the left half of the
  * entry's flags.  The SetFields interface takes them in the right half.  There
@@ -26,6 +26,9 @@
 
 #include <roken.h>
 
+#include <afs/opr.h>
+#include <opr/queue.h>
+#include <opr/jhash.h>
 #include <lock.h>
 #include <ubik.h>
 #include <rx/xdr.h>
@@ -60,6 +63,8 @@ int prp_group_default = PRP_GROUP_DEFAULT;
 afs_int32 depthsg = 5;		/* Maximum iterations used during IsAMemberOF */
 afs_int32 GetListSG2(struct ubik_trans *at, afs_int32 gid, prlist * alist,
 		     afs_int32 * sizeP, afs_int32 depth);
+static afs_int32 AddSGClosure(struct ubik_trans *at, afs_int32 gid,
+			      prlist *alist, afs_int32 *sizeP);
 
 struct map *sg_flagged;
 struct map *sg_found;
@@ -1219,6 +1224,407 @@ AddToSGEntry(struct ubik_trans *tt, struct prentry *entry, afs_int32 loc, afs_in
 }
 #endif /* SUPERGROUPS */
 
+/*
+ * In-memory cache of computed membership lists.
+ *
+ * Computing a CPS walks the entry's continuation blocks and, with
+ * supergroups, recurses through every group the entry belongs to.  When
+ * fileservers restart, every host and user asks for its CPS at once, so we
+ * keep the results around until the database changes.  The cache is
+ * flushed whenever our cached copy of the header is reloaded because the
+ * ubik version moved, and at the start of every local write transaction;
+ * both happen with the ubik database lock held exclusively, so no read
+ * transaction can be filling the cache with stale data at the same time.
+ * Lists computed inside a write transaction are never cached, since that
+ * transaction may still abort.
+ */
+
+struct cpscache_entry {
+    struct opr_queue hashq;
+    struct opr_queue lruq;
+    int kind;
+    afs_int32 id;
+    afs_int32 len;
+    afs_int32 *ids;
+};
+
+static struct Lock cpscache_lock;
+static struct opr_queue *cpscache_hash;
+static struct opr_queue cpscache_lru;
+static int cpscache_hashsize;
+static int cpscache_max;
+static int cpscache_count;
+
+#define CPSCACHE_HASH(kind, id) \
+    ((((afs_uint32)(id) * 2654435761U) ^ (kind)) & (cpscache_hashsize - 1))
+
+/* Only data read under a read transaction reflects the committed database. */
+#define CACHEABLE_TRANS(at) ((at) != NULL && (at)->type == UBIK_READTRANS)
+
+/**
+ * set up the CPS cache.
+ *
+ * @param[in] entries  maximum number of lists to keep; 0 disables the cache
+ *
+ * @return operation status
+ *   @retval 0 success
+ *   @retval PRNOMEM out of memory
+ */
+afs_int32
+pt_InitCPSCache(int entries)
+{
+    int i;
+
+    Lock_Init(&cpscache_lock);
+    opr_queue_Init(&cpscache_lru);
+    if (entries <= 0)
+	return 0;
+
+    for (cpscache_hashsize = 1; cpscache_hashsize < entries / 2;
+	 cpscache_hashsize <<= 1)
+	;
+    cpscache_hash = calloc(cpscache_hashsize, sizeof(*cpscache_hash));
+    if (!cpscache_hash)
+	return PRNOMEM;
+    for (i = 0; i < cpscache_hashsize; i++)
+	opr_queue_Init(&cpscache_hash[i]);
+    cpscache_max = entries;
+    return 0;
+}
+
+static void
+FreeCPSCacheEntry(struct cpscache_entry *entry)
+{
+    opr_queue_Remove(&entry->hashq);
+    opr_queue_Remove(&entry->lruq);
+    free(entry->ids);
+    free(entry);
+    cpscache_count--;
+}
+
+static void
+InvalidateCPSCache(void)
+{
+    struct cpscache_entry *entry;
+
+    if (!cpscache_max)
+	return;
+    ObtainWriteLock(&cpscache_lock);
+    while (!opr_queue_IsEmpty(&cpscache_lru)) {
+	entry = opr_queue_First(&cpscache_lru, struct cpscache_entry, lruq);
+	FreeCPSCacheEntry(entry);
+    }
+    ReleaseWriteLock(&cpscache_lock);
+}
+
+/**
+ * look up a cached list.
+ *
+ * @param[in]  kind   CPSCACHE_* type of list
+ * @param[in]  id     entry id (or host address for CPSCACHE_HOST)
+ * @param[out] alist  on a hit, set to a newly allocated copy of the list
+ *
+ * @return 1 on a hit, 0 otherwise
+ */
+int
+pt_LookupCPSCache(int kind, afs_int32 id, prlist *alist)
+{
+    struct opr_queue *cursor;
+    struct cpscache_entry *entry;
+    int found = 0;
+
+    if (!cpscache_max)
+	return 0;
+    ObtainWriteLock(&cpscache_lock);
+    for (opr_queue_Scan(&cpscache_hash[CPSCACHE_HASH(kind, id)], cursor)) {
+	entry = opr_queue_Entry(cursor, struct cpscache_entry, hashq);
+	if (entry->kind != kind || entry->id != id)
+	    continue;
+	alist->prlist_val = malloc((entry->len + 1) * sizeof(afs_int32));
+	if (!alist->prlist_val)
+	    break;
+	memcpy(alist->prlist_val, entry->ids, entry->len * sizeof(afs_int32));
+	alist->prlist_len = entry->len;
+	opr_queue_Remove(&entry->lruq);
+	opr_queue_Append(&cpscache_lru, &entry->lruq);
+	found = 1;
+	break;
+    }
+    ReleaseWriteLock(&cpscache_lock);
+    return found;
+}
+
+/**
+ * remember a computed list, evicting the least recently used one if full.
+ *
+ * The caller keeps ownership of alist.  Failure to allocate memory just
+ * means the list is not cached; so does computing it in a write
+ * transaction, whose changes are not committed yet.
+ *
+ * @param[in] at     transaction the list was computed in
+ * @param[in] kind   CPSCACHE_* type of list
+ * @param[in] id     entry id (or host address for CPSCACHE_HOST)
+ * @param[in] alist  the list
+ */
+void
+pt_InsertCPSCache(struct ubik_trans *at, int kind, afs_int32 id,
+		  prlist *alist)
+{
+    struct opr_queue *cursor;
+    struct cpscache_entry *entry;
+
+    if (!cpscache_max || !CACHEABLE_TRANS(at))
+	return;
+    entry = malloc(sizeof(*entry));
+    if (!entry)
+	return;
+    entry->ids = malloc((alist->prlist_len + 1) * sizeof(afs_int32));
+    if (!entry->ids) {
+	free(entry);
+	return;
+    }
+    memcpy(entry->ids, alist->prlist_val,
+	   alist->prlist_len * sizeof(afs_int32));
+    entry->len = alist->prlist_len;
+    entry->kind = kind;
+    entry->id = id;
+
+    ObtainWriteLock(&cpscache_lock);
+    for (opr_queue_Scan(&cpscache_hash[CPSCACHE_HASH(kind, id)], cursor)) {
+	struct cpscache_entry *old;
+
+	old = opr_queue_Entry(cursor, struct cpscache_entry, hashq);
+	if (old->kind == kind && old->id == id) {
+	    FreeCPSCacheEntry(old);
+	    break;
+	}
+    }
+    if (cpscache_count >= cpscache_max)
+	FreeCPSCacheEntry(opr_queue_First(&cpscache_lru,
+					  struct cpscache_entry, lruq));
+    opr_queue_Prepend(&cpscache_hash[CPSCACHE_HASH(kind, id)], &entry->hashq);
+    opr_queue_Append(&cpscache_lru, &entry->lruq);
+    cpscache_count++;
+    ReleaseWriteLock(&cpscache_lock);
+}
+
+/*
+ * In-memory map between names and ids, filled in by NameToID and IDToName
+ * lookups so that large translation batches (ACL listings of big groups)
+ * mostly avoid walking the hash chains in the database.  It is flushed
+ * together with the CPS cache, and like it is only filled from read
+ * transactions.
+ */
+
+struct namecache_entry {
+    struct opr_queue idq;
+    struct opr_queue nameq;
+    struct opr_queue lruq;
+    afs_int32 id;
+    char name[PR_MAXNAMELEN];
+};
+
+static struct Lock namecache_lock;
+static struct opr_queue *namecache_idhash;
+static struct opr_queue *namecache_namehash;
+static struct opr_queue namecache_lru;
+static int namecache_hashsize;
+static int namecache_max;
+static int namecache_count;
+
+#define NAMECACHE_IDHASH(id) \
+    (opr_jhash_int((id), 0) & (namecache_hashsize - 1))
+#define NAMECACHE_NAMEHASH(name) \
+    (opr_jhash_opaque((name), strlen(name), 0) & (namecache_hashsize - 1))
+
+/**
+ * set up the name/id cache.
+ *
+ * @param[in] entries  maximum number of names to keep; 0 disables the cache
+ *
+ * @return operation status
+ *   @retval 0 success
+ *   @retval PRNOMEM out of memory
+ */
+afs_int32
+pt_InitNameCache(int entries)
+{
+    int i;
+
+    Lock_Init(&namecache_lock);
+    opr_queue_Init(&namecache_lru);
+    if (entries <= 0)
+	return 0;
+
+    for (namecache_hashsize = 1; namecache_hashsize < entries / 2;
+	 namecache_hashsize <<= 1)
+	;
+    namecache_idhash = calloc(namecache_hashsize, sizeof(*namecache_idhash));
+    namecache_namehash =
+	calloc(namecache_hashsize, sizeof(*namecache_namehash));
+    if (!namecache_idhash || !namecache_namehash) {
+	free(namecache_idhash);
+	free(namecache_namehash);
+	return PRNOMEM;
+    }
+    for (i = 0; i < namecache_hashsize; i++) {
+	opr_queue_Init(&namecache_idhash[i]);
+	opr_queue_Init(&namecache_namehash[i]);
+    }
+    namecache_max = entries;
+    return 0;
+}
+
+static void
+FreeNameCacheEntry(struct namecache_entry *entry)
+{
+    opr_queue_Remove(&entry->idq);
+    opr_queue_Remove(&entry->nameq);
+    opr_queue_Remove(&entry->lruq);
+    free(entry);
+    namecache_count--;
+}
+
+static void
+InvalidateNameCache(void)
+{
+    struct namecache_entry *entry;
+
+    if (!namecache_max)
+	return;
+    ObtainWriteLock(&namecache_lock);
+    while (!opr_queue_IsEmpty(&namecache_lru)) {
+	entry = opr_queue_First(&namecache_lru, struct namecache_entry, lruq);
+	FreeNameCacheEntry(entry);
+    }
+    ReleaseWriteLock(&namecache_lock);
+}
+
+/* Caller must hold namecache_lock. */
+static struct namecache_entry *
+FindNameCacheByID(afs_int32 id)
+{
+    struct opr_queue *cursor;
+    struct namecache_entry *entry;
+
+    for (opr_queue_Scan(&namecache_idhash[NAMECACHE_IDHASH(id)], cursor)) {
+	entry = opr_queue_Entry(cursor, struct namecache_entry, idq);
+	if (entry->id == id)
+	    return entry;
+    }
+    return NULL;
+}
+
+/* Caller must hold namecache_lock. */
+static struct namecache_entry *
+FindNameCacheByName(char *name)
+{
+    struct opr_queue *cursor;
+    struct namecache_entry *entry;
+
+    for (opr_queue_Scan(&namecache_namehash[NAMECACHE_NAMEHASH(name)],
+			cursor)) {
+	entry = opr_queue_Entry(cursor, struct namecache_entry, nameq);
+	if (strcmp(entry->name, name) == 0)
+	    return entry;
+    }
+    return NULL;
+}
+
+static void
+InsertNameCache(afs_int32 id, char *name)
+{
+    struct namecache_entry *entry, *old;
+
+    entry = malloc(sizeof(*entry));
+    if (!entry)
+	return;
+    entry->id = id;
+    strlcpy(entry->name, name, sizeof(entry->name));
+
+    ObtainWriteLock(&namecache_lock);
+    if ((old = FindNameCacheByID(id)) != NULL)
+	FreeNameCacheEntry(old);
+    if ((old = FindNameCacheByName(entry->name)) != NULL)
+	FreeNameCacheEntry(old);
+    if (namecache_count >= namecache_max)
+	FreeNameCacheEntry(opr_queue_First(&namecache_lru,
+					   struct namecache_entry, lruq));
+    opr_queue_Prepend(&namecache_idhash[NAMECACHE_IDHASH(id)], &entry->idq);
+    opr_queue_Prepend(&namecache_namehash[NAMECACHE_NAMEHASH(entry->name)],
+		      &entry->nameq);
+    opr_queue_Append(&namecache_lru, &entry->lruq);
+    namecache_count++;
+    ReleaseWriteLock(&namecache_lock);
+}
+
+/**
+ * IDToName, answered from the name cache when possible.
+ */
+afs_int32
+CachedIDToName(struct ubik_trans *at, afs_int32 aid,
+	       char aname[PR_MAXNAMELEN])
+{
+    struct namecache_entry *entry;
+    afs_int32 code;
+
+    if (namecache_max) {
+	ObtainWriteLock(&namecache_lock);
+	entry = FindNameCacheByID(aid);
+	if (entry) {
+	    strncpy(aname, entry->name, PR_MAXNAMELEN);
+	    opr_queue_Remove(&entry->lruq);
+	    opr_queue_Append(&namecache_lru, &entry->lruq);
+	}
+	ReleaseWriteLock(&namecache_lock);
+	if (entry)
+	    return PRSUCCESS;
+    }
+    code = IDToName(at, aid, aname);
+    if (code == PRSUCCESS && namecache_max && CACHEABLE_TRANS(at))
+	InsertNameCache(aid, aname);
+    return code;
+}
+
+/**
+ * NameToID, answered from the name cache when possible.
+ */
+afs_int32
+CachedNameToID(struct ubik_trans *at, char aname[PR_MAXNAMELEN],
+	       afs_int32 *aid)
+{
+    struct namecache_entry *entry;
+    afs_int32 code;
+
+    if (namecache_max) {
+	ObtainWriteLock(&namecache_lock);
+	entry = FindNameCacheByName(aname);
+	if (entry) {
+	    *aid = entry->id;
+	    opr_queue_Remove(&entry->lruq);
+	    opr_queue_Append(&namecache_lru, &entry->lruq);
+	}
+	ReleaseWriteLock(&namecache_lock);
+	if (entry)
+	    return PRSUCCESS;
+    }
+    code = NameToID(at, aname, aid);
+    if (code == PRSUCCESS && namecache_max && CACHEABLE_TRANS(at))
+	InsertNameCache(*aid, aname);
+    return code;
+}
+
+/**
+ * throw away the CPS and name caches; called whenever the database may
+ * have changed.
+ */
+void
+pt_InvalidateCaches(void)
+{
+    InvalidateCPSCache();
+    InvalidateNameCache();
+}
+
 afs_int32
 AddToPRList(prlist *alist, int *sizeP, afs_int32 id)
 {
@@ -1266,7 +1672,7 @@ GetList(struct ubik_trans *at, struct prentry *tentry, prlist *alist, afs_int32
 #if defined(SUPERGROUPS)
 	if (!add)
 	    continue;
-	code = GetListSG2(at, tentry->entries[i], alist, &size, depthsg);
+	code = AddSGClosure(at, tentry->entries[i], alist, &size);
 	if (code)
 	    return code;
 #endif
@@ -1288,7 +1694,7 @@ GetList(struct ubik_trans *at, struct prentry *tentry, prlist *alist, afs_int32
 #if defined(SUPERGROUPS)
 	    if (!add)
 		continue;
-	    code = GetListSG2(at, centry.entries[i], alist, &size, depthsg);
+	    code = AddSGClosure(at, centry.entries[i], alist, &size);
 	    if (code)
 		return code;
 #endif
@@ -1322,6 +1728,23 @@ GetList(struct ubik_trans *at, struct prentry *tentry, prlist *alist, afs_int32
 }
 
 
+/**
+ * GetList(at, tentry, alist, 1), answered from the CPS cache when possible.
+ */
+afs_int32
+GetCPSList(struct ubik_trans *at, struct prentry *tentry, prlist *alist)
+{
+    afs_int32 code;
+
+    if (pt_LookupCPSCache(CPSCACHE_CPS, tentry->id, alist))
+	return PRSUCCESS;
+    code = GetList(at, tentry, alist, 1);
+    if (code == PRSUCCESS)
+	pt_InsertCPSCache(at, CPSCACHE_CPS, tentry->id, alist);
+    return code;
+}
+
+
 afs_int32
 GetList2(struct ubik_trans *at, struct prentry *tentry, struct prentry *tentry2, prlist *alist, afs_int32 add)
 {
@@ -1346,7 +1769,7 @@ GetList2(struct ubik_trans *at, struct prentry *tentry, struct prentry *tentry2,
 #if defined(SUPERGROUPS)
 	if (!add)
 	    continue;
-	code = GetListSG2(at, tentry->entries[i], alist, &size, depthsg);
+	code = AddSGClosure(at, tentry->entries[i], alist, &size);
 	if (code)
 	    return code;
 #endif
@@ -1369,7 +1792,7 @@ GetList2(struct ubik_trans *at, struct prentry *tentry, struct prentry *tentry2,
 #if defined(SUPERGROUPS)
 	    if (!add)
 		continue;
-	    code = GetListSG2(at, centry.entries[i], alist, &size, depthsg);
+	    code = AddSGClosure(at, centry.entries[i], alist, &size);
 	    if (code)
 		return code;
 #endif
@@ -1560,6 +1983,39 @@ GetListSG2(struct ubik_trans *at, afs_int32 gid, prlist *alist, afs_int32 *sizeP
     return 0;
 }
 
+/*
+ * Append the supergroups of gid, down to depthsg levels, to alist.  The
+ * closure is computed by GetListSG2 once and then kept in the CPS cache, so
+ * groups shared by many users are only walked once per database version.
+ */
+static afs_int32
+AddSGClosure(struct ubik_trans *at, afs_int32 gid, prlist *alist,
+	     afs_int32 *sizeP)
+{
+    afs_int32 code = 0;
+    afs_int32 size = 0;
+    afs_int32 i;
+    prlist closure;
+
+    closure.prlist_len = 0;
+    closure.prlist_val = NULL;
+    if (!pt_LookupCPSCache(CPSCACHE_SUPERGROUPS, gid, &closure)) {
+	code = GetListSG2(at, gid, &closure, &size, depthsg);
+	if (code) {
+	    free(closure.prlist_val);
+	    return code;
+	}
+	pt_InsertCPSCache(at, CPSCACHE_SUPERGROUPS, gid, &closure);
+    }
+    for (i = 0; i < closure.prlist_len; i++) {
+	code = AddToPRList(alist, sizeP, closure.prlist_val[i]);
+	if (code)
+	    break;
+    }
+    free(closure.prlist_val);
+    return code;
+}
+
 afs_int32
 GetSGList(struct ubik_trans *at, struct prentry *tentry, prlist *alist)
 {
@@ -1692,6 +2148,7 @@ UpdateCache(struct ubik_trans *tt, void *rock)
 {
     afs_int32 code;
 
+    pt_InvalidateCaches();
     code = pr_Read(tt, 0, 0, (char *)&cheader, sizeof(cheader));
     if (code != 0) {
 	afs_com_err(whoami, code, "Couldn't read header");
@@ -1724,13 +2181,16 @@ Initdb_check(struct ubik_trans *tt, void *rock)
     afs_int32 code;
     afs_int32 len;
 
+    pt_InvalidateCaches();
+
     len = sizeof(cheader);
     code = pr_Read(tt, 0, 0, (char *)&cheader, len);
     if (code != 0) {
 	afs_com_err(whoami, code, "couldn't read header");
 	return code;
     }
-    if ((ntohl(cheader.version) == PRDBVERSION)
+    if ((ntohl(cheader.version) == PRDBVERSION
+	 || ntohl(cheader.version) == PRDBVERSION_HASH)
 	&& ntohl(cheader.headerSize) == sizeof(cheader)
 	&& ntohl(cheader.eofPtr) != 0
 	&& FindByID(tt, ANONYMOUSID) != 0) {
@@ -1816,7 +2276,8 @@ Initdb(void)
 	ubik_AbortTrans(tt);
 	return code;
     }
-    if ((ntohl(cheader.version) == PRDBVERSION)
+    if ((ntohl(cheader.version) == PRDBVERSION
+	 || ntohl(cheader.version) == PRDBVERSION_HASH)
 	&& ntohl(cheader.headerSize) == sizeof(cheader)
 	&& ntohl(cheader.eofPtr) != 0
 	&& FindByID(tt, ANONYMOUSID) != 0) {
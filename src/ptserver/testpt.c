@@ -217,7 +217,7 @@ void
 CreateUser(int u)
 {
     afs_int32 code;
-    char name[16];
+    char name[PR_MAXNAMELEN];
     afs_int32 id;
 
     sprintf(name, "%s%d", createPrefix, u);
@@ -255,7 +255,7 @@ void
 CreateGroup(int g)
 {
     afs_int32 code;
-    char name[16];
+    char name[PR_MAXNAMELEN];
     afs_int32 id = 0;
     afs_int32 owner = 0;
     char *ownerName = NULL;
@@ -697,6 +697,252 @@ TestManyMembers(struct cmd_syndesc *as, void *arock)
     return 0;
 }
 
+static double
+ElapsedSeconds(struct timeval *start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec)
+	+ (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
+static afs_int32
+CreateBenchEntry(char *name, afs_int32 flag, afs_int32 owner, afs_int32 *id)
+{
+    afs_int32 code;
+
+    *id = 0;
+    code = ubik_PR_NewEntry(pruclient, 0, name, flag, owner, id);
+    if (code == PREXIST) {
+	code = pr_SNameToId(name, id);
+	if (code == 0)
+	    code = ubik_PR_Delete(pruclient, 0, *id);
+	if (code == 0) {
+	    *id = 0;
+	    code = ubik_PR_NewEntry(pruclient, 0, name, flag, owner, id);
+	}
+    }
+    if (code)
+	afs_com_err(whoami, code, "couldn't create %s", name);
+    return code;
+}
+
+/*
+ * Time GetCPS over a synthetic population: every user belongs to the same
+ * set of groups, and (with supergroups) the first of them is nested in a
+ * chain of -depth further groups, so each CPS needs the chain walked.
+ * The first pass shows the uncached cost, later passes the cached one.
+ */
+int
+TestCPSBench(struct cmd_syndesc *as, void *arock)
+{
+    afs_int32 code;
+    int nusers, ngroups, depth, passes;
+    int u, g, p;
+    int nested = 1;
+    afs_int32 *uids, *gids;
+    char name[PR_MAXNAMELEN];
+    struct timeval start;
+    double secs;
+
+    code = pr_Initialize(1, conf_dir, NULL);
+    if (code) {
+	afs_com_err(whoami, code, "initializing pruser");
+	exit(1);
+    }
+
+    nusers = atoi(as->parms[0].items->data);
+    ngroups = as->parms[1].items ? atoi(as->parms[1].items->data) : 10;
+    depth = as->parms[2].items ? atoi(as->parms[2].items->data) : 0;
+    passes = as->parms[3].items ? atoi(as->parms[3].items->data) : 3;
+    createPrefix = as->parms[4].items ? as->parms[4].items->data : "cpsb";
+    if (nusers < 1 || ngroups < 1 || depth < 0 || passes < 1) {
+	fprintf(stderr, "%s: invalid benchmark parameters\n", whoami);
+	exit(7);
+    }
+
+    uids = calloc(nusers, sizeof(afs_int32));
+    gids = calloc(ngroups + depth, sizeof(afs_int32));
+    if (!uids || !gids) {
+	fprintf(stderr, "%s: out of memory\n", whoami);
+	exit(8);
+    }
+
+    printf("Creating %d users and %d groups\n", nusers, ngroups + depth);
+    gettimeofday(&start, NULL);
+    for (g = 0; g < ngroups + depth; g++) {
+	sprintf(name, "system:%sg%d", createPrefix, g);
+	if (CreateBenchEntry(name, PRGRP, SYSADMINID, &gids[g]))
+	    exit(13);
+    }
+    /* chain the extra groups: group i is a member of group i + 1 */
+    for (g = ngroups; g < ngroups + depth && nested; g++) {
+	afs_int32 inner = (g == ngroups) ? gids[0] : gids[g - 1];
+
+	code = ubik_PR_AddToGroup(pruclient, 0, inner, gids[g]);
+	if (code) {
+	    afs_com_err(whoami, code,
+			"couldn't nest groups; timing flat membership only");
+	    nested = 0;
+	}
+    }
+    for (u = 0; u < nusers; u++) {
+	sprintf(name, "%su%d", createPrefix, u);
+	if (CreateBenchEntry(name, 0, 0, &uids[u]))
+	    exit(12);
+	for (g = 0; g < ngroups; g++) {
+	    code = ubik_PR_AddToGroup(pruclient, 0, uids[u], gids[g]);
+	    if (code) {
+		afs_com_err(whoami, code, "couldn't add %d to %d", uids[u],
+			    gids[g]);
+		exit(14);
+	    }
+	}
+    }
+    printf("Setup took %.2f seconds\n", ElapsedSeconds(&start));
+
+    for (p = 0; p < passes; p++) {
+	gettimeofday(&start, NULL);
+	for (u = 0; u < nusers; u++) {
+	    prlist alist;
+	    afs_int32 over;
+
+	    alist.prlist_len = 0;
+	    alist.prlist_val = NULL;
+	    code = ubik_PR_GetCPS(pruclient, 0, uids[u], &alist, &over);
+	    if (code) {
+		afs_com_err(whoami, code, "getting CPS of (%di)", uids[u]);
+		exit(24);
+	    }
+	    free(alist.prlist_val);
+	}
+	secs = ElapsedSeconds(&start);
+	printf("Pass %d: %d GetCPS calls in %.3f seconds (%.0f/sec)\n",
+	       p + 1, nusers, secs, secs > 0 ? nusers / secs : 0.0);
+    }
+
+    printf("Deleting users and groups\n");
+    for (u = 0; u < nusers; u++)
+	ubik_PR_Delete(pruclient, 0, uids[u]);
+    for (g = ngroups + depth - 1; g >= 0; g--)
+	ubik_PR_Delete(pruclient, 0, gids[g]);
+    free(uids);
+    free(gids);
+    return 0;
+}
+
+/*
+ * Time IDToName and NameToID over one large batch, in the style of an ACL
+ * listing for a big group.  Each entry appears -repeat times in the batch.
+ */
+int
+TestNameBench(struct cmd_syndesc *as, void *arock)
+{
+    afs_int32 code;
+    int nusers, repeat, passes;
+    int u, p, i;
+    afs_int32 *uids;
+    idlist ids;
+    namelist names;
+    struct timeval start;
+    double secs;
+
+    code = pr_Initialize(1, conf_dir, NULL);
+    if (code) {
+	afs_com_err(whoami, code, "initializing pruser");
+	exit(1);
+    }
+
+    nusers = atoi(as->parms[0].items->data);
+    repeat = as->parms[1].items ? atoi(as->parms[1].items->data) : 1;
+    passes = as->parms[2].items ? atoi(as->parms[2].items->data) : 3;
+    createPrefix = as->parms[3].items ? as->parms[3].items->data : "nameb";
+    if (nusers < 1 || repeat < 1 || passes < 1) {
+	fprintf(stderr, "%s: invalid benchmark parameters\n", whoami);
+	exit(7);
+    }
+
+    uids = calloc(nusers, sizeof(afs_int32));
+    ids.idlist_len = nusers * repeat;
+    ids.idlist_val = calloc(ids.idlist_len, sizeof(afs_int32));
+    names.namelist_len = nusers * repeat;
+    names.namelist_val = calloc(names.namelist_len, PR_MAXNAMELEN);
+    if (!uids || !ids.idlist_val || !names.namelist_val) {
+	fprintf(stderr, "%s: out of memory\n", whoami);
+	exit(8);
+    }
+
+    printf("Creating %d users\n", nusers);
+    for (u = 0; u < nusers; u++) {
+	sprintf(names.namelist_val[u], "%su%d", createPrefix, u);
+	if (CreateBenchEntry(names.namelist_val[u], 0, 0, &uids[u]))
+	    exit(12);
+	ids.idlist_val[u] = uids[u];
+    }
+    /* interleave the copies so duplicates are not adjacent */
+    for (i = nusers; i < ids.idlist_len; i++) {
+	ids.idlist_val[i] = uids[i % nusers];
+	strlcpy(names.namelist_val[i], names.namelist_val[i % nusers],
+		PR_MAXNAMELEN);
+    }
+
+    for (p = 0; p < passes; p++) {
+	namelist rnames;
+	idlist rids;
+
+	rnames.namelist_len = 0;
+	rnames.namelist_val = NULL;
+	gettimeofday(&start, NULL);
+	code = ubik_PR_IDToName(pruclient, 0, &ids, &rnames);
+	secs = ElapsedSeconds(&start);
+	if (code) {
+	    afs_com_err(whoami, code, "translating ids");
+	    exit(24);
+	}
+	for (i = 0; i < ids.idlist_len; i++) {
+	    if (strcmp(rnames.namelist_val[i], names.namelist_val[i]) != 0) {
+		fprintf(stderr, "IDToName gave %s for %d, expected %s\n",
+			rnames.namelist_val[i], ids.idlist_val[i],
+			names.namelist_val[i]);
+		exit(21);
+	    }
+	}
+	free(rnames.namelist_val);
+	printf("Pass %d: IDToName of %d ids in %.3f seconds\n", p + 1,
+	       ids.idlist_len, secs);
+
+	rids.idlist_len = 0;
+	rids.idlist_val = NULL;
+	gettimeofday(&start, NULL);
+	code = ubik_PR_NameToID(pruclient, 0, &names, &rids);
+	secs = ElapsedSeconds(&start);
+	if (code) {
+	    afs_com_err(whoami, code, "translating names");
+	    exit(24);
+	}
+	for (i = 0; i < names.namelist_len; i++) {
+	    if (rids.idlist_val[i] != ids.idlist_val[i]) {
+		fprintf(stderr, "NameToID gave %d for %s, expected %d\n",
+			rids.idlist_val[i], names.namelist_val[i],
+			ids.idlist_val[i]);
+		exit(21);
+	    }
+	}
+	free(rids.idlist_val);
+	printf("Pass %d: NameToID of %d names in %.3f seconds\n", p + 1,
+	       names.namelist_len, secs);
+    }
+
+    printf("Deleting users\n");
+    for (u = 0; u < nusers; u++)
+	ubik_PR_Delete(pruclient, 0, uids[u]);
+    free(uids);
+    free(ids.idlist_val);
+    free(names.namelist_val);
+    return 0;
+}
+
 /* from ka_ConvertBytes included here to avoid circularity */
 /* Converts a byte string to ascii.  Return the number of unconverted bytes. */
 
@@ -1030,7 +1276,7 @@ MyBeforeProc(struct cmd_syndesc *as, void *arock)
 	}
     }
 
-    strncpy(conf_dir, tmp_conf_dir, sizeof(conf_dir));
+    strncpy(conf_dir, cdir ? cdir : tmp_conf_dir, sizeof(conf_dir));
     conf = afsconf_Open(conf_dir);
     if (conf == 0)
 	return AFSCONF_NOTFOUND;
@@ -1109,6 +1355,28 @@ main(int argc, char *argv[])
     add_std_args(ts);
     cmd_CreateAlias(ts, "mm");
 
+    ts = cmd_CreateSyntax("cpsbench", TestCPSBench, NULL, 0,
+			  "time GetCPS over nested groups");
+    cmd_AddParm(ts, "-users", CMD_SINGLE, 0, "number of users to create");
+    cmd_AddParm(ts, "-groups", CMD_SINGLE, CMD_OPTIONAL,
+		"groups each user is a member of");
+    cmd_AddParm(ts, "-depth", CMD_SINGLE, CMD_OPTIONAL,
+		"further levels of nested groups");
+    cmd_AddParm(ts, "-passes", CMD_SINGLE, CMD_OPTIONAL,
+		"number of timed passes");
+    cmd_AddParm(ts, "-prefix", CMD_SINGLE, CMD_OPTIONAL, "naming prefix");
+    add_std_args(ts);
+
+    ts = cmd_CreateSyntax("namebench", TestNameBench, NULL, 0,
+			  "time large IDToName and NameToID batches");
+    cmd_AddParm(ts, "-users", CMD_SINGLE, 0, "number of users to create");
+    cmd_AddParm(ts, "-repeat", CMD_SINGLE, CMD_OPTIONAL,
+		"copies of each user in the batch");
+    cmd_AddParm(ts, "-passes", CMD_SINGLE, CMD_OPTIONAL,
+		"number of timed passes");
+    cmd_AddParm(ts, "-prefix", CMD_SINGLE, CMD_OPTIONAL, "naming prefix");
+    add_std_args(ts);
+
 
     code = cmd_Dispatch(argc, argv);
     if (code)
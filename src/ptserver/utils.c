@@ -26,14 +26,14 @@ afs_int32 IsAMemberOfSG(struct ubik_trans *at, afs_int32 aid, afs_int32 gid,
 #endif
 
 static afs_int32
-IDHash(afs_int32 x)
+IDHash(afs_int32 x, afs_int32 size)
 {
     /* returns hash bucket for x */
-    return ((abs(x)) % HASHSIZE);
+    return ((abs(x)) % size);
 }
 
 afs_int32
-NameHash(char *aname)
+NameHash(char *aname, afs_int32 size)
 {
     /* returns hash bucket for aname */
     unsigned int hash = 0;
@@ -41,9 +41,24 @@ NameHash(char *aname)
 /* stolen directly from the HashString function in the vol package */
     for (i = strlen(aname), aname += i - 1; i--; aname--)
 	hash = (hash * 31) + (*(unsigned char *)aname - 31);
-    return (hash % HASHSIZE);
+    return (hash % size);
 }
 
+/* Smallest prime not less than n, for sizing the hash tables */
+afs_int32
+NextPrime(afs_int32 n)
+{
+    afs_int32 d;
+
+    if (n <= 2)
+	return 2;
+    for (n |= 1;; n += 2) {
+	for (d = 3; d * d <= n && n % d; d += 2)
+	    ;
+	if (d * d > n)
+	    return n;
+    }
+}
 
 afs_int32
 pr_Write(struct ubik_trans *tt, afs_int32 afd, afs_int32 pos, void *buff, afs_int32 len)
@@ -204,6 +219,76 @@ pr_ReadCoEntry(struct ubik_trans *tt, afs_int32 afd, afs_int32 pos, struct conte
     return (code);
 }
 
+/* Returns the offset of the extended hash table block, or 0 if the database
+ * still uses the fixed size hash tables in its header. */
+static afs_int32
+HashTableAddr(void)
+{
+    if (ntohl(cheader.version) != PRDBVERSION_HASH)
+	return 0;
+    return ntohl(cheader.hashTable);
+}
+
+/* Returns the number of buckets in each of the database's hash tables */
+afs_int32
+HashTableSize(void)
+{
+    if (!HashTableAddr())
+	return HASHSIZE;
+    return ntohl(cheader.hashSize);
+}
+
+/* Read the head of a hash chain; table is PR_NAMEHASH or PR_IDHASH */
+afs_int32
+GetHashHead(struct ubik_trans *tt, int table, afs_int32 hashindex,
+	    afs_int32 *headp)
+{
+    afs_int32 base, head;
+
+    base = HashTableAddr();
+    if (!base) {
+	if (table == PR_NAMEHASH)
+	    head = cheader.nameHash[hashindex];
+	else
+	    head = cheader.idHash[hashindex];
+    } else if (pr_Read(tt, 0,
+		       PR_HASHBUCKET_OFFSET(base, HashTableSize(), table,
+					    hashindex),
+		       (char *)&head, sizeof(head))) {
+	return PRDBFAIL;
+    }
+    *headp = ntohl(head);
+    return 0;
+}
+
+/* Set the head of a hash chain, both in the cached header and on disk */
+static afs_int32
+SetHashHead(struct ubik_trans *tt, int table, afs_int32 hashindex,
+	    afs_int32 loc)
+{
+    afs_int32 base, head;
+    afs_int32 *headp;
+
+    head = htonl(loc);
+    base = HashTableAddr();
+    if (!base) {
+	if (table == PR_NAMEHASH)
+	    headp = &cheader.nameHash[hashindex];
+	else
+	    headp = &cheader.idHash[hashindex];
+	*headp = head;
+	if (pr_Write(tt, 0, (char *)headp - (char *)&cheader, (char *)headp,
+		     sizeof(*headp)))
+	    return PRDBFAIL;
+    } else if (pr_Write(tt, 0,
+			PR_HASHBUCKET_OFFSET(base, HashTableSize(), table,
+					     hashindex),
+			(char *)&head, sizeof(head))) {
+	return PRDBFAIL;
+    }
+    return 0;
+}
+
 /* AllocBloc - allocate a free block of storage for entry, returning address of
  * new entry */
 
@@ -272,8 +357,9 @@ FindByID(struct ubik_trans *at, afs_int32 aid)
 
     if ((aid == PRBADID) || (aid == 0))
 	return 0;
-    i = IDHash(aid);
-    entry = ntohl(cheader.idHash[i]);
+    i = IDHash(aid, HashTableSize());
+    if (GetHashHead(at, PR_IDHASH, i, &entry))
+	return 0;
     if (entry == 0)
 	return entry;
     memset(&tentry, 0, sizeof(tentry));
@@ -305,8 +391,9 @@ FindByName(struct ubik_trans *at, char aname[PR_MAXNAMELEN], struct prentry *ten
     afs_int32 i;
     afs_int32 entry;
 
-    i = NameHash(aname);
-    entry = ntohl(cheader.nameHash[i]);
+    i = NameHash(aname, HashTableSize());
+    if (GetHashHead(at, PR_NAMEHASH, i, &entry))
+	return 0;
     if (entry == 0)
 	return entry;
     memset(tentryp, 0, sizeof(struct prentry));
@@ -444,8 +531,9 @@ RemoveFromIDHash(struct ubik_trans *tt, afs_int32 aid, afs_int32 *loc)		/* ??? i
 
     if ((aid == PRBADID) || (aid == 0))
 	return PRINCONSISTENT;
-    i = IDHash(aid);
-    current = ntohl(cheader.idHash[i]);
+    i = IDHash(aid, HashTableSize());
+    if (GetHashHead(tt, PR_IDHASH, i, &current))
+	return PRDBFAIL;
     memset(&tentry, 0, sizeof(tentry));
     memset(&bentry, 0, sizeof(bentry));
     trail = 0;
@@ -468,10 +556,7 @@ RemoveFromIDHash(struct ubik_trans *tt, afs_int32 aid, afs_int32 *loc)		/* ??? i
 	return PRSUCCESS;	/* we didn't find him, so he's already gone */
     if (trail == 0) {
 	/* it's the first entry! */
-	cheader.idHash[i] = htonl(tentry.nextID);
-	code =
-	    pr_Write(tt, 0, 72 + HASHSIZE * 4 + i * 4,
-		     (char *)&cheader.idHash[i], sizeof(cheader.idHash[i]));
+	code = SetHashHead(tt, PR_IDHASH, i, tentry.nextID);
 	if (code)
 	    return PRDBFAIL;
     } else {
@@ -497,19 +582,18 @@ AddToIDHash(struct ubik_trans *tt, afs_int32 aid, afs_int32 loc)
 
     if ((aid == PRBADID) || (aid == 0))
 	return PRINCONSISTENT;
-    i = IDHash(aid);
+    i = IDHash(aid, HashTableSize());
     memset(&tentry, 0, sizeof(tentry));
     code = pr_ReadEntry(tt, 0, loc, &tentry);
     if (code)
 	return PRDBFAIL;
-    tentry.nextID = ntohl(cheader.idHash[i]);
-    cheader.idHash[i] = htonl(loc);
+    code = GetHashHead(tt, PR_IDHASH, i, &tentry.nextID);
+    if (code)
+	return PRDBFAIL;
     code = pr_WriteEntry(tt, 0, loc, &tentry);
     if (code)
 	return PRDBFAIL;
-    code =
-	pr_Write(tt, 0, 72 + HASHSIZE * 4 + i * 4, (char *)&cheader.idHash[i],
-		 sizeof(cheader.idHash[i]));
+    code = SetHashHead(tt, PR_IDHASH, i, loc);
     if (code)
 	return PRDBFAIL;
     return PRSUCCESS;
@@ -524,8 +608,9 @@ RemoveFromNameHash(struct ubik_trans *tt, char *aname, afs_int32 *loc)
     struct prentry tentry;
     struct prentry bentry;
 
-    i = NameHash(aname);
-    current = ntohl(cheader.nameHash[i]);
+    i = NameHash(aname, HashTableSize());
+    if (GetHashHead(tt, PR_NAMEHASH, i, &current))
+	return PRDBFAIL;
     memset(&tentry, 0, sizeof(tentry));
     memset(&bentry, 0, sizeof(bentry));
     trail = 0;
@@ -548,10 +633,7 @@ RemoveFromNameHash(struct ubik_trans *tt, char *aname, afs_int32 *loc)
 	return PRSUCCESS;	/* we didn't find him, already gone */
     if (trail == 0) {
 	/* it's the first entry! */
-	cheader.nameHash[i] = htonl(tentry.nextName);
-	code =
-	    pr_Write(tt, 0, 72 + i * 4, (char *)&cheader.nameHash[i],
-		     sizeof(cheader.nameHash[i]));
+	code = SetHashHead(tt, PR_NAMEHASH, i, tentry.nextName);
 	if (code)
 	    return PRDBFAIL;
     } else {
@@ -575,24 +657,129 @@ AddToNameHash(struct ubik_trans *tt, char *aname, afs_int32 loc)
     afs_int32 i;
     struct prentry tentry;
 
-    i = NameHash(aname);
+    i = NameHash(aname, HashTableSize());
     memset(&tentry, 0, sizeof(tentry));
     code = pr_ReadEntry(tt, 0, loc, &tentry);
     if (code)
 	return PRDBFAIL;
-    tentry.nextName = ntohl(cheader.nameHash[i]);
-    cheader.nameHash[i] = htonl(loc);
+    code = GetHashHead(tt, PR_NAMEHASH, i, &tentry.nextName);
+    if (code)
+	return PRDBFAIL;
     code = pr_WriteEntry(tt, 0, loc, &tentry);
     if (code)
 	return PRDBFAIL;
-    code =
-	pr_Write(tt, 0, 72 + i * 4, (char *)&cheader.nameHash[i],
-		 sizeof(cheader.nameHash[i]));
+    code = SetHashHead(tt, PR_NAMEHASH, i, loc);
     if (code)
 	return PRDBFAIL;
     return PRSUCCESS;
 }
 
+/**
+ * Move the name and id hash tables into a new extended hash table block with
+ * hashsize buckets per table, and mark the database as PRDBVERSION_HASH.
+ * Every entry is rethreaded onto the new chains, and any previous extended
+ * hash table block is put back on the free list.
+ *
+ * @param[in] tt        write transaction
+ * @param[in] hashsize  new number of buckets; should be prime
+ *
+ * @return operation status
+ *   @retval 0 success
+ */
+afs_int32
+ResizeHashTables(struct ubik_trans *tt, afs_int32 hashsize)
+{
+    struct prhashblock hblock;
+    struct prentry tentry;
+    afs_int32 *heads, *headp;
+    afs_int32 links[2];		/* nextID and nextName, in network order */
+    afs_int32 code = 0, pos, eof, oldaddr, oldend, i;
+
+    if (hashsize < HASHSIZE || hashsize > PR_MAXHASHSIZE)
+	return PRBADARG;
+
+    oldaddr = HashTableAddr();
+    oldend = oldaddr ? oldaddr + PR_HASHBLOCK_SIZE(HashTableSize()) : 0;
+
+    /* Sized to include the padding at the end of the block */
+    heads = calloc(1, PR_HASHBLOCK_SIZE(hashsize) - sizeof(hblock));
+    if (!heads)
+	return PRNOMEM;
+
+    /* Rethread every entry that is on the hash chains, building the new
+     * tables in memory */
+    eof = ntohl(cheader.eofPtr);
+    for (pos = ntohl(cheader.headerSize); pos < eof; pos += ENTRYSIZE) {
+	code = pr_ReadEntry(tt, 0, pos, &tentry);
+	if (code)
+	    goto done;
+	if (tentry.flags == PRHASHBLOCK) {
+	    /* the hashSize of the block lines up with the entry's id */
+	    if (tentry.id < HASHSIZE || tentry.id > PR_MAXHASHSIZE) {
+		code = PRDBBAD;
+		goto done;
+	    }
+	    pos += PR_HASHBLOCK_SIZE(tentry.id) - ENTRYSIZE;
+	    continue;
+	}
+	if (tentry.flags & (PRFREE | PRCONT))
+	    continue;
+	headp = &heads[PR_IDHASH * hashsize + IDHash(tentry.id, hashsize)];
+	links[0] = htonl(*headp);
+	*headp = pos;
+	headp = &heads[PR_NAMEHASH * hashsize + NameHash(tentry.name, hashsize)];
+	links[1] = htonl(*headp);
+	*headp = pos;
+	code = pr_Write(tt, 0,
+			pos + ((char *)&tentry.nextID - (char *)&tentry),
+			(char *)links, sizeof(links));
+	if (code)
+	    goto done;
+    }
+
+    /* Write out the new block at the end of the database */
+    memset(&hblock, 0, sizeof(hblock));
+    hblock.flags = htonl(PRHASHBLOCK);
+    hblock.hashSize = htonl(hashsize);
+    code = pr_Write(tt, 0, eof, (char *)&hblock, sizeof(hblock));
+    if (code)
+	goto done;
+    for (i = 0; i < 2 * hashsize; i++)
+	heads[i] = htonl(heads[i]);
+    code = pr_Write(tt, 0, eof + sizeof(hblock), (char *)heads,
+		    PR_HASHBLOCK_SIZE(hashsize) - sizeof(hblock));
+    if (code)
+	goto done;
+    if ((code = set_header_word(tt, eofPtr,
+				htonl(eof + PR_HASHBLOCK_SIZE(hashsize))))
+	|| (code = set_header_word(tt, hashTable, htonl(eof)))
+	|| (code = set_header_word(tt, hashSize, htonl(hashsize)))
+	|| (code = set_header_word(tt, version, htonl(PRDBVERSION_HASH))))
+	goto done;
+
+    /* The tables in the header are no longer used */
+    if (!oldaddr) {
+	memset(cheader.nameHash, 0, sizeof(cheader.nameHash));
+	memset(cheader.idHash, 0, sizeof(cheader.idHash));
+	code = pr_Write(tt, 0, (char *)cheader.nameHash - (char *)&cheader,
+			(char *)cheader.nameHash,
+			sizeof(cheader.nameHash) + sizeof(cheader.idHash));
+	if (code)
+	    goto done;
+    }
+
+    /* Put the entries of the old block back on the free list */
+    for (pos = oldaddr; pos < oldend; pos += ENTRYSIZE) {
+	code = FreeBlock(tt, pos);
+	if (code)
+	    goto done;
+    }
+
+  done:
+    free(heads);
+    return code;
+}
+
 afs_int32
 AddToOwnerChain(struct ubik_trans *at, afs_int32 gid, afs_int32 oid)
 {
@@ -195,15 +195,6 @@ struct clock rx_softAckDelay = {0, 100000};
 
 static unsigned int rxi_rpc_peer_stat_cnt;
 
-/*
- * rxi_rpc_process_stat_cnt counts the total number of local process stat
- * structures currently allocated within rx.  The number is used to allocate
- * the memory required to return the statistics when queried.
- * Protected by the rx_rpc_stats mutex.
- */
-
-static unsigned int rxi_rpc_process_stat_cnt;
-
 rx_atomic_t rx_nWaiting = RX_ATOMIC_INIT(0);
 rx_atomic_t rx_nWaited = RX_ATOMIC_INIT(0);
 
@@ -215,6 +206,25 @@ struct opr_queue rx_incomingCallQueue;
  * calls to process */
 struct opr_queue rx_idleServerQueue;
 
+#if defined(AFS_PTHREAD_ENV) && !defined(KERNEL)
+# define RX_ELASTIC_THREADS
+#endif
+
+#ifdef RX_ELASTIC_THREADS
+/* The elastic server thread pool; see rx_SetServerThreadPool.  All but the
+ * settings are protected by rx_serverPool_lock. */
+static int rxi_poolMinSetting;		/* 0: start every thread at once */
+static int rxi_poolIdleTime;		/* seconds */
+static int rxi_poolWaitTarget;		/* milliseconds */
+static int rxi_poolThreads;		/* server threads started */
+static int rxi_poolMin;			/* never fewer server threads */
+static int rxi_poolMax;			/* nor more */
+static int rxi_poolRetired;		/* threads which have exited */
+static struct clock rxi_poolLastSlowWait;	/* when a call last waited
+						 * longer than the target */
+static struct rxevent *rxi_poolGrowEvent;
+#endif
+
 #if !defined(offsetof)
 #include <stddef.h>		/* for definition of offsetof() */
 #endif
@@ -290,7 +300,12 @@ rxi_InitPthread(void)
 #endif
 
     osi_Assert(pthread_key_create(&rx_thread_id_key, NULL) == 0);
+#ifdef KERNEL
+    /* UKERNEL has no rx_pthread.c, and no thread-specific data to free */
     osi_Assert(pthread_key_create(&rx_ts_info_key, NULL) == 0);
+#else
+    osi_Assert(pthread_key_create(&rx_ts_info_key, rx_ts_info_free) == 0);
+#endif
 
     MUTEX_INIT(&rx_rpc_stats, "rx_rpc_stats", MUTEX_DEFAULT, 0);
     MUTEX_INIT(&rx_freePktQ_lock, "rx_freePktQ_lock", MUTEX_DEFAULT, 0);
@@ -539,6 +554,9 @@ rx_InitHost(u_int host, u_int port)
     /* Malloc up a bunch of packets & buffers */
     rx_nFreePackets = 0;
     opr_queue_Init(&rx_freePacketQueue);
+#ifdef RX_ENABLE_TSFPQ
+    rxi_InitPacketNodes();
+#endif
     rxi_NeedMorePackets = FALSE;
     rx_nPackets = 0;	/* rx_nPackets is managed by rxi_MorePackets* */
     opr_queue_Init(&rx_mallocedPacketQueue);
@@ -912,6 +930,20 @@ rxi_StartServerProcs(int nExistingProcs)
 	    maxdiff = diff;
     }
     nProcs += maxdiff;		/* Extra processes needed to allow max number requested to run in any given service, under good conditions */
+#ifdef RX_ELASTIC_THREADS
+    /* An elastic pool starts with enough threads for every service's
+     * minimum, and grows to the full number only when calls wait. */
+    MUTEX_ENTER(&rx_serverPool_lock);
+    rxi_poolMax = nProcs;
+    if (rxi_poolMinSetting > 0) {
+	rxi_poolMin = MAX(rxi_poolMinSetting, nProcs - maxdiff);
+	rxi_poolMin = MAX(rxi_poolMin, nExistingProcs);
+	if (rxi_poolMin < nProcs)
+	    nProcs = rxi_poolMin;
+    }
+    rxi_poolThreads = MAX(nProcs, nExistingProcs);
+    MUTEX_EXIT(&rx_serverPool_lock);
+#endif
     nProcs -= nExistingProcs;	/* Subtract the number of procs that were previously created for use as server procs */
     for (i = 0; i < nProcs; i++) {
 	rxi_StartServerProc(rx_ServerProc, rx_stackSize);
@@ -919,6 +951,143 @@ rxi_StartServerProcs(int nExistingProcs)
 }
 #endif /* KERNEL */
 
+/*!
+ * Let the server thread pool grow and shrink with the load.
+ *
+ * Normally rx_StartServer starts at once every server thread the services'
+ * minProcs and maxProcs call for, and they run until the process exits.
+ * With an elastic pool, rx_StartServer starts only minThreads, or enough
+ * for every service's minProcs if that is more.  When a call has to wait
+ * because no thread is idle, more threads are started, up to the usual
+ * number.  A thread beyond minThreads which has been idle for idleTime
+ * seconds exits, unless in that time some call waited longer than
+ * waitTarget milliseconds for a thread.  Each service's minProcs and
+ * maxProcs still apply to the calls it may run at once.
+ *
+ * Must be called before rx_StartServer.  Only pthreaded user-space
+ * servers have an elastic pool; elsewhere this does nothing.
+ *
+ * \param[in] minThreads  the fewest server threads to keep, or 0 to start
+ *                        them all at once (the default)
+ * \param[in] idleTime    seconds a thread must be idle before it exits
+ * \param[in] waitTarget  milliseconds a call may wait for a thread without
+ *                        keeping the pool from shrinking
+ */
+void
+rx_SetServerThreadPool(int minThreads, int idleTime, int waitTarget)
+{
+#ifdef RX_ELASTIC_THREADS
+    rxi_poolMinSetting = MAX(minThreads, 0);
+    rxi_poolIdleTime = MAX(idleTime, 1);
+    rxi_poolWaitTarget = MAX(waitTarget, 0);
+#endif
+}
+
+#ifdef RX_ELASTIC_THREADS
+static void
+rxi_GrowServerPoolEvent(struct rxevent *event, void *arg, void *arg1,
+			int arg2)
+{
+    int n;
+
+    MUTEX_ENTER(&rx_serverPool_lock);
+    if (event == rxi_poolGrowEvent)
+	rxevent_Put(&rxi_poolGrowEvent);
+    /* One more thread for each call still waiting. */
+    n = MIN(rx_atomic_read(&rx_nWaiting), rxi_poolMax - rxi_poolThreads);
+    if (n > 0)
+	rxi_poolThreads += n;
+    MUTEX_EXIT(&rx_serverPool_lock);
+
+    for (; n > 0; n--)
+	rxi_StartServerProc(rx_ServerProc, rx_stackSize);
+}
+
+/*
+ * Start more server threads, if the pool may grow, because a call has to
+ * wait for one.  The threads are started from the event thread, which holds
+ * no locks.  Called with rx_serverPool_lock held.
+ */
+static void
+rxi_GrowServerPool(void)
+{
+    struct clock now;
+
+    if (rxi_poolMinSetting == 0 || rxi_poolGrowEvent != NULL
+	|| rxi_poolThreads >= rxi_poolMax)
+	return;
+    clock_GetTime(&now);
+    rxi_poolGrowEvent = rxevent_Post(&now, &now, rxi_GrowServerPoolEvent,
+				     NULL, NULL, 0);
+}
+
+/*
+ * May the idle server thread tno exit?  Called with rx_serverPool_lock
+ * held.
+ */
+static int
+rxi_CanRetireServerThread(int tno)
+{
+    struct clock now;
+    int fcfs;
+
+    if (rxi_poolMinSetting == 0 || rxi_poolThreads <= rxi_poolMin)
+	return 0;
+
+    /* Keep the thread which takes calls in order, so none starve. */
+    MUTEX_ENTER(&rx_pthread_mutex);
+    fcfs = (tno == rxi_fcfs_thread_num);
+    MUTEX_EXIT(&rx_pthread_mutex);
+    if (fcfs)
+	return 0;
+
+    clock_GetTime(&now);
+    return (clock_ElapsedTime(&rxi_poolLastSlowWait, &now)
+	    >= rxi_poolIdleTime * 1000);
+}
+
+/*
+ * Take an idle server thread out of the pool.  Called with
+ * rx_serverPool_lock held.
+ */
+static void
+rxi_RetireServerThread(void)
+{
+    rxi_poolThreads--;
+    rxi_poolRetired++;
+    MUTEX_ENTER(&rx_quota_mutex);
+    rxi_availProcs--;
+    rxi_dataQuota -= rx_initSendWindow;
+    MUTEX_EXIT(&rx_quota_mutex);
+}
+#endif /* RX_ELASTIC_THREADS */
+
+/*
+ * Account for the time a call spent on the incoming call queue, as it is
+ * taken off.  Called with rx_serverPool_lock held.
+ */
+static void
+rxi_CountQueueWait(struct rx_call *call, struct rx_service *service)
+{
+    struct clock now, wait;
+
+    clock_GetTime(&now);
+    wait = now;
+    if (clock_Gt(&wait, &call->queueTime))
+	clock_Sub(&wait, &call->queueTime);
+    else
+	clock_Zero(&wait);
+
+    service->nCallsQueued++;
+    clock_Add(&service->queueWaitTotal, &wait);
+    if (clock_Gt(&wait, &service->queueWaitMax))
+	service->queueWaitMax = wait;
+#ifdef RX_ELASTIC_THREADS
+    if (MSEC(&wait) > rxi_poolWaitTarget)
+	rxi_poolLastSlowWait = now;
+#endif
+}
+
 #ifdef AFS_NT40_ENV
 /* This routine is only required on Windows */
 void
@@ -1840,6 +2009,12 @@ rxi_ServerProc(int threadID, struct rx_call *newcall, osi_socket * socketp)
 		/* We are now a listener thread */
 		return;
 	    }
+#ifdef RX_ELASTIC_THREADS
+	    if (call == NULL) {
+		/* This thread has left the pool; see rx_GetCall */
+		return;
+	    }
+#endif
 	}
 
 #ifdef	KERNEL
@@ -2049,6 +2224,7 @@ rx_GetCall(int tno, struct rx_service *cur_service, osi_socket * socketp)
 
 	if (call) {
 	    opr_queue_Remove(&call->entry);
+	    rxi_CountQueueWait(call, service);
 	    MUTEX_EXIT(&rx_serverPool_lock);
 	    MUTEX_ENTER(&call->lock);
 
@@ -2085,6 +2261,28 @@ rx_GetCall(int tno, struct rx_service *cur_service, osi_socket * socketp)
 	    rx_waitForPacket = sq;
 #endif /* AFS_AIX41_ENV */
 	    do {
+#ifdef RX_ELASTIC_THREADS
+		if (rxi_CanRetireServerThread(tno)) {
+		    struct timespec until;
+		    struct clock now;
+
+		    clock_GetTime(&now);
+		    until.tv_sec = now.sec + rxi_poolIdleTime;
+		    until.tv_nsec = now.usec * 1000;
+		    if (CV_TIMEDWAIT(&sq->cv, &rx_serverPool_lock,
+				     &until) == ETIMEDOUT
+			&& sq->newcall == NULL
+			&& !(socketp && *socketp != OSI_NULLSOCKET)
+			&& rxi_CanRetireServerThread(tno)) {
+			/* Idle for long enough; leave the pool.  The NULL
+			 * call, with no socket, tells the caller to exit. */
+			opr_queue_Remove(&sq->entry);
+			rxi_RetireServerThread();
+			break;
+		    }
+		    continue;
+		}
+#endif
 		CV_WAIT(&sq->cv, &rx_serverPool_lock);
 #ifdef	KERNEL
 		if (afs_termState == AFSOP_STOP_RXCALLBACK) {
@@ -2220,6 +2418,7 @@ rx_GetCall(int tno, struct rx_service *cur_service, osi_socket * socketp)
 
     if (call) {
 	opr_queue_Remove(&call->entry);
+	rxi_CountQueueWait(call, service);
 	/* we can't schedule a call if there's no data!!! */
 	/* send an ack if there's no data, if we're missing the
 	 * first packet, or we're missing something between first
@@ -4851,6 +5050,11 @@ rxi_AttachServerProc(struct rx_call *call,
 	    SET_CALL_QUEUE_LOCK(call, &rx_serverPool_lock);
 	    opr_queue_Append(&rx_incomingCallQueue, &call->entry);
 	}
+#ifdef RX_ELASTIC_THREADS
+	/* More threads won't help a service already running its maximum. */
+	if (service->nRequestsRunning < service->maxProcs)
+	    rxi_GrowServerPool();
+#endif
     } else {
 	sq = opr_queue_Last(&rx_idleServerQueue,
 			    struct rx_serverQueueEntry, entry);
@@ -7348,6 +7552,10 @@ rx_PrintTheseStats(FILE * file, struct rx_statistics *s, int size,
 	    s->nServerConns, s->nClientConns, s->nPeerStructs,
 	    s->nCallStructs, s->nFreeCallStructs);
 
+    fprintf(file,
+	    "   %d huge page packet arenas, %d packets freed on another node\n",
+	    s->hugePageArenas, s->crossNodeFrees);
+
 #if	!defined(AFS_PTHREAD_ENV) && !defined(AFS_USE_GETTIMEOFDAY)
     fprintf(file, "   %d clock updates\n", clock_nUpdates);
 #endif
@@ -7364,6 +7572,159 @@ rx_PrintStats(FILE * file)
     MUTEX_EXIT(&rx_stats_mutex);
 }
 
+static void
+rxi_PrintMetricFamily(FILE * file, const char *name, const char *type,
+		      const char *help)
+{
+    fprintf(file, "# HELP openafs_rx_%s %s\n# TYPE openafs_rx_%s %s\n",
+	    name, help, name, type);
+}
+
+static void
+rxi_PrintMetric(FILE * file, const char *name, const char *type,
+		const char *help, int value)
+{
+    rxi_PrintMetricFamily(file, name, type, help);
+    fprintf(file, "openafs_rx_%s %u\n", name, (unsigned int)value);
+}
+
+/*
+ * Print the rx statistics as metrics, in the Prometheus text exposition
+ * format.  The counters are those printed by rx_PrintStats.
+ */
+void
+rx_PrintMetrics(FILE * file)
+{
+    struct rx_statistics s;
+    struct {
+	afs_uint32 nCallsQueued;
+	struct clock queueWaitTotal;
+	struct clock queueWaitMax;
+    } queued[RX_MAX_SERVICES];
+    int freePackets;
+    int threads = 0, retired = 0;
+    int nServices;
+    int i;
+
+    MUTEX_ENTER(&rx_stats_mutex);
+    memcpy(&s, (struct rx_statistics *)&rx_stats, sizeof(s));
+    freePackets = rx_nFreePackets;
+    MUTEX_EXIT(&rx_stats_mutex);
+
+    MUTEX_ENTER(&rx_serverPool_lock);
+    for (nServices = 0; nServices < RX_MAX_SERVICES; nServices++) {
+	i = nServices;
+	if (rx_services[i] == NULL)
+	    break;
+	queued[i].nCallsQueued = rx_services[i]->nCallsQueued;
+	queued[i].queueWaitTotal = rx_services[i]->queueWaitTotal;
+	queued[i].queueWaitMax = rx_services[i]->queueWaitMax;
+    }
+#ifdef RX_ELASTIC_THREADS
+    threads = rxi_poolThreads;
+    retired = rxi_poolRetired;
+#endif
+    MUTEX_EXIT(&rx_serverPool_lock);
+
+    rxi_PrintMetricFamily(file, "packets_read_total", "counter",
+			  "Packets read, by packet type.");
+    for (i = 0; i < RX_N_PACKET_TYPES; i++) {
+	if (strcmp(rx_packetTypes[i], "unused") != 0)
+	    fprintf(file, "openafs_rx_packets_read_total{type=\"%s\"} %u\n",
+		    rx_packetTypes[i], (unsigned int)s.packetsRead[i]);
+    }
+    rxi_PrintMetricFamily(file, "packets_sent_total", "counter",
+			  "Packets sent, by packet type.");
+    for (i = 0; i < RX_N_PACKET_TYPES; i++) {
+	if (strcmp(rx_packetTypes[i], "unused") != 0)
+	    fprintf(file, "openafs_rx_packets_sent_total{type=\"%s\"} %u\n",
+		    rx_packetTypes[i], (unsigned int)s.packetsSent[i]);
+    }
+    rxi_PrintMetricFamily(file, "packet_alloc_failures_total", "counter",
+			  "Packet allocations which failed, by packet class.");
+    fprintf(file,
+	    "openafs_rx_packet_alloc_failures_total{class=\"receive\"} %u\n"
+	    "openafs_rx_packet_alloc_failures_total{class=\"send\"} %u\n"
+	    "openafs_rx_packet_alloc_failures_total{class=\"special\"} %u\n",
+	    (unsigned int)s.receivePktAllocFailures,
+	    (unsigned int)s.sendPktAllocFailures,
+	    (unsigned int)s.specialPktAllocFailures);
+
+    rxi_PrintMetric(file, "packet_requests_total", "counter",
+		    "Packet allocation requests.", s.packetRequests);
+    rxi_PrintMetric(file, "free_packets", "gauge",
+		    "Packets on the free list.", freePackets);
+    rxi_PrintMetric(file, "no_packet_buffers_total", "counter",
+		    "Data packets dropped for lack of packet buffers.",
+		    s.noPacketBuffersOnRead);
+    rxi_PrintMetric(file, "bogus_packets_read_total", "counter",
+		    "Packets read which were too short.", s.bogusPacketOnRead);
+    rxi_PrintMetric(file, "dup_packets_read_total", "counter",
+		    "Duplicate data packets read.", s.dupPacketsRead);
+    rxi_PrintMetric(file, "spurious_packets_read_total", "counter",
+		    "Data packets read which were out of the call's window.",
+		    s.spuriousPacketsRead);
+    rxi_PrintMetric(file, "data_packets_sent_total", "counter",
+		    "Data packets sent, not counting retransmissions.",
+		    s.dataPacketsSent);
+    rxi_PrintMetric(file, "data_packets_resent_total", "counter",
+		    "Data packets retransmitted.", s.dataPacketsReSent);
+    rxi_PrintMetric(file, "send_failures_total", "counter",
+		    "Packets which could not be sent.", s.netSendFailures);
+    rxi_PrintMetric(file, "busies_total", "counter",
+		    "Calls answered with a busy packet.", s.nBusies);
+    rxi_PrintMetric(file, "cross_node_frees_total", "counter",
+		    "Packets freed on a NUMA node other than their own.",
+		    s.crossNodeFrees);
+    rxi_PrintMetric(file, "huge_page_arenas", "gauge",
+		    "Packet arenas backed by huge pages.", s.hugePageArenas);
+
+    rxi_PrintMetricFamily(file, "rtt_seconds", "summary",
+			  "Round trip times measured.");
+    fprintf(file, "openafs_rx_rtt_seconds_sum %.6f\n"
+	    "openafs_rx_rtt_seconds_count %u\n",
+	    clock_Float(&s.totalRtt), (unsigned int)s.nRttSamples);
+
+    rxi_PrintMetric(file, "server_connections", "gauge",
+		    "Server connections.", s.nServerConns);
+    rxi_PrintMetric(file, "client_connections", "gauge",
+		    "Client connections.", s.nClientConns);
+    rxi_PrintMetric(file, "peers", "gauge",
+		    "Peer structures.", s.nPeerStructs);
+    rxi_PrintMetric(file, "calls", "gauge",
+		    "Call structures allocated.", s.nCallStructs);
+    rxi_PrintMetric(file, "free_calls", "gauge",
+		    "Call structures on the free list.", s.nFreeCallStructs);
+
+    rxi_PrintMetric(file, "server_threads", "gauge",
+		    "Server threads started and not yet exited.", threads);
+    rxi_PrintMetric(file, "server_threads_retired_total", "counter",
+		    "Idle server threads which have exited.", retired);
+    rxi_PrintMetric(file, "waiting_calls", "gauge",
+		    "Calls waiting for a server thread.",
+		    rx_atomic_read(&rx_nWaiting));
+
+    rxi_PrintMetricFamily(file, "calls_queued_total", "counter",
+			  "Calls which waited for a server thread, by service.");
+    for (i = 0; i < nServices; i++)
+	fprintf(file, "openafs_rx_calls_queued_total{service=\"%s\"} %u\n",
+		rx_services[i]->serviceName,
+		(unsigned int)queued[i].nCallsQueued);
+    rxi_PrintMetricFamily(file, "queue_wait_seconds_total", "counter",
+			  "Time calls waited for a server thread, by service.");
+    for (i = 0; i < nServices; i++)
+	fprintf(file, "openafs_rx_queue_wait_seconds_total{service=\"%s\"}"
+		" %.6f\n", rx_services[i]->serviceName,
+		clock_Float(&queued[i].queueWaitTotal));
+    rxi_PrintMetricFamily(file, "queue_wait_max_seconds", "gauge",
+			  "Longest time a call waited for a server thread, "
+			  "by service.");
+    for (i = 0; i < nServices; i++)
+	fprintf(file, "openafs_rx_queue_wait_max_seconds{service=\"%s\"}"
+		" %.6f\n", rx_services[i]->serviceName,
+		clock_Float(&queued[i].queueWaitMax));
+}
+
 void
 rx_PrintPeerStats(FILE * file, struct rx_peer *peer)
 {
@@ -8067,15 +8428,63 @@ rx_GetServiceSpecific(struct rx_service *svc, int key)
 #endif /* !KERNEL */
 
 /*
- * processStats is a queue used to store the statistics for the local
- * process.  Its contents are similar to the contents of the rpcStats
- * queue on a rx_peer structure, but the actual data stored within
- * this queue contains totals across the lifetime of the process (assuming
- * the stats have not been reset) - unlike the per peer structures
- * which can come and go based upon the peer lifetime.
+ * The statistics for the local process are kept separately by each thread
+ * that makes or serves calls, so that recording them needs no lock shared
+ * between threads, and are added up when they are read.  Unlike the per
+ * peer structures, which can come and go based upon the peer lifetime,
+ * they hold totals across the lifetime of the process (assuming the stats
+ * have not been reset).
+ *
+ * Each thread's rxi_thread_rpc_stats is on the rxi_threadRpcStats queue.
+ * Only the thread itself adds to its interfaces queue or changes the
+ * counts in it, so it may look through the queue without a lock; it holds
+ * its own lock while changing either, and anyone else reading or clearing
+ * the stats holds rx_rpc_stats and then that lock.  Nothing is freed
+ * until the process exits; when a thread exits, its statistics stay on
+ * the queue, so their totals are kept, and go on the rxi_retiredRpcStats
+ * list for the next new thread to carry on with.
+ *
+ * Where there are no thread-specific data, all calls share a single set
+ * of statistics protected by rx_rpc_stats.
  */
 
-static struct opr_queue processStats = { &processStats, &processStats };
+struct rxi_rpcop_stat {
+    rx_function_entry_v1_t s;
+    rx_function_hist_t hist;
+};
+
+struct rxi_thread_rpc_interface {
+    struct opr_queue entry;
+    afs_uint32 interfaceId;
+    afs_uint32 isServer;
+    afs_uint32 func_total;
+    struct rxi_rpcop_stat ops[1];
+};
+
+struct rxi_thread_rpc_stats {
+    struct opr_queue entry;
+    struct opr_queue interfaces;
+#ifdef RX_ENABLE_TSFPQ
+    afs_kmutex_t lock;
+    struct rxi_thread_rpc_stats *nextRetired;
+#endif
+};
+
+static struct opr_queue rxi_threadRpcStats =
+    { &rxi_threadRpcStats, &rxi_threadRpcStats };
+#ifdef RX_ENABLE_TSFPQ
+/* protected by rx_rpc_stats */
+static struct rxi_thread_rpc_stats *rxi_retiredRpcStats;
+#endif
+
+#ifdef RX_ENABLE_TSFPQ
+# define RPC_STATS_LOCK(ts)	MUTEX_ENTER(&(ts)->lock)
+# define RPC_STATS_UNLOCK(ts)	MUTEX_EXIT(&(ts)->lock)
+#else
+static struct rxi_thread_rpc_stats rxi_sharedRpcStats;
+# define RPC_STATS_LOCK(ts)
+# define RPC_STATS_UNLOCK(ts)
+#endif
 
 /*
  * peerStats is a queue used to store the statistics for all peer structs.
@@ -8122,6 +8531,386 @@ rxi_ClearRPCOpStat(rx_function_entry_v1_p rpc_stat)
     rpc_stat->execution_time_max.usec = 0;
 }
 
+/* Clear those statistics of a function that clearFlag asks for. */
+static void
+rxi_ClearRPCOpStatFlags(rx_function_entry_v1_p rpc_stat, afs_uint32 clearFlag)
+{
+    if (clearFlag & AFS_RX_STATS_CLEAR_INVOCATIONS) {
+	rpc_stat->invocations = 0;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_BYTES_SENT) {
+	rpc_stat->bytes_sent = 0;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_BYTES_RCVD) {
+	rpc_stat->bytes_rcvd = 0;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_SUM) {
+	rpc_stat->queue_time_sum.sec = 0;
+	rpc_stat->queue_time_sum.usec = 0;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_SQUARE) {
+	rpc_stat->queue_time_sum_sqr.sec = 0;
+	rpc_stat->queue_time_sum_sqr.usec = 0;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_MIN) {
+	rpc_stat->queue_time_min.sec = 9999999;
+	rpc_stat->queue_time_min.usec = 9999999;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_MAX) {
+	rpc_stat->queue_time_max.sec = 0;
+	rpc_stat->queue_time_max.usec = 0;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_SUM) {
+	rpc_stat->execution_time_sum.sec = 0;
+	rpc_stat->execution_time_sum.usec = 0;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_SQUARE) {
+	rpc_stat->execution_time_sum_sqr.sec = 0;
+	rpc_stat->execution_time_sum_sqr.usec = 0;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_MIN) {
+	rpc_stat->execution_time_min.sec = 9999999;
+	rpc_stat->execution_time_min.usec = 9999999;
+    }
+    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_MAX) {
+	rpc_stat->execution_time_max.sec = 0;
+	rpc_stat->execution_time_max.usec = 0;
+    }
+}
+
+/* Add one invocation of a function to its statistics. */
+static void
+rxi_UpdateRPCOpStat(rx_function_entry_v1_p rpc_stat, struct clock *queueTime,
+		    struct clock *execTime, afs_uint64 bytesSent,
+		    afs_uint64 bytesRcvd)
+{
+    rpc_stat->invocations++;
+    rpc_stat->bytes_sent += bytesSent;
+    rpc_stat->bytes_rcvd += bytesRcvd;
+    clock_Add(&rpc_stat->queue_time_sum, queueTime);
+    clock_AddSq(&rpc_stat->queue_time_sum_sqr, queueTime);
+    if (clock_Lt(queueTime, &rpc_stat->queue_time_min)) {
+	rpc_stat->queue_time_min = *queueTime;
+    }
+    if (clock_Gt(queueTime, &rpc_stat->queue_time_max)) {
+	rpc_stat->queue_time_max = *queueTime;
+    }
+    clock_Add(&rpc_stat->execution_time_sum, execTime);
+    clock_AddSq(&rpc_stat->execution_time_sum_sqr, execTime);
+    if (clock_Lt(execTime, &rpc_stat->execution_time_min)) {
+	rpc_stat->execution_time_min = *execTime;
+    }
+    if (clock_Gt(execTime, &rpc_stat->execution_time_max)) {
+	rpc_stat->execution_time_max = *execTime;
+    }
+}
+
+/* Return the rx_function_hist bucket that counts a time. */
+static int
+rxi_RPCStatBucket(struct clock *t)
+{
+    afs_uint64 usec;
+    int bucket = 0;
+
+    if (t->sec < 0)
+	return 0;
+    usec = (afs_uint64)t->sec * 1000000 + t->usec;
+    while (usec != 0 && bucket < RX_STATS_HIST_BUCKETS - 1) {
+	usec >>= 1;
+	bucket++;
+    }
+    return bucket;
+}
+
+static void
+rxi_ClearRPCOpHist(rx_function_hist_p hist, afs_uint32 clearFlag)
+{
+    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_HIST)
+	memset(hist->queue_time_hist, 0, sizeof(hist->queue_time_hist));
+    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_HIST)
+	memset(hist->execution_time_hist, 0,
+	       sizeof(hist->execution_time_hist));
+}
+
+/* Add the statistics of one function, from another thread, to a total. */
+static void
+rxi_MergeRPCOpStat(struct rxi_rpcop_stat *to, struct rxi_rpcop_stat *from)
+{
+    int i;
+
+    to->s.invocations += from->s.invocations;
+    to->s.bytes_sent += from->s.bytes_sent;
+    to->s.bytes_rcvd += from->s.bytes_rcvd;
+    clock_Add(&to->s.queue_time_sum, &from->s.queue_time_sum);
+    clock_Add(&to->s.queue_time_sum_sqr, &from->s.queue_time_sum_sqr);
+    if (clock_Lt(&from->s.queue_time_min, &to->s.queue_time_min))
+	to->s.queue_time_min = from->s.queue_time_min;
+    if (clock_Gt(&from->s.queue_time_max, &to->s.queue_time_max))
+	to->s.queue_time_max = from->s.queue_time_max;
+    clock_Add(&to->s.execution_time_sum, &from->s.execution_time_sum);
+    clock_Add(&to->s.execution_time_sum_sqr, &from->s.execution_time_sum_sqr);
+    if (clock_Lt(&from->s.execution_time_min, &to->s.execution_time_min))
+	to->s.execution_time_min = from->s.execution_time_min;
+    if (clock_Gt(&from->s.execution_time_max, &to->s.execution_time_max))
+	to->s.execution_time_max = from->s.execution_time_max;
+    for (i = 0; i < RX_STATS_HIST_BUCKETS; i++) {
+	to->hist.queue_time_hist[i] += from->hist.queue_time_hist[i];
+	to->hist.execution_time_hist[i] += from->hist.execution_time_hist[i];
+    }
+}
+
+static size_t
+rxi_ThreadRpcInterfaceSize(afs_uint32 totalFunc)
+{
+    return sizeof(struct rxi_thread_rpc_interface) +
+	(totalFunc - 1) * sizeof(struct rxi_rpcop_stat);
+}
+
+static struct rxi_thread_rpc_interface *
+rxi_NewThreadRpcInterface(afs_uint32 rxInterface, afs_uint32 totalFunc,
+			  int isServer)
+{
+    struct rxi_thread_rpc_interface *tif;
+    afs_uint32 i;
+
+    tif = rxi_Alloc(rxi_ThreadRpcInterfaceSize(totalFunc));
+    if (tif == NULL)
+	return NULL;
+    tif->interfaceId = rxInterface;
+    tif->isServer = isServer;
+    tif->func_total = totalFunc;
+    for (i = 0; i < totalFunc; i++) {
+	rxi_ClearRPCOpStat(&tif->ops[i].s);
+	tif->ops[i].s.remote_peer = 0xffffffff;
+	tif->ops[i].s.remote_port = 0xffffffff;
+	tif->ops[i].s.remote_is_server = isServer;
+	tif->ops[i].s.interfaceId = rxInterface;
+	tif->ops[i].s.func_total = totalFunc;
+	tif->ops[i].s.func_index = i;
+    }
+    return tif;
+}
+
+static struct rxi_thread_rpc_interface *
+rxi_FindThreadRpcInterface(struct opr_queue *interfaces,
+			   afs_uint32 rxInterface, int isServer)
+{
+    struct opr_queue *cursor;
+
+    for (opr_queue_Scan(interfaces, cursor)) {
+	struct rxi_thread_rpc_interface *tif
+	    = opr_queue_Entry(cursor, struct rxi_thread_rpc_interface, entry);
+
+	if (tif->interfaceId == rxInterface && tif->isServer == isServer)
+	    return tif;
+    }
+    return NULL;
+}
+
+static void
+rxi_FreeThreadRpcInterfaces(struct opr_queue *interfaces)
+{
+    struct opr_queue *cursor, *store;
+
+    for (opr_queue_ScanSafe(interfaces, cursor, store)) {
+	struct rxi_thread_rpc_interface *tif
+	    = opr_queue_Entry(cursor, struct rxi_thread_rpc_interface, entry);
+
+	opr_queue_Remove(&tif->entry);
+	rxi_Free(tif, rxi_ThreadRpcInterfaceSize(tif->func_total));
+    }
+}
+
+/*
+ * Add up the process statistics kept by every thread onto the queue sums,
+ * and return the number of functions there, or -1 if out of memory.
+ * rx_rpc_stats must be held.
+ */
+static int
+rxi_SumThreadRpcStats(struct opr_queue *sums)
+{
+    struct opr_queue *cursor, *icursor;
+    int count = 0;
+    afs_uint32 i;
+
+    for (opr_queue_Scan(&rxi_threadRpcStats, cursor)) {
+	struct rxi_thread_rpc_stats *ts
+	    = opr_queue_Entry(cursor, struct rxi_thread_rpc_stats, entry);
+
+	RPC_STATS_LOCK(ts);
+	for (opr_queue_Scan(&ts->interfaces, icursor)) {
+	    struct rxi_thread_rpc_interface *tif, *sum;
+
+	    tif = opr_queue_Entry(icursor, struct rxi_thread_rpc_interface,
+				  entry);
+	    sum = rxi_FindThreadRpcInterface(sums, tif->interfaceId,
+					     tif->isServer);
+	    if (sum == NULL) {
+		sum = rxi_NewThreadRpcInterface(tif->interfaceId,
+						tif->func_total, tif->isServer);
+		if (sum == NULL) {
+		    RPC_STATS_UNLOCK(ts);
+		    return -1;
+		}
+		opr_queue_Append(sums, &sum->entry);
+		count += sum->func_total;
+	    }
+	    for (i = 0; i < sum->func_total && i < tif->func_total; i++)
+		rxi_MergeRPCOpStat(&sum->ops[i], &tif->ops[i]);
+	}
+	RPC_STATS_UNLOCK(ts);
+    }
+    return count;
+}
+
+/* Clear the process statistics kept by every thread. */
+static void
+rxi_ClearThreadRpcStats(afs_int32 rxInterface, afs_uint32 clearFlag)
+{
+    struct opr_queue *cursor, *icursor;
+    afs_uint32 i;
+
+    MUTEX_ENTER(&rx_rpc_stats);
+    for (opr_queue_Scan(&rxi_threadRpcStats, cursor)) {
+	struct rxi_thread_rpc_stats *ts
+	    = opr_queue_Entry(cursor, struct rxi_thread_rpc_stats, entry);
+
+	RPC_STATS_LOCK(ts);
+	for (opr_queue_Scan(&ts->interfaces, icursor)) {
+	    struct rxi_thread_rpc_interface *tif
+		= opr_queue_Entry(icursor, struct rxi_thread_rpc_interface,
+				  entry);
+
+	    if (rxInterface != -1 && (tif->interfaceId != rxInterface
+				      || tif->isServer))
+		continue;
+	    for (i = 0; i < tif->func_total; i++) {
+		rxi_ClearRPCOpStatFlags(&tif->ops[i].s, clearFlag);
+		rxi_ClearRPCOpHist(&tif->ops[i].hist, clearFlag);
+	    }
+	}
+	RPC_STATS_UNLOCK(ts);
+    }
+    MUTEX_EXIT(&rx_rpc_stats);
+}
+
+/*
+ * Return the statistics for the calling thread.  Without thread-specific
+ * data, the caller must hold rx_rpc_stats.
+ */
+static struct rxi_thread_rpc_stats *
+rxi_GetThreadRpcStats(void)
+{
+#ifdef RX_ENABLE_TSFPQ
+    struct rx_ts_info_t *rx_ts_info;
+    struct rxi_thread_rpc_stats *ts;
+
+    RX_TS_INFO_GET(rx_ts_info);
+    ts = rx_ts_info->rpc_stats;
+    if (ts == NULL) {
+	MUTEX_ENTER(&rx_rpc_stats);
+	ts = rxi_retiredRpcStats;
+	if (ts != NULL)
+	    rxi_retiredRpcStats = ts->nextRetired;
+	MUTEX_EXIT(&rx_rpc_stats);
+    }
+    if (ts == NULL) {
+	ts = rxi_Alloc(sizeof(*ts));
+	if (ts == NULL)
+	    return NULL;
+	opr_queue_Init(&ts->interfaces);
+	MUTEX_INIT(&ts->lock, "rx_thread_rpc_stats", MUTEX_DEFAULT, 0);
+	MUTEX_ENTER(&rx_rpc_stats);
+	opr_queue_Append(&rxi_threadRpcStats, &ts->entry);
+	MUTEX_EXIT(&rx_rpc_stats);
+    }
+    rx_ts_info->rpc_stats = ts;
+    return ts;
+#else
+    if (opr_queue_IsEmpty(&rxi_threadRpcStats)) {
+	opr_queue_Init(&rxi_sharedRpcStats.interfaces);
+	opr_queue_Append(&rxi_threadRpcStats, &rxi_sharedRpcStats.entry);
+    }
+    return &rxi_sharedRpcStats;
+#endif
+}
+
+#ifdef AFS_PTHREAD_ENV
+/*
+ * Hand the statistics of a thread which is about to exit on to the next
+ * thread that needs some.  The counts stay in the process totals.
+ */
+void
+rxi_RetireThreadRpcStats(void)
+{
+#ifdef RX_ENABLE_TSFPQ
+    struct rx_ts_info_t *rx_ts_info;
+    struct rxi_thread_rpc_stats *ts;
+
+    rx_ts_info = pthread_getspecific(rx_ts_info_key);
+    if (rx_ts_info == NULL || rx_ts_info->rpc_stats == NULL)
+	return;
+    ts = rx_ts_info->rpc_stats;
+    rx_ts_info->rpc_stats = NULL;
+    MUTEX_ENTER(&rx_rpc_stats);
+    ts->nextRetired = rxi_retiredRpcStats;
+    rxi_retiredRpcStats = ts;
+    MUTEX_EXIT(&rx_rpc_stats);
+#endif
+}
+#endif
+
+/*
+ * Add a call to the process statistics.  With thread-specific data the
+ * only lock taken is the calling thread's own, which nobody else wants
+ * unless the statistics are being read.
+ */
+static void
+rxi_AddThreadRpcStat(afs_uint32 rxInterface, afs_uint32 currentFunc,
+		     afs_uint32 totalFunc, struct clock *queueTime,
+		     struct clock *execTime, afs_uint64 bytesSent,
+		     afs_uint64 bytesRcvd, int isServer)
+{
+    struct rxi_thread_rpc_stats *ts;
+    struct rxi_thread_rpc_interface *tif;
+    struct rxi_rpcop_stat *op;
+
+#ifndef RX_ENABLE_TSFPQ
+    MUTEX_ENTER(&rx_rpc_stats);
+#endif
+    ts = rxi_GetThreadRpcStats();
+    if (ts == NULL)
+	goto done;
+
+    /* Only this thread changes the queue, so it may look without a lock. */
+    tif = rxi_FindThreadRpcInterface(&ts->interfaces, rxInterface, isServer);
+    if (tif == NULL) {
+	if (totalFunc == 0)
+	    goto done;
+	tif = rxi_NewThreadRpcInterface(rxInterface, totalFunc, isServer);
+	if (tif == NULL)
+	    goto done;
+	RPC_STATS_LOCK(ts);
+	opr_queue_Prepend(&ts->interfaces, &tif->entry);
+	RPC_STATS_UNLOCK(ts);
+    }
+    if (currentFunc >= tif->func_total)
+	goto done;
+    op = &tif->ops[currentFunc];
+
+    RPC_STATS_LOCK(ts);
+    rxi_UpdateRPCOpStat(&op->s, queueTime, execTime, bytesSent, bytesRcvd);
+    op->hist.queue_time_hist[rxi_RPCStatBucket(queueTime)]++;
+    op->hist.execution_time_hist[rxi_RPCStatBucket(execTime)]++;
+    RPC_STATS_UNLOCK(ts);
+
+  done:
+#ifndef RX_ENABLE_TSFPQ
+    MUTEX_EXIT(&rx_rpc_stats);
+#endif
+    return;
+}
+
 /*!
  * Given all of the information for a particular rpc
  * call, find or create (if requested) the stat structure for the rpc.
@@ -8233,22 +9022,10 @@ rxi_FindRpcStat(struct opr_queue *stats, afs_uint32 rxInterface,
 void
 rx_ClearProcessRPCStats(afs_int32 rxInterface)
 {
-    rx_interface_stat_p rpc_stat;
-    int totalFunc, i;
-
     if (rxInterface == -1)
         return;
 
-    MUTEX_ENTER(&rx_rpc_stats);
-    rpc_stat = rxi_FindRpcStat(&processStats, rxInterface, 0, 0,
-			       0, 0, 0, 0, 0);
-    if (rpc_stat) {
-	totalFunc = rpc_stat->stats[0].func_total;
-	for (i = 0; i < totalFunc; i++)
-	    rxi_ClearRPCOpStat(&(rpc_stat->stats[i]));
-    }
-    MUTEX_EXIT(&rx_rpc_stats);
-    return;
+    rxi_ClearThreadRpcStats(rxInterface, AFS_RX_STATS_CLEAR_ALL);
 }
 
 void
@@ -8280,7 +9057,8 @@ rx_ClearPeerRPCStats(afs_int32 rxInterface, afs_uint32 peerHost, afs_uint16 peer
 void *
 rx_CopyProcessRPCStats(afs_uint64 op)
 {
-    rx_interface_stat_p rpc_stat;
+    struct opr_queue sums;
+    struct rxi_thread_rpc_interface *sum = NULL;
     rx_function_entry_v1_p rpcop_stat =
 	rxi_Alloc(sizeof(rx_function_entry_v1_t));
     int currentFunc = (op & MAX_AFS_UINT32);
@@ -8295,14 +9073,18 @@ rx_CopyProcessRPCStats(afs_uint64 op)
     if (rpcop_stat == NULL)
         return NULL;
 
+    opr_queue_Init(&sums);
     MUTEX_ENTER(&rx_rpc_stats);
-    rpc_stat = rxi_FindRpcStat(&processStats, rxInterface, 0, 0,
-			       0, 0, 0, 0, 0);
-    if (rpc_stat)
-	memcpy(rpcop_stat, &(rpc_stat->stats[currentFunc]),
+    if (rxi_SumThreadRpcStats(&sums) > 0)
+	sum = rxi_FindThreadRpcInterface(&sums, rxInterface, 0);
+    if (sum && currentFunc < sum->func_total)
+	memcpy(rpcop_stat, &sum->ops[currentFunc].s,
 	       sizeof(rx_function_entry_v1_t));
+    else
+	sum = NULL;
+    rxi_FreeThreadRpcInterfaces(&sums);
     MUTEX_EXIT(&rx_rpc_stats);
-    if (!rpc_stat) {
+    if (!sum) {
 	rxi_Free(rpcop_stat, sizeof(rx_function_entry_v1_t));
 	return NULL;
     }
@@ -8422,26 +9204,8 @@ rxi_AddRpcStat(struct opr_queue *stats, afs_uint32 rxInterface,
      * Increment the stats for this function
      */
 
-    rpc_stat->stats[currentFunc].invocations++;
-    rpc_stat->stats[currentFunc].bytes_sent += bytesSent;
-    rpc_stat->stats[currentFunc].bytes_rcvd += bytesRcvd;
-    clock_Add(&rpc_stat->stats[currentFunc].queue_time_sum, queueTime);
-    clock_AddSq(&rpc_stat->stats[currentFunc].queue_time_sum_sqr, queueTime);
-    if (clock_Lt(queueTime, &rpc_stat->stats[currentFunc].queue_time_min)) {
-	rpc_stat->stats[currentFunc].queue_time_min = *queueTime;
-    }
-    if (clock_Gt(queueTime, &rpc_stat->stats[currentFunc].queue_time_max)) {
-	rpc_stat->stats[currentFunc].queue_time_max = *queueTime;
-    }
-    clock_Add(&rpc_stat->stats[currentFunc].execution_time_sum, execTime);
-    clock_AddSq(&rpc_stat->stats[currentFunc].execution_time_sum_sqr,
-		execTime);
-    if (clock_Lt(execTime, &rpc_stat->stats[currentFunc].execution_time_min)) {
-	rpc_stat->stats[currentFunc].execution_time_min = *execTime;
-    }
-    if (clock_Gt(execTime, &rpc_stat->stats[currentFunc].execution_time_max)) {
-	rpc_stat->stats[currentFunc].execution_time_max = *execTime;
-    }
+    rxi_UpdateRPCOpStat(&rpc_stat->stats[currentFunc], queueTime, execTime,
+			bytesSent, bytesRcvd);
 
   fail:
     return rc;
@@ -8458,23 +9222,20 @@ rxi_IncrementTimeAndCount(struct rx_peer *peer, afs_uint32 rxInterface,
     if (!(rxi_monitor_peerStats || rxi_monitor_processStats))
         return;
 
-    MUTEX_ENTER(&rx_rpc_stats);
-
     if (rxi_monitor_peerStats) {
+	MUTEX_ENTER(&rx_rpc_stats);
         MUTEX_ENTER(&peer->peer_lock);
 	rxi_AddRpcStat(&peer->rpcStats, rxInterface, currentFunc, totalFunc,
 		       queueTime, execTime, bytesSent, bytesRcvd, isServer,
 		       peer->host, peer->port, 1, &rxi_rpc_peer_stat_cnt);
         MUTEX_EXIT(&peer->peer_lock);
+	MUTEX_EXIT(&rx_rpc_stats);
     }
 
     if (rxi_monitor_processStats) {
-	rxi_AddRpcStat(&processStats, rxInterface, currentFunc, totalFunc,
-		       queueTime, execTime, bytesSent, bytesRcvd, isServer,
-		       0xffffffff, 0xffffffff, 0, &rxi_rpc_process_stat_cnt);
+	rxi_AddThreadRpcStat(rxInterface, currentFunc, totalFunc, queueTime,
+			     execTime, bytesSent, bytesRcvd, isServer);
     }
-
-    MUTEX_EXIT(&rx_rpc_stats);
 }
 
 /*!
@@ -8592,6 +9353,24 @@ rx_MarshallProcessRPCStats(afs_uint32 callerVersion, int count,
     *ptrP = ptr;
 }
 
+/* Marshall the histograms that follow a function's statistics. */
+static void
+rxi_MarshallRPCHist(rx_function_hist_t * hist, afs_uint32 ** ptrP)
+{
+    afs_uint32 *ptr = *ptrP;
+    int i;
+
+    for (i = 0; i < RX_STATS_HIST_BUCKETS; i++) {
+	*(ptr++) = hist->queue_time_hist[i] >> 32;
+	*(ptr++) = hist->queue_time_hist[i] & MAX_AFS_UINT32;
+    }
+    for (i = 0; i < RX_STATS_HIST_BUCKETS; i++) {
+	*(ptr++) = hist->execution_time_hist[i] >> 32;
+	*(ptr++) = hist->execution_time_hist[i] & MAX_AFS_UINT32;
+    }
+    *ptrP = ptr;
+}
+
 /*
  * rx_RetrieveProcessRPCStats - retrieve all of the rpc statistics for
  * this process
@@ -8626,6 +9405,8 @@ rx_RetrieveProcessRPCStats(afs_uint32 callerVersion, afs_uint32 * myVersion,
     size_t space = 0;
     afs_uint32 *ptr;
     struct clock now;
+    struct opr_queue sums;
+    int count;
     int rc = 0;
 
     *stats = 0;
@@ -8647,6 +9428,13 @@ rx_RetrieveProcessRPCStats(afs_uint32 callerVersion, afs_uint32 * myVersion,
     *clock_sec = now.sec;
     *clock_usec = now.usec;
 
+    opr_queue_Init(&sums);
+    count = rxi_SumThreadRpcStats(&sums);
+    if (count < 0) {
+	rc = ENOMEM;
+	goto done;
+    }
+
     /*
      * Allocate the space based upon the caller version
      *
@@ -8656,9 +9444,13 @@ rx_RetrieveProcessRPCStats(afs_uint32 callerVersion, afs_uint32 * myVersion,
      * are maintaining more data than it can retrieve.
      */
 
-    if (callerVersion >= RX_STATS_RETRIEVAL_FIRST_EDITION) {
-	space = rxi_rpc_process_stat_cnt * sizeof(rx_function_entry_v1_t);
-	*statCount = rxi_rpc_process_stat_cnt;
+    if (callerVersion >= RX_STATS_RETRIEVAL_HISTOGRAM_EDITION) {
+	space = count * (sizeof(rx_function_entry_v1_t) +
+			 sizeof(rx_function_hist_t));
+	*statCount = count;
+    } else if (callerVersion >= RX_STATS_RETRIEVAL_FIRST_EDITION) {
+	space = count * sizeof(rx_function_entry_v1_t);
+	*statCount = count;
     } else {
 	/*
 	 * This can't happen yet, but in the future version changes
@@ -8673,20 +9465,28 @@ rx_RetrieveProcessRPCStats(afs_uint32 callerVersion, afs_uint32 * myVersion,
 	if (ptr != NULL) {
 	    struct opr_queue *cursor;
 
-	    for (opr_queue_Scan(&processStats, cursor)) {
-		struct rx_interface_stat *rpc_stat = 
-		    opr_queue_Entry(cursor, struct rx_interface_stat, entry);
+	    for (opr_queue_Scan(&sums, cursor)) {
+		struct rxi_thread_rpc_interface *sum =
+		    opr_queue_Entry(cursor, struct rxi_thread_rpc_interface,
+				    entry);
+		afs_uint32 i;
+
 		/*
 		 * Copy the data based upon the caller version
 		 */
-		rx_MarshallProcessRPCStats(callerVersion,
-					   rpc_stat->stats[0].func_total,
-					   rpc_stat->stats, &ptr);
+		for (i = 0; i < sum->func_total; i++) {
+		    rx_MarshallProcessRPCStats(callerVersion, 1,
+					       &sum->ops[i].s, &ptr);
+		    if (callerVersion >= RX_STATS_RETRIEVAL_HISTOGRAM_EDITION)
+			rxi_MarshallRPCHist(&sum->ops[i].hist, &ptr);
+		}
 	    }
 	} else {
 	    rc = ENOMEM;
 	}
     }
+  done:
+    rxi_FreeThreadRpcInterfaces(&sums);
     MUTEX_EXIT(&rx_rpc_stats);
     return rc;
 }
@@ -8730,7 +9530,8 @@ rx_RetrievePeerRPCStats(afs_uint32 callerVersion, afs_uint32 * myVersion,
     *stats = 0;
     *statCount = 0;
     *allocSize = 0;
-    *myVersion = RX_STATS_RETRIEVAL_VERSION;
+    /* peers have no histograms, so their stats are all first edition */
+    *myVersion = RX_STATS_RETRIEVAL_FIRST_EDITION;
 
     /*
      * Check to see if stats are enabled
@@ -8906,9 +9707,6 @@ rx_enablePeerRPCStats(void)
 void
 rx_disableProcessRPCStats(void)
 {
-    struct opr_queue *cursor, *store;
-    size_t space;
-
     MUTEX_ENTER(&rx_rpc_stats);
 
     /*
@@ -8920,23 +9718,13 @@ rx_disableProcessRPCStats(void)
     if (rxi_monitor_peerStats == 0) {
 	rx_enable_stats = 0;
     }
-
-    for (opr_queue_ScanSafe(&processStats, cursor, store)) {
-    	unsigned int num_funcs = 0;
-	struct rx_interface_stat *rpc_stat
-	    = opr_queue_Entry(cursor, struct rx_interface_stat, entry);
-
-	opr_queue_Remove(&rpc_stat->entry);
-
-	num_funcs = rpc_stat->stats[0].func_total;
-	space =
-	    sizeof(rx_interface_stat_t) +
-	    rpc_stat->stats[0].func_total * sizeof(rx_function_entry_v1_t);
-
-	rxi_Free(rpc_stat, space);
-	rxi_rpc_process_stat_cnt -= num_funcs;
-    }
     MUTEX_EXIT(&rx_rpc_stats);
+
+    /*
+     * Threads may still be adding a call or two, and keep their stats,
+     * so just start them again from zero.
+     */
+    rxi_ClearThreadRpcStats(-1, AFS_RX_STATS_CLEAR_ALL);
 }
 
 /*
@@ -9042,62 +9830,7 @@ rx_disablePeerRPCStats(void)
 void
 rx_clearProcessRPCStats(afs_uint32 clearFlag)
 {
-    struct opr_queue *cursor;
-
-    MUTEX_ENTER(&rx_rpc_stats);
-
-    for (opr_queue_Scan(&processStats, cursor)) {
-	unsigned int num_funcs = 0, i;
-	struct rx_interface_stat *rpc_stat
-	     = opr_queue_Entry(cursor, struct rx_interface_stat, entry);
-
-	num_funcs = rpc_stat->stats[0].func_total;
-	for (i = 0; i < num_funcs; i++) {
-	    if (clearFlag & AFS_RX_STATS_CLEAR_INVOCATIONS) {
-		rpc_stat->stats[i].invocations = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_BYTES_SENT) {
-		rpc_stat->stats[i].bytes_sent = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_BYTES_RCVD) {
-		rpc_stat->stats[i].bytes_rcvd = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_SUM) {
-		rpc_stat->stats[i].queue_time_sum.sec = 0;
-		rpc_stat->stats[i].queue_time_sum.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_SQUARE) {
-		rpc_stat->stats[i].queue_time_sum_sqr.sec = 0;
-		rpc_stat->stats[i].queue_time_sum_sqr.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_MIN) {
-		rpc_stat->stats[i].queue_time_min.sec = 9999999;
-		rpc_stat->stats[i].queue_time_min.usec = 9999999;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_MAX) {
-		rpc_stat->stats[i].queue_time_max.sec = 0;
-		rpc_stat->stats[i].queue_time_max.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_SUM) {
-		rpc_stat->stats[i].execution_time_sum.sec = 0;
-		rpc_stat->stats[i].execution_time_sum.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_SQUARE) {
-		rpc_stat->stats[i].execution_time_sum_sqr.sec = 0;
-		rpc_stat->stats[i].execution_time_sum_sqr.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_MIN) {
-		rpc_stat->stats[i].execution_time_min.sec = 9999999;
-		rpc_stat->stats[i].execution_time_min.usec = 9999999;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_MAX) {
-		rpc_stat->stats[i].execution_time_max.sec = 0;
-		rpc_stat->stats[i].execution_time_max.usec = 0;
-	    }
-	}
-    }
-
-    MUTEX_EXIT(&rx_rpc_stats);
+    rxi_ClearThreadRpcStats(-1, clearFlag);
 }
 
 /*
@@ -9126,49 +9859,8 @@ rx_clearPeerRPCStats(afs_uint32 clearFlag)
 	    = opr_queue_Entry(cursor, struct rx_interface_stat, entryPeers);
 
 	num_funcs = rpc_stat->stats[0].func_total;
-	for (i = 0; i < num_funcs; i++) {
-	    if (clearFlag & AFS_RX_STATS_CLEAR_INVOCATIONS) {
-		rpc_stat->stats[i].invocations = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_BYTES_SENT) {
-		rpc_stat->stats[i].bytes_sent = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_BYTES_RCVD) {
-		rpc_stat->stats[i].bytes_rcvd = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_SUM) {
-		rpc_stat->stats[i].queue_time_sum.sec = 0;
-		rpc_stat->stats[i].queue_time_sum.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_SQUARE) {
-		rpc_stat->stats[i].queue_time_sum_sqr.sec = 0;
-		rpc_stat->stats[i].queue_time_sum_sqr.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_MIN) {
-		rpc_stat->stats[i].queue_time_min.sec = 9999999;
-		rpc_stat->stats[i].queue_time_min.usec = 9999999;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_QUEUE_TIME_MAX) {
-		rpc_stat->stats[i].queue_time_max.sec = 0;
-		rpc_stat->stats[i].queue_time_max.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_SUM) {
-		rpc_stat->stats[i].execution_time_sum.sec = 0;
-		rpc_stat->stats[i].execution_time_sum.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_SQUARE) {
-		rpc_stat->stats[i].execution_time_sum_sqr.sec = 0;
-		rpc_stat->stats[i].execution_time_sum_sqr.usec = 0;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_MIN) {
-		rpc_stat->stats[i].execution_time_min.sec = 9999999;
-		rpc_stat->stats[i].execution_time_min.usec = 9999999;
-	    }
-	    if (clearFlag & AFS_RX_STATS_CLEAR_EXEC_TIME_MAX) {
-		rpc_stat->stats[i].execution_time_max.sec = 0;
-		rpc_stat->stats[i].execution_time_max.usec = 0;
-	    }
-	}
+	for (i = 0; i < num_funcs; i++)
+	    rxi_ClearRPCOpStatFlags(&rpc_stat->stats[i], clearFlag);
     }
 
     MUTEX_EXIT(&rx_rpc_stats);
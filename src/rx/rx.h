@@ -95,6 +95,7 @@ extern int rx_GetRemoteStatus(struct rx_call *call);
 extern void rx_SetLocalStatus(struct rx_call *call, int status);
 extern int rx_GetCallAbortCode(struct rx_call *call);
 extern void rx_SetCallAbortCode(struct rx_call *call, int code);
+extern void rx_GetCallQueueTime(struct rx_call *call, struct clock *queue);
 
 extern void rx_RecordCallStatistics(struct rx_call *call,
 				    unsigned int rxInterface,
@@ -345,7 +346,11 @@ struct rx_service {
 #ifdef	RX_ENABLE_LOCKS
     afs_kmutex_t svc_data_lock;	/* protect specific data */
 #endif
-
+    /* Calls which had to wait for a server thread, protected by
+     * rx_serverPool_lock */
+    afs_uint32 nCallsQueued;	/* Number of such calls */
+    struct clock queueWaitTotal;	/* Total time they waited */
+    struct clock queueWaitMax;	/* Longest time one waited */
 };
 
 #endif /* KDUMP_RX_LOCK */
@@ -667,7 +672,9 @@ struct rx_statistics {		/* General rx statistics */
     int receiveCbufPktAllocFailures;
     int sendCbufPktAllocFailures;
     int nBusies;
-    int spares[4];
+    int crossNodeFrees;		/* Packets freed on another NUMA node */
+    int hugePageArenas;		/* Packet arenas backed by huge pages */
+    int spares[2];
 };
 
 /* structures for debug input and output packets */
@@ -815,6 +822,8 @@ struct rx_debugPeer {
 #define AFS_RX_STATS_CLEAR_EXEC_TIME_SQUARE	0x100
 #define AFS_RX_STATS_CLEAR_EXEC_TIME_MIN	0x200
 #define AFS_RX_STATS_CLEAR_EXEC_TIME_MAX	0x400
+#define AFS_RX_STATS_CLEAR_QUEUE_TIME_HIST	0x800
+#define AFS_RX_STATS_CLEAR_EXEC_TIME_HIST	0x1000
 
 typedef struct rx_function_entry_v1 {
     afs_uint32 remote_peer;
@@ -845,8 +854,23 @@ typedef struct rx_function_entry_v1 {
  * of versioning a la rxdebug.
  */
 
-#define RX_STATS_RETRIEVAL_VERSION 1	/* latest version */
+#define RX_STATS_RETRIEVAL_VERSION 2	/* latest version */
 #define RX_STATS_RETRIEVAL_FIRST_EDITION 1	/* first implementation */
+#define RX_STATS_RETRIEVAL_HISTOGRAM_EDITION 2	/* adds rx_function_hist */
+
+/*
+ * Process statistics in the histogram edition are each an
+ * rx_function_entry_v1 followed by an rx_function_hist.  Bucket 0 counts
+ * times of 0 microseconds, bucket n times of 2^(n-1) up to 2^n - 1
+ * microseconds, and the last bucket everything longer.  Peer statistics
+ * are always in the first edition format.
+ */
+#define RX_STATS_HIST_BUCKETS	24
+
+typedef struct rx_function_hist {
+    afs_uint64 queue_time_hist[RX_STATS_HIST_BUCKETS];
+    afs_uint64 execution_time_hist[RX_STATS_HIST_BUCKETS];
+} rx_function_hist_t, *rx_function_hist_p;
 
 typedef struct rx_interface_stat {
     struct opr_queue entry;
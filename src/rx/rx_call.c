@@ -55,6 +55,16 @@ rx_SetCallAbortCode(struct rx_call *call, int code)
     call->abortCode = code;
 }
 
+/*
+ * How long a server call waited to be given to a thread.
+ */
+void
+rx_GetCallQueueTime(struct rx_call *call, struct clock *queue)
+{
+    *queue = call->startTime;
+    clock_Sub(queue, &call->queueTime);
+}
+
 void
 rx_RecordCallStatistics(struct rx_call *call, unsigned int rxInterface,
 			unsigned int currentFunc, unsigned int totalFunc,
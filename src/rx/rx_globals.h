@@ -144,6 +144,7 @@ EXT int rx_nPackets GLOBALSINIT(0);	/* preallocate packets with rx_extraPackets
  * thread-specific rx data:
  *
  *  _FPQ member contains a thread-specific free packet queue
+ *  rpc_stats member holds the process rpc statistics of calls on this thread
  */
 #ifdef AFS_PTHREAD_ENV
 EXT pthread_key_t rx_ts_info_key;
@@ -152,6 +153,7 @@ typedef struct rx_ts_info_t {
         struct opr_queue queue;
         int len;                /* local queue length */
         int delta;              /* number of new packets alloc'd locally since last sync w/ global queue */
+        int node;               /* NUMA node the thread last ran on */
 
         /* FPQ stats */
         int checkin_ops;
@@ -168,8 +170,10 @@ typedef struct rx_ts_info_t {
         int galloc_xfer;
     } _FPQ;
     struct rx_packet * local_special_packet;
+    struct rxi_thread_rpc_stats *rpc_stats;	/* process rpc stats */
 } rx_ts_info_t;
 EXT struct rx_ts_info_t * rx_ts_info_init(void);   /* init function for thread-specific data struct */
+EXT void rx_ts_info_free(void *);   /* destructor for thread-specific data struct */
 #define RX_TS_INFO_GET(ts_info_p) \
     do { \
         ts_info_p = (struct rx_ts_info_t*)pthread_getspecific(rx_ts_info_key); \
@@ -183,7 +187,8 @@ EXT struct rx_ts_info_t * rx_ts_info_init(void);   /* init function for thread-s
 /* List of free packets */
 /* in pthreads rx, free packet queue is now a two-tiered queueing system
  * in which the first tier is thread-specific, and the second tier is
- * a global free packet queue */
+ * a global free packet queue for each NUMA node (rx_nodeFreePacketQueue,
+ * below); rx_freePacketQueue is used only without RX_ENABLE_TSFPQ */
 EXT struct opr_queue rx_freePacketQueue;
 #ifdef RX_TRACK_PACKETS
 #define RX_FPQ_MARK_FREE(p) \
@@ -255,6 +260,19 @@ EXT int rx_TSFPQMaxProcs GLOBALSINIT(0); /* max number of threads expected */
 #define RX_TS_FPQ_FLUSH_GLOBAL 1
 #define RX_TS_FPQ_PULL_GLOBAL 1
 #define RX_TS_FPQ_ALLOW_OVERCOMMIT 1
+/*
+ * The global free packet queue is split by NUMA node.  A packet belongs to
+ * the node whose memory holds it (p->node), and always goes back to that
+ * node's queue; a thread refilling its local queue takes packets from its
+ * own node's queue first.  rx_nFreePackets is the total of all the nodes'
+ * queues.  All are protected by rx_freePktQ_lock.
+ */
+#define RX_MAXNODES 8
+EXT struct opr_queue rx_nodeFreePacketQueue[RX_MAXNODES];
+EXT int rx_nNodeFreePackets[RX_MAXNODES];
+EXT int rxi_PacketNode(void);
+EXT int rxi_GetNodeFreePackets(int node, int num_transfer,
+			       struct opr_queue *q);
 /*
  * compute the localmax and globsize values from rx_TSFPQMaxProcs and rx_nPackets.
  * arbitarily set local max so that all threads consume 90% of packets, if all local queues are full.
@@ -289,43 +307,20 @@ EXT int rx_TSFPQMaxProcs GLOBALSINIT(0); /* max number of threads expected */
         (rx_ts_info_p)->_FPQ.galloc_ops++; \
         (rx_ts_info_p)->_FPQ.galloc_xfer += num_alloc; \
     } while (0)
-/* move packets from local (thread-specific) to global free packet queue.
-   rx_freePktQ_lock must be held. default is to reduce the queue size to 40% ofmax */
-#define RX_TS_FPQ_LTOG(rx_ts_info_p) \
+/* move num_transfer packets from the tail of the local (thread-specific)
+   queue to the global free packet queues of their home nodes.
+   rx_freePktQ_lock must be held. */
+#define RX_TS_FPQ_LTON(rx_ts_info_p,num_transfer) \
     do { \
         int i; \
         struct rx_packet * p; \
-        int tsize = MIN((rx_ts_info_p)->_FPQ.len, (rx_ts_info_p)->_FPQ.len - rx_TSFPQLocalMax + 3 *  rx_TSFPQGlobSize); \
-	if (tsize <= 0) break; \
-        for (i=0,p=opr_queue_Last(&((rx_ts_info_p)->_FPQ.queue), \
-				 struct rx_packet, entry); \
-             i < tsize; i++,p=opr_queue_Prev(&p->entry, \
-		     			    struct rx_packet, entry )); \
-        opr_queue_SplitAfterPrepend(&((rx_ts_info_p)->_FPQ.queue), \
-				   &rx_freePacketQueue, &p->entry); \
-        (rx_ts_info_p)->_FPQ.len -= tsize; \
-        rx_nFreePackets += tsize; \
-        (rx_ts_info_p)->_FPQ.ltog_ops++; \
-        (rx_ts_info_p)->_FPQ.ltog_xfer += tsize; \
-        if ((rx_ts_info_p)->_FPQ.delta) { \
-            MUTEX_ENTER(&rx_packets_mutex); \
-            RX_TS_FPQ_COMPUTE_LIMITS; \
-            MUTEX_EXIT(&rx_packets_mutex); \
-           (rx_ts_info_p)->_FPQ.delta = 0; \
+        for (i=0; i < (num_transfer); i++) { \
+            p = opr_queue_Last(&((rx_ts_info_p)->_FPQ.queue), \
+			       struct rx_packet, entry); \
+            opr_queue_Remove(&p->entry); \
+            opr_queue_Prepend(&rx_nodeFreePacketQueue[p->node], &p->entry); \
+            rx_nNodeFreePackets[p->node]++; \
         } \
-    } while(0)
-/* same as above, except user has direct control over number to transfer */
-#define RX_TS_FPQ_LTOG2(rx_ts_info_p,num_transfer) \
-    do { \
-        int i; \
-        struct rx_packet * p; \
-        if (num_transfer <= 0) break; \
-        for (i=0,p=opr_queue_Last(&((rx_ts_info_p)->_FPQ.queue), \
-				 struct rx_packet, entry ); \
-	     i < (num_transfer); \
-	     i++,p=opr_queue_Prev(&p->entry, struct rx_packet, entry )); \
-        opr_queue_SplitAfterPrepend(&((rx_ts_info_p)->_FPQ.queue), \
-				   &rx_freePacketQueue, &p->entry); \
         (rx_ts_info_p)->_FPQ.len -= (num_transfer); \
         rx_nFreePackets += (num_transfer); \
         (rx_ts_info_p)->_FPQ.ltog_ops++; \
@@ -337,38 +332,34 @@ EXT int rx_TSFPQMaxProcs GLOBALSINIT(0); /* max number of threads expected */
             (rx_ts_info_p)->_FPQ.delta = 0; \
         } \
     } while(0)
-/* move packets from global to local (thread-specific) free packet queue.
-   rx_freePktQ_lock must be held. */
-#define RX_TS_FPQ_GTOL(rx_ts_info_p) \
+/* move packets from local (thread-specific) to global free packet queue.
+   rx_freePktQ_lock must be held. default is to reduce the queue size to 40% ofmax */
+#define RX_TS_FPQ_LTOG(rx_ts_info_p) \
     do { \
-        int i, tsize; \
-        struct rx_packet * p; \
-        tsize = (rx_TSFPQGlobSize <= rx_nFreePackets) ? \
-                 rx_TSFPQGlobSize : rx_nFreePackets; \
-        for (i=0, \
-	       p=opr_queue_First(&rx_freePacketQueue, struct rx_packet, entry); \
-             i < tsize; \
-	     i++,p=opr_queue_Next(&p->entry, struct rx_packet, entry)); \
-        opr_queue_SplitBeforeAppend(&rx_freePacketQueue, \
-				   &((rx_ts_info_p)->_FPQ.queue), &p->entry); \
-        (rx_ts_info_p)->_FPQ.len += i; \
-        rx_nFreePackets -= i; \
-        (rx_ts_info_p)->_FPQ.gtol_ops++; \
-        (rx_ts_info_p)->_FPQ.gtol_xfer += i; \
+        int tsize = MIN((rx_ts_info_p)->_FPQ.len, (rx_ts_info_p)->_FPQ.len - rx_TSFPQLocalMax + 3 *  rx_TSFPQGlobSize); \
+	if (tsize <= 0) break; \
+        RX_TS_FPQ_LTON(rx_ts_info_p, tsize); \
     } while(0)
 /* same as above, except user has direct control over number to transfer */
+#define RX_TS_FPQ_LTOG2(rx_ts_info_p,num_transfer) \
+    do { \
+        if (num_transfer <= 0) break; \
+        RX_TS_FPQ_LTON(rx_ts_info_p, num_transfer); \
+    } while(0)
+/* move packets from global to local (thread-specific) free packet queue,
+   preferring packets from the thread's own node.
+   rx_freePktQ_lock must be held. */
+#define RX_TS_FPQ_GTOL(rx_ts_info_p) \
+    RX_TS_FPQ_GTOL2(rx_ts_info_p, rx_TSFPQGlobSize)
+/* same as above, except user has direct control over number to transfer */
 #define RX_TS_FPQ_GTOL2(rx_ts_info_p,num_transfer) \
     do { \
         int i, tsize; \
-        struct rx_packet * p; \
         tsize = (num_transfer); \
         if (tsize > rx_nFreePackets) tsize = rx_nFreePackets; \
-        for (i=0, \
-	       p=opr_queue_First(&rx_freePacketQueue, struct rx_packet, entry); \
-             i < tsize; \
-	     i++, p=opr_queue_Next(&p->entry, struct rx_packet, entry)); \
-        opr_queue_SplitBeforeAppend(&rx_freePacketQueue, \
-				   &((rx_ts_info_p)->_FPQ.queue), &p->entry); \
+        (rx_ts_info_p)->_FPQ.node = rxi_PacketNode(); \
+        i = rxi_GetNodeFreePackets((rx_ts_info_p)->_FPQ.node, tsize, \
+				   &((rx_ts_info_p)->_FPQ.queue)); \
         (rx_ts_info_p)->_FPQ.len += i; \
         rx_nFreePackets -= i; \
         (rx_ts_info_p)->_FPQ.gtol_ops++; \
@@ -405,10 +396,23 @@ EXT int rx_TSFPQMaxProcs GLOBALSINIT(0); /* max number of threads expected */
         (rx_ts_info_p)->_FPQ.checkout_ops++; \
         (rx_ts_info_p)->_FPQ.checkout_xfer += num_transfer; \
     } while(0)
+/* queue a packet which is being checked in.  Packets from other nodes go
+ * to the tail, so that the thread reuses its own node's packets first, and
+ * the others are the first to be returned to the global queues. */
+#define RX_TS_FPQ_QUEUE(rx_ts_info_p,p) \
+    do { \
+        if ((p)->node == (rx_ts_info_p)->_FPQ.node) { \
+            opr_queue_Prepend(&((rx_ts_info_p)->_FPQ.queue), &((p)->entry)); \
+        } else { \
+            opr_queue_Append(&((rx_ts_info_p)->_FPQ.queue), &((p)->entry)); \
+            if (rx_stats_active) \
+                rx_atomic_inc(&rx_stats.crossNodeFrees); \
+        } \
+    } while(0)
 /* check a packet into the thread-specific free packet queue */
 #define RX_TS_FPQ_CHECKIN(rx_ts_info_p,p) \
     do { \
-        opr_queue_Prepend(&((rx_ts_info_p)->_FPQ.queue), &((p)->entry)); \
+        RX_TS_FPQ_QUEUE(rx_ts_info_p, p); \
         RX_FPQ_MARK_FREE(p); \
         (rx_ts_info_p)->_FPQ.len++; \
         (rx_ts_info_p)->_FPQ.checkin_ops++; \
@@ -420,11 +424,14 @@ EXT int rx_TSFPQMaxProcs GLOBALSINIT(0); /* max number of threads expected */
  * since caller already knows length of (q) for other reasons */
 #define RX_TS_FPQ_QCHECKIN(rx_ts_info_p,num_transfer,q) \
     do { \
-	struct opr_queue *cur; \
-        for (opr_queue_Scan((q), cur)) { \
-            RX_FPQ_MARK_FREE(opr_queue_Entry(cur, struct rx_packet, entry)); \
+	struct opr_queue *cur, *store; \
+	struct rx_packet *p; \
+        for (opr_queue_ScanBackwardsSafe((q), cur, store)) { \
+            p = opr_queue_Entry(cur, struct rx_packet, entry); \
+            opr_queue_Remove(cur); \
+            RX_TS_FPQ_QUEUE(rx_ts_info_p, p); \
+            RX_FPQ_MARK_FREE(p); \
         } \
-        opr_queue_SplicePrepend(&((rx_ts_info_p)->_FPQ.queue),(q)); \
         (rx_ts_info_p)->_FPQ.len += (num_transfer); \
         (rx_ts_info_p)->_FPQ.checkin_ops++; \
         (rx_ts_info_p)->_FPQ.checkin_xfer += (num_transfer); \
@@ -54,6 +54,11 @@
 # include <lwp.h>
 #endif /* KERNEL */
 
+#if defined(AFS_LINUX26_ENV) && !defined(KERNEL)
+# define RX_PACKET_ARENAS
+# include <sys/mman.h>
+#endif
+
 #ifdef	AFS_SUN5_ENV
 # include <sys/sysmacros.h>
 #endif
@@ -79,8 +84,20 @@ struct rx_mallocedPacket {
     struct opr_queue entry;	/*!< chained using opr_queue */
     struct rx_packet *addr;	/*!< address of the first element */
     afs_uint32 size;		/*!< array size in bytes */
+    int mapped;			/*!< allocated by mmap, not osi_Alloc */
 };
 
+#ifdef RX_PACKET_ARENAS
+/* Packet arrays of at least half this size are mapped in huge pages. */
+#define RX_HUGEPAGE_SIZE	(2 * 1024 * 1024)
+#endif
+
+#ifdef RX_ENABLE_TSFPQ
+/* NUMA node of each cpu, filled in by rxi_InitPacketNodes */
+#define RX_MAXCPUS 4096
+static u_char rxi_cpuNode[RX_MAXCPUS];
+#endif
+
 #ifdef RX_LOCKS_DB
 /* rxdb_fileID is used to identify the lock location, along with line#. */
 static int rxdb_fileID = RXDB_FILE_RX_PACKET;
@@ -548,13 +565,14 @@ rxi_AllocDataBuf(struct rx_packet *p, int nb, int class)
 /**
  * Register allocated packets.
  *
- * @param[in] addr array of packets
- * @param[in] npkt number of packets
+ * @param[in] addr   array of packets
+ * @param[in] size   array size in bytes
+ * @param[in] mapped nonzero if the array was allocated by mmap
  *
  * @return none
  */
 static void
-registerPackets(struct rx_packet *addr, afs_uint32 npkt)
+registerPackets(struct rx_packet *addr, afs_uint32 size, int mapped)
 {
     struct rx_mallocedPacket *mp;
 
@@ -564,14 +582,180 @@ registerPackets(struct rx_packet *addr, afs_uint32 npkt)
     memset(mp, 0, sizeof(*mp));
 
     mp->addr = addr;
-    mp->size = npkt * sizeof(struct rx_packet);
-    osi_Assert(npkt <= MAX_AFS_UINT32 / sizeof(struct rx_packet));
+    mp->size = size;
+    mp->mapped = mapped;
 
     MUTEX_ENTER(&rx_mallocedPktQ_lock);
     opr_queue_Append(&rx_mallocedPacketQueue, &mp->entry);
     MUTEX_EXIT(&rx_mallocedPktQ_lock);
 }
 
+#ifdef RX_PACKET_ARENAS
+/*
+ * Map a packet arena in huge pages.  Explicit huge pages are used if the
+ * administrator has reserved some; otherwise the arena is aligned to a
+ * huge page boundary and the kernel asked to back it with transparent huge
+ * pages.
+ */
+static void *
+rxi_MapPacketArena(size_t size)
+{
+    char *addr, *aligned;
+    size_t head;
+
+# ifdef MAP_HUGETLB
+    addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (addr != MAP_FAILED) {
+	if (rx_stats_active)
+	    rx_atomic_inc(&rx_stats.hugePageArenas);
+	return addr;
+    }
+# endif
+
+    addr = mmap(NULL, size + RX_HUGEPAGE_SIZE, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+	return NULL;
+    aligned = (char *)(((uintptr_t)addr + RX_HUGEPAGE_SIZE - 1)
+		       & ~((uintptr_t)RX_HUGEPAGE_SIZE - 1));
+    head = aligned - addr;
+    if (head > 0)
+	munmap(addr, head);
+    munmap(aligned + size, RX_HUGEPAGE_SIZE - head);
+
+# ifdef MADV_HUGEPAGE
+    if (madvise(aligned, size, MADV_HUGEPAGE) == 0 && rx_stats_active)
+	rx_atomic_inc(&rx_stats.hugePageArenas);
+# endif
+    return aligned;
+}
+#endif /* RX_PACKET_ARENAS */
+
+/*
+ * Allocate and register an array of *apackets packets.
+ *
+ * Large arrays are mapped in huge pages, to spare the TLB, and rounded up to
+ * a whole number of huge pages; *apackets is raised to use the extra space.
+ * The memory is not touched here, so it is placed on the NUMA node of the
+ * thread which first writes to it.
+ *
+ * @return the array, or NULL if there is no memory
+ */
+static struct rx_packet *
+rxi_AllocPacketArena(int *apackets)
+{
+    struct rx_packet *p;
+    size_t size;
+
+    size = *apackets * sizeof(struct rx_packet);
+#ifdef RX_PACKET_ARENAS
+    if (size >= RX_HUGEPAGE_SIZE / 2) {
+	size = (size + RX_HUGEPAGE_SIZE - 1) & ~((size_t)RX_HUGEPAGE_SIZE - 1);
+	if (size <= MAX_AFS_UINT32 && (p = rxi_MapPacketArena(size)) != NULL) {
+	    *apackets = size / sizeof(struct rx_packet);
+	    registerPackets(p, size, 1);
+	    return p;
+	}
+	size = *apackets * sizeof(struct rx_packet);
+    }
+#endif
+    osi_Assert(size <= MAX_AFS_UINT32);
+    p = osi_Alloc(size);
+    if (p != NULL)
+	registerPackets(p, size, 0);
+    return p;
+}
+
+#ifdef RX_ENABLE_TSFPQ
+/*
+ * Learn which NUMA node each cpu belongs to, so that rxi_PacketNode can be
+ * cheap.  Systems without NUMA, or where it can't be found out, are treated
+ * as having the single node 0.
+ */
+void
+rxi_InitPacketNodes(void)
+{
+    int node;
+
+    for (node = 0; node < RX_MAXNODES; node++) {
+	opr_queue_Init(&rx_nodeFreePacketQueue[node]);
+	rx_nNodeFreePackets[node] = 0;
+    }
+
+# ifdef AFS_LINUX26_ENV
+    for (node = 0; node < 64; node++) {
+	char path[64], list[1024], *cp;
+	FILE *f;
+	long first, last;
+
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/node/node%d/cpulist", node);
+	f = fopen(path, "r");
+	if (f == NULL)
+	    continue;
+	cp = fgets(list, sizeof(list), f);
+	fclose(f);
+	while (cp != NULL && *cp != '\0' && *cp != '\n') {
+	    first = last = strtol(cp, &cp, 10);
+	    if (*cp == '-')
+		last = strtol(cp + 1, &cp, 10);
+	    for (; first <= last && first < RX_MAXCPUS; first++)
+		if (first >= 0)
+		    rxi_cpuNode[first] = node % RX_MAXNODES;
+	    if (*cp != ',')
+		break;
+	    cp++;
+	}
+    }
+# endif
+}
+
+/*
+ * Return the NUMA node the calling thread is running on.
+ */
+int
+rxi_PacketNode(void)
+{
+# ifdef AFS_LINUX26_ENV
+    int cpu = sched_getcpu();
+
+    if (cpu >= 0 && cpu < RX_MAXCPUS)
+	return rxi_cpuNode[cpu];
+# endif
+    return 0;
+}
+
+/*
+ * Move up to num_transfer packets from the global free packet queues to q,
+ * taking them from the given node's queue first.  rx_freePktQ_lock must be
+ * held.  The caller adjusts rx_nFreePackets.
+ *
+ * @return the number of packets moved
+ */
+int
+rxi_GetNodeFreePackets(int node, int num_transfer, struct opr_queue *q)
+{
+    struct opr_queue *pivot;
+    int i, n, total = 0;
+
+    for (i = 0; i < RX_MAXNODES && total < num_transfer; i++) {
+	n = MIN(num_transfer - total, rx_nNodeFreePackets[node]);
+	if (n > 0) {
+	    for (pivot = rx_nodeFreePacketQueue[node].next; n > 0; n--) {
+		pivot = pivot->next;
+		total++;
+		rx_nNodeFreePackets[node]--;
+	    }
+	    opr_queue_SplitBeforeAppend(&rx_nodeFreePacketQueue[node], q,
+					pivot);
+	}
+	node = (node + 1) % RX_MAXNODES;
+    }
+    return total;
+}
+#endif /* RX_ENABLE_TSFPQ */
+
 /* Add more packet buffers */
 #ifdef RX_ENABLE_TSFPQ
 void
@@ -582,14 +766,14 @@ rxi_MorePackets(int apackets)
     int getme;
     SPLVAR;
 
-    getme = apackets * sizeof(struct rx_packet);
-    p = osi_Alloc(getme);
+    p = rxi_AllocPacketArena(&apackets);
     osi_Assert(p);
-    registerPackets(p, apackets);
+    getme = apackets * sizeof(struct rx_packet);
 
     PIN(p, getme);		/* XXXXX */
     memset(p, 0, getme);
     RX_TS_INFO_GET(rx_ts_info);
+    rx_ts_info->_FPQ.node = rxi_PacketNode();
 
     RX_TS_FPQ_LOCAL_ALLOC(rx_ts_info,apackets);
     /* TSFPQ patch also needs to keep track of total packets */
@@ -602,6 +786,7 @@ rxi_MorePackets(int apackets)
     for (e = p + apackets; p < e; p++) {
         RX_PACKET_IOV_INIT(p);
 	p->niovecs = 2;
+	p->node = rx_ts_info->_FPQ.node;
 
 	RX_TS_FPQ_CHECKIN(rx_ts_info,p);
 
@@ -637,10 +822,9 @@ rxi_MorePackets(int apackets)
     int getme;
     SPLVAR;
 
-    getme = apackets * sizeof(struct rx_packet);
-    p = osi_Alloc(getme);
+    p = rxi_AllocPacketArena(&apackets);
     osi_Assert(p);
-    registerPackets(p, apackets);
+    getme = apackets * sizeof(struct rx_packet);
 
     PIN(p, getme);		/* XXXXX */
     memset(p, 0, getme);
@@ -681,13 +865,14 @@ rxi_MorePacketsTSFPQ(int apackets, int flush_global, int num_keep_local)
     int getme;
     SPLVAR;
 
+    p = rxi_AllocPacketArena(&apackets);
+    osi_Assert(p);
     getme = apackets * sizeof(struct rx_packet);
-    p = osi_Alloc(getme);
-    registerPackets(p, apackets);
 
     PIN(p, getme);		/* XXXXX */
     memset(p, 0, getme);
     RX_TS_INFO_GET(rx_ts_info);
+    rx_ts_info->_FPQ.node = rxi_PacketNode();
 
     RX_TS_FPQ_LOCAL_ALLOC(rx_ts_info,apackets);
     /* TSFPQ patch also needs to keep track of total packets */
@@ -699,6 +884,7 @@ rxi_MorePacketsTSFPQ(int apackets, int flush_global, int num_keep_local)
     for (e = p + apackets; p < e; p++) {
         RX_PACKET_IOV_INIT(p);
 	p->niovecs = 2;
+	p->node = rx_ts_info->_FPQ.node;
 	RX_TS_FPQ_CHECKIN(rx_ts_info,p);
 
         NETPRI;
@@ -735,6 +921,7 @@ rxi_MorePacketsNoLock(int apackets)
 {
 #ifdef RX_ENABLE_TSFPQ
     struct rx_ts_info_t * rx_ts_info;
+    int node;
 #endif /* RX_ENABLE_TSFPQ */
     struct rx_packet *p, *e;
     int getme;
@@ -744,19 +931,20 @@ rxi_MorePacketsNoLock(int apackets)
     apackets += (apackets / 4)
 	* ((rx_maxJumboRecvSize - RX_FIRSTBUFFERSIZE) / RX_CBUFFERSIZE);
     do {
-        getme = apackets * sizeof(struct rx_packet);
-        p = osi_Alloc(getme);
+        p = rxi_AllocPacketArena(&apackets);
 	if (p == NULL) {
             apackets -= apackets / 4;
             osi_Assert(apackets > 0);
         }
     } while(p == NULL);
+    getme = apackets * sizeof(struct rx_packet);
     memset(p, 0, getme);
-    registerPackets(p, apackets);
 
 #ifdef RX_ENABLE_TSFPQ
     RX_TS_INFO_GET(rx_ts_info);
     RX_TS_FPQ_GLOBAL_ALLOC(rx_ts_info,apackets);
+    node = rxi_PacketNode();
+    rx_nNodeFreePackets[node] += apackets;
 #endif /* RX_ENABLE_TSFPQ */
 
     for (e = p + apackets; p < e; p++) {
@@ -766,7 +954,12 @@ rxi_MorePacketsNoLock(int apackets)
 #endif
 	p->niovecs = 2;
 
+#ifdef RX_ENABLE_TSFPQ
+	p->node = node;
+	opr_queue_Append(&rx_nodeFreePacketQueue[node], &p->entry);
+#else
 	opr_queue_Append(&rx_freePacketQueue, &p->entry);
+#endif
 #ifdef RXDEBUG_PACKET
         p->packetId = rx_packet_id++;
         p->allNextp = rx_mallocedP;
@@ -797,8 +990,13 @@ rxi_FreeAllPackets(void)
 	mp = opr_queue_First(&rx_mallocedPacketQueue,
 			     struct rx_mallocedPacket, entry);
 	opr_queue_Remove(&mp->entry);
-	osi_Free(mp->addr, mp->size);
 	UNPIN(mp->addr, mp->size);
+#ifdef RX_PACKET_ARENAS
+	if (mp->mapped)
+	    munmap(mp->addr, mp->size);
+	else
+#endif
+	    osi_Free(mp->addr, mp->size);
 	osi_Free(mp, sizeof(*mp));
     }
     MUTEX_EXIT(&rx_mallocedPktQ_lock);
@@ -1170,10 +1368,10 @@ rxi_AllocPacketNoLock(int class)
     if (opr_queue_IsEmpty(&rx_ts_info->_FPQ.queue)) {
 
 #ifdef KERNEL
-        if (opr_queue_IsEmpty(&rx_freePacketQueue))
+        if (rx_nFreePackets == 0)
 	    osi_Panic("rxi_AllocPacket error");
 #else /* KERNEL */
-        if (opr_queue_IsEmpty(&rx_freePacketQueue))
+        if (rx_nFreePackets == 0)
 	    rxi_MorePacketsNoLock(rx_maxSendWindow);
 #endif /* KERNEL */
 
@@ -1267,7 +1465,7 @@ rxi_AllocPacketTSFPQ(int class, int pull_global)
     if (pull_global && opr_queue_IsEmpty(&rx_ts_info->_FPQ.queue)) {
         MUTEX_ENTER(&rx_freePktQ_lock);
 
-        if (opr_queue_IsEmpty(&rx_freePacketQueue))
+        if (rx_nFreePackets == 0)
 	    rxi_MorePacketsNoLock(rx_maxSendWindow);
 
 	RX_TS_FPQ_GTOL(rx_ts_info);
@@ -253,7 +253,7 @@ struct rx_packet {
     struct iovec wirevec[RX_MAXWVECS + 1];	/* the new form of the packet */
 
     u_char flags;		/* Flags for local state of this packet */
-    u_char unused;		/* was backoff, now just here for alignment */
+    u_char node;		/* NUMA node of the packet's memory */
     u_short length;		/* Data length */
     /* NT port relies on the fact that the next two are physically adjacent.
      * If that assumption changes change sendmsg and recvmsg in rx_xmit_nt.c .
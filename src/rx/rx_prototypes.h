@@ -30,6 +30,8 @@ extern void rx_StatsOnOff(int on);
 extern void rx_StartClientThread(void);
 #endif
 extern void rx_StartServer(int donateMe);
+extern void rx_SetServerThreadPool(int minThreads, int idleTime,
+				   int waitTarget);
 extern struct rx_connection *rx_NewConnection(afs_uint32 shost,
 					      u_short sport, u_short sservice,
 					      struct rx_securityClass
@@ -66,6 +68,9 @@ extern struct rx_service *rx_NewServiceHost(afs_uint32 host, u_short port,
 								     acall));
 extern void rxi_ServerProc(int threadID, struct rx_call *newcall,
 			   osi_socket * socketp);
+#ifdef AFS_PTHREAD_ENV
+extern void rxi_RetireThreadRpcStats(void);
+#endif
 extern void rx_WakeupServerProcs(void);
 extern struct rx_call *rx_GetCall(int tno, struct rx_service *cur_service,
 				  osi_socket * socketp);
@@ -88,6 +93,7 @@ extern int rxs_Release(struct rx_securityClass *aobj);
 extern void rx_PrintTheseStats(FILE * file, struct rx_statistics *s, int size,
 			       afs_int32 freePackets, char version);
 extern void rx_PrintStats(FILE * file);
+extern void rx_PrintMetrics(FILE * file);
 extern void rx_PrintPeerStats(FILE * file, struct rx_peer *peer);
 #endif
 extern afs_int32 rx_GetServerDebug(osi_socket socket, afs_uint32 remoteAddr,
@@ -392,6 +398,7 @@ extern void rxi_MorePackets(int apackets);
 #if defined(AFS_PTHREAD_ENV)
 extern void rxi_MorePacketsTSFPQ(int apackets, int flush_global, int num_keep_local); /* more flexible packet alloc function */
 extern void rxi_FlushLocalPacketsTSFPQ(void); /* flush all thread-local packets to global queue */
+extern void rxi_InitPacketNodes(void);
 #endif
 extern void rxi_FreeAllPackets(void);
 extern void rx_CheckPackets(void);
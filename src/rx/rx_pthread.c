@@ -63,6 +63,7 @@ afs_kmutex_t rx_clock_mutex;
 struct clock rxi_clockNow;
 
 static rx_atomic_t threadHiNum;
+static int rxi_retiredServerThreads;	/* protected by rx_pthread_mutex */
 
 int
 rx_NewThreadId(void) {
@@ -243,6 +244,27 @@ rxi_ListenerProc(osi_socket sock, int *tnop, struct rx_call **newcallp)
     /* NOTREACHED */
 }
 
+/*
+ * Exit a server thread which has left an elastic thread pool (see
+ * rx_SetServerThreadPool), returning the packets it holds.
+ */
+static void AFS_NORETURN
+rxi_ExitServerThread(void)
+{
+    struct rx_ts_info_t *rx_ts_info;
+
+    /* The packets this thread added to the pool stay there, for the next
+     * thread started to use. */
+    MUTEX_ENTER(&rx_pthread_mutex);
+    rxi_retiredServerThreads++;
+    MUTEX_EXIT(&rx_pthread_mutex);
+
+    rx_ts_info = pthread_getspecific(rx_ts_info_key);
+    if (rx_ts_info != NULL)
+	rx_ts_info_free(rx_ts_info);
+    pthread_exit(NULL);
+}
+
 /* This is the listener process request loop. The listener process loop
  * becomes a server thread when rxi_ListenerProc returns, and stays
  * server thread until rxi_ServerProc returns. */
@@ -262,7 +284,8 @@ rx_ListenerProc(void *argp)
 	sock = OSI_NULLSOCKET;
 	rxi_SetThreadNum(threadID);
 	rxi_ServerProc(threadID, newcall, &sock);
-	/* osi_Assert(sock != OSI_NULLSOCKET); */
+	if (sock == OSI_NULLSOCKET)
+	    rxi_ExitServerThread();	/* retired from the pool */
     }
     AFS_UNREACHED(return(NULL));
 }
@@ -276,8 +299,16 @@ rx_ServerProc(void * dummy)
     osi_socket sock;
     int threadID;
     struct rx_call *newcall = NULL;
+    int reuse = 0;
 
-    rxi_MorePackets(rx_maxReceiveWindow + 2);	/* alloc more packets */
+    MUTEX_ENTER(&rx_pthread_mutex);
+    if (rxi_retiredServerThreads > 0) {
+	rxi_retiredServerThreads--;
+	reuse = 1;
+    }
+    MUTEX_EXIT(&rx_pthread_mutex);
+    if (!reuse)
+	rxi_MorePackets(rx_maxReceiveWindow + 2);	/* alloc more packets */
     MUTEX_ENTER(&rx_quota_mutex);
     rxi_dataQuota += rx_initSendWindow;	/* Reserve some pkts for hard times */
     /* threadID is used for making decisions in GetCall.  Get it by bumping
@@ -305,7 +336,8 @@ rx_ServerProc(void * dummy)
 	sock = OSI_NULLSOCKET;
 	rxi_SetThreadNum(threadID);
 	rxi_ServerProc(threadID, newcall, &sock);
-	/* osi_Assert(sock != OSI_NULLSOCKET); */
+	if (sock == OSI_NULLSOCKET)
+	    rxi_ExitServerThread();	/* retired from the pool */
 	newcall = NULL;
 	rxi_ListenerProc(sock, &threadID, &newcall);
 	/* osi_Assert(threadID != -1); */
@@ -448,6 +480,7 @@ struct rx_ts_info_t * rx_ts_info_init(void) {
     osi_Assert(rx_ts_info != NULL && pthread_setspecific(rx_ts_info_key, rx_ts_info) == 0);
 #ifdef RX_ENABLE_TSFPQ
     opr_queue_Init(&rx_ts_info->_FPQ.queue);
+    rx_ts_info->_FPQ.node = rxi_PacketNode();
 
     MUTEX_ENTER(&rx_packets_mutex);
     rx_TSFPQMaxProcs++;
@@ -457,6 +490,36 @@ struct rx_ts_info_t * rx_ts_info_init(void) {
     return rx_ts_info;
 }
 
+/*
+ * Release the thread-specific data of a thread which is going away; this
+ * is also the destructor of rx_ts_info_key, for threads which exit
+ * without telling us.  Its rpc statistics are kept, and its packets go
+ * back to the global pool.
+ */
+void
+rx_ts_info_free(void *arg)
+{
+    struct rx_ts_info_t *rx_ts_info = arg;
+
+    /* a key's value is cleared before its destructor runs; set it again
+     * for the calls below, which find it from the key */
+    osi_Assert(pthread_setspecific(rx_ts_info_key, rx_ts_info) == 0);
+    rxi_RetireThreadRpcStats();
+    if (rx_ts_info->local_special_packet != NULL)
+	rxi_FreePacket(rx_ts_info->local_special_packet);
+#ifdef RX_ENABLE_TSFPQ
+    rxi_FlushLocalPacketsTSFPQ();
+
+    MUTEX_ENTER(&rx_packets_mutex);
+    rx_TSFPQMaxProcs--;
+    RX_TS_FPQ_COMPUTE_LIMITS;
+    MUTEX_EXIT(&rx_packets_mutex);
+#endif /* RX_ENABLE_TSFPQ */
+
+    osi_Assert(pthread_setspecific(rx_ts_info_key, NULL) == 0);
+    free(rx_ts_info);
+}
+
 int
 rx_GetThreadNum(void) {
     return (intptr_t)pthread_getspecific(rx_thread_id_key);
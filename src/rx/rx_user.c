@@ -240,6 +240,7 @@ osi_Panic(char *msg, ...)
     va_end(ap);
     fflush(stderr);
     fflush(stdout);
+    opr_RunAbortHook();
     opr_abort();
 }
 
@@ -38,6 +38,8 @@
 
 #include "rxkad.h"
 #include <rx/rx.h>
+#include <rx/rx_packet.h>
+#include "../rx/rx_conn.h"
 #include "private_data.h"
 
 #define ROUNDS 16
@@ -67,6 +69,22 @@ const char ciph2[] = {
     0x2a, 0x8e, 0x8c, 0x94, 0xfc, 0xc7, 0x68, 0xe4, 0x88, 0xaa, 0xde, 0x0f
 };
 
+/*
+ * Thirteen blocks of (i * 7 + 3) under key2 with key1 as iv, encrypted in
+ * place.  Long enough to cover the four block decryption and its tail.
+ */
+const unsigned char ciph3[] = {
+    0x42, 0xfc, 0xa5, 0x8a, 0x16, 0x34, 0x55, 0x2d, 0x5f, 0x7a, 0x7a, 0x26,
+    0x15, 0x70, 0x8e, 0xc5, 0x7c, 0xfc, 0x7b, 0x79, 0x67, 0x32, 0xb3, 0x55,
+    0x9f, 0x02, 0x44, 0xc1, 0x9a, 0x81, 0x1a, 0x71, 0x53, 0xc1, 0x05, 0x16,
+    0x56, 0xc2, 0x1e, 0xc7, 0x63, 0x21, 0xa3, 0x41, 0x91, 0x0c, 0xe3, 0x55,
+    0x8c, 0x62, 0x51, 0x50, 0xab, 0x3b, 0x62, 0xc8, 0x90, 0x24, 0xfb, 0xd5,
+    0x2b, 0xc9, 0x30, 0xb8, 0xfb, 0xad, 0xef, 0x6b, 0x48, 0xe1, 0x8b, 0xa0,
+    0x2a, 0x0c, 0x6c, 0xcb, 0x09, 0x09, 0x1b, 0x3b, 0x31, 0x65, 0xeb, 0x8f,
+    0x44, 0xd0, 0x33, 0xed, 0x34, 0x07, 0x45, 0x56, 0xfb, 0x09, 0x16, 0xaf,
+    0xe2, 0x8f, 0xe7, 0xb6, 0xae, 0x61, 0xf5, 0xd2
+};
+
 #ifdef TEST_KERNEL
 #define fc_keysched    _afs_QTKrFdpoFL
 #define fc_ecb_encrypt _afs_sDLThwNLok
@@ -134,6 +152,32 @@ main(void)
 	fail++;
     }
 
+    /*
+     * Use key2 and key1 as iv, in place over thirteen blocks
+     */
+    {
+	unsigned char buf[sizeof(ciph3)];
+	int i;
+
+	for (i = 0; i < sizeof(buf); i++)
+	    buf[i] = i * 7 + 3;
+	memcpy(iv, key1, sizeof(iv));
+	fc_cbc_encrypt(buf, buf, sizeof(buf), sched, iv, ENCRYPT);
+	if (memcmp(ciph3, buf, sizeof(ciph3)) != 0) {
+	    fprintf(stderr, "in place encrypt FAILED\n");
+	    fail++;
+	}
+	memcpy(iv, key1, sizeof(iv));
+	fc_cbc_encrypt(buf, buf, sizeof(buf), sched, iv, DECRYPT);
+	for (i = 0; i < sizeof(buf); i++)
+	    if (buf[i] != (unsigned char)(i * 7 + 3))
+		break;
+	if (i < sizeof(buf)) {
+	    fprintf(stderr, "in place decrypt FAILED\n");
+	    fail++;
+	}
+    }
+
     /*
      * Test Encrypt- and Decrypt-Packet, use key1 and key2 as iv
      */
@@ -145,8 +189,12 @@ main(void)
     packet.wirevec[2].iov_len = 0;
 
     /* For unknown reasons bytes 4-7 are zeroed in rxkad_EncryptPacket */
-    rxkad_EncryptPacket(&conn, sched, iv, sizeof(the_quick), &packet);
-    rxkad_DecryptPacket(&conn, sched, iv, sizeof(the_quick), &packet);
+    rxkad_EncryptPacket(&conn, (const fc_KeySchedule *)sched,
+			(const fc_InitializationVector *)iv, sizeof(the_quick),
+			&packet);
+    rxkad_DecryptPacket(&conn, (const fc_KeySchedule *)sched,
+			(const fc_InitializationVector *)iv, sizeof(the_quick),
+			&packet);
     clear[4] ^= 'q';
     clear[5] ^= 'u';
     clear[6] ^= 'i';
@@ -189,5 +237,62 @@ main(void)
 
     }
 
+    /*
+     * Throughput of rxkad_crypt packets: a single buffer packet, and a
+     * jumbogram sized one spread over several buffers.
+     */
+    {
+	static char bufs[4][RX_CBUFFERSIZE];
+	struct timeval start, stop;
+	double secs;
+	int i, j, n, nbufs, len;
+
+	for (nbufs = 1; nbufs <= 4; nbufs += 3) {
+	    len = nbufs * RX_CBUFFERSIZE;
+	    for (j = 0; j < nbufs; j++) {
+		for (i = 0; i < RX_CBUFFERSIZE; i++)
+		    bufs[j][i] = i * 7 + j;
+		packet.wirevec[j + 1].iov_base = bufs[j];
+		packet.wirevec[j + 1].iov_len = RX_CBUFFERSIZE;
+	    }
+	    packet.wirevec[j + 1].iov_len = 0;
+
+	    rxkad_EncryptPacket(&conn, (const fc_KeySchedule *)sched,
+				(const fc_InitializationVector *)iv, len,
+				&packet);
+	    rxkad_DecryptPacket(&conn, (const fc_KeySchedule *)sched,
+				(const fc_InitializationVector *)iv, len,
+				&packet);
+	    for (j = 0; j < nbufs; j++) {
+		for (i = j ? 0 : 8; i < RX_CBUFFERSIZE; i++)
+		    if (bufs[j][i] != (char)(i * 7 + j))
+			break;
+		if (i < RX_CBUFFERSIZE) {
+		    fprintf(stderr, "%d buffer packet round trip FAILED\n",
+			    nbufs);
+		    fail++;
+		    break;
+		}
+	    }
+
+	    n = 200000 / nbufs;
+	    gettimeofday(&start, NULL);
+	    for (i = 0; i < n; i++) {
+		rxkad_EncryptPacket(&conn, (const fc_KeySchedule *)sched,
+				    (const fc_InitializationVector *)iv, len,
+				    &packet);
+		rxkad_DecryptPacket(&conn, (const fc_KeySchedule *)sched,
+				    (const fc_InitializationVector *)iv, len,
+				    &packet);
+	    }
+	    gettimeofday(&stop, NULL);
+	    secs = stop.tv_sec - start.tv_sec +
+		(stop.tv_usec - start.tv_usec) / 1e6;
+	    printf("%d buffer packet = %2.2f us, %.1f MB/s encrypted and "
+		   "decrypted\n", nbufs, secs * 1e6 / n,
+		   2.0 * n * len / secs / (1024 * 1024));
+	}
+    }
+
     exit(fail);
 }
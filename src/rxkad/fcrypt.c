@@ -94,82 +94,112 @@ fc_keysched(struct ktc_encryptionKey *key, fc_KeySchedule schedule)
     return 0;
 }
 
+/*
+ * One half round: the S box substitution and permutation, then a right
+ * rotation by 5 bits.  sbox0 fills the second least significant byte of
+ * the result, sbox1 the least, sbox2 the second most and sbox3 the most.
+ * Working on whole words keeps it independent of the host byte order.
+ */
+static_inline afs_uint32
+fc_f(afs_uint32 S)
+{
+    afs_uint32 P;
+
+    P = ((afs_uint32)sbox0[S >> 24] << 8)
+	| (afs_uint32)sbox1[(S >> 16) & 0xff]
+	| ((afs_uint32)sbox2[(S >> 8) & 0xff] << 16)
+	| ((afs_uint32)sbox3[S & 0xff] << 24);
+    return (P >> 5) | ((P & ((1 << 5) - 1)) << (32 - 5));
+}
+
+static_inline void
+fc_encrypt_block(afs_uint32 *lp, afs_uint32 *rp, const afs_int32 *schedule)
+{
+    afs_uint32 L = *lp, R = *rp, S;
+    int i;
+
+    for (i = 0; i < (ROUNDS / 2); i++) {
+	S = *schedule++ ^ R;
+	L ^= fc_f(S);
+	S = *schedule++ ^ L;
+	R ^= fc_f(S);
+    }
+    *lp = L;
+    *rp = R;
+}
+
+static_inline void
+fc_decrypt_block(afs_uint32 *lp, afs_uint32 *rp, const afs_int32 *schedule)
+{
+    afs_uint32 L = *lp, R = *rp, S;
+    int i;
+
+    schedule = &schedule[ROUNDS - 1];	/* start at end of key schedule */
+    for (i = 0; i < (ROUNDS / 2); i++) {
+	S = *schedule-- ^ L;
+	R ^= fc_f(S);
+	S = *schedule-- ^ R;
+	L ^= fc_f(S);
+    }
+    *lp = L;
+    *rp = R;
+}
+
+/*
+ * Decrypt four independent blocks, in b[0..7] as L,R pairs.  The rounds
+ * of each block depend on each other, but those of different blocks do
+ * not, so interleaving them lets the processor overlap the S box lookups.
+ */
+static_inline void
+fc_decrypt_4blocks(afs_uint32 *b, const afs_int32 *schedule)
+{
+    afs_uint32 L0 = b[0], R0 = b[1], L1 = b[2], R1 = b[3];
+    afs_uint32 L2 = b[4], R2 = b[5], L3 = b[6], R3 = b[7];
+    afs_uint32 K;
+    int i;
+
+    schedule = &schedule[ROUNDS - 1];
+    for (i = 0; i < (ROUNDS / 2); i++) {
+	K = *schedule--;
+	R0 ^= fc_f(K ^ L0);
+	R1 ^= fc_f(K ^ L1);
+	R2 ^= fc_f(K ^ L2);
+	R3 ^= fc_f(K ^ L3);
+	K = *schedule--;
+	L0 ^= fc_f(K ^ R0);
+	L1 ^= fc_f(K ^ R1);
+	L2 ^= fc_f(K ^ R2);
+	L3 ^= fc_f(K ^ R3);
+    }
+    b[0] = L0;
+    b[1] = R0;
+    b[2] = L1;
+    b[3] = R1;
+    b[4] = L2;
+    b[5] = R2;
+    b[6] = L3;
+    b[7] = R3;
+}
+
 /* IN int encrypt; * 0 ==> decrypt, else encrypt */
 afs_int32
 fc_ecb_encrypt(void * clear, void * cipher,
 	       const fc_KeySchedule schedule, int encrypt)
 {
     afs_uint32 L, R;
-    volatile afs_uint32 S, P;
-    volatile unsigned char *Pchar = (unsigned char *)&P;
-    volatile unsigned char *Schar = (unsigned char *)&S;
-    int i;
 
-#ifndef WORDS_BIGENDIAN
-#define Byte0 3
-#define Byte1 2
-#define Byte2 1
-#define Byte3 0
-#else
-#define Byte0 0
-#define Byte1 1
-#define Byte2 2
-#define Byte3 3
-#endif
-
-#if 0
-    memcpy(&L, clear, sizeof(afs_int32));
-    memcpy(&R, clear + 1, sizeof(afs_int32));
-#else
     L = ntohl(*((afs_uint32 *)clear));
     R = ntohl(*((afs_uint32 *)clear + 1));
-#endif
 
     if (encrypt) {
 	INC_RXKAD_STATS(fc_encrypts[ENCRYPT]);
-	for (i = 0; i < (ROUNDS / 2); i++) {
-	    S = *schedule++ ^ R;	/* xor R with key bits from schedule */
-	    Pchar[Byte2] = sbox0[Schar[Byte0]];	/* do 8-bit S Box subst. */
-	    Pchar[Byte3] = sbox1[Schar[Byte1]];	/* and permute the result */
-	    Pchar[Byte1] = sbox2[Schar[Byte2]];
-	    Pchar[Byte0] = sbox3[Schar[Byte3]];
-	    P = (P >> 5) | ((P & ((1 << 5) - 1)) << (32 - 5));	/* right rot 5 bits */
-	    L ^= P;		/* we're done with L, so save there */
-	    S = *schedule++ ^ L;	/* this time xor with L */
-	    Pchar[Byte2] = sbox0[Schar[Byte0]];
-	    Pchar[Byte3] = sbox1[Schar[Byte1]];
-	    Pchar[Byte1] = sbox2[Schar[Byte2]];
-	    Pchar[Byte0] = sbox3[Schar[Byte3]];
-	    P = (P >> 5) | ((P & ((1 << 5) - 1)) << (32 - 5));	/* right rot 5 bits */
-	    R ^= P;
-	}
+	fc_encrypt_block(&L, &R, schedule);
     } else {
 	INC_RXKAD_STATS(fc_encrypts[DECRYPT]);
-	schedule = &schedule[ROUNDS - 1];	/* start at end of key schedule */
-	for (i = 0; i < (ROUNDS / 2); i++) {
-	    S = *schedule-- ^ L;	/* xor R with key bits from schedule */
-	    Pchar[Byte2] = sbox0[Schar[Byte0]];	/* do 8-bit S Box subst. and */
-	    Pchar[Byte3] = sbox1[Schar[Byte1]];	/* permute the result */
-	    Pchar[Byte1] = sbox2[Schar[Byte2]];
-	    Pchar[Byte0] = sbox3[Schar[Byte3]];
-	    P = (P >> 5) | ((P & ((1 << 5) - 1)) << (32 - 5));	/* right rot 5 bits */
-	    R ^= P;		/* we're done with L, so save there */
-	    S = *schedule-- ^ R;	/* this time xor with L */
-	    Pchar[Byte2] = sbox0[Schar[Byte0]];
-	    Pchar[Byte3] = sbox1[Schar[Byte1]];
-	    Pchar[Byte1] = sbox2[Schar[Byte2]];
-	    Pchar[Byte0] = sbox3[Schar[Byte3]];
-	    P = (P >> 5) | ((P & ((1 << 5) - 1)) << (32 - 5));	/* right rot 5 bits */
-	    L ^= P;
-	}
+	fc_decrypt_block(&L, &R, schedule);
     }
-#if 0
-    memcpy(cipher, &L, sizeof(afs_int32));
-    memcpy(cipher + 1, &R, sizeof(afs_int32));
-#else
     *((afs_int32 *)cipher) = htonl(L);
     *((afs_int32 *)cipher + 1) = htonl(R);
-#endif
     return 0;
 }
 
@@ -177,6 +207,10 @@ fc_ecb_encrypt(void * clear, void * cipher,
  * be multiples of 8 bytes.
  * NOTE: fc_cbc_encrypt now modifies its 5th argument, to permit chaining over
  * scatter/gather vectors.
+ *
+ * The chaining value is kept in registers and each block goes straight
+ * through the rounds, rather than through fc_ecb_encrypt, since for
+ * rxkad_crypt connections this runs over every byte sent and received.
  */
 /*
   afs_int32 length; * in bytes *
@@ -188,61 +222,89 @@ afs_int32
 fc_cbc_encrypt(void *input, void *output, afs_int32 length,
 	       const fc_KeySchedule key, afs_uint32 * xor, int encrypt)
 {
-    afs_uint32 i, j;
+    char *in = input;
+    char *out = output;
     afs_uint32 t_input[2];
     afs_uint32 t_output[2];
-    unsigned char *t_in_p = (unsigned char *)t_input;
+    afs_uint32 x0 = xor[0], x1 = xor[1];
+    afs_uint32 L, R;
 
-    if (encrypt) {
-	for (i = 0; length > 0; i++, length -= 8) {
-	    /* get input */
-	    memcpy(t_input, input, sizeof(t_input));
-	    input=((char *)input) + sizeof(t_input);
+    if (length <= 0)
+	return 0;
 
-	    /* zero pad */
-	    for (j = length; j <= 7; j++)
-		*(t_in_p + j) = 0;
+    if (encrypt) {
+	ADD_RXKAD_STATS(fc_encrypts[ENCRYPT], (length + 7) / 8);
+	for (; length > 0; length -= 8) {
+	    /* get input, zero padding a short last block */
+	    if (length < 8) {
+		memset(t_input, 0, sizeof(t_input));
+		memcpy(t_input, in, length);
+	    } else
+		memcpy(t_input, in, sizeof(t_input));
+	    in += sizeof(t_input);
 
-	    /* do the xor for cbc into the temp */
-	    xor[0] ^= t_input[0];
-	    xor[1] ^= t_input[1];
-	    /* encrypt */
-	    fc_ecb_encrypt(xor, t_output, key, encrypt);
+	    /* do the xor for cbc, and encrypt */
+	    L = ntohl(x0 ^ t_input[0]);
+	    R = ntohl(x1 ^ t_input[1]);
+	    fc_encrypt_block(&L, &R, key);
+	    t_output[0] = htonl(L);
+	    t_output[1] = htonl(R);
 
-	    /* copy temp output and save it for cbc */
-	    memcpy(output, t_output, sizeof(t_output));
-	    output=(char *)output + sizeof(t_output);
+	    memcpy(out, t_output, sizeof(t_output));
+	    out += sizeof(t_output);
 
 	    /* calculate xor value for next round from plain & cipher text */
-	    xor[0] = t_input[0] ^ t_output[0];
-	    xor[1] = t_input[1] ^ t_output[1];
-
-
+	    x0 = t_input[0] ^ t_output[0];
+	    x1 = t_input[1] ^ t_output[1];
 	}
-	t_output[0] = 0;
-	t_output[1] = 0;
     } else {
-	/* decrypt */
-	for (i = 0; length > 0; i++, length -= 8) {
-	    /* get input */
-	    memcpy(t_input, input, sizeof(t_input));
-	    input=((char *)input) + sizeof(t_input);
+	ADD_RXKAD_STATS(fc_encrypts[DECRYPT], (length + 7) / 8);
+	/*
+	 * Each plain text block depends only on its own cipher text and the
+	 * chaining value, so decrypt four at a time and chain afterwards.
+	 */
+	for (; length >= 32; length -= 32) {
+	    afs_uint32 t_in4[8], t_blk[8];
+	    int i;
+
+	    memcpy(t_in4, in, sizeof(t_in4));
+	    in += sizeof(t_in4);
+	    for (i = 0; i < 8; i++)
+		t_blk[i] = ntohl(t_in4[i]);
+	    fc_decrypt_4blocks(t_blk, key);
+	    for (i = 0; i < 8; i += 2) {
+		t_output[0] = htonl(t_blk[i]) ^ x0;
+		t_output[1] = htonl(t_blk[i + 1]) ^ x1;
+		x0 = t_in4[i] ^ t_output[0];
+		x1 = t_in4[i + 1] ^ t_output[1];
+		t_blk[i] = t_output[0];
+		t_blk[i + 1] = t_output[1];
+	    }
+	    memcpy(out, t_blk, sizeof(t_blk));
+	    out += sizeof(t_blk);
+	}
+	for (; length > 0; length -= 8) {
+	    /* get input; no padding for decrypt */
+	    memcpy(t_input, in, sizeof(t_input));
+	    in += sizeof(t_input);
 
-	    /* no padding for decrypt */
-	    fc_ecb_encrypt(t_input, t_output, key, encrypt);
+	    L = ntohl(t_input[0]);
+	    R = ntohl(t_input[1]);
+	    fc_decrypt_block(&L, &R, key);
 
 	    /* do the xor for cbc into the output */
-	    t_output[0] ^= xor[0];
-	    t_output[1] ^= xor[1];
+	    t_output[0] = htonl(L) ^ x0;
+	    t_output[1] = htonl(R) ^ x1;
 
-	    /* copy temp output */
-	    memcpy(output, t_output, sizeof(t_output));
-	    output=((char *)output) + sizeof(t_output);
+	    memcpy(out, t_output, sizeof(t_output));
+	    out += sizeof(t_output);
 
 	    /* calculate xor value for next round from plain & cipher text */
-	    xor[0] = t_input[0] ^ t_output[0];
-	    xor[1] = t_input[1] ^ t_output[1];
+	    x0 = t_input[0] ^ t_output[0];
+	    x1 = t_input[1] ^ t_output[1];
 	}
     }
+    xor[0] = x0;
+    xor[1] = x1;
     return 0;
 }
@@ -23,6 +23,8 @@
 #include <lock.h>
 #include <rx/rx.h>
 #include <afs/cellconfig.h>
+#include <afs/srvtrace.h>
+#include <afs/srvmetrics.h>
 
 
 #define UBIK_INTERNALS
@@ -705,7 +707,11 @@ int
 ubik_BeginTrans(struct ubik_dbase *dbase, afs_int32 transMode,
 		struct ubik_trans **transPtr)
 {
-    return BeginTrans(dbase, transMode, transPtr, 0);
+    int code;
+
+    code = BeginTrans(dbase, transMode, transPtr, 0);
+    SrvTrace3(SRVT_UBIK_BEGIN, transMode, 0, code);
+    return code;
 }
 
 /*!
@@ -715,7 +721,11 @@ int
 ubik_BeginTransReadAny(struct ubik_dbase *dbase, afs_int32 transMode,
 		       struct ubik_trans **transPtr)
 {
-    return BeginTrans(dbase, transMode, transPtr, 1);
+    int code;
+
+    code = BeginTrans(dbase, transMode, transPtr, 1);
+    SrvTrace3(SRVT_UBIK_BEGIN, transMode, 1, code);
+    return code;
 }
 
 /*!
@@ -725,14 +735,15 @@ int
 ubik_BeginTransReadAnyWrite(struct ubik_dbase *dbase, afs_int32 transMode,
                             struct ubik_trans **transPtr)
 {
-    return BeginTrans(dbase, transMode, transPtr, 2);
+    int code;
+
+    code = BeginTrans(dbase, transMode, transPtr, 2);
+    SrvTrace3(SRVT_UBIK_BEGIN, transMode, 2, code);
+    return code;
 }
 
-/*!
- * \brief This routine ends a read or write transaction by aborting it.
- */
-int
-ubik_AbortTrans(struct ubik_trans *transPtr)
+static int
+AbortTrans(struct ubik_trans *transPtr)
 {
     afs_int32 code;
     afs_int32 code2;
@@ -783,6 +794,19 @@ ubik_AbortTrans(struct ubik_trans *transPtr)
     return (code ? code : code2);
 }
 
+/*!
+ * \brief This routine ends a read or write transaction by aborting it.
+ */
+int
+ubik_AbortTrans(struct ubik_trans *transPtr)
+{
+    int code;
+
+    code = AbortTrans(transPtr);
+    SrvTrace1(SRVT_UBIK_ABORT, code);
+    return code;
+}
+
 static void
 WritebackApplicationCache(struct ubik_dbase *dbase)
 {
@@ -800,12 +824,8 @@ WritebackApplicationCache(struct ubik_dbase *dbase)
     }
 }
 
-/*!
- * \brief This routine ends a read or write transaction on the open transaction identified by transPtr.
- * \return an error code.
- */
-int
-ubik_EndTrans(struct ubik_trans *transPtr)
+static int
+EndTrans(struct ubik_trans *transPtr)
 {
     afs_int32 code;
     struct timeval tv;
@@ -963,6 +983,20 @@ ubik_EndTrans(struct ubik_trans *transPtr)
     return code;
 }
 
+/*!
+ * \brief This routine ends a read or write transaction on the open transaction identified by transPtr.
+ * \return an error code.
+ */
+int
+ubik_EndTrans(struct ubik_trans *transPtr)
+{
+    int code;
+
+    code = EndTrans(transPtr);
+    SrvTrace1(SRVT_UBIK_END, code);
+    return code;
+}
+
 /*!
  * \brief This routine reads length bytes into buffer from the current position in the database.
  *
@@ -1378,6 +1412,63 @@ ubik_CheckCache(struct ubik_trans *atrans, ubik_updatecache_func cbf, void *rock
     return 0;
 }
 
+/*!
+ * Print the state udebug reports, as metrics in the Prometheus text
+ * exposition format.  Like the VOTE_Debug RPCs, this reads the state
+ * without locking it.
+ *
+ * \param[in] out  the file passed to the metrics collector
+ */
+void
+ubik_PrintMetrics(FILE *out)
+{
+    struct ubik_debug dbg;
+    struct ubik_server *ts;
+    afs_int32 up = 0;
+
+    if (ubik_dbase == NULL)
+	return;
+
+    memset(&dbg, 0, sizeof(dbg));
+    SVOTE_Debug(NULL, &dbg);
+    for (ts = ubik_servers; ts; ts = ts->next) {
+	if (ts->up)
+	    up++;
+    }
+
+    SrvMetrics_Gauge(out, "openafs_ubik_sync_site",
+		     "Whether this server is the sync site.", dbg.amSyncSite);
+    SrvMetrics_Gauge(out, "openafs_ubik_servers",
+		     "Servers taking part in the vote, counting this one.",
+		     dbg.nServers);
+    SrvMetrics_Gauge(out, "openafs_ubik_servers_up",
+		     "Other servers which are up.", up);
+    SrvMetrics_Gauge(out, "openafs_ubik_db_version_epoch",
+		     "Epoch of the local database version.",
+		     (afs_uint32)dbg.localVersion.epoch);
+    SrvMetrics_Gauge(out, "openafs_ubik_db_version_counter",
+		     "Counter of the local database version.",
+		     (afs_uint32)dbg.localVersion.counter);
+    SrvMetrics_Gauge(out, "openafs_ubik_recovery_state",
+		     "Recovery state flags, as printed by udebug.",
+		     (afs_uint32)dbg.recoveryState);
+    SrvMetrics_Gauge(out, "openafs_ubik_active_write",
+		     "Whether a write transaction is in progress.",
+		     dbg.activeWrite ? 1 : 0);
+    SrvMetrics_Gauge(out, "openafs_ubik_locked_pages",
+		     "Database pages which are read locked.", dbg.lockedPages);
+    SrvMetrics_Gauge(out, "openafs_ubik_write_locked_pages",
+		     "Database pages which are write locked.",
+		     dbg.writeLockedPages);
+    if (dbg.lastYesTime != 0 && dbg.now >= dbg.lastYesTime)
+	SrvMetrics_Gauge(out, "openafs_ubik_last_yes_vote_age_seconds",
+			 "Seconds since this server last voted yes.",
+			 dbg.now - dbg.lastYesTime);
+    SrvMetrics_Counter(out, "openafs_ubik_escapes_total",
+		       "Commits which gave up waiting for other servers "
+		       "to time out.", (afs_uint32)ubik_stats.escapes);
+}
+
 /*!
  * "Who said anything about panicking?" snapped Arthur.
  * "This is still just the culture shock. You wait till I've settled down
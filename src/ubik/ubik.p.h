@@ -613,6 +613,7 @@ extern int ubik_GetVersion(struct ubik_trans *atrans,
 extern int ubik_CheckCache(struct ubik_trans *atrans,
                            ubik_updatecache_func check,
                            void *rock);
+extern void ubik_PrintMetrics(FILE *out);
 extern struct version_data version_globals;
 /*\}*/
 
@@ -46,6 +46,11 @@ enum logRotateStyle {
     logRotate_timestamp,  /**< Rename log file to a timestamped file name. */
 };
 
+enum logFormat {
+    logFormat_plain = 0,  /**< Timestamp, thread number and message. */
+    logFormat_keyvalue,   /**< time=, thread= and msg= fields. */
+};
+
 struct logOptions {
     int logLevel;                  /**< The initial log level. */
     enum logDest dest;             /**< Log destination */
@@ -55,6 +60,8 @@ struct logOptions {
 	    int rotateOnOpen;      /**< Rotate the log file during OpenLog. */
 	    int rotateOnReset;     /**< Rotate the log file when the SIGHUP is caught. */
 	    enum logRotateStyle rotateStyle; /**< Specifies how logs are renamed. */
+	    int buffered;          /**< Write messages from a background thread. */
+	    enum logFormat format; /**< Specifies how messages are written. */
 	} fileOpts;
 #ifdef HAVE_SYSLOG
 	struct syslogOptions {
@@ -70,6 +77,8 @@ struct logOptions {
 #define lopt_rotateOnOpen opts.fileOpts.rotateOnOpen
 #define lopt_rotateOnReset opts.fileOpts.rotateOnReset
 #define lopt_rotateStyle opts.fileOpts.rotateStyle
+#define lopt_buffered opts.fileOpts.buffered
+#define lopt_format opts.fileOpts.format
 #define lopt_facility opts.syslogOpts.facility
 #define lopt_tag opts.syslogOpts.tag
 
@@ -93,6 +102,7 @@ extern int OpenLog(struct logOptions *opts);
 extern int ReOpenLog(void);
 extern void SetupLogSignals(void);
 extern void CloseLog(void);
+extern void FlushLog(void);
 extern void SetupLogSoftSignals(void);
 extern int GetLogLevel(void);
 extern enum logDest GetLogDest(void);
@@ -55,6 +55,13 @@ static pthread_mutex_t serverLogMutex;
 #define O_NONBLOCK 0
 #endif
 
+#if defined(AFS_PTHREAD_ENV) && !defined(AFS_NT40_ENV)
+#define LOG_BUFFERING
+#endif
+
+#define LOG_MSG_SIZE	1024	/*!< Longest message, before formatting. */
+#define LOG_LINE_SIZE	(2 * LOG_MSG_SIZE + 128)	/*!< Longest log line. */
+
 /*!
  * Placeholder function to return dummy thread number.
  */
@@ -74,10 +81,72 @@ int LogLevel;			/*!< The current logging level. */
 static int threadIdLogs = 0;	/*!< Include the thread id in log messages when true. */
 static int resetSignals = 0;	/*!< Reset signal handlers for the next signal when true. */
 static char *ourName = NULL;	/*!< The fully qualified log file path, saved for reopens. */
+static enum logFormat logFormat = logFormat_plain; /*!< How log lines are written. */
 
 static int OpenLogFile(const char *fileName);
 static void RotateLogFile(void);
 
+#ifdef LOG_BUFFERING
+/*
+ * Buffered logging.
+ *
+ * Each thread formats its messages into a staging buffer of its own, so
+ * logging a message takes only an uncontended lock.  A flusher thread
+ * writes out the staged messages of all the threads together, merged in
+ * time order, at least every LOG_FLUSH_SECS.  A thread which fills its
+ * buffer before then flushes everything itself.  Each thread has two
+ * buffers, so it can log into one while the other is being written.
+ *
+ * A thread which logs the same message over and over has the repeats
+ * counted rather than logged, and the count logged at most once every
+ * LOG_REPEAT_SECS.
+ */
+#define LOG_STAGE_SIZE	16384	/*!< Bytes of messages staged per thread. */
+#define LOG_FLUSH_SECS	1	/*!< How often the flusher runs. */
+#define LOG_REPEAT_SECS	10	/*!< How often repeats are counted in the log. */
+
+/* A staged log line; the line follows, padded to keep the headers aligned. */
+struct logRec {
+    afs_uint64 when;		/*!< usecs since the epoch, to order lines */
+    afs_uint32 len;		/*!< length of the line */
+    afs_uint32 spare;
+};
+#define LOG_REC_SIZE(len) (sizeof(struct logRec) + (((len) + 7) & ~7))
+
+struct logStage {
+    struct logStage *next;
+    pthread_mutex_t lock;	/*!< protects the rest */
+    char *buf;			/*!< lines being staged */
+    char *flushBuf;		/*!< the other buffer, being written */
+    size_t used;		/*!< bytes staged in buf */
+    int num;			/*!< thread number, for repeat counts */
+    int repeats;		/*!< repeats of last which were not logged */
+    time_t repeatStart;		/*!< when the first of those was seen */
+    char last[LOG_MSG_SIZE];	/*!< the last message logged */
+};
+
+/* A staged line found by the flusher. */
+struct logFlushRec {
+    afs_uint64 when;
+    int stage;			/*!< which stage, to keep each thread's order */
+    struct logRec *rec;
+};
+
+static int logBuffered;		/*!< Stage messages rather than write them. */
+static pthread_key_t logStageKey;
+/* logFlushMutex serializes flushes, and protects logStages and the
+ * flusher's buffers. */
+static pthread_mutex_t logFlushMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t logFlushCond = PTHREAD_COND_INITIALIZER;
+static struct logStage *logStages;
+static struct logFlushRec *logFlushRecs;
+static size_t logFlushMax;
+static char logFlushOut[65536];
+static char logFlushLine[LOG_LINE_SIZE];
+
+static void FlushStages_r(int finish);
+#endif /* LOG_BUFFERING */
+
 /*!
  * Determine if the file is a named pipe.
  *
@@ -147,6 +216,7 @@ SetLogThreadNumProgram(int (*func) (void) )
 void
 WriteLogBuffer(char *buf, afs_uint32 len)
 {
+    FlushLog();
     LOCK_SERVERLOG();
     if (serverLogFD >= 0) {
 	if (write(serverLogFD, buf, len) < 0)
@@ -164,6 +234,379 @@ LogThreadNum(void)
   return (*threadNumProgram) ();
 }
 
+/*!
+ * Format a message as a line for the log file.
+ *
+ * \param[out] line  buffer for the line
+ * \param[in]  size  size of the buffer
+ * \param[in]  when  when the message was logged
+ * \param[in]  num   thread number, or -1 to leave it out
+ * \param[in]  msg   the message
+ *
+ * \returns the length of the line
+ */
+static size_t
+FormatLogLine(char *line, size_t size, time_t when, int num, const char *msg)
+{
+    struct tm tm;
+    const char *p;
+    size_t len;
+
+    localtime_r(&when, &tm);
+    if (logFormat == logFormat_keyvalue) {
+	len = strftime(line, size, "time=%Y-%m-%dT%H:%M:%S", &tm);
+	if (num > -1)
+	    len += snprintf(line + len, size - len, " thread=%d", num);
+	len += snprintf(line + len, size - len, " msg=\"");
+	/* Quote the message, and drop its newline. */
+	for (p = msg; *p != '\0' && len < size - 4; p++) {
+	    if (*p == '\n') {
+		if (p[1] == '\0')
+		    break;
+		line[len++] = '\\';
+		line[len++] = 'n';
+	    } else {
+		if (*p == '"' || *p == '\\')
+		    line[len++] = '\\';
+		line[len++] = *p;
+	    }
+	}
+	line[len++] = '"';
+	line[len++] = '\n';
+	line[len] = '\0';
+    } else {
+	len = strftime(line, size, "%a %b %d %H:%M:%S %Y ", &tm);
+	if (num > -1)
+	    len += snprintf(line + len, size - len, "[%d] ", num);
+	len += strlcpy(line + len, msg, size - len);
+	if (len >= size)
+	    len = size - 1;
+    }
+    return len;
+}
+
+#ifdef LOG_BUFFERING
+/*!
+ * Stage a line, if there is room for it.
+ *
+ * \pre stage->lock is held
+ *
+ * \returns 1 if the line was staged, else 0
+ */
+static int
+StageLine(struct logStage *stage, const struct timeval *when,
+	  const char *line, size_t len)
+{
+    struct logRec *rec;
+
+    if (stage->used + LOG_REC_SIZE(len) > LOG_STAGE_SIZE)
+	return 0;
+    rec = (struct logRec *)(stage->buf + stage->used);
+    rec->when = (afs_uint64)when->tv_sec * 1000000 + when->tv_usec;
+    rec->len = len;
+    memcpy(rec + 1, line, len);
+    stage->used += LOG_REC_SIZE(len);
+    return 1;
+}
+
+/*!
+ * Stage a line, flushing the stages first if this one is full.
+ */
+static void
+StageAppend(struct logStage *stage, const struct timeval *when,
+	    const char *line, size_t len)
+{
+    int half;
+
+    opr_Verify(pthread_mutex_lock(&stage->lock) == 0);
+    while (!StageLine(stage, when, line, len)) {
+	opr_Verify(pthread_mutex_unlock(&stage->lock) == 0);
+	opr_Verify(pthread_mutex_lock(&logFlushMutex) == 0);
+	FlushStages_r(0);
+	opr_Verify(pthread_mutex_unlock(&logFlushMutex) == 0);
+	opr_Verify(pthread_mutex_lock(&stage->lock) == 0);
+    }
+    half = stage->used > LOG_STAGE_SIZE / 2;
+    opr_Verify(pthread_mutex_unlock(&stage->lock) == 0);
+
+    /* Have the flusher start early, before we have to stop and flush. */
+    if (half)
+	opr_Verify(pthread_cond_signal(&logFlushCond) == 0);
+}
+
+/*!
+ * Format the count of a message's repeats as a log line.
+ */
+static size_t
+FormatRepeats(char *line, size_t size, time_t when, int num, int repeats)
+{
+    char msg[64];
+
+    snprintf(msg, sizeof(msg), "last message repeated %d times\n", repeats);
+    return FormatLogLine(line, size, when, num, msg);
+}
+
+/*!
+ * Free the calling thread's stage when it exits, after writing out what
+ * is staged.
+ */
+static void
+FreeLogStage(void *arg)
+{
+    struct logStage *stage = arg, **sp;
+
+    opr_Verify(pthread_mutex_lock(&logFlushMutex) == 0);
+    FlushStages_r(1);
+    for (sp = &logStages; *sp != stage; sp = &(*sp)->next)
+	;
+    *sp = stage->next;
+    opr_Verify(pthread_mutex_unlock(&logFlushMutex) == 0);
+
+    opr_Verify(pthread_mutex_destroy(&stage->lock) == 0);
+    free(stage->buf);
+    free(stage->flushBuf);
+    free(stage);
+}
+
+/*!
+ * Get the calling thread's stage, creating it if need be.
+ *
+ * \returns the stage, or NULL if there is no memory for one
+ */
+static struct logStage *
+GetLogStage(void)
+{
+    struct logStage *stage;
+
+    stage = pthread_getspecific(logStageKey);
+    if (stage != NULL)
+	return stage;
+
+    stage = calloc(1, sizeof(*stage));
+    if (stage == NULL)
+	return NULL;
+    stage->buf = malloc(LOG_STAGE_SIZE);
+    stage->flushBuf = malloc(LOG_STAGE_SIZE);
+    if (stage->buf == NULL || stage->flushBuf == NULL) {
+	free(stage->buf);
+	free(stage->flushBuf);
+	free(stage);
+	return NULL;
+    }
+    opr_Verify(pthread_mutex_init(&stage->lock, NULL) == 0);
+
+    opr_Verify(pthread_mutex_lock(&logFlushMutex) == 0);
+    stage->next = logStages;
+    logStages = stage;
+    opr_Verify(pthread_mutex_unlock(&logFlushMutex) == 0);
+
+    opr_Verify(pthread_setspecific(logStageKey, stage) == 0);
+    return stage;
+}
+
+/*!
+ * Log a message through the calling thread's stage.
+ *
+ * \returns 0 if the message was logged or counted as a repeat, else -1
+ */
+static int
+LogStaged(const struct timeval *now, int num, const char *msg)
+{
+    struct logStage *stage;
+    char line[LOG_LINE_SIZE];
+    size_t len;
+    int repeats;
+
+    stage = GetLogStage();
+    if (stage == NULL)
+	return -1;
+
+    opr_Verify(pthread_mutex_lock(&stage->lock) == 0);
+    stage->num = num;
+    if (strcmp(msg, stage->last) == 0) {
+	if (stage->repeats++ == 0)
+	    stage->repeatStart = now->tv_sec;
+	if (now->tv_sec - stage->repeatStart < LOG_REPEAT_SECS) {
+	    opr_Verify(pthread_mutex_unlock(&stage->lock) == 0);
+	    return 0;
+	}
+	repeats = stage->repeats;
+	stage->repeats = 0;
+	msg = NULL;
+    } else {
+	repeats = stage->repeats;
+	stage->repeats = 0;
+	strlcpy(stage->last, msg, sizeof(stage->last));
+    }
+    opr_Verify(pthread_mutex_unlock(&stage->lock) == 0);
+
+    if (repeats > 0) {
+	len = FormatRepeats(line, sizeof(line), now->tv_sec, num, repeats);
+	StageAppend(stage, now, line, len);
+    }
+    if (msg != NULL) {
+	len = FormatLogLine(line, sizeof(line), now->tv_sec, num, msg);
+	StageAppend(stage, now, line, len);
+    }
+    return 0;
+}
+
+static int
+CompareFlushRecs(const void *a, const void *b)
+{
+    const struct logFlushRec *ra = a, *rb = b;
+
+    if (ra->when != rb->when)
+	return ra->when < rb->when ? -1 : 1;
+    if (ra->stage != rb->stage)
+	return ra->stage < rb->stage ? -1 : 1;
+    return ra->rec < rb->rec ? -1 : (ra->rec > rb->rec);
+}
+
+static void
+WriteLogOut(const char *buf, size_t len)
+{
+    if (serverLogFD >= 0) {
+	if (write(serverLogFD, buf, len) < 0)
+	    ; /* don't care */
+    }
+}
+
+/*!
+ * Write out the lines staged by all the threads, in time order.
+ *
+ * \param[in] finish  log the counts of all unlogged repeats, rather than
+ *                    just those which are due
+ *
+ * \pre logFlushMutex is held
+ */
+static void
+FlushStages_r(int finish)
+{
+    struct logStage *stage;
+    struct logFlushRec *recs;
+    struct logRec *rec;
+    struct timeval now;
+    char *buf, *p;
+    size_t used, len, n = 0, out = 0, i;
+    int s;
+
+    gettimeofday(&now, NULL);
+    for (stage = logStages, s = 0; stage != NULL; stage = stage->next, s++) {
+	opr_Verify(pthread_mutex_lock(&stage->lock) == 0);
+	if (stage->repeats > 0
+	    && (finish || now.tv_sec - stage->repeatStart >= LOG_REPEAT_SECS)) {
+	    len = FormatRepeats(logFlushLine, sizeof(logFlushLine), now.tv_sec,
+				stage->num, stage->repeats);
+	    if (StageLine(stage, &now, logFlushLine, len))
+		stage->repeats = 0;
+	}
+	buf = stage->buf;
+	used = stage->used;
+	stage->buf = stage->flushBuf;
+	stage->flushBuf = buf;
+	stage->used = 0;
+	opr_Verify(pthread_mutex_unlock(&stage->lock) == 0);
+
+	for (p = buf; p < buf + used; p += LOG_REC_SIZE(rec->len)) {
+	    rec = (struct logRec *)p;
+	    if (n == logFlushMax) {
+		recs = realloc(logFlushRecs, (n + 1024) * sizeof(*recs));
+		if (recs == NULL)
+		    break;	/* drop the rest */
+		logFlushRecs = recs;
+		logFlushMax = n + 1024;
+	    }
+	    logFlushRecs[n].when = rec->when;
+	    logFlushRecs[n].stage = s;
+	    logFlushRecs[n].rec = rec;
+	    n++;
+	}
+    }
+    if (n == 0)
+	return;
+    qsort(logFlushRecs, n, sizeof(*logFlushRecs), CompareFlushRecs);
+
+    LOCK_SERVERLOG();
+    for (i = 0; i < n; i++) {
+	rec = logFlushRecs[i].rec;
+	if (out + rec->len > sizeof(logFlushOut)) {
+	    WriteLogOut(logFlushOut, out);
+	    out = 0;
+	}
+	memcpy(logFlushOut + out, rec + 1, rec->len);
+	out += rec->len;
+    }
+    WriteLogOut(logFlushOut, out);
+    UNLOCK_SERVERLOG();
+}
+
+/*!
+ * The flusher thread; writes out staged lines every LOG_FLUSH_SECS, or
+ * sooner when a thread's buffer is filling up.
+ */
+static void *
+LogFlusher(void *arg)
+{
+    struct timeval now;
+    struct timespec until;
+
+    afs_pthread_setname_self("log flusher");
+    opr_Verify(pthread_mutex_lock(&logFlushMutex) == 0);
+    for (;;) {
+	gettimeofday(&now, NULL);
+	until.tv_sec = now.tv_sec + LOG_FLUSH_SECS;
+	until.tv_nsec = now.tv_usec * 1000;
+	pthread_cond_timedwait(&logFlushCond, &logFlushMutex, &until);
+	FlushStages_r(0);
+    }
+    AFS_UNREACHED(return(NULL));
+}
+
+/*!
+ * Start buffered logging, unless it is already running.
+ *
+ * \returns 0 on success
+ */
+static int
+StartLogBuffering(void)
+{
+    static int started;
+    pthread_attr_t tattr;
+    pthread_t tid;
+
+    if (started)
+	return 0;
+    if (pthread_key_create(&logStageKey, FreeLogStage) != 0)
+	return -1;
+    if (pthread_attr_init(&tattr) != 0
+	|| pthread_attr_setdetachstate(&tattr, PTHREAD_CREATE_DETACHED) != 0
+	|| pthread_create(&tid, &tattr, LogFlusher, NULL) != 0) {
+	pthread_key_delete(logStageKey);
+	return -1;
+    }
+    atexit(FlushLog);
+    opr_SetAbortHook(FlushLog);
+    started = 1;
+    return 0;
+}
+#endif /* LOG_BUFFERING */
+
+/*!
+ * Write out any messages which buffered logging has not written yet.
+ */
+void
+FlushLog(void)
+{
+#ifdef LOG_BUFFERING
+    if (logBuffered) {
+	opr_Verify(pthread_mutex_lock(&logFlushMutex) == 0);
+	FlushStages_r(1);
+	opr_Verify(pthread_mutex_unlock(&logFlushMutex) == 0);
+    }
+#endif
+}
+
 /*!
  * Write a message to the log.
  *
@@ -173,38 +616,34 @@ LogThreadNum(void)
 void
 vFSLog(const char *format, va_list args)
 {
-    time_t currenttime;
-    char tbuffer[1024];
-    char *info;
+    struct timeval now;
+    char msg[LOG_MSG_SIZE];
+    char line[LOG_LINE_SIZE];
     size_t len;
-    struct tm tm;
-    int num;
-
-    currenttime = time(NULL);
-    len = strftime(tbuffer, sizeof(tbuffer), "%a %b %d %H:%M:%S %Y ",
-		   localtime_r(&currenttime, &tm));
-    info = &tbuffer[len];
+    int num = -1;
 
-    if (threadIdLogs) {
+    gettimeofday(&now, NULL);
+    if (threadIdLogs)
 	num = (*threadNumProgram) ();
-        if (num > -1) {
-	    snprintf(info, (sizeof tbuffer) - strlen(tbuffer), "[%d] ",
-		     num);
-	    info += strlen(info);
-	}
-    }
-
-    vsnprintf(info, (sizeof tbuffer) - strlen(tbuffer), format, args);
+    vsnprintf(msg, sizeof(msg), format, args);
 
-    len = strlen(tbuffer);
-    LOCK_SERVERLOG();
 #ifdef HAVE_SYSLOG
     if (serverLogOpts.dest == logDest_syslog) {
-	syslog(LOG_INFO, "%s", info);
-    } else
+	LOCK_SERVERLOG();
+	syslog(LOG_INFO, "%s", msg);
+	UNLOCK_SERVERLOG();
+	return;
+    }
+#endif
+#ifdef LOG_BUFFERING
+    if (logBuffered && LogStaged(&now, num, msg) == 0)
+	return;
 #endif
+
+    len = FormatLogLine(line, sizeof(line), now.tv_sec, num, msg);
+    LOCK_SERVERLOG();
     if (serverLogFD >= 0) {
-	if (write(serverLogFD, tbuffer, len) < 0)
+	if (write(serverLogFD, line, len) < 0)
 	    ; /* don't care */
     }
     UNLOCK_SERVERLOG();
@@ -623,6 +1062,17 @@ OpenLogFile(const char *fileName)
  * string is appended to the log file name and existing files are not
  * removed.
  *
+ * The lopt_format enum specifies how messages are written; either the
+ * traditional timestamp and message (logFormat_plain), or as time=,
+ * thread= and msg= fields for log processing tools (logFormat_keyvalue).
+ *
+ * The lopt_buffered flag specifies that each thread stages its messages
+ * and a background thread writes them out, at least once a second, so
+ * logging threads do not wait for each other or for the disk.  Repeats
+ * of a message by the same thread are counted rather than logged.  The
+ * last second of messages may be lost if the process crashes.  The flag
+ * has no effect for LWP programs.
+ *
  * \note  Messages written to stdout and stderr are redirected to the log
  *        file when file-based logging is in effect.
  *
@@ -660,8 +1110,20 @@ OpenLog(struct logOptions *opts)
 	serverLogOpts.lopt_rotateOnOpen = opts->lopt_rotateOnOpen;
 	serverLogOpts.lopt_rotateOnReset = opts->lopt_rotateOnReset;
 	serverLogOpts.lopt_rotateStyle = opts->lopt_rotateStyle;
+	serverLogOpts.lopt_buffered = opts->lopt_buffered;
+	serverLogOpts.lopt_format = opts->lopt_format;
+	logFormat = opts->lopt_format;
 	/* OpenLogFile() sets ourName; don't cache filename here. */
 	code = OpenLogFile(opts->lopt_filename);
+#ifdef LOG_BUFFERING
+	if (code == 0 && opts->lopt_buffered) {
+	    if (StartLogBuffering() == 0)
+		logBuffered = 1;
+	    else
+		printf("Unable to start buffered logging; "
+		       "writing log messages directly\n");
+	}
+#endif
 	break;
 #ifdef HAVE_SYSLOG
     case logDest_syslog:
@@ -697,6 +1159,7 @@ ReOpenLog(void)
     }
 #endif
 
+    FlushLog();
     LOCK_SERVERLOG();
     if (ourName == NULL) {
 	UNLOCK_SERVERLOG();
@@ -721,6 +1184,7 @@ ReOpenLog(void)
 static void
 RotateLogFile(void)
 {
+    FlushLog();
     LOCK_SERVERLOG();
     if (ourName != NULL) {
 	if (serverLogFD >= 0) {
@@ -740,6 +1204,10 @@ RotateLogFile(void)
 void
 CloseLog(void)
 {
+    FlushLog();
+#ifdef LOG_BUFFERING
+    logBuffered = 0;
+#endif
     LOCK_SERVERLOG();
 
 #ifdef HAVE_SYSLOG
@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2026 The OpenAFS Contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR `AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Metrics export for the servers; see srvmetrics.h.
+ *
+ * The metrics are written to a temporary file which is then renamed over
+ * the metrics file, so a reader never sees a partly written file.
+ */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+#include <afs/stds.h>
+
+#include <roken.h>
+#include <afs/opr.h>
+
+#ifdef AFS_PTHREAD_ENV
+# include <pthread.h>
+#endif
+
+#include "afsutil.h"
+#include "srvmetrics.h"
+
+/* rename() can't replace an open file on Windows. */
+#if defined(AFS_PTHREAD_ENV) && !defined(AFS_NT40_ENV)
+# define SRVMETRICS_WRITER
+#endif
+
+static struct {
+    srvmetrics_collector func;
+    void *rock;
+} srvmetrics_collectors[SRVMETRICS_MAXCOLLECTORS];
+static int srvmetrics_ncollectors;
+
+#ifdef SRVMETRICS_WRITER
+static char *srvmetrics_path;
+static char *srvmetrics_tmpPath;
+#endif
+#ifdef AFS_PTHREAD_ENV
+static pthread_mutex_t srvmetrics_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/*!
+ * Add a function to be called each time the metrics file is written.
+ *
+ * \param[in] func  the collector, which prints its metrics to the file
+ *                  it is passed
+ * \param[in] rock  passed to func
+ *
+ * \return 0 on success, else an errno value
+ */
+int
+SrvMetrics_AddCollector(srvmetrics_collector func, void *rock)
+{
+    int code = 0;
+
+#ifdef AFS_PTHREAD_ENV
+    opr_Verify(pthread_mutex_lock(&srvmetrics_lock) == 0);
+#endif
+    if (srvmetrics_ncollectors < SRVMETRICS_MAXCOLLECTORS) {
+	srvmetrics_collectors[srvmetrics_ncollectors].func = func;
+	srvmetrics_collectors[srvmetrics_ncollectors].rock = rock;
+	srvmetrics_ncollectors++;
+    } else {
+	code = ENOSPC;
+    }
+#ifdef AFS_PTHREAD_ENV
+    opr_Verify(pthread_mutex_unlock(&srvmetrics_lock) == 0);
+#endif
+    return code;
+}
+
+#ifdef SRVMETRICS_WRITER
+static int
+WriteMetrics(void)
+{
+    FILE *out;
+    int i, code = 0;
+
+    out = fopen(srvmetrics_tmpPath, "w");
+    if (out == NULL)
+	return errno;
+
+    opr_Verify(pthread_mutex_lock(&srvmetrics_lock) == 0);
+    for (i = 0; i < srvmetrics_ncollectors; i++)
+	(*srvmetrics_collectors[i].func)(out, srvmetrics_collectors[i].rock);
+    opr_Verify(pthread_mutex_unlock(&srvmetrics_lock) == 0);
+
+    if (ferror(out))
+	code = EIO;
+    if (fclose(out) != 0 && code == 0)
+	code = errno;
+    if (code == 0 && rename(srvmetrics_tmpPath, srvmetrics_path) < 0)
+	code = errno;
+    if (code != 0)
+	unlink(srvmetrics_tmpPath);
+    return code;
+}
+
+static void *
+SrvMetricsWriter(void *unused)
+{
+    int code, lastCode = 0;
+
+    afs_pthread_setname_self("metrics");
+    for (;;) {
+	code = WriteMetrics();
+	/* Only complain when the trouble starts, not on every update. */
+	if (code != 0 && code != lastCode)
+	    ViceLog(0, ("Unable to write metrics file %s: %s\n",
+			srvmetrics_path, strerror(code)));
+	lastCode = code;
+	sleep(SRVMETRICS_INTERVAL);
+    }
+    AFS_UNREACHED(return NULL);
+}
+#endif /* SRVMETRICS_WRITER */
+
+/*!
+ * Start writing the metrics file.
+ *
+ * The collectors which have been added are run and the file is written
+ * at once, and again every SRVMETRICS_INTERVAL seconds until the server
+ * exits.  Only pthreaded servers, and not on Windows, can export metrics.
+ *
+ * \param[in] path  the metrics file
+ *
+ * \return 0 on success, else an errno value
+ */
+int
+SrvMetrics_Open(const char *path)
+{
+#ifdef SRVMETRICS_WRITER
+    pthread_attr_t tattr;
+    pthread_t tid;
+    int code;
+
+    if (srvmetrics_path != NULL)
+	return EEXIST;
+
+    srvmetrics_path = strdup(path);
+    if (srvmetrics_path == NULL)
+	return ENOMEM;
+    if (asprintf(&srvmetrics_tmpPath, "%s.tmp", path) < 0) {
+	free(srvmetrics_path);
+	srvmetrics_path = NULL;
+	return ENOMEM;
+    }
+
+    /* Fail now, rather than in the background, if the file can't be made. */
+    code = WriteMetrics();
+    if (code == 0) {
+	opr_Verify(pthread_attr_init(&tattr) == 0);
+	opr_Verify(pthread_attr_setdetachstate(&tattr,
+					       PTHREAD_CREATE_DETACHED) == 0);
+	code = pthread_create(&tid, &tattr, SrvMetricsWriter, NULL);
+	opr_Verify(pthread_attr_destroy(&tattr) == 0);
+    }
+    if (code != 0) {
+	free(srvmetrics_path);
+	free(srvmetrics_tmpPath);
+	srvmetrics_path = srvmetrics_tmpPath = NULL;
+    }
+    return code;
+#else
+    return ENOTSUP;
+#endif
+}
+
+/*!
+ * Print the HELP and TYPE lines which introduce a metric.
+ *
+ * \param[in] out   the file passed to the collector
+ * \param[in] name  the metric's name
+ * \param[in] type  SRVMETRICS_COUNTER or SRVMETRICS_GAUGE
+ * \param[in] help  a description of the metric
+ */
+void
+SrvMetrics_Family(FILE *out, const char *name, const char *type,
+		  const char *help)
+{
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/*!
+ * Print one sample of a metric.
+ *
+ * \param[in] out     the file passed to the collector
+ * \param[in] name    the metric's name
+ * \param[in] labels  the sample's labels, such as 'op="FetchData"', or
+ *                    NULL if it has none
+ * \param[in] value   the sample's value
+ */
+void
+SrvMetrics_Value(FILE *out, const char *name, const char *labels,
+		 afs_uint64 value)
+{
+    if (labels != NULL)
+	fprintf(out, "%s{%s} %" AFS_UINT64_FMT "\n", name, labels, value);
+    else
+	fprintf(out, "%s %" AFS_UINT64_FMT "\n", name, value);
+}
+
+/*!
+ * Print one sample of a metric measured in seconds.
+ *
+ * \param[in] out     the file passed to the collector
+ * \param[in] name    the metric's name
+ * \param[in] labels  the sample's labels, or NULL if it has none
+ * \param[in] tv      the sample's value
+ */
+void
+SrvMetrics_Seconds(FILE *out, const char *name, const char *labels,
+		   struct timeval *tv)
+{
+    if (labels != NULL)
+	fprintf(out, "%s{%s} %ld.%06ld\n", name, labels,
+		(long)tv->tv_sec, (long)tv->tv_usec);
+    else
+	fprintf(out, "%s %ld.%06ld\n", name, (long)tv->tv_sec,
+		(long)tv->tv_usec);
+}
+
+/*!
+ * Print a counter which has a single sample.
+ */
+void
+SrvMetrics_Counter(FILE *out, const char *name, const char *help,
+		   afs_uint64 value)
+{
+    SrvMetrics_Family(out, name, SRVMETRICS_COUNTER, help);
+    SrvMetrics_Value(out, name, NULL, value);
+}
+
+/*!
+ * Print a gauge which has a single sample.
+ */
+void
+SrvMetrics_Gauge(FILE *out, const char *name, const char *help,
+		 afs_uint64 value)
+{
+    SrvMetrics_Family(out, name, SRVMETRICS_GAUGE, help);
+    SrvMetrics_Value(out, name, NULL, value);
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2026 The OpenAFS Contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR `AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef AFS_SRC_UTIL_SRVMETRICS_H
+#define AFS_SRC_UTIL_SRVMETRICS_H
+
+/*
+ * Metrics export for the servers.
+ *
+ * A server registers collectors, functions which print its counters in the
+ * Prometheus text exposition format, and names a metrics file.  A
+ * background thread runs the collectors every SRVMETRICS_INTERVAL seconds
+ * and replaces the file with their output, so the file can be read at any
+ * time by a monitoring agent (for example, the textfile collector of the
+ * Prometheus node exporter).
+ *
+ * The collectors read the counters the servers already keep for xstat,
+ * rxdebug and udebug, so exporting metrics adds nothing to the paths which
+ * update them.
+ */
+
+#define SRVMETRICS_INTERVAL	15	/* seconds between updates */
+#define SRVMETRICS_MAXCOLLECTORS 16
+
+#define SRVMETRICS_COUNTER	"counter"
+#define SRVMETRICS_GAUGE	"gauge"
+
+typedef void (*srvmetrics_collector)(FILE *out, void *rock);
+
+extern int SrvMetrics_AddCollector(srvmetrics_collector func, void *rock);
+extern int SrvMetrics_Open(const char *path);
+
+extern void SrvMetrics_Family(FILE *out, const char *name, const char *type,
+			      const char *help);
+extern void SrvMetrics_Value(FILE *out, const char *name, const char *labels,
+			     afs_uint64 value);
+extern void SrvMetrics_Seconds(FILE *out, const char *name,
+			       const char *labels, struct timeval *tv);
+extern void SrvMetrics_Counter(FILE *out, const char *name, const char *help,
+			       afs_uint64 value);
+extern void SrvMetrics_Gauge(FILE *out, const char *name, const char *help,
+			     afs_uint64 value);
+
+#endif /* AFS_SRC_UTIL_SRVMETRICS_H */
@@ -0,0 +1,232 @@
+/*
+ * Copyright (c) 2026 The OpenAFS Contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR `AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Binary event tracing for the servers; see srvtrace.h.
+ *
+ * The trace file holds a header and SRVTRACE_NBUFS rings.  A thread
+ * claims a ring the first time it logs an event and is then the only
+ * writer to it until it exits, so logging an event is a few stores and
+ * no locks.  The file is sized up front and mapped shared, so the kernel
+ * writes the records back on its own, even if the server dies, and the
+ * rings of threads which never log anything take no space on disk.
+ */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+#include <afs/stds.h>
+
+#include <roken.h>
+#include <afs/opr.h>
+
+#ifdef AFS_PTHREAD_ENV
+# include <pthread.h>
+#endif
+#ifndef AFS_NT40_ENV
+# include <sys/mman.h>
+#endif
+
+#include "afsutil.h"
+#include "srvtrace.h"
+
+int srvtrace_enabled = 0;
+
+static struct srvtrace_header *srvtrace_hdr;
+static afs_uint32 srvtrace_nextBuf;	/* next unclaimed ring */
+
+#ifdef AFS_PTHREAD_ENV
+static pthread_mutex_t srvtrace_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t srvtrace_key;
+/* rings of threads which have exited; protected by srvtrace_lock */
+static struct srvtrace_buf *srvtrace_freeBufs[SRVTRACE_NBUFS];
+static int srvtrace_nFreeBufs;
+#else
+/* LWP threads are not preemptive, so they can all share one ring. */
+static struct srvtrace_buf *srvtrace_lwpBuf;
+#endif
+
+/* Marks a thread which found no free ring, so it only looks once. */
+static char srvtrace_noBuf;
+#define SRVTRACE_NOBUF ((struct srvtrace_buf *)&srvtrace_noBuf)
+
+static afs_uint64
+srvtrace_now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (afs_uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static_inline struct srvtrace_buf *
+srvtrace_buf(afs_uint32 i)
+{
+    return (struct srvtrace_buf *)((char *)(srvtrace_hdr + 1) +
+				   i * SRVTRACE_BUFSIZE(srvtrace_hdr->nrecs));
+}
+
+/*
+ * Give the calling thread a ring of its own.  Unused rings are handed out
+ * first, so the trace of a thread which has gone away stays readable for
+ * as long as possible.  Once they run out, a thread which starts, as those
+ * of an elastic Rx thread pool do, takes over the ring of one which has
+ * exited.  It carries on from the old ring's position, so the old thread's
+ * latest records are only overwritten as new ones arrive; each record
+ * names the thread which logged it.  Threads which find neither are
+ * counted in lostThreads.
+ */
+static struct srvtrace_buf *
+srvtrace_claim(void)
+{
+    struct srvtrace_buf *tb = SRVTRACE_NOBUF;
+    int tid;
+
+#ifdef AFS_PTHREAD_ENV
+    opr_Verify(pthread_mutex_lock(&srvtrace_lock) == 0);
+#endif
+    tid = LogThreadNum();
+    if (srvtrace_nextBuf < srvtrace_hdr->nbufs) {
+	tb = srvtrace_buf(srvtrace_nextBuf++);
+	tb->thread = tid > 0 ? tid : srvtrace_nextBuf;
+	tb->pos = 0;
+#ifdef AFS_PTHREAD_ENV
+    } else if (srvtrace_nFreeBufs > 0) {
+	tb = srvtrace_freeBufs[--srvtrace_nFreeBufs];
+	if (tid > 0)
+	    tb->thread = tid;
+#endif
+    } else {
+	srvtrace_hdr->lostThreads++;
+    }
+#ifdef AFS_PTHREAD_ENV
+    opr_Verify(pthread_mutex_unlock(&srvtrace_lock) == 0);
+#endif
+    return tb;
+}
+
+#ifdef AFS_PTHREAD_ENV
+/* Key destructor; let the ring of an exiting thread be claimed again. */
+static void
+srvtrace_release(void *arg)
+{
+    struct srvtrace_buf *tb = arg;
+
+    if (tb == SRVTRACE_NOBUF)
+	return;
+    opr_Verify(pthread_mutex_lock(&srvtrace_lock) == 0);
+    srvtrace_freeBufs[srvtrace_nFreeBufs++] = tb;
+    opr_Verify(pthread_mutex_unlock(&srvtrace_lock) == 0);
+}
+#endif
+
+/*!
+ * Start tracing into a file.
+ *
+ * The file is created, or truncated if it exists, and sized for
+ * SRVTRACE_NBUFS threads.
+ *
+ * \param[in] path  the trace file
+ *
+ * \return 0 on success, else an errno value
+ */
+int
+SrvTrace_Open(const char *path)
+{
+#ifdef AFS_NT40_ENV
+    return ENOTSUP;
+#else
+    struct srvtrace_header *hdr;
+    size_t size;
+    int fd, code;
+
+    if (srvtrace_enabled)
+	return EEXIST;
+
+    size = sizeof(*hdr) + SRVTRACE_NBUFS * SRVTRACE_BUFSIZE(SRVTRACE_NRECS);
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+	return errno;
+    if (ftruncate(fd, size) < 0) {
+	code = errno;
+	close(fd);
+	return code;
+    }
+    hdr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    code = errno;
+    close(fd);
+    if (hdr == MAP_FAILED)
+	return code;
+
+    hdr->version = SRVTRACE_VERSION;
+    hdr->nbufs = SRVTRACE_NBUFS;
+    hdr->nrecs = SRVTRACE_NRECS;
+    hdr->pid = getpid();
+    hdr->lostThreads = 0;
+    hdr->start = srvtrace_now();
+    hdr->magic = SRVTRACE_MAGIC;
+    srvtrace_hdr = hdr;
+
+#ifdef AFS_PTHREAD_ENV
+    opr_Verify(pthread_key_create(&srvtrace_key, srvtrace_release) == 0);
+#endif
+    srvtrace_enabled = 1;
+    return 0;
+#endif /* AFS_NT40_ENV */
+}
+
+/*!
+ * Log an event; called through the SrvTrace macros, which check first
+ * that tracing is on.
+ */
+void
+SrvTrace_Event(afs_uint32 event, afs_uint32 p1, afs_uint32 p2,
+	       afs_uint32 p3, afs_uint32 p4)
+{
+    struct srvtrace_buf *tb;
+    struct srvtrace_rec *rec;
+
+#ifdef AFS_PTHREAD_ENV
+    tb = pthread_getspecific(srvtrace_key);
+    if (tb == NULL) {
+	tb = srvtrace_claim();
+	pthread_setspecific(srvtrace_key, tb);
+    }
+#else
+    tb = srvtrace_lwpBuf;
+    if (tb == NULL)
+	tb = srvtrace_lwpBuf = srvtrace_claim();
+#endif
+    if (tb == SRVTRACE_NOBUF)
+	return;
+
+    rec = &SRVTRACE_RECS(tb)[tb->pos & (srvtrace_hdr->nrecs - 1)];
+    rec->time = srvtrace_now();
+    rec->event = event;
+    rec->thread = tb->thread;
+    rec->p[0] = p1;
+    rec->p[1] = p2;
+    rec->p[2] = p3;
+    rec->p[3] = p4;
+    tb->pos++;
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2026 The OpenAFS Contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR `AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef AFS_SRC_UTIL_SRVTRACE_H
+#define AFS_SRC_UTIL_SRVTRACE_H
+
+/*
+ * Binary event tracing for the servers.
+ *
+ * Like the cache manager's ICL logs, events are small fixed size binary
+ * records, a code and up to four numeric parameters, which are only
+ * formatted when the trace is dumped.  Each thread writes to its own ring
+ * of records, so tracing takes no locks, and the rings live in a file
+ * mapped into memory so the trace survives the server crashing.  The
+ * srvtrace program dumps the file.
+ *
+ * Tracing is off unless the server was started with -srvtrace, in which case
+ * the cost of a trace point is a test of srvtrace_enabled.
+ */
+
+#define SRVTRACE_MAGIC		0x53525654	/* "SRVT" */
+#define SRVTRACE_VERSION	1
+
+#define SRVTRACE_NBUFS		128	/* threads which can be traced */
+#define SRVTRACE_NRECS		8192	/* records kept for each thread */
+
+/*
+ * The trace events, with the format used to dump each.  The parameters
+ * are 32 bit unsigned values; signed error codes are printed with %d.
+ * New events go on the end, since the codes are recorded in trace files.
+ */
+#define SRVTRACE_EVENTS \
+    SRVTRACE_EVENT(SRVT_FS_RPC_START, \
+		   "fileserver RPC %u start") \
+    SRVTRACE_EVENT(SRVT_FS_RPC_END, \
+		   "fileserver RPC %u end, code %d, %u usecs") \
+    SRVTRACE_EVENT(SRVT_VOL_RPC_START, \
+		   "volserver RPC start, from host 0x%x port %u") \
+    SRVTRACE_EVENT(SRVT_VOL_RPC_END, \
+		   "volserver RPC end, code %d") \
+    SRVTRACE_EVENT(SRVT_GETVNODE, \
+		   "VGetVnode volume %u vnode %u locktype %d, error %d") \
+    SRVTRACE_EVENT(SRVT_BREAK_CALLBACK, \
+		   "BreakCallBack fid %u.%u.%u, %u hosts") \
+    SRVTRACE_EVENT(SRVT_UBIK_BEGIN, \
+		   "ubik BeginTrans mode %d readany %d, code %d") \
+    SRVTRACE_EVENT(SRVT_UBIK_END, \
+		   "ubik EndTrans, code %d") \
+    SRVTRACE_EVENT(SRVT_UBIK_ABORT, \
+		   "ubik AbortTrans, code %d")
+
+#define SRVTRACE_EVENT(code, format) code,
+enum srvtrace_event {
+    SRVT_NONE = 0,
+    SRVTRACE_EVENTS
+    SRVT_NEVENTS
+};
+#undef SRVTRACE_EVENT
+
+/* One event.  Records are 32 bytes, so two share a cache line. */
+struct srvtrace_rec {
+    afs_uint64 time;		/* microseconds since the epoch */
+    afs_uint32 event;		/* enum srvtrace_event */
+    afs_uint32 thread;		/* tid of the thread which logged it */
+    afs_uint32 p[4];
+};
+
+/* The ring of records belonging to one thread; the records follow it. */
+struct srvtrace_buf {
+    afs_uint32 thread;		/* tid of the thread which last claimed it,
+				 * 0 if unused */
+    afs_uint32 spare;
+    afs_uint64 pos;		/* records ever written to this ring */
+};
+
+/* The start of a trace file, followed by nbufs struct srvtrace_bufs. */
+struct srvtrace_header {
+    afs_uint32 magic;
+    afs_uint32 version;
+    afs_uint32 nbufs;
+    afs_uint32 nrecs;		/* a power of two */
+    afs_uint32 pid;
+    afs_uint32 lostThreads;	/* threads which found no free buffer */
+    afs_uint64 start;		/* when tracing started, in usecs */
+};
+
+#define SRVTRACE_BUFSIZE(nrecs) \
+    (sizeof(struct srvtrace_buf) + (nrecs) * sizeof(struct srvtrace_rec))
+#define SRVTRACE_RECS(tb)	((struct srvtrace_rec *)((tb) + 1))
+
+extern int srvtrace_enabled;
+
+extern int SrvTrace_Open(const char *path);
+extern void SrvTrace_Event(afs_uint32 event, afs_uint32 p1, afs_uint32 p2,
+			   afs_uint32 p3, afs_uint32 p4);
+
+#define SrvTrace4(ev, p1, p2, p3, p4) \
+    do { \
+	if (srvtrace_enabled) \
+	    SrvTrace_Event((ev), (afs_uint32)(p1), (afs_uint32)(p2), \
+			   (afs_uint32)(p3), (afs_uint32)(p4)); \
+    } while (0)
+#define SrvTrace3(ev, p1, p2, p3)	SrvTrace4(ev, p1, p2, p3, 0)
+#define SrvTrace2(ev, p1, p2)		SrvTrace4(ev, p1, p2, 0, 0)
+#define SrvTrace1(ev, p1)		SrvTrace4(ev, p1, 0, 0, 0)
+
+#endif /* AFS_SRC_UTIL_SRVTRACE_H */
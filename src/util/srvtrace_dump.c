@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2026 The OpenAFS Contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR `AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * srvtrace - print a server trace file.
+ *
+ * The events from every thread's ring are merged and printed in time
+ * order.  The file may be read while the server is still writing it.
+ */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+#include <afs/stds.h>
+
+#include <roken.h>
+
+#include "srvtrace.h"
+
+#include "AFS_component_version_number.c"
+
+#define SRVTRACE_EVENT(code, format) format,
+static const char *eventFormats[] = {
+    "unknown event",
+    SRVTRACE_EVENTS
+};
+#undef SRVTRACE_EVENT
+
+/* A record, and where it was in its thread's ring, to keep their order. */
+struct entry {
+    struct srvtrace_rec rec;
+    afs_uint64 pos;
+};
+
+static int
+CompareEntries(const void *a, const void *b)
+{
+    const struct entry *ea = a, *eb = b;
+
+    if (ea->rec.time != eb->rec.time)
+	return ea->rec.time < eb->rec.time ? -1 : 1;
+    if (ea->rec.thread != eb->rec.thread)
+	return ea->rec.thread < eb->rec.thread ? -1 : 1;
+    if (ea->pos != eb->pos)
+	return ea->pos < eb->pos ? -1 : 1;
+    return 0;
+}
+
+static void
+PrintRec(struct srvtrace_rec *rec)
+{
+    time_t secs = rec->time / 1000000;
+    struct tm tm;
+    char tbuf[32];
+    afs_uint32 event = rec->event;
+
+    strftime(tbuf, sizeof(tbuf), "%a %b %d %H:%M:%S",
+	     localtime_r(&secs, &tm));
+    printf("%s.%06u [%u] ", tbuf, (unsigned int)(rec->time % 1000000),
+	   rec->thread);
+    if (event >= SRVT_NEVENTS)
+	event = SRVT_NONE;
+    printf(eventFormats[event], rec->p[0], rec->p[1], rec->p[2], rec->p[3]);
+    if (event == SRVT_NONE)
+	printf(" %u", rec->event);
+    printf("\n");
+}
+
+int
+main(int argc, char **argv)
+{
+    struct srvtrace_header hdr;
+    struct srvtrace_buf *tb;
+    struct entry *entries;
+    char *bufs;
+    size_t bufsize, n, nentries = 0;
+    afs_uint64 first;
+    int fd;
+    afs_uint32 i;
+
+    if (argc != 2) {
+	fprintf(stderr, "usage: %s <trace file>\n", argv[0]);
+	return 1;
+    }
+    fd = open(argv[1], O_RDONLY);
+    if (fd < 0) {
+	fprintf(stderr, "%s: cannot open %s: %s\n", argv[0], argv[1],
+		strerror(errno));
+	return 1;
+    }
+    if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr)
+	|| hdr.magic != SRVTRACE_MAGIC || hdr.version != SRVTRACE_VERSION
+	|| hdr.nrecs == 0 || (hdr.nrecs & (hdr.nrecs - 1)) != 0) {
+	fprintf(stderr, "%s: %s is not a server trace file\n", argv[0],
+		argv[1]);
+	return 1;
+    }
+
+    bufsize = SRVTRACE_BUFSIZE(hdr.nrecs);
+    bufs = malloc(hdr.nbufs * bufsize);
+    entries = malloc(hdr.nbufs * hdr.nrecs * sizeof(*entries));
+    if (bufs == NULL || entries == NULL) {
+	fprintf(stderr, "%s: out of memory\n", argv[0]);
+	return 1;
+    }
+    if (read(fd, bufs, hdr.nbufs * bufsize) != hdr.nbufs * bufsize) {
+	fprintf(stderr, "%s: %s is truncated\n", argv[0], argv[1]);
+	return 1;
+    }
+    close(fd);
+
+    for (i = 0; i < hdr.nbufs; i++) {
+	tb = (struct srvtrace_buf *)(bufs + i * bufsize);
+	if (tb->thread == 0)
+	    break;
+	/* The oldest records have been overwritten once the ring wraps. */
+	first = tb->pos > hdr.nrecs ? tb->pos - hdr.nrecs : 0;
+	for (; first < tb->pos; first++) {
+	    entries[nentries].rec = SRVTRACE_RECS(tb)[first & (hdr.nrecs - 1)];
+	    entries[nentries].pos = first;
+	    nentries++;
+	}
+    }
+    qsort(entries, nentries, sizeof(*entries), CompareEntries);
+
+    printf("Trace of process %u, %u threads", hdr.pid, i);
+    if (hdr.lostThreads)
+	printf(" (%u more not traced)", hdr.lostThreads);
+    printf("\n");
+    for (n = 0; n < nentries; n++)
+	PrintRec(&entries[n].rec);
+    return 0;
+}
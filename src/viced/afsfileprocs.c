@@ -164,6 +164,7 @@ extern afs_int32 dataVersionHigh;
 extern int SystemId;
 static struct AFSCallStatistics AFSCallStats;
 struct fs_stats_FullPerfStats afs_FullPerfStats;
+struct fs_stats_PhaseStats afs_PhaseStats;
 extern int AnonymousID;
 static const char nullString[] = "";
 
@@ -365,6 +366,7 @@ CallPreamble(struct rx_call *acall, int activecall, struct AFSFid *Fid,
     int code = 0;
     char hoststr[16], hoststr2[16];
     struct ubik_client *uclient;
+    struct timeval phaseStart;
     *ahostp = NULL;
 
     if (!tconn) {
@@ -373,11 +375,14 @@ CallPreamble(struct rx_call *acall, int activecall, struct AFSFid *Fid,
     }
     *tconn = rx_ConnectionOf(acall);
 
+    fsstats_QueuePhase(acall);
+    fsstats_StartPhase(&phaseStart);
     H_LOCK;
   retry:
     tclient = h_FindClient_r(*tconn, &viceid);
     if (!tclient) {
 	H_UNLOCK;
+	fsstats_FinishPhase(&phaseStart, FS_STATS_PHASE_HOST);
 	LogClientError("CallPreamble: Couldn't get client", *tconn, viceid, Fid);
 	return VBUSY;
     }
@@ -387,6 +392,7 @@ CallPreamble(struct rx_call *acall, int activecall, struct AFSFid *Fid,
 	    h_ReleaseClient_r(tclient);
 	    h_Release_r(thost);
 	    H_UNLOCK;
+	    fsstats_FinishPhase(&phaseStart, FS_STATS_PHASE_HOST);
 	    LogClientError("CallPreamble: Couldn't get CPS", *tconn, viceid, Fid);
 	    return -1001;
 	}
@@ -414,6 +420,7 @@ CallPreamble(struct rx_call *acall, int activecall, struct AFSFid *Fid,
 	    h_ReleaseClient_r(tclient);
 	    h_Release_r(thost);
 	    H_UNLOCK;
+	    fsstats_FinishPhase(&phaseStart, FS_STATS_PHASE_HOST);
 	    LogClientError("CallPreamble: couldn't reconnect to ptserver", *tconn, viceid, Fid);
 	    return -1001;
 	}
@@ -468,6 +475,7 @@ CallPreamble(struct rx_call *acall, int activecall, struct AFSFid *Fid,
     h_ReleaseClient_r(tclient);
     h_Unlock_r(thost);
     H_UNLOCK;
+    fsstats_FinishPhase(&phaseStart, FS_STATS_PHASE_HOST);
     *ahostp = thost;
     return code;
 
@@ -849,7 +857,9 @@ GetVolumePackageWithCall(struct rx_call *acall, struct VCallByVol *cbv,
     int aCLSize;		/* size of the access list */
     Error errorCode = 0;		/* return code to caller */
     struct rx_connection *tcon = rx_ConnectionOf(acall);
+    struct timeval phaseStart;
 
+    fsstats_StartPhase(&phaseStart);
     if ((errorCode = CheckVnodeWithCall(Fid, volptr, cbv, targetptr, locktype)))
 	goto gvpdone;
 
@@ -901,6 +911,7 @@ GetVolumePackageWithCall(struct rx_call *acall, struct VCallByVol *cbv,
 #endif /* ADMIN_IMPLICIT_LOOKUP */
     }
 gvpdone:
+    fsstats_FinishPhase(&phaseStart, FS_STATS_PHASE_VOLUME);
     return errorCode;
 
 }				/*GetVolumePackage */
@@ -5489,6 +5500,21 @@ SRXAFS_GetXStats(struct rx_call *a_call, afs_int32 a_clientVersionNum,
 	a_dataP->AFS_CollData_val = dataBuffP;
 	break;
 
+    case AFS_XSTATSCOLL_PHASE_INFO:
+	/*
+	 * Pass back the time each RPC spent in each phase.  The phase data
+	 * has no timevals, so its layout is the same on every platform.
+	 */
+	afs_perfstats.numPerfCalls++;
+
+	dataBytes = sizeof(struct fs_stats_PhaseStats);
+	dataBuffP = malloc(dataBytes);
+	FS_LOCK;
+	memcpy(dataBuffP, &afs_PhaseStats, dataBytes);
+	FS_UNLOCK;
+	a_dataP->AFS_CollData_len = dataBytes >> 2;
+	a_dataP->AFS_CollData_val = dataBuffP;
+	break;
 
     default:
 	/*
@@ -6151,6 +6177,7 @@ FetchData_RXStyle(Volume * volptr, Vnode * targetptr,
 		  afs_sfsize_t * a_bytesFetchedP)
 {
     struct timeval StartTime, StopTime;	/* used to calculate file  transfer rates */
+    struct timeval phaseStart;
     IHandle_t *ihP;
     FdHandle_t *fdP;
 #ifndef HAVE_PIOV
@@ -6230,6 +6257,7 @@ FetchData_RXStyle(Volume * volptr, Vnode * targetptr,
 #ifndef HAVE_PIOV
     tbuffer = AllocSendBuffer();
 #endif /* HAVE_PIOV */
+    fsstats_StartPhase(&phaseStart);
     while (Len > 0) {
 	size_t wlen;
 	ssize_t nBytes;
@@ -6239,6 +6267,7 @@ FetchData_RXStyle(Volume * volptr, Vnode * targetptr,
 	    wlen = Len;
 #ifndef HAVE_PIOV
 	nBytes = FDH_PREAD(fdP, tbuffer, wlen, Pos);
+	fsstats_FinishPhase(&phaseStart, FS_STATS_PHASE_DISK);
 	if (nBytes != wlen) {
 	    FDH_CLOSE(fdP);
 	    FreeSendBuffer((struct afs_buffer *)tbuffer);
@@ -6248,14 +6277,17 @@ FetchData_RXStyle(Volume * volptr, Vnode * targetptr,
 	    return EIO;
 	}
 	nBytes = rx_Write(Call, tbuffer, wlen);
+	fsstats_FinishPhase(&phaseStart, FS_STATS_PHASE_NET);
 #else /* HAVE_PIOV */
 	nBytes = rx_WritevAlloc(Call, tiov, &tnio, RX_MAXIOVECS, wlen);
+	fsstats_FinishPhase(&phaseStart, FS_STATS_PHASE_NET);
 	if (nBytes <= 0) {
 	    FDH_CLOSE(fdP);
 	    return EIO;
 	}
 	wlen = nBytes;
 	nBytes = FDH_PREADV(fdP, tiov, tnio, Pos);
+	fsstats_FinishPhase(&phaseStart, FS_STATS_PHASE_DISK);
 	if (nBytes != wlen) {
 	    FDH_CLOSE(fdP);
 	    VTakeOffline(volptr);
@@ -6264,6 +6296,7 @@ FetchData_RXStyle(Volume * volptr, Vnode * targetptr,
 	    return EIO;
 	}
 	nBytes = rx_Writev(Call, tiov, tnio, wlen);
+	fsstats_FinishPhase(&phaseStart, FS_STATS_PHASE_NET);
 #endif /* HAVE_PIOV */
 	Pos += wlen;
 	/*
@@ -6390,6 +6423,7 @@ StoreData_RXStyle(Volume * volptr, Vnode * targetptr, struct AFSFid * Fid,
     FdHandle_t *fdP;
     struct in_addr logHostAddr;	/* host ip holder for inet_ntoa */
     afs_ino_str_t stmp;
+    struct timeval phaseStart;	/* start of the current disk or net phase */
 
     /*
      * Initialize the byte count arguments.
@@ -6548,6 +6582,7 @@ StoreData_RXStyle(Volume * volptr, Vnode * targetptr, struct AFSFid * Fid,
     } else {
 	/* have some data to copy */
 	(*a_bytesToStoreP) = Length;
+	fsstats_StartPhase(&phaseStart);
 	while (1) {
 	    int rlen;
 	    if (bytesTransfered >= Length) {
@@ -6564,6 +6599,7 @@ StoreData_RXStyle(Volume * volptr, Vnode * targetptr, struct AFSFid * Fid,
 #else /* HAVE_PIOV */
 	    errorCode = rx_Readv(Call, tiov, &tnio, RX_MAXIOVECS, rlen);
 #endif /* HAVE_PIOV */
+	    fsstats_FinishPhase(&phaseStart, FS_STATS_PHASE_NET);
 	    if (errorCode <= 0) {
 		errorCode = -32;
 		break;
@@ -6575,6 +6611,7 @@ StoreData_RXStyle(Volume * volptr, Vnode * targetptr, struct AFSFid * Fid,
 #else /* HAVE_PIOV */
 	    nBytes = FDH_PWRITEV(fdP, tiov, tnio, Pos);
 #endif /* HAVE_PIOV */
+	    fsstats_FinishPhase(&phaseStart, FS_STATS_PHASE_DISK);
 	    if (nBytes != rlen) {
 		errorCode = VDISKFULL;
 		break;
@@ -6588,7 +6625,9 @@ StoreData_RXStyle(Volume * volptr, Vnode * targetptr, struct AFSFid * Fid,
     FreeSendBuffer((struct afs_buffer *)tbuffer);
 #endif /* HAVE_PIOV */
     if (sync) {
+	fsstats_StartPhase(&phaseStart);
 	(void) FDH_SYNC(fdP);
+	fsstats_FinishPhase(&phaseStart, FS_STATS_PHASE_DISK);
     }
     if (errorCode) {
 	Error tmp_errorCode = 0;
@@ -98,6 +98,7 @@
 #include <rx/rx_queue.h>
 #include <afs/afscbint.h>
 #include <afs/afsutil.h>
+#include <afs/srvtrace.h>
 #include <afs/ihandle.h>
 #include <afs/partition.h>
 #include <afs/vnode.h>
@@ -886,6 +887,8 @@ BreakCallBack(struct host *xhost, AFSFid * fid, int flag)
 	}
 
 	if (ncbas) {
+	    SrvTrace4(SRVT_BREAK_CALLBACK, fid->Volume, fid->Vnode,
+		      fid->Unique, ncbas);
 	    MultiBreakCallBack_r(cba, ncbas, &tf);
 
 	    /* we need to to all these initializations again because MultiBreakCallBack may block */
@@ -324,6 +324,54 @@ extern struct fs_stats_FullPerfStats afs_FullPerfStats;
  */
 extern struct afs_PerfStats afs_perfstats;
 
+/*
+ * The phases into which the time of each File Server RPC is broken down.
+ * Time not spent in any of these (checking access, breaking callbacks,
+ * putting back the volume and vnodes) is the rest of the call's total.
+ */
+#define FS_STATS_PHASE_QUEUE		0	/*Waiting in Rx for a thread */
+#define FS_STATS_PHASE_HOST		1	/*Finding and locking the host */
+#define FS_STATS_PHASE_VOLUME		2	/*Getting the volume and vnodes */
+#define FS_STATS_PHASE_DISK		3	/*Reading and writing file data */
+#define FS_STATS_PHASE_NET		4	/*Sending and receiving file data */
+
+#define FS_STATS_NUM_PHASES		5
+
+/*
+ * A time value which has the same size on every platform, so the phase
+ * data can be passed back as is.
+ */
+struct fs_stats_phaseTime {
+    afs_int32 tv_sec;
+    afs_int32 tv_usec;
+};
+
+/*
+ * Record to track how long each File Server RPC operation spent in each
+ * phase.  Unlike fs_stats_opTimingData, failed operations are counted.
+ */
+struct fs_stats_phaseData {
+    afs_int32 numOps;		/*Number of operations timed */
+    struct fs_stats_phaseTime totalTime;	/*Sum of whole call times */
+    struct fs_stats_phaseTime
+      sumTime[FS_STATS_NUM_PHASES];	/*Sum of time in each phase */
+    struct fs_stats_phaseTime
+      maxTime[FS_STATS_NUM_PHASES];	/*Longest time in each phase */
+};
+
+/*
+ * This is the structure accessible by specifying the
+ * AFS_XSTATSCOLL_PHASE_INFO collection to the xstat package.
+ */
+struct fs_stats_PhaseStats {
+    afs_int32 epoch;		/*Time when data collection began */
+    afs_int32 numPhases;	/*FS_STATS_NUM_PHASES */
+    struct fs_stats_phaseData
+      rpcOpPhases[FS_STATS_NUM_RPC_OPS];	/*Phase timings for each RPC */
+};
+
+extern struct fs_stats_PhaseStats afs_PhaseStats;
+
 /*
   * FileServer's name and IP address, both network byte order and
   * host byte order.
@@ -345,5 +393,9 @@ extern void fsstats_FinishOp(struct fsstats *stats, int code);
 extern void fsstats_StartXfer(struct fsstats *stats, int index);
 extern void fsstats_FinishXfer(struct fsstats *, int, afs_sfsize_t,
 			       afs_sfsize_t, int *);
+extern void fsstats_StartPhase(struct timeval *start);
+extern void fsstats_FinishPhase(struct timeval *start, int phase);
+extern void fsstats_QueuePhase(struct rx_call *call);
+extern void fsstats_PrintMetrics(FILE *out, void *rock);
 
 #endif /* __fs_stats_h */
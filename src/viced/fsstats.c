@@ -17,22 +17,137 @@
 
 #include <afs/opr.h>
 #include <opr/lock.h>
+#include <afs/nfs.h>
+#include <rx/rx.h>
+#include <rx/rx_queue.h>
+#include <lock.h>
 #include <afs/afsint.h>
 #include <afs/ihandle.h>
-#include <afs/nfs.h>
+#include <afs/vnode.h>
+#include <afs/volume.h>
+#include <afs/dir.h>
+#include <afs/srvtrace.h>
+#include <afs/srvmetrics.h>
 #include "viced.h"
+#include <afs/ptclient.h>	/* need definition of prlist for host.h */
+#include "host.h"
+#include "callback.h"
 #include "fs_stats.h"
 
+extern int CEs, HTs;
+
+/* Names of the RPCs, indexed by FS_STATS_RPCIDX_*. */
+static const char *fsstats_opNames[FS_STATS_NUM_RPC_OPS] = {
+    "FetchData", "FetchACL", "FetchStatus", "StoreData", "StoreACL",
+    "StoreStatus", "RemoveFile", "CreateFile", "Rename", "Symlink",
+    "Link", "MakeDir", "RemoveDir", "SetLock", "ExtendLock",
+    "ReleaseLock", "GetStatistics", "GiveUpCallbacks", "GetVolumeInfo",
+    "GetVolumeStatus", "SetVolumeStatus", "GetRootVolume", "CheckToken",
+    "GetTime", "NGetVolumeInfo", "BulkStatus", "XStatsVersion",
+    "GetXStats"
+};
+
+/* Names of the transfer RPCs, indexed by FS_STATS_XFERIDX_*. */
+static const char *fsstats_xferNames[FS_STATS_NUM_XFER_OPS] = {
+    "FetchData", "StoreData"
+};
+
+/* Names of the phases of an RPC, indexed by FS_STATS_PHASE_*. */
+static const char *fsstats_phaseNames[FS_STATS_NUM_PHASES] = {
+    "queue", "host", "volume", "disk", "net"
+};
+
+/*
+ * The time the RPC each thread is running has spent in each phase so far.
+ * The phases are timed in functions which don't have the RPC's struct
+ * fsstats, so they are kept per thread rather than in it.
+ */
+struct fsstats_thread {
+    int index;			/* FS_STATS_RPCIDX_* of the RPC, or -1 */
+    struct timeval phaseTime[FS_STATS_NUM_PHASES];
+};
+
+static pthread_key_t fsstats_key;
+static pthread_once_t fsstats_once = PTHREAD_ONCE_INIT;
+
+static void
+fsstats_InitKey(void)
+{
+    opr_Verify(pthread_key_create(&fsstats_key, free) == 0);
+}
+
+static struct fsstats_thread *
+fsstats_GetThread(void)
+{
+    struct fsstats_thread *ts;
+
+    opr_Verify(pthread_once(&fsstats_once, fsstats_InitKey) == 0);
+    ts = pthread_getspecific(fsstats_key);
+    if (ts == NULL) {
+	ts = calloc(1, sizeof(*ts));
+	if (ts == NULL)
+	    return NULL;
+	ts->index = -1;
+	opr_Verify(pthread_setspecific(fsstats_key, ts) == 0);
+    }
+    return ts;
+}
+
+static void
+fsstats_AddPhase(int phase, struct timeval *elapsed)
+{
+    struct fsstats_thread *ts;
+
+    opr_Verify(pthread_once(&fsstats_once, fsstats_InitKey) == 0);
+    ts = pthread_getspecific(fsstats_key);
+    if (ts != NULL && ts->index >= 0)
+	fs_stats_AddTo(ts->phaseTime[phase], (*elapsed));
+}
+
+/* Add the phase times of the RPC which has just finished to its totals. */
+static void
+fsstats_FinishPhases(int index, struct timeval *elapsed)
+{
+    struct fsstats_thread *ts;
+    struct fs_stats_phaseData *phP;
+    int i;
+
+    ts = pthread_getspecific(fsstats_key);
+    if (ts == NULL || ts->index != index)
+	return;
+    ts->index = -1;
+
+    phP = &afs_PhaseStats.rpcOpPhases[index];
+    FS_LOCK;
+    phP->numOps++;
+    fs_stats_AddTo(phP->totalTime, (*elapsed));
+    for (i = 0; i < FS_STATS_NUM_PHASES; i++) {
+	fs_stats_AddTo(phP->sumTime[i], ts->phaseTime[i]);
+	if (fs_stats_TimeGreaterThan(ts->phaseTime[i], phP->maxTime[i])) {
+	    fs_stats_TimeAssign(phP->maxTime[i], ts->phaseTime[i]);
+	}
+    }
+    FS_UNLOCK;
+}
+
 
 void
 fsstats_StartOp(struct fsstats *stats, int index)
 {
+    struct fsstats_thread *ts;
+
     assert(index >= 0 && index < FS_STATS_NUM_RPC_OPS);
     stats->opP = &(afs_FullPerfStats.det.rpcOpTimes[index]);
     FS_LOCK;
     (stats->opP->numOps)++;
     FS_UNLOCK;
+    ts = fsstats_GetThread();
+    if (ts != NULL) {
+	ts->index = index;
+	memset(ts->phaseTime, 0, sizeof(ts->phaseTime));
+    }
     gettimeofday(&stats->opStartTime, NULL);
+    SrvTrace1(SRVT_FS_RPC_START, index);
 }
 
 void
@@ -41,10 +156,12 @@ fsstats_FinishOp(struct fsstats *stats, int code)
     struct timeval opStopTime, elapsedTime;
 
     gettimeofday(&opStopTime, NULL);
+    fs_stats_GetDiff(elapsedTime, stats->opStartTime, opStopTime);
+    fsstats_FinishPhases(stats->opP - afs_FullPerfStats.det.rpcOpTimes,
+			 &elapsedTime);
     if (code == 0) {
 	FS_LOCK;
 	(stats->opP->numSuccesses)++;
-	fs_stats_GetDiff(elapsedTime, stats->opStartTime, opStopTime);
 	fs_stats_AddTo((stats->opP->sumTime), elapsedTime);
 	fs_stats_SquareAddTo((stats->opP->sqrTime), elapsedTime);
 	if (fs_stats_TimeLessThan(elapsedTime, (stats->opP->minTime))) {
@@ -55,6 +172,62 @@ fsstats_FinishOp(struct fsstats *stats, int code)
 	}
 	FS_UNLOCK;
     }
+    if (srvtrace_enabled) {
+	SrvTrace3(SRVT_FS_RPC_END,
+		  stats->opP - afs_FullPerfStats.det.rpcOpTimes, code,
+		  elapsedTime.tv_sec * 1000000 + elapsedTime.tv_usec);
+    }
+}
+
+/*!
+ * Start timing a phase of the current RPC.
+ *
+ * \param[out] start  the time the phase started
+ */
+void
+fsstats_StartPhase(struct timeval *start)
+{
+    gettimeofday(start, NULL);
+}
+
+/*!
+ * Add the time since a phase started to the current RPC's time in it.
+ *
+ * The start time is then reset, so back to back phases, such as the disk
+ * reads and network writes of a fetch, need no new call to
+ * fsstats_StartPhase.
+ *
+ * \param[inout] start  the time the phase started
+ * \param[in]    phase  FS_STATS_PHASE_*
+ */
+void
+fsstats_FinishPhase(struct timeval *start, int phase)
+{
+    struct timeval now, stop, elapsed;
+
+    opr_Assert(phase >= 0 && phase < FS_STATS_NUM_PHASES);
+    gettimeofday(&now, NULL);
+    stop = now;
+    fs_stats_GetDiff(elapsed, (*start), stop);
+    fsstats_AddPhase(phase, &elapsed);
+    *start = now;
+}
+
+/*!
+ * Record how long an Rx call waited for a thread to run it.
+ *
+ * \param[in] call  the current RPC's call
+ */
+void
+fsstats_QueuePhase(struct rx_call *call)
+{
+    struct clock queue;
+    struct timeval elapsed;
+
+    rx_GetCallQueueTime(call, &queue);
+    elapsed.tv_sec = queue.sec;
+    elapsed.tv_usec = queue.usec;
+    fsstats_AddPhase(FS_STATS_PHASE_QUEUE, &elapsed);
 }
 
 void
@@ -132,3 +305,198 @@ fsstats_FinishXfer(struct fsstats *stats, int code,
     }
     FS_UNLOCK;
 }
+
+/*
+ * Print the RPC counts and times kept for xstat, as metrics.
+ */
+static void
+PrintOpMetrics(FILE *out)
+{
+    struct fs_stats_DetailedStats det;
+    struct fs_stats_PhaseStats phases;
+    struct timeval tv;
+    char label[64];
+    int i, phase;
+
+    FS_LOCK;
+    memcpy(&det, &afs_FullPerfStats.det, sizeof(det));
+    FS_UNLOCK;
+
+    SrvMetrics_Family(out, "openafs_fileserver_rpc_total", SRVMETRICS_COUNTER,
+		      "RPCs started, by RPC.");
+    for (i = 0; i < FS_STATS_NUM_RPC_OPS; i++) {
+	snprintf(label, sizeof(label), "op=\"%s\"", fsstats_opNames[i]);
+	SrvMetrics_Value(out, "openafs_fileserver_rpc_total", label,
+			 (afs_uint32)det.rpcOpTimes[i].numOps);
+    }
+    SrvMetrics_Family(out, "openafs_fileserver_rpc_successes_total",
+		      SRVMETRICS_COUNTER, "RPCs which succeeded, by RPC.");
+    for (i = 0; i < FS_STATS_NUM_RPC_OPS; i++) {
+	snprintf(label, sizeof(label), "op=\"%s\"", fsstats_opNames[i]);
+	SrvMetrics_Value(out, "openafs_fileserver_rpc_successes_total", label,
+			 (afs_uint32)det.rpcOpTimes[i].numSuccesses);
+    }
+    SrvMetrics_Family(out, "openafs_fileserver_rpc_seconds_total",
+		      SRVMETRICS_COUNTER,
+		      "Time spent in RPCs which succeeded, by RPC.");
+    for (i = 0; i < FS_STATS_NUM_RPC_OPS; i++) {
+	snprintf(label, sizeof(label), "op=\"%s\"", fsstats_opNames[i]);
+	SrvMetrics_Seconds(out, "openafs_fileserver_rpc_seconds_total", label,
+			   &det.rpcOpTimes[i].sumTime);
+    }
+
+    SrvMetrics_Family(out, "openafs_fileserver_xfer_total",
+		      SRVMETRICS_COUNTER, "Data transfers, by RPC.");
+    for (i = 0; i < FS_STATS_NUM_XFER_OPS; i++) {
+	snprintf(label, sizeof(label), "op=\"%s\"", fsstats_xferNames[i]);
+	SrvMetrics_Value(out, "openafs_fileserver_xfer_total", label,
+			 (afs_uint32)det.xferOpTimes[i].numXfers);
+    }
+    SrvMetrics_Family(out, "openafs_fileserver_xfer_bytes_total",
+		      SRVMETRICS_COUNTER,
+		      "Bytes moved by data transfers which succeeded, by RPC, "
+		      "to the kilobyte.");
+    for (i = 0; i < FS_STATS_NUM_XFER_OPS; i++) {
+	snprintf(label, sizeof(label), "op=\"%s\"", fsstats_xferNames[i]);
+	SrvMetrics_Value(out, "openafs_fileserver_xfer_bytes_total", label,
+			 (afs_uint64)(afs_uint32)det.xferOpTimes[i].sumBytes
+			 * 1024);
+    }
+
+    FS_LOCK;
+    memcpy(&phases, &afs_PhaseStats, sizeof(phases));
+    FS_UNLOCK;
+
+    SrvMetrics_Family(out, "openafs_fileserver_rpc_phase_seconds_total",
+		      SRVMETRICS_COUNTER,
+		      "Time spent in each phase of RPCs, by RPC and phase.");
+    for (i = 0; i < FS_STATS_NUM_RPC_OPS; i++) {
+	for (phase = 0; phase < FS_STATS_NUM_PHASES; phase++) {
+	    snprintf(label, sizeof(label), "op=\"%s\",phase=\"%s\"",
+		     fsstats_opNames[i], fsstats_phaseNames[phase]);
+	    tv.tv_sec = phases.rpcOpPhases[i].sumTime[phase].tv_sec;
+	    tv.tv_usec = phases.rpcOpPhases[i].sumTime[phase].tv_usec;
+	    SrvMetrics_Seconds(out,
+			       "openafs_fileserver_rpc_phase_seconds_total",
+			       label, &tv);
+	}
+    }
+}
+
+/*!
+ * Metrics collector for the fileserver.
+ *
+ * Prints the counters the fileserver reports through xstat and rxdebug,
+ * as metrics.  Nothing here is counted specially for the metrics, so the
+ * RPCs pay nothing for them.
+ */
+void
+fsstats_PrintMetrics(FILE *out, void *rock)
+{
+    afs_int32 hosts, sameNet, diffSubnet, diffNet;
+    int dirBuffers, dirCalls, dirIOs;
+    char label[32];
+    int i;
+#ifdef AFS_DEMAND_ATTACH_FS
+    static const char *vlruNames[VLRU_QUEUE_INVALID] = {
+	"new", "mid", "old", "candidate", "held"
+    };
+    afs_uint32 vlru[VLRU_QUEUE_INVALID];
+#endif
+
+    PrintOpMetrics(out);
+    SrvMetrics_Counter(out, "openafs_fileserver_busies_total",
+		       "VBUSY errors returned during restarts and volume clones.",
+		       (afs_uint32)afs_perfstats.fs_nBusies);
+
+    /* Callbacks. */
+    SrvMetrics_Gauge(out, "openafs_fileserver_callbacks",
+		     "Callbacks held by clients.", cbstuff.nCBs);
+    SrvMetrics_Gauge(out, "openafs_fileserver_callback_files",
+		     "Files on which clients hold callbacks.", cbstuff.nFEs);
+    SrvMetrics_Gauge(out, "openafs_fileserver_callback_limit",
+		     "Callbacks which can be held at once.", cbstuff.nblks);
+    SrvMetrics_Counter(out, "openafs_fileserver_callbacks_added_total",
+		       "Callbacks granted.", (afs_uint32)cbstuff.AddCallBacks);
+    SrvMetrics_Counter(out, "openafs_fileserver_callbacks_broken_total",
+		       "Callback breaks.", (afs_uint32)cbstuff.BreakCallBacks);
+    SrvMetrics_Counter(out, "openafs_fileserver_callbacks_deleted_total",
+		       "Callbacks given up by clients.",
+		       (afs_uint32)cbstuff.DeleteCallBacks);
+    SrvMetrics_Counter(out, "openafs_fileserver_callbacks_timed_out_total",
+		       "Callbacks which expired.",
+		       (afs_uint32)cbstuff.CBsTimedOut);
+    SrvMetrics_Counter(out, "openafs_fileserver_callback_space_reclaims_total",
+		       "Times callbacks were revoked to make room for more.",
+		       (afs_uint32)cbstuff.GotSomeSpaces);
+    SrvMetrics_Gauge(out, "openafs_fileserver_callback_breakers",
+		     "Threads breaking callbacks.", cbstuff.nbreakers);
+
+    /* Hosts and clients. */
+    h_GetHostNetStats(&hosts, &sameNet, &diffSubnet, &diffNet);
+    SrvMetrics_Gauge(out, "openafs_fileserver_hosts",
+		     "Client hosts known to the server.", hosts);
+    SrvMetrics_Gauge(out, "openafs_fileserver_host_entries",
+		     "Host entries allocated.", HTs);
+    SrvMetrics_Gauge(out, "openafs_fileserver_clients",
+		     "Client entries, one for each authenticated user.", CEs);
+
+    /* Vnode, volume header and directory caches. */
+    SrvMetrics_Family(out, "openafs_fileserver_vnode_gets_total",
+		      SRVMETRICS_COUNTER, "Vnode lookups, by vnode class.");
+    for (i = 0; i < nVNODECLASSES; i++) {
+	snprintf(label, sizeof(label), "class=\"%s\"",
+		 i == vLarge ? "large" : "small");
+	SrvMetrics_Value(out, "openafs_fileserver_vnode_gets_total", label,
+			 (afs_uint32)VnodeClassInfo[i].gets);
+    }
+    SrvMetrics_Family(out, "openafs_fileserver_vnode_reads_total",
+		      SRVMETRICS_COUNTER,
+		      "Vnode lookups which missed the cache, by vnode class.");
+    for (i = 0; i < nVNODECLASSES; i++) {
+	snprintf(label, sizeof(label), "class=\"%s\"",
+		 i == vLarge ? "large" : "small");
+	SrvMetrics_Value(out, "openafs_fileserver_vnode_reads_total", label,
+			 (afs_uint32)VnodeClassInfo[i].reads);
+    }
+    SrvMetrics_Family(out, "openafs_fileserver_vnode_writes_total",
+		      SRVMETRICS_COUNTER, "Vnodes written, by vnode class.");
+    for (i = 0; i < nVNODECLASSES; i++) {
+	snprintf(label, sizeof(label), "class=\"%s\"",
+		 i == vLarge ? "large" : "small");
+	SrvMetrics_Value(out, "openafs_fileserver_vnode_writes_total", label,
+			 (afs_uint32)VnodeClassInfo[i].writes);
+    }
+    SrvMetrics_Counter(out, "openafs_fileserver_volume_header_gets_total",
+		       "Volume header lookups.", VStats.hdr_gets);
+    SrvMetrics_Counter(out, "openafs_fileserver_volume_header_loads_total",
+		       "Volume headers read from disk.", VStats.hdr_loads);
+    SrvMetrics_Counter(out, "openafs_fileserver_volume_attaches_total",
+		       "Volumes attached.", VStats.attaches);
+    SrvMetrics_Counter(out, "openafs_fileserver_volume_soft_detaches_total",
+		       "Volumes detached for being idle.",
+		       VStats.soft_detaches);
+#ifdef AFS_DEMAND_ATTACH_FS
+    SrvMetrics_Counter(out, "openafs_fileserver_volume_salvages_total",
+		       "Volumes salvaged while the server ran.",
+		       VStats.salvages);
+    VLRU_GetQueueLengths(vlru);
+    SrvMetrics_Family(out, "openafs_fileserver_vlru_volumes",
+		      SRVMETRICS_GAUGE,
+		      "Volumes on each queue of the volume LRU.");
+    for (i = 0; i < VLRU_QUEUE_INVALID; i++) {
+	snprintf(label, sizeof(label), "queue=\"%s\"", vlruNames[i]);
+	SrvMetrics_Value(out, "openafs_fileserver_vlru_volumes", label,
+			 vlru[i]);
+    }
+#endif
+    DStat(&dirBuffers, &dirCalls, &dirIOs);
+    SrvMetrics_Gauge(out, "openafs_fileserver_dir_buffers",
+		     "Directory buffers.", dirBuffers);
+    SrvMetrics_Counter(out, "openafs_fileserver_dir_reads_total",
+		       "Directory page lookups.", (afs_uint32)dirCalls);
+    SrvMetrics_Counter(out, "openafs_fileserver_dir_ios_total",
+		       "Directory pages read from disk.", (afs_uint32)dirIOs);
+
+    rx_PrintMetrics(out);
+}
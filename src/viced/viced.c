@@ -69,6 +69,8 @@
 #include <afs/fileutil.h>
 #include <afs/ptuser.h>
 #include <afs/audit.h>
+#include <afs/srvtrace.h>
+#include <afs/srvmetrics.h>
 #include <afs/partition.h>
 #include <afs/dir.h>
 #include <afs/afsutil.h>
@@ -165,6 +167,10 @@ int saneacls = 0;		/* Sane ACLs Flag */
 static int unsafe_attach = 0;   /* avoid inUse check on vol attach? */
 static int offline_timeout = -1; /* -offline-timeout option */
 static int offline_shutdown_timeout = -1; /* -offline-shutdown-timeout option */
+static char *metricsFile = NULL;	/* -metrics option */
+static int minThreads = 0;		/* -minthreads option */
+static int threadIdleTime = 60;		/* -thread-idle-time option */
+static int threadWaitTarget = 50;	/* -thread-wait-target option */
 
 struct timeval tp;
 
@@ -591,6 +597,8 @@ ClearXStatValues(void)
     memset((&afs_perfstats), 0, sizeof(struct afs_PerfStats));
     memset((&afs_FullPerfStats), 0,
 	   sizeof(struct fs_stats_FullPerfStats));
+    memset((&afs_PhaseStats), 0, sizeof(struct fs_stats_PhaseStats));
+    afs_PhaseStats.numPhases = FS_STATS_NUM_PHASES;
 
     /*
      * That's not enough.  We have to set reasonable minima for
@@ -924,11 +932,18 @@ enum optionsList {
     OPT_novbc,
     OPT_auditlog,
     OPT_auditiface,
+    OPT_srvtrace,
+    OPT_metrics,
     OPT_config,
     OPT_debug,
     OPT_logfile,
     OPT_mrafslogs,
+    OPT_buffered_logs,
+    OPT_log_format,
     OPT_threads,
+    OPT_minthreads,
+    OPT_thread_idle_time,
+    OPT_thread_wait_target,
 #ifdef HAVE_SYSLOG
     OPT_syslog,
 #endif
@@ -1079,14 +1094,30 @@ ParseArgs(int argc, char *argv[])
 		    	CMD_OPTIONAL, "location of audit log");
     cmd_AddParmAtOffset(opts, OPT_auditiface, "-audit-interface", CMD_SINGLE,
 			CMD_OPTIONAL, "interface to use for audit logging");
+    cmd_AddParmAtOffset(opts, OPT_srvtrace, "-srvtrace", CMD_SINGLE,
+			CMD_OPTIONAL, "location of binary trace file");
+    cmd_AddParmAtOffset(opts, OPT_metrics, "-metrics", CMD_SINGLE,
+			CMD_OPTIONAL, "location of metrics file");
     cmd_AddParmAtOffset(opts, OPT_debug, "-d", CMD_SINGLE, CMD_OPTIONAL,
 			"debug level");
     cmd_AddParmAtOffset(opts, OPT_mrafslogs, "-mrafslogs", CMD_FLAG,
 			CMD_OPTIONAL, "enable MRAFS style logging");
     cmd_AddParmAtOffset(opts, OPT_transarc_logs, "-transarc-logs", CMD_FLAG,
 			CMD_OPTIONAL, "enable Transarc style logging");
+    cmd_AddParmAtOffset(opts, OPT_buffered_logs, "-buffered-logs", CMD_FLAG,
+			CMD_OPTIONAL, "write log messages from a background thread");
+    cmd_AddParmAtOffset(opts, OPT_log_format, "-log-format", CMD_SINGLE,
+			CMD_OPTIONAL, "plain | keyvalue");
     cmd_AddParmAtOffset(opts, OPT_threads, "-p", CMD_SINGLE, CMD_OPTIONAL,
 		        "number of threads");
+    cmd_AddParmAtOffset(opts, OPT_minthreads, "-minthreads", CMD_SINGLE,
+			CMD_OPTIONAL, "fewest threads to keep running");
+    cmd_AddParmAtOffset(opts, OPT_thread_idle_time, "-thread-idle-time",
+			CMD_SINGLE, CMD_OPTIONAL,
+			"seconds an extra thread may be idle");
+    cmd_AddParmAtOffset(opts, OPT_thread_wait_target, "-thread-wait-target",
+			CMD_SINGLE, CMD_OPTIONAL,
+			"milliseconds a call may wait for a thread");
 #ifdef HAVE_SYSLOG
     cmd_AddParmAtOffset(opts, OPT_syslog, "-syslog", CMD_SINGLE_OR_FLAG,
 			CMD_OPTIONAL, "log to syslog");
@@ -1322,6 +1353,19 @@ ParseArgs(int argc, char *argv[])
 	optstring = NULL;
     }
 
+    if (cmd_OptionAsString(opts, OPT_srvtrace, &optstring) == 0) {
+	code = SrvTrace_Open(optstring);
+	if (code) {
+	    printf("Unable to open trace file '%s': %s\n", optstring,
+		   strerror(code));
+	    return -1;
+	}
+	free(optstring);
+	optstring = NULL;
+    }
+
+    cmd_OptionAsString(opts, OPT_metrics, &metricsFile);
+
     if (cmd_OptionAsInt(opts, OPT_threads, &lwps) == 0) {
 	lwps_max = max_fileserver_thread() - FILESERVER_HELPER_THREADS;
 	if (lwps > lwps_max)
@@ -1329,6 +1373,15 @@ ParseArgs(int argc, char *argv[])
 	else if (lwps <6)
 	    lwps = 6;
     }
+    if (cmd_OptionAsInt(opts, OPT_minthreads, &minThreads) == 0
+	&& minThreads < 6)
+	minThreads = 6;
+    cmd_OptionAsInt(opts, OPT_thread_idle_time, &threadIdleTime);
+    cmd_OptionAsInt(opts, OPT_thread_wait_target, &threadWaitTarget);
+    if (threadIdleTime < 1 || threadWaitTarget < 0) {
+	printf("Invalid thread idle time or wait target\n");
+	return -1;
+    }
 
     /* Logging options. */
 #ifdef HAVE_SYSLOG
@@ -1345,6 +1398,14 @@ ParseArgs(int argc, char *argv[])
 	    fprintf(stderr, "Invalid options: -syslog and -mrafslogs are exclusive.\n");
 	    return -1;
 	}
+	if (cmd_OptionPresent(opts, OPT_buffered_logs)) {
+	    fprintf(stderr, "Invalid options: -syslog and -buffered-logs are exclusive.\n");
+	    return -1;
+	}
+	if (cmd_OptionPresent(opts, OPT_log_format)) {
+	    fprintf(stderr, "Invalid options: -syslog and -log-format are exclusive.\n");
+	    return -1;
+	}
 
 	logopts.lopt_dest = logDest_syslog;
 	logopts.lopt_facility = LOG_DAEMON;
@@ -1373,7 +1434,20 @@ ParseArgs(int argc, char *argv[])
 	    cmd_OptionAsString(opts, OPT_logfile, (char**)&logopts.lopt_filename);
 	else
 	    logopts.lopt_filename = AFSDIR_SERVER_FILELOG_FILEPATH;
-
+	if (cmd_OptionAsFlag(opts, OPT_buffered_logs, &optval) == 0)
+	    logopts.lopt_buffered = optval;
+	if (cmd_OptionAsString(opts, OPT_log_format, &optstring) == 0) {
+	    if (strcmp(optstring, "plain") == 0)
+		logopts.lopt_format = logFormat_plain;
+	    else if (strcmp(optstring, "keyvalue") == 0)
+		logopts.lopt_format = logFormat_keyvalue;
+	    else {
+		fprintf(stderr, "Invalid log format '%s'\n", optstring);
+		return -1;
+	    }
+	    free(optstring);
+	    optstring = NULL;
+	}
     }
     cmd_OptionAsInt(opts, OPT_debug, &logopts.lopt_logLevel);
 
@@ -1471,6 +1545,13 @@ Die(const char *msg)
 }				/*Die */
 
 
+/* Close the ptserver connection of a server thread which exits. */
+static void
+FreeThreadClient(void *rock)
+{
+    hpr_End(rock);
+}
+
 afs_int32
 InitPR(void)
 {
@@ -1487,7 +1568,7 @@ InitPR(void)
 	return code;
     }
 
-    opr_Verify(pthread_key_create(&viced_uclient_key, NULL) == 0);
+    opr_Verify(pthread_key_create(&viced_uclient_key, FreeThreadClient) == 0);
 
     SystemId = SYSADMINID;
     SystemAnyUser = ANYUSERID;
@@ -2051,6 +2132,9 @@ main(int argc, char *argv[])
     rx_SetMinProcs(tservice, 2);
     rx_SetMaxProcs(tservice, 4);
 
+    if (minThreads > 0)
+	rx_SetServerThreadPool(minThreads, threadIdleTime, threadWaitTarget);
+
     /* Some rx debugging */
     if (rxlog || eventlog) {
 	debugFile = afs_fopen("rx_dbg", "w");
@@ -2137,6 +2221,12 @@ main(int argc, char *argv[])
 	opts.interrupt_rxcall = rx_InterruptCall;
 	opts.offline_shutdown_timeout = offline_shutdown_timeout;
     }
+#ifdef AFS_DEMAND_ATTACH_FS
+    /* the attach index is saved and restored along with the fileserver
+     * state */
+    opts.attach_index_save = fs_state.options.fs_state_save;
+    opts.attach_index_restore = fs_state.options.fs_state_restore;
+#endif
 
     if (VInitVolumePackage2(fileServer, &opts)) {
 	ViceLog(0,
@@ -2215,7 +2305,16 @@ main(int argc, char *argv[])
     strftime(tbuffer, sizeof(tbuffer), "%a %b %d %H:%M:%S %Y",
 	     localtime_r(&t, &tm));
     ViceLog(0, ("File Server started %s\n", tbuffer));
+    if (metricsFile != NULL) {
+	code = SrvMetrics_AddCollector(fsstats_PrintMetrics, NULL);
+	if (code == 0)
+	    code = SrvMetrics_Open(metricsFile);
+	if (code != 0)
+	    ViceLog(0, ("Unable to write metrics file %s: %s\n",
+			metricsFile, strerror(code)));
+    }
     afs_FullPerfStats.det.epoch.tv_sec = StartTime = tp.tv_sec;
+    afs_PhaseStats.epoch = StartTime;
     while (1) {
 	sleep(1000);		/* long time */
     }
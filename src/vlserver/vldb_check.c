@@ -28,6 +28,7 @@
 #define VL  0x001		/* good volume entry */
 #define FR  0x002		/* free volume entry */
 #define MH  0x004		/* multi-homed entry */
+#define HB  0x008		/* extended hash table block */
 
 #define RWH 0x010		/* on rw hash chain */
 #define ROH 0x020		/* on ro hash chain */
@@ -82,6 +83,13 @@ int serveraddrs[MAXSERVERID + 2];
 u_char serverxref[MAXSERVERID + 2];  /**< to resolve cross-linked mh entries */
 int serverref[MAXSERVERID + 2];      /**< which addrs are referenced by vl entries */
 
+/* The hash tables, in host byte order.  These are copies of the tables in
+ * the header, or of the extended hash table block of a version 5 vldb. */
+afs_uint32 hashsize = HASHSIZE;		/**< buckets in each hash table */
+afs_uint32 hashaddr = 0;		/**< extended hash table block, if any */
+afs_uint32 *volnameHash;
+afs_uint32 *volidHash[MAXTYPES];
+
 struct mhinfo {
     afs_uint32 addr;			/**< vldb file record */
     char orphan[VL_MHSRV_PERBLK];	/**< unreferenced mh enties */
@@ -207,13 +215,13 @@ NameHash(char *volname)
     hash = 0;
     for (vchar = volname + strlen(volname) - 1; vchar >= volname; vchar--)
 	hash = (hash * 63) + (*((unsigned char *)vchar) - 63);
-    return (hash % HASHSIZE);
+    return (hash % hashsize);
 }
 
 afs_int32
 IdHash(afs_uint32 volid)
 {
-    return (volid % HASHSIZE);
+    return (volid % hashsize);
 }
 
 #define LEGALCHARS ".ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"
@@ -246,6 +254,81 @@ validVolumeAddr(afs_uint32 fileOffset)
     return 1;
 }
 
+/*
+ * Read the hash tables, either from the header or, for a version 5 vldb,
+ * from the extended hash table block named by the first mh block.
+ */
+void
+readhashtables(struct vlheader *headerp)
+{
+    struct extentaddr mhheader;
+    afs_uint32 i, j;
+
+    hashaddr = 0;
+    hashsize = HASHSIZE;
+    if (headerp->vital_header.vldbversion == VLDBVERSION_5) {
+	if (!headerp->SIT) {
+	    log_error(VLDB_CHECK_ERROR,"Version 5 vldb has no multihome info; using the header hash tables\n");
+	} else if (vldbread(headerp->SIT, (char *)&mhheader, sizeof(mhheader)) == 0) {
+	    hashaddr = ntohl(mhheader.ex_hashtable);
+	    hashsize = ntohl(mhheader.ex_hashsize);
+	    if (!hashaddr || hashaddr >= headerp->vital_header.eofPtr
+		|| hashsize < HASHSIZE || hashsize > VL_MAXHASHSIZE) {
+		log_error(VLDB_CHECK_ERROR,"Invalid hash table block %u (size %u); using the header hash tables\n",
+			  hashaddr, hashsize);
+		hashaddr = 0;
+		hashsize = HASHSIZE;
+	    }
+	}
+    }
+
+    volnameHash = calloc(hashsize, sizeof(afs_uint32));
+    for (i = 0; i < MAXTYPES; i++)
+	volidHash[i] = calloc(hashsize, sizeof(afs_uint32));
+    if (hashaddr) {
+	for (i = 0; i < MAXTYPES; i++)
+	    vldbread(VL_HASHBUCKET_OFFSET(hashaddr, hashsize, i, 0),
+		     (char *)volidHash[i], hashsize * sizeof(afs_uint32));
+	vldbread(VL_HASHBUCKET_OFFSET(hashaddr, hashsize, VL_NAMEHASH, 0),
+		 (char *)volnameHash, hashsize * sizeof(afs_uint32));
+	for (i = 0; i < hashsize; i++) {
+	    volnameHash[i] = ntohl(volnameHash[i]);
+	    for (j = 0; j < MAXTYPES; j++)
+		volidHash[j][i] = ntohl(volidHash[j][i]);
+	}
+    } else {
+	memcpy(volnameHash, headerp->VolnameHash, sizeof(headerp->VolnameHash));
+	for (i = 0; i < MAXTYPES; i++)
+	    memcpy(volidHash[i], headerp->VolidHash[i],
+		   sizeof(headerp->VolidHash[i]));
+    }
+}
+
+/* Write the hash tables back to wherever readhashtables found them */
+void
+writehashtables(struct vlheader *headerp)
+{
+    afs_uint32 *buffer;
+    afs_uint32 i, j;
+
+    if (!hashaddr) {
+	memcpy(headerp->VolnameHash, volnameHash, sizeof(headerp->VolnameHash));
+	for (i = 0; i < MAXTYPES; i++)
+	    memcpy(headerp->VolidHash[i], volidHash[i],
+		   sizeof(headerp->VolidHash[i]));
+	return;
+    }
+
+    buffer = malloc(hashsize * sizeof(afs_uint32));
+    for (j = 0; j <= MAXTYPES; j++) {
+	for (i = 0; i < hashsize; i++)
+	    buffer[i] = htonl(j == VL_NAMEHASH ? volnameHash[i] : volidHash[j][i]);
+	vldbwrite(VL_HASHBUCKET_OFFSET(hashaddr, hashsize, j, 0),
+		  (char *)buffer, hashsize * sizeof(afs_uint32));
+    }
+    free(buffer);
+}
+
 void
 readheader(struct vlheader *headerp)
 {
@@ -278,6 +361,8 @@ readheader(struct vlheader *headerp)
 	for (j = 0; j < HASHSIZE; j++)
 	    headerp->VolidHash[i][j] = ntohl(headerp->VolidHash[i][j]);
 
+    readhashtables(headerp);
+
     if (listheader) {
 	quiet_println("vldb header\n");
 	quiet_println("   vldbversion      = %u\n",
@@ -300,9 +385,11 @@ readheader(struct vlheader *headerp)
 	       headerp->SIT);
 	quiet_println("   server ip addr   table: size = %d entries\n",
 	       MAXSERVERID + 1);
-	quiet_println("   volume name hash table: size = %d buckets\n", HASHSIZE);
+	if (hashaddr)
+	    quiet_println("   hash table block = %u\n", hashaddr);
+	quiet_println("   volume name hash table: size = %d buckets\n", hashsize);
 	quiet_println("   volume id   hash table: %d tables with %d buckets each\n",
-	       MAXTYPES, HASHSIZE);
+	       MAXTYPES, hashsize);
     }
 
     /* Check the header size */
@@ -317,6 +404,8 @@ writeheader(struct vlheader *headerp)
 {
     int i, j;
 
+    writehashtables(headerp);
+
     headerp->vital_header.vldbversion =
 	htonl(headerp->vital_header.vldbversion);
     headerp->vital_header.headersize =
@@ -403,6 +492,8 @@ readentry(afs_int32 addr, struct nvlentry *vlentryp, afs_int32 *type)
 
     if (vlentryp->flags == VLCONTBLOCK) {
 	*type = MH;
+    } else if (vlentryp->flags == VLHASHBLOCK) {
+	*type = HB;
     } else if (vlentryp->flags == VLFREE) {
 	*type = FR;
     } else {
@@ -413,6 +504,10 @@ readentry(afs_int32 addr, struct nvlentry *vlentryp, afs_int32 *type)
 	quiet_println("address %u (offset 0x%0x): ", addr, OFFSET(addr));
 	if (vlentryp->flags == VLCONTBLOCK) {
 	    quiet_println("mh extension block\n");
+	} else if (vlentryp->flags == VLHASHBLOCK) {
+	    /* the hashsize field of the block lines up with LockAfsId */
+	    quiet_println("hash table block (%d buckets)\n",
+			  vlentryp->LockAfsId);
 	} else if (vlentryp->flags == VLFREE) {
 	    quiet_println("free vlentry\n");
 	} else {
@@ -530,7 +625,7 @@ void
 ReadAllEntries(struct vlheader *header)
 {
     afs_int32 type, rindex, i, j, e;
-    int freecount = 0, mhcount = 0, vlcount = 0;
+    int freecount = 0, mhcount = 0, vlcount = 0, hbcount = 0;
     int rwcount = 0, rocount = 0, bkcount = 0;
     struct nvlentry vlentry;
     afs_uint32 addr;
@@ -599,14 +694,18 @@ ReadAllEntries(struct vlheader *header)
 	} else if (type == MH) {
 	    entrysize = VL_ADDREXTBLK_SIZE;
 	    mhcount++;
+	} else if (type == HB && vlentry.LockAfsId > 0
+		   && vlentry.LockAfsId <= VL_MAXHASHSIZE) {
+	    entrysize = VL_HASHBLOCK_SIZE(vlentry.LockAfsId);
+	    hbcount++;
 	} else {
 	    log_error(VLDB_CHECK_ERROR, "address %u (offset 0x%0x): Unknown entry. Aborting\n", addr, OFFSET(addr));
 	    break;
 	}
     }
     if (verbose) {
-	quiet_println("Found %d entries, %d free entries, %d multihomed blocks\n",
-	       vlcount, freecount, mhcount);
+	quiet_println("Found %d entries, %d free entries, %d multihomed blocks, %d hash table blocks\n",
+	       vlcount, freecount, mhcount, hbcount);
 	quiet_println("Found %d RW volumes, %d BK volumes, %d RO volumes\n", rwcount,
 	       bkcount, rocount);
     }
@@ -633,16 +732,16 @@ FollowNameHash(struct vlheader *header)
 
     /* Now follow the Name Hash Table */
     if (verbose) quiet_println("Check Volume Name Hash\n");
-    for (i = 0; i < HASHSIZE; i++) {
+    for (i = 0; i < hashsize; i++) {
 	chainlength = 0;
 
-	if (!validVolumeAddr(header->VolnameHash[i])) {
+	if (!validVolumeAddr(volnameHash[i])) {
 	    log_error(VLDB_CHECK_ERROR,"Name Hash index %d is out of range: %u\n",
-		      i, header->VolnameHash[i]);
+		      i, volnameHash[i]);
 	    continue;
 	}
 
-	for (addr = header->VolnameHash[i]; addr; addr = vlentry.nextNameHash) {
+	for (addr = volnameHash[i]; addr; addr = vlentry.nextNameHash) {
 	    readentry(addr, &vlentry, &type);
 	    if (type != VL) {
 		log_error(VLDB_CHECK_ERROR,"address %u (offset 0x%0x): Name Hash %d: Not a vlentry\n",
@@ -698,7 +797,7 @@ FollowNameHash(struct vlheader *header)
     if (verbose) {
 	quiet_println
 	    ("%d entries in name hash, longest is %d, shortest is %d, average length is %f\n",
-	     count, longest, shortest, ((float)count / (float)HASHSIZE));
+	     count, longest, shortest, ((float)count / (float)hashsize));
     }
     return;
 }
@@ -726,15 +825,15 @@ FollowIdHash(struct vlheader *header)
 	count = longest = 0;
 	shortest = -1;
 
-	for (j = 0; j < HASHSIZE; j++) {
+	for (j = 0; j < hashsize; j++) {
 	    chainlength = 0;
-	    if (!validVolumeAddr(header->VolidHash[i][j])) {
+	    if (!validVolumeAddr(volidHash[i][j])) {
 		log_error(VLDB_CHECK_ERROR,"%s Hash index %d is out of range: %u\n",
-			  vtype(i), j, header->VolidHash[i][j]);
+			  vtype(i), j, volidHash[i][j]);
 		continue;
 	    }
 
-	    for (addr = header->VolidHash[i][j]; addr;
+	    for (addr = volidHash[i][j]; addr;
 		 addr = vlentry.nextIdHash[i]) {
 		readentry(addr, &vlentry, &type);
 		if (type != VL) {
@@ -789,7 +888,7 @@ FollowIdHash(struct vlheader *header)
 	if (verbose) {
 	    quiet_println
 		("%d entries in %s hash, longest is %d, shortest is %d, average length is %f\n",
-		 count, vtype(i), longest, shortest,((float)count / (float)HASHSIZE));
+		 count, vtype(i), longest, shortest,((float)count / (float)hashsize));
 	}
     }
     return;
@@ -1100,7 +1199,7 @@ nameForAddr(afs_uint32 addr, int hashtype, afs_uint32 *hash, char *buffer)
 }
 
 void
-reportHashChanges(struct vlheader *header, afs_uint32 oldnamehash[HASHSIZE], afs_uint32 oldidhash[MAXTYPES][HASHSIZE])
+reportHashChanges(struct vlheader *header, afs_uint32 *oldnamehash, afs_uint32 *oldidhash[MAXTYPES])
 {
     int i, j;
     afs_uint32 oldhash, newhash;
@@ -1111,20 +1210,20 @@ reportHashChanges(struct vlheader *header, afs_uint32 oldnamehash[HASHSIZE], afs
      * report hash changes
      */
 
-    for (i = 0; i < HASHSIZE; i++) {
-	if (oldnamehash[i] != header->VolnameHash[i]) {
+    for (i = 0; i < hashsize; i++) {
+	if (oldnamehash[i] != volnameHash[i]) {
 
 	    oldname = nameForAddr(oldnamehash[i], MAXTYPES, &oldhash, oldNameBuffer);
-	    newname = nameForAddr(header->VolnameHash[i], MAXTYPES, &newhash, newNameBuffer);
+	    newname = nameForAddr(volnameHash[i], MAXTYPES, &newhash, newNameBuffer);
 	    if (verbose || (oldhash != newhash)) {
 		quiet_println("FIX: Name hash header at %d was %s, is now %s\n", i, oldname, newname);
 	    }
 	}
 	for (j = 0; j < MAXTYPES; j++) {
-	    if (oldidhash[j][i] != header->VolidHash[j][i]) {
+	    if (oldidhash[j][i] != volidHash[j][i]) {
 
 		oldname = nameForAddr(oldidhash[j][i], j, &oldhash, oldNameBuffer);
-		newname = nameForAddr(header->VolidHash[j][i], j, &newhash, newNameBuffer);
+		newname = nameForAddr(volidHash[j][i], j, &newhash, newNameBuffer);
 		if (verbose || (oldhash != newhash)) {
 		    quiet_println("FIX: %s hash header at %d was %s, is now %s\n", vtype(j), i, oldname, newname);
 		}
@@ -1182,8 +1281,8 @@ WorkerBee(struct cmd_syndesc *as, void *arock)
     struct vlheader header;
     struct nvlentry vlentry, vlentry2;
     int i, j, k;
-    afs_uint32 oldnamehash[HASHSIZE];
-    afs_uint32 oldidhash[MAXTYPES][HASHSIZE];
+    afs_uint32 *oldnamehash = NULL;
+    afs_uint32 *oldidhash[MAXTYPES];
 
     error_level = 0;  /*  start clean with no error status */
     dbfile = as->parms[0].items->data;	/* -database */
@@ -1231,6 +1330,13 @@ WorkerBee(struct cmd_syndesc *as, void *arock)
     ReadAllEntries(&header);
     listentries = 0;		/* Listed all the entries */
 
+    if (hashaddr && (!(record[ADDR(hashaddr)].type & HB)
+		     || record[ADDR(hashaddr)].addr != hashaddr)) {
+	log_error(VLDB_CHECK_FATAL,"Hash table block %u (offset 0x%0x) was not found\n",
+		  hashaddr, OFFSET(hashaddr));
+	return VLDB_CHECK_FATAL;
+    }
+
     /* Check the multihomed blocks for valid entries as well as
      * the IpMappedAddrs array in the header for valid entries.
      */
@@ -1421,6 +1527,21 @@ WorkerBee(struct cmd_syndesc *as, void *arock)
 		    (VLDB_CHECK_ERROR,"address %u (offset 0x%0x): Multihomed block also found on other chains (0x%x)\n",
 		     record[i].addr, OFFSET(record[i].addr), record[i].type);
 
+	    /* An extended hash table block */
+	} else if (record[i].type & HB) {
+	    if (record[i].addr != hashaddr) {
+		readentry(record[i].addr, &vlentry, &type);
+		log_error(VLDB_CHECK_WARNING,
+			  "address %u (offset 0x%0x): Hash table block is no longer in use (%u bytes)\n",
+			  record[i].addr, OFFSET(record[i].addr),
+			  (afs_uint32)VL_HASHBLOCK_SIZE(vlentry.LockAfsId));
+	    }
+
+	    if (record[i].type & 0xfffffff0)
+	        log_error
+		    (VLDB_CHECK_ERROR,"address %u (offset 0x%0x): Hash table block also found on other chains (0x%x)\n",
+		     record[i].addr, OFFSET(record[i].addr), record[i].type);
+
 	} else {
 	    log_error(VLDB_CHECK_ERROR,"address %u (offset 0x%0x): Unknown entry type 0x%x\n",
 		   record[i].addr, OFFSET(record[i].addr), record[i].type);
@@ -1432,11 +1553,13 @@ WorkerBee(struct cmd_syndesc *as, void *arock)
 	 * If we are fixing we will rebuild the free and hash lists from the ground up.
 	 */
 	header.vital_header.freePtr = 0;
-	memcpy(oldnamehash, header.VolnameHash, sizeof(oldnamehash));
-	memset(header.VolnameHash, 0, sizeof(header.VolnameHash));
+	oldnamehash = volnameHash;
+	volnameHash = calloc(hashsize, sizeof(afs_uint32));
 
-	memcpy(oldidhash, header.VolidHash, sizeof(oldidhash));
-	memset(header.VolidHash, 0, sizeof(header.VolidHash));
+	for (j = 0; j < MAXTYPES; j++) {
+	    oldidhash[j] = volidHash[j];
+	    volidHash[j] = calloc(hashsize, sizeof(afs_uint32));
+	}
 	quiet_println("Rebuilding %u entries\n", maxentries);
     } else {
 	quiet_println("Scanning %u entries for possible repairs\n", maxentries);
@@ -1488,12 +1611,12 @@ WorkerBee(struct cmd_syndesc *as, void *arock)
 		 */
 		hash = NameHash(vlentry.name);
 
-		if (vlentry.nextNameHash != header.VolnameHash[hash]) {
+		if (vlentry.nextNameHash != volnameHash[hash]) {
 		    oldname = nameForAddr(vlentry.nextNameHash, MAXTYPES, &oldhash, oldNameBuffer);
-		    newname = nameForAddr(header.VolnameHash[hash], MAXTYPES, &newhash, newNameBuffer);
+		    newname = nameForAddr(volnameHash[hash], MAXTYPES, &newhash, newNameBuffer);
 		    if (verbose || ((oldhash != newhash) &&
                                     (0 != vlentry.nextNameHash) &&
-                                    (0 != header.VolnameHash[hash]))) {
+                                    (0 != volnameHash[hash]))) {
 			/*
 			 * That is, only report if we are verbose
 			 * or the hash is changing (and one side wasn't NULL
@@ -1503,8 +1626,8 @@ WorkerBee(struct cmd_syndesc *as, void *arock)
 		    }
 		}
 
-		vlentry.nextNameHash = header.VolnameHash[hash];
-		header.VolnameHash[hash] = record[i].addr;
+		vlentry.nextNameHash = volnameHash[hash];
+		volnameHash[hash] = record[i].addr;
 
 		for (j = 0; j < MAXTYPES; j++) {
 
@@ -1516,12 +1639,12 @@ WorkerBee(struct cmd_syndesc *as, void *arock)
 		    }
 		    hash = IdHash(vlentry.volumeId[j]);
 
-		    if (vlentry.nextIdHash[j] != header.VolidHash[j][hash]) {
+		    if (vlentry.nextIdHash[j] != volidHash[j][hash]) {
 			oldname = nameForAddr(vlentry.nextIdHash[j], j, &oldhash, oldNameBuffer);
-			newname = nameForAddr(header.VolidHash[j][hash], j, &newhash, newNameBuffer);
+			newname = nameForAddr(volidHash[j][hash], j, &newhash, newNameBuffer);
 			if (verbose || ((oldhash != newhash) &&
 					(0 != vlentry.nextIdHash[j]) &&
-					(0 != header.VolidHash[j][hash]))) {
+					(0 != volidHash[j][hash]))) {
 			    quiet_println("FIX: %s hash link for '%s' was %s, is now %s\n",
 					  vtype(j), vlentry.name, oldname, newname);
 			}
@@ -1557,8 +1680,8 @@ WorkerBee(struct cmd_syndesc *as, void *arock)
 			}
 		    }
 
-		    vlentry.nextIdHash[j] = header.VolidHash[j][hash];
-		    header.VolidHash[j][hash] = record[i].addr;
+		    vlentry.nextIdHash[j] = volidHash[j][hash];
+		    volidHash[j][hash] = record[i].addr;
 		}
 		writeentry(record[i].addr, &vlentry);
 	    }
@@ -1598,10 +1721,31 @@ WorkerBee(struct cmd_syndesc *as, void *arock)
 		}
 		writeentry(record[i].addr, &vlentry);
 	    }
+	} else if (record[i].type & HB) {
+	    if (fix && record[i].addr != hashaddr) {
+		afs_uint32 addr, end;
+
+		/* Put the entries of an unused hash table block on the free chain */
+		readentry(record[i].addr, &vlentry, &type);
+		end = record[i].addr + VL_HASHBLOCK_SIZE(vlentry.LockAfsId);
+		quiet_println
+		    ("FIX: Freeing unused hash table block: addr=%lu (offset 0x%0x)\n",
+		     record[i].addr, OFFSET(record[i].addr));
+		for (addr = record[i].addr; addr < end; addr += sizeof(vlentry)) {
+		    memset(&vlentry, 0, sizeof(vlentry));
+		    vlentry.flags = VLFREE;
+		    vlentry.nextIdHash[0] = header.vital_header.freePtr;
+		    header.vital_header.freePtr = addr;
+		    writeentry(addr, &vlentry);
+		}
+	    }
 	}
     }
     if (fix) {
 	reportHashChanges(&header, oldnamehash, oldidhash);
+	free(oldnamehash);
+	for (j = 0; j < MAXTYPES; j++)
+	    free(oldidhash[j]);
 	removeCrossLinkedAddresses(&header);
 	writeheader(&header);
     }
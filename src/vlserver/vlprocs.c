@@ -30,6 +30,7 @@
 #endif
 
 extern int smallMem;
+extern afs_uint32 vl_hashsize;
 extern int restrictedQueryLevel;
 extern int extent_mod;
 extern struct afsconf_dir *vldb_confdir;
@@ -256,6 +257,21 @@ Init_VLdbase(struct vl_ctx *ctx,
     if (code == 0) {
 	code = vlsetcache(ctx, locktype);
     }
+    /* Convert to the hash table size asked for with -hashsize, if any, the
+     * first time we get to write to the database */
+    if (code == 0 && locktype == LOCKWRITE && vl_hashsize
+	&& vl_hashsize != HashTableSize(ctx)) {
+	VLog(0, ("Resizing VLDB hash tables from %u to %u buckets\n",
+		 HashTableSize(ctx), vl_hashsize));
+	code = ResizeHashTables(ctx, vl_hashsize);
+	if (code) {
+	    VLog(0, ("Resizing VLDB hash tables failed (error = %d); "
+		     "not trying again\n", code));
+	    vl_hashsize = 0;
+	    countAbort(opcode);
+	    ubik_AbortTrans(ctx->trans);
+	}
+    }
     return code;
 }
 
@@ -1348,8 +1364,10 @@ SVL_ListEntryN(struct rx_call *rxcall, afs_int32 previous_index,
 /* Retrieves in vldbentries all vldb entries that match the specified
  * attributes (by server number, partition, volume type, and flag); if volume
  * id is specified then the associated list for that entry is returned.
- * CAUTION: This could be a very expensive call since in most cases
- * sequential search of all vldb entries is performed.
+ * CAUTION: This could be a very expensive call if neither a server nor a
+ * partition is given, since a sequential search of all vldb entries is
+ * then performed; otherwise only the entries in the attribute index for
+ * that server or partition are read.
  */
 static afs_int32
 ListAttributes(struct rx_call *rxcall,
@@ -1402,9 +1420,16 @@ ListAttributes(struct rx_call *rxcall,
 	if (code)
 	    goto abort;
     } else {
-	afs_int32 nextblockindex = 0, count = 0, k = 0, match = 0;
-	while ((nextblockindex =
-	       NextEntry(&ctx, nextblockindex, &tentry, &count))) {
+	afs_int32 k = 0, match = 0;
+	int serverindex = -1;
+	struct vl_attriter iter;
+
+	if (attributes->Mask & VLLIST_SERVER)
+	    serverindex = IpAddrToRelAddr(&ctx, attributes->server, 0);
+	code = InitAttrIter(&ctx, attributes, serverindex, 0, &iter);
+	if (code)
+	    goto abort;
+	while (NextAttrEntry(&ctx, &iter, &tentry, &code)) {
 	    if (++pollcount > 50) {
 #ifndef AFS_PTHREAD_ENV
 		IOMGR_Poll();
@@ -1413,10 +1438,6 @@ ListAttributes(struct rx_call *rxcall,
 	    }
 	    match = 0;
 	    if (attributes->Mask & VLLIST_SERVER) {
-		int serverindex;
-		if ((serverindex =
-		     IpAddrToRelAddr(&ctx, attributes->server, 0)) == -1)
-		    continue;
 		for (k = 0; k < OMAXNSERVERS; k++) {
 		    if (tentry.serverNumber[k] == BADSERVERID)
 			break;
@@ -1457,6 +1478,8 @@ ListAttributes(struct rx_call *rxcall,
 	    if (code)
 		goto abort;
 	}
+	if (code)
+	    goto abort;	/* an entry could not be read */
     }
     if (vldbentries->bulkentries_len
 	&& (allocCount > vldbentries->bulkentries_len)) {
@@ -1549,9 +1572,16 @@ ListAttributesN(struct rx_call *rxcall,
 	if (code)
 	    goto abort;
     } else {
-	afs_int32 nextblockindex = 0, count = 0, k = 0, match = 0;
-	while ((nextblockindex =
-	       NextEntry(&ctx, nextblockindex, &tentry, &count))) {
+	afs_int32 k = 0, match = 0;
+	int serverindex = -1;
+	struct vl_attriter iter;
+
+	if (attributes->Mask & VLLIST_SERVER)
+	    serverindex = IpAddrToRelAddr(&ctx, attributes->server, 0);
+	code = InitAttrIter(&ctx, attributes, serverindex, 0, &iter);
+	if (code)
+	    goto abort;
+	while (NextAttrEntry(&ctx, &iter, &tentry, &code)) {
 	    if (++pollcount > 50) {
 #ifndef AFS_PTHREAD_ENV
 		IOMGR_Poll();
@@ -1561,10 +1591,6 @@ ListAttributesN(struct rx_call *rxcall,
 
 	    match = 0;
 	    if (attributes->Mask & VLLIST_SERVER) {
-		int serverindex;
-		if ((serverindex =
-		     IpAddrToRelAddr(&ctx, attributes->server, 0)) == -1)
-		    continue;
 		for (k = 0; k < NMAXNSERVERS; k++) {
 		    if (tentry.serverNumber[k] == BADSERVERID)
 			break;
@@ -1605,6 +1631,8 @@ ListAttributesN(struct rx_call *rxcall,
 	    if (code)
 		goto abort;
 	}
+	if (code)
+	    goto abort;	/* an entry could not be read */
     }
     if (vldbentries->nbulkentries_len
 	&& (allocCount > vldbentries->nbulkentries_len)) {
@@ -1659,9 +1687,10 @@ ListAttributesN2(struct rx_call *rxcall,
     struct vl_ctx ctx;
     struct nvlentry tentry;
     struct nvldbentry *Vldbentry = 0, *VldbentryFirst = 0, *VldbentryLast = 0;
-    afs_int32 blockindex = 0, count = 0, k, match;
+    afs_int32 blockindex = 0, k, match;
     afs_int32 matchindex = 0;
     int serverindex = -1;	/* no server found */
+    struct vl_attriter iter;
     int findserver = 0, findpartition = 0, findflag = 0, findname = 0;
     int pollcount = 0;
     int namematchRWBK, namematchRO, thismatch;
@@ -1762,8 +1791,10 @@ ListAttributesN2(struct rx_call *rxcall,
 	}
 
 	/* Read each entry and see if it is the one we want */
-	blockindex = startindex;
-	while ((blockindex = NextEntry(&ctx, blockindex, &tentry, &count))) {
+	code = InitAttrIter(&ctx, attributes, serverindex, startindex, &iter);
+	if (code)
+	    goto done;
+	while ((blockindex = NextAttrEntry(&ctx, &iter, &tentry, &code))) {
 	    if (++pollcount > 50) {
 #ifndef AFS_PTHREAD_ENV
 		IOMGR_Poll();
@@ -1918,6 +1949,8 @@ ListAttributesN2(struct rx_call *rxcall,
 		    break;	/* collected the max */
 	    }
 	}
+	if (code)
+	    goto done;	/* an entry could not be read */
 	*nextstartindex = (blockindex ? blockindex : -1);
     }
 
@@ -1965,8 +1998,9 @@ SVL_ListAttributesN2(struct rx_call *rxcall,
 /* Retrieves in vldbentries all vldb entries that match the specified
  * attributes (by server number, partition, volume type, and flag); if
  * volume id is specified then the associated list for that entry is
- * returned. CAUTION: This could be a very expensive call since in most
- * cases sequential search of all vldb entries is performed.
+ * returned. CAUTION: This could be a very expensive call if neither a
+ * server nor a partition is given, since a sequential search of all vldb
+ * entries is then performed.
  */
 static afs_int32
 LinkedList(struct rx_call *rxcall,
@@ -1979,9 +2013,10 @@ LinkedList(struct rx_call *rxcall,
     struct vl_ctx ctx;
     struct nvlentry tentry;
     vldblist vllist, *vllistptr;
-    afs_int32 blockindex, count, match;
+    afs_int32 blockindex, match;
     afs_int32 k = 0;
-    int serverindex;
+    int serverindex = -1;
+    struct vl_attriter iter;
     int pollcount = 0;
 
     countRequest(this_op);
@@ -2025,8 +2060,12 @@ LinkedList(struct rx_call *rxcall,
 
     /* Search by server, partition, and flags */
     else {
-	for (blockindex = NextEntry(&ctx, 0, &tentry, &count); blockindex;
-	     blockindex = NextEntry(&ctx, blockindex, &tentry, &count)) {
+	if (attributes->Mask & VLLIST_SERVER)
+	    serverindex = IpAddrToRelAddr(&ctx, attributes->server, 0);
+	code = InitAttrIter(&ctx, attributes, serverindex, 0, &iter);
+	if (code)
+	    goto abort;
+	while (NextAttrEntry(&ctx, &iter, &tentry, &code)) {
 	    match = 0;
 
 	    if (++pollcount > 50) {
@@ -2038,10 +2077,6 @@ LinkedList(struct rx_call *rxcall,
 
 	    /* Does this volume exist on the desired server */
 	    if (attributes->Mask & VLLIST_SERVER) {
-		serverindex =
-		    IpAddrToRelAddr(&ctx, attributes->server, 0);
-		if (serverindex == -1)
-		    continue;
 		for (k = 0; k < OMAXNSERVERS; k++) {
 		    if (tentry.serverNumber[k] == BADSERVERID)
 			break;
@@ -2099,6 +2134,8 @@ LinkedList(struct rx_call *rxcall,
 		goto abort;
 	    }
 	}
+	if (code)
+	    goto abort;	/* an entry could not be read */
     }
     *vllistptr = NULL;
     return ubik_EndTrans(ctx.trans);
@@ -2133,9 +2170,10 @@ LinkedListN(struct rx_call *rxcall,
     struct vl_ctx ctx;
     struct nvlentry tentry;
     nvldblist vllist, *vllistptr;
-    afs_int32 blockindex, count, match;
+    afs_int32 blockindex, match;
     afs_int32 k = 0;
-    int serverindex;
+    int serverindex = -1;
+    struct vl_attriter iter;
     int pollcount = 0;
 
     countRequest(this_op);
@@ -2179,8 +2217,12 @@ LinkedListN(struct rx_call *rxcall,
 
     /* Search by server, partition, and flags */
     else {
-	for (blockindex = NextEntry(&ctx, 0, &tentry, &count); blockindex;
-	     blockindex = NextEntry(&ctx, blockindex, &tentry, &count)) {
+	if (attributes->Mask & VLLIST_SERVER)
+	    serverindex = IpAddrToRelAddr(&ctx, attributes->server, 0);
+	code = InitAttrIter(&ctx, attributes, serverindex, 0, &iter);
+	if (code)
+	    goto abort;
+	while (NextAttrEntry(&ctx, &iter, &tentry, &code)) {
 	    match = 0;
 
 	    if (++pollcount > 50) {
@@ -2192,10 +2234,6 @@ LinkedListN(struct rx_call *rxcall,
 
 	    /* Does this volume exist on the desired server */
 	    if (attributes->Mask & VLLIST_SERVER) {
-		serverindex =
-		    IpAddrToRelAddr(&ctx, attributes->server, 0);
-		if (serverindex == -1)
-		    continue;
 		for (k = 0; k < NMAXNSERVERS; k++) {
 		    if (tentry.serverNumber[k] == BADSERVERID)
 			break;
@@ -2253,6 +2291,8 @@ LinkedListN(struct rx_call *rxcall,
 		goto abort;
 	    }
 	}
+	if (code)
+	    goto abort;	/* an entry could not be read */
     }
     *vllistptr = NULL;
     return ubik_EndTrans(ctx.trans);
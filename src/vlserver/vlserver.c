@@ -34,6 +34,8 @@
 #include <afs/keys.h>
 #include <afs/auth.h>
 #include <afs/audit.h>
+#include <afs/srvtrace.h>
+#include <afs/srvmetrics.h>
 #include <afs/com_err.h>
 #include <lock.h>
 #include <ubik.h>
@@ -53,6 +55,7 @@ afs_uint32 wr_HostAddress[MAXSERVERID + 1];
 
 static void *CheckSignal(void*);
 int smallMem = 0;
+afs_uint32 vl_hashsize = 0;	/* hash table size to convert to, if any */
 int restrictedQueryLevel = RESTRICTED_QUERY_ANYUSER;
 int rxJumbograms = 0;		/* default is to not send and receive jumbo grams */
 int rxMaxMTU = -1;
@@ -76,17 +79,19 @@ static void *
 CheckSignal(void *unused)
 {
     int i, errorcode;
+    afs_uint32 hashsize;
     struct vl_ctx ctx;
 
     if ((errorcode =
 	Init_VLdbase(&ctx, LOCKREAD, VLGETSTATS - VL_LOWEST_OPCODE)))
 	return (void *)(intptr_t)errorcode;
+    hashsize = HashTableSize(&ctx);
     VLog(0, ("Dump name hash table out\n"));
-    for (i = 0; i < HASHSIZE; i++) {
+    for (i = 0; i < hashsize; i++) {
 	HashNDump(&ctx, i);
     }
     VLog(0, ("Dump id hash table out\n"));
-    for (i = 0; i < HASHSIZE; i++) {
+    for (i = 0; i < hashsize; i++) {
 	HashIdDump(&ctx, i);
     }
     return ((void *)(intptr_t)ubik_EndTrans(ctx.trans));
@@ -106,6 +111,40 @@ initialize_dstats(void)
     }
 }
 
+/* Print one of the opcode counts VL_GetStats reports, as a metric. */
+static void
+vldb_PrintOpMetrics(FILE *out, const char *metric, const char *help,
+		    afs_int32 *counts)
+{
+    char label[64];
+    const char *name;
+    int op, idx;
+
+    SrvMetrics_Family(out, metric, SRVMETRICS_COUNTER, help);
+    for (op = VL_LOWEST_OPCODE; op <= VL_HIGHEST_OPCODE; op++) {
+	if ((idx = VL_OpCodeIndex(op)) < 0)
+	    continue;
+	name = VL_function_names[idx];
+	if (strncmp(name, "VL_", 3) == 0)
+	    name += 3;
+	snprintf(label, sizeof(label), "op=\"%s\"", name);
+	SrvMetrics_Value(out, metric, label,
+			 (afs_uint32)counts[op - VL_LOWEST_OPCODE]);
+    }
+}
+
+/* Metrics collector for the vlserver. */
+static void
+vldb_PrintMetrics(FILE *out, void *rock)
+{
+    vldb_PrintOpMetrics(out, "openafs_vlserver_rpc_total",
+			"RPCs started, by RPC.", dynamic_statistics.requests);
+    vldb_PrintOpMetrics(out, "openafs_vlserver_rpc_aborts_total",
+			"RPCs which failed, by RPC.", dynamic_statistics.aborts);
+    ubik_PrintMetrics(out);
+    rx_PrintMetrics(out);
+}
+
 /* check whether caller is authorized to manage RX statistics */
 int
 vldb_rxstat_userok(struct rx_call *call)
@@ -132,6 +171,22 @@ vldb_IsLocalRealmMatch(void *rock, char *name, char *inst, char *cell)
     return islocal;
 }
 
+/* Smallest prime not less than n, for sizing the hash tables */
+static afs_uint32
+NextPrime(afs_uint32 n)
+{
+    afs_uint32 d;
+
+    if (n <= 2)
+	return 2;
+    for (n |= 1;; n += 2) {
+	for (d = 3; d * d <= n && n % d; d += 2)
+	    ;
+	if (d * d > n)
+	    return n;
+    }
+}
+
 /* Main server module */
 
 #include "AFS_component_version_number.c"
@@ -139,8 +194,11 @@ vldb_IsLocalRealmMatch(void *rock, char *name, char *inst, char *cell)
 enum optionsList {
     OPT_noauth,
     OPT_smallmem,
+    OPT_hashsize,
     OPT_auditlog,
     OPT_auditiface,
+    OPT_srvtrace,
+    OPT_metrics,
     OPT_config,
     OPT_debug,
     OPT_database,
@@ -175,6 +233,7 @@ main(int argc, char **argv)
     struct hostent *th;
     char hostname[VL_MAXNAMELEN];
     int noAuth = 0;
+    int hashsize;
     char clones[MAXHOSTSPERCELL];
     afs_uint32 host = ntohl(INADDR_ANY);
     struct cmd_syndesc *opts;
@@ -184,6 +243,8 @@ main(int argc, char **argv)
     char *configDir;
 
     char *auditFileName = NULL;
+    char *traceFileName = NULL;
+    char *metricsFileName = NULL;
     char *interface = NULL;
     char *optstring = NULL;
 
@@ -231,12 +292,18 @@ main(int argc, char **argv)
 		        CMD_OPTIONAL, "disable authentication");
     cmd_AddParmAtOffset(opts, OPT_smallmem, "-smallmem", CMD_FLAG,
 		        CMD_OPTIONAL, "optimise for small memory systems");
+    cmd_AddParmAtOffset(opts, OPT_hashsize, "-hashsize", CMD_SINGLE,
+		        CMD_OPTIONAL, "number of hash table buckets");
 
     /* general server options */
     cmd_AddParmAtOffset(opts, OPT_auditlog, "-auditlog", CMD_SINGLE,
 		        CMD_OPTIONAL, "location of audit log");
     cmd_AddParmAtOffset(opts, OPT_auditiface, "-audit-interface", CMD_SINGLE,
 		        CMD_OPTIONAL, "interface to use for audit logging");
+    cmd_AddParmAtOffset(opts, OPT_srvtrace, "-srvtrace", CMD_SINGLE,
+		        CMD_OPTIONAL, "location of binary trace file");
+    cmd_AddParmAtOffset(opts, OPT_metrics, "-metrics", CMD_SINGLE,
+		        CMD_OPTIONAL, "location of metrics file");
     cmd_AddParmAtOffset(opts, OPT_config, "-config", CMD_SINGLE,
 		        CMD_OPTIONAL, "configuration location");
     cmd_AddParmAtOffset(opts, OPT_debug, "-d", CMD_SINGLE,
@@ -294,6 +361,14 @@ main(int argc, char **argv)
     /* vlserver options */
     cmd_OptionAsFlag(opts, OPT_noauth, &noAuth);
     cmd_OptionAsFlag(opts, OPT_smallmem, &smallMem);
+    if (cmd_OptionAsInt(opts, OPT_hashsize, &hashsize) == 0) {
+	if (hashsize < HASHSIZE || hashsize > VL_MAXHASHSIZE) {
+	    printf("Invalid -hashsize %d; must be between %d and %d\n",
+		   hashsize, HASHSIZE, VL_MAXHASHSIZE);
+	    return -1;
+	}
+	vl_hashsize = NextPrime(hashsize);
+    }
     if (cmd_OptionAsString(opts, OPT_trace, &optstring) == 0) {
 	extern char rxi_tracename[80];
 	strcpy(rxi_tracename, optstring);
@@ -313,6 +388,18 @@ main(int argc, char **argv)
 	free(interface);
     }
 
+    if (cmd_OptionAsString(opts, OPT_srvtrace, &traceFileName) == 0) {
+	code = SrvTrace_Open(traceFileName);
+	if (code) {
+	    printf("Unable to open trace file '%s': %s\n", traceFileName,
+		   strerror(code));
+	    return -1;
+	}
+	free(traceFileName);
+    }
+
+    cmd_OptionAsString(opts, OPT_metrics, &metricsFileName);
+
     cmd_OptionAsString(opts, OPT_database, &vl_dbaseName);
 
     if (cmd_OptionAsInt(opts, OPT_threads, &lwps) == 0) {
@@ -485,10 +572,26 @@ main(int argc, char **argv)
     rx_SetRxDeadTime(50);
 
     ubik_nBuffers = 512;
+    if (vl_hashsize) {
+	/* Resizing the hash tables rewrites every entry, and both the old and
+	 * the new tables, in a single transaction; all of it has to fit in the
+	 * ubik buffer cache at once */
+	struct stat status;
+	char *dbfile;
+	afs_int64 bytes = VL_HASHBLOCK_SIZE(vl_hashsize);
+
+	if (asprintf(&dbfile, "%s.DB0", vl_dbaseName) >= 0) {
+	    if (stat(dbfile, &status) == 0)
+		bytes += status.st_size;
+	    free(dbfile);
+	}
+	ubik_nBuffers += bytes / 1024 + 1;	/* 1K buffers */
+    }
     ubik_SetClientSecurityProcs(afsconf_ClientAuth, afsconf_UpToDate, tdir);
     ubik_SetServerSecurityProcs(afsconf_BuildServerSecurityObjects,
 				afsconf_CheckAuth, tdir);
 
+    InitAttrIndex();
     ubik_SyncWriterCacheProc = vlsynccache;
     code =
 	ubik_ServerInitByInfo(myHost, htons(AFSCONF_VLDBPORT), &info, clones,
@@ -542,6 +645,15 @@ main(int argc, char **argv)
     /* allow super users to manage RX statistics */
     rx_SetRxStatUserOk(vldb_rxstat_userok);
 
+    if (metricsFileName != NULL) {
+	code = SrvMetrics_AddCollector(vldb_PrintMetrics, NULL);
+	if (code == 0)
+	    code = SrvMetrics_Open(metricsFileName);
+	if (code != 0)
+	    VLog(0, ("Unable to write metrics file %s: %s\n",
+		     metricsFileName, strerror(code)));
+    }
+
     rx_StartServer(1);		/* Why waste this idle process?? */
 
     return 0; /* not reachable */
@@ -48,6 +48,8 @@ struct vlheader {
 #define	VLDELETED	2	/* Entry is soft deleted */
 #define	VLLOCKED	4	/* Advisory lock on entry */
 #define	VLCONTBLOCK	8	/* Special continuation block entry */
+#define	VLHASHBLOCK	0x10000	/* Extended hash table block (VLDBVERSION_5);
+				 * not a VLOP_* or VLF_* bit */
 
 /* Valid RelaseLock types */
 #define	LOCKREL_TIMESTAMP   1
@@ -109,7 +111,9 @@ struct extentaddr {
 	    afs_int32 flags;	/* must be in the same position as the vlentry's
 				   flags field */
 	    afs_uint32 contaddrs[VL_MAX_ADDREXTBLKS];
-	    afs_int32 spares2[24];
+	    afs_uint32 hashtable;	/* extended hash table block (v5) */
+	    afs_uint32 hashsize;	/* # of buckets per extended table */
+	    afs_int32 spares2[22];
 	} _ex_header;
 	struct {
 	    afsUUID hostuuid;
@@ -123,11 +127,40 @@ struct extentaddr {
 #define	ex_count	_ex_un._ex_header.count
 #define	ex_hdrflags	_ex_un._ex_header.flags
 #define	ex_contaddrs	_ex_un._ex_header.contaddrs
+#define	ex_hashtable	_ex_un._ex_header.hashtable
+#define	ex_hashsize	_ex_un._ex_header.hashsize
 #define	ex_hostuuid	_ex_un._ex_addrentry.hostuuid
 #define	ex_addrs	_ex_un._ex_addrentry.addrs
 #define	ex_uniquifier	_ex_un._ex_addrentry.uniquifier
 #define ex_srvflags	_ex_un._ex_addrentry.flags
 
+/*
+ * Extended hash tables.  A VLDBVERSION_5 database keeps its volume name and
+ * volume id hash tables in a single block, found through the header of the
+ * first multihomed extension block, instead of in the fixed size arrays of
+ * the vlheader (which are then left empty).  This lets the number of buckets
+ * grow with the number of volumes.  The block starts with this header and is
+ * followed by the id tables for each volume type and then the name table,
+ * each hashsize buckets long, padded to a whole number of entries so that
+ * the block can be put back on the free list when it is replaced.
+ */
+#define	VL_MAXHASHSIZE		4194301	/* Largest extended table; prime */
+#define	VL_NAMEHASH		MAXTYPES	/* Table index of the name hash */
+struct vlhashblock {
+    afs_int32 spares1[3];
+    afs_int32 flags;		/* VLHASHBLOCK; same position as the vlentry's
+				   flags field */
+    afs_uint32 hashsize;	/* # of buckets in each table */
+    afs_int32 spares2[11];
+};
+#define	VL_HASHBLOCK_SIZE(size) \
+    ((sizeof(struct vlhashblock) + (MAXTYPES + 1) * (size) * sizeof(afs_uint32) \
+      + sizeof(struct nvlentry) - 1) / sizeof(struct nvlentry) \
+     * sizeof(struct nvlentry))
+#define	VL_HASHBUCKET_OFFSET(base, size, table, idx) \
+    ((base) + sizeof(struct vlhashblock) + \
+     ((table) * (size) + (idx)) * sizeof(afs_uint32))
+
 #define VLog(level, str)   ViceLog(level, str)
 
 #endif /* _VLSERVER_ */
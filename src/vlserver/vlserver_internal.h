@@ -20,17 +20,32 @@ struct vl_ctx {
     struct vlheader *cheader;
 };
 
+/**
+ * iterator over the candidate entries of a list-by-attributes query.
+ */
+struct vl_attriter {
+    int useindex;		/* walk entries[] rather than the whole db */
+    afs_int32 *entries;		/* candidate block indexes, ascending */
+    afs_int32 count;		/* number of entries */
+    afs_int32 next;		/* next element of entries to return */
+    afs_int32 blockindex;	/* last block index returned */
+};
+
 /* vlprocs.c */
 extern int Init_VLdbase(struct vl_ctx *ctx, int locktype, int this_op);
 
 /* vlutils.c */
 extern afs_int32 vlwrite(struct ubik_trans *trans, afs_int32 offset,
 		         void *buffer, afs_int32 length);
+extern afs_int32 vlread(struct ubik_trans *trans, afs_int32 offset,
+			char *buffer, afs_int32 length);
 extern afs_int32 vlentrywrite(struct ubik_trans *trans, afs_int32 offset,
 			      void *buffer, afs_int32 length);
 extern int write_vital_vlheader(struct vl_ctx *ctx);
 extern afs_int32 readExtents(struct ubik_trans *trans);
 extern afs_int32 CheckInit(struct ubik_trans *trans, int builddb);
+extern afs_uint32 HashTableSize(struct vl_ctx *ctx);
+extern afs_int32 ResizeHashTables(struct vl_ctx *ctx, afs_uint32 hashsize);
 extern afs_int32 AllocBlock(struct vl_ctx *ctx,
 			    struct nvlentry *tentry);
 extern afs_int32 FindExtentBlock(struct vl_ctx *ctx, afsUUID *uuidp,
@@ -62,6 +77,13 @@ extern int UnhashVolname(struct vl_ctx *ctx, afs_int32 blockindex,
 extern afs_int32 NextEntry(struct vl_ctx *ctx, afs_int32 blockindex,
 			   struct nvlentry *tentry, afs_int32 *remaining);
 extern int FreeBlock(struct vl_ctx *ctx, afs_int32 blockindex);
+extern void InitAttrIndex(void);
+extern int InitAttrIter(struct vl_ctx *ctx,
+			struct VldbListByAttributes *attributes,
+			int serverindex, afs_int32 startindex,
+			struct vl_attriter *iter);
+extern afs_int32 NextAttrEntry(struct vl_ctx *ctx, struct vl_attriter *iter,
+			       struct nvlentry *tentry, afs_int32 *error);
 extern int vlsetcache(struct vl_ctx *ctx, int locktype);
 extern int vlsynccache(void);
 #endif
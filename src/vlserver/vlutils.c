@@ -30,23 +30,24 @@ struct vlheader wr_cheader;
 int vldbversion = 0;
 
 static int index_OK(struct vl_ctx *ctx, afs_int32 blockindex);
+static void InvalidateAttrIndex(void);
 
 #define ERROR_EXIT(code) do { \
     error = (code); \
     goto error_exit; \
 } while (0)
 
-/* Hashing algorithm based on the volume id; HASHSIZE must be prime */
+/* Hashing algorithm based on the volume id; hashsize must be prime */
 afs_int32
-IDHash(afs_int32 volumeid)
+IDHash(afs_int32 volumeid, afs_uint32 hashsize)
 {
-    return ((abs(volumeid)) % HASHSIZE);
+    return ((abs(volumeid)) % hashsize);
 }
 
 
 /* Hashing algorithm based on the volume name; name's size is implicit (64 chars) and if changed it should be reflected here. */
 afs_int32
-NameHash(char *volumename)
+NameHash(char *volumename, afs_uint32 hashsize)
 {
     unsigned int hash;
     int i;
@@ -54,7 +55,77 @@ NameHash(char *volumename)
     hash = 0;
     for (i = strlen(volumename), volumename += i - 1; i--; volumename--)
 	hash = (hash * 63) + (*((unsigned char *)volumename) - 63);
-    return (hash % HASHSIZE);
+    return (hash % hashsize);
+}
+
+/* Returns the offset of the extended hash table block, or 0 if the database
+ * still uses the fixed size hash tables in its header. */
+static afs_uint32
+HashTableAddr(struct vl_ctx *ctx)
+{
+    if (ntohl(ctx->cheader->vital_header.vldbversion) != VLDBVERSION_5
+	|| !ctx->cheader->SIT || !ctx->ex_addr[0])
+	return 0;
+    return ntohl(ctx->ex_addr[0]->ex_hashtable);
+}
+
+/* Returns the number of buckets in each of the database's hash tables */
+afs_uint32
+HashTableSize(struct vl_ctx *ctx)
+{
+    if (!HashTableAddr(ctx))
+	return HASHSIZE;
+    return ntohl(ctx->ex_addr[0]->ex_hashsize);
+}
+
+/* Read the head of a hash chain; table is a volume type for the volume id
+ * hash tables, or VL_NAMEHASH for the volume name hash table. */
+static afs_int32
+GetHashHead(struct vl_ctx *ctx, int table, afs_uint32 hashindex,
+	    afs_uint32 *blockindexp)
+{
+    afs_uint32 base, head;
+
+    base = HashTableAddr(ctx);
+    if (!base) {
+	if (table == VL_NAMEHASH)
+	    head = ctx->cheader->VolnameHash[hashindex];
+	else
+	    head = ctx->cheader->VolidHash[table][hashindex];
+    } else if (vlread(ctx->trans,
+		      VL_HASHBUCKET_OFFSET(base, HashTableSize(ctx), table,
+					   hashindex),
+		      (char *)&head, sizeof(head))) {
+	return VL_IO;
+    }
+    *blockindexp = ntohl(head);
+    return 0;
+}
+
+/* Set the head of a hash chain, both in the cache and on disk */
+static afs_int32
+SetHashHead(struct vl_ctx *ctx, int table, afs_uint32 hashindex,
+	    afs_uint32 blockindex)
+{
+    afs_uint32 base, head, *headp;
+    afs_int32 offset;
+
+    head = htonl(blockindex);
+    base = HashTableAddr(ctx);
+    if (!base) {
+	if (table == VL_NAMEHASH)
+	    headp = &ctx->cheader->VolnameHash[hashindex];
+	else
+	    headp = &ctx->cheader->VolidHash[table][hashindex];
+	*headp = head;
+	offset = DOFFSET(0, ctx->cheader, headp);
+    } else {
+	offset = VL_HASHBUCKET_OFFSET(base, HashTableSize(ctx), table,
+				      hashindex);
+    }
+    if (vlwrite(ctx->trans, offset, (char *)&head, sizeof(head)))
+	return VL_IO;
+    return 0;
 }
 
 
@@ -307,6 +378,9 @@ UpdateCache(struct ubik_trans *trans, void *rock)
     int builddb = *builddb_rock;
     afs_int32 error = 0, i, code, ubcode;
 
+    /* someone else changed the database; the attribute index is stale */
+    InvalidateAttrIndex();
+
     /* if version changed (or first call), read the header */
     ubcode = vlread(trans, 0, (char *)&rd_cheader, sizeof(rd_cheader));
     vldbversion = ntohl(rd_cheader.vital_header.vldbversion);
@@ -353,14 +427,16 @@ UpdateCache(struct ubik_trans *trans, void *rock)
     }
 
     if ((vldbversion != VLDBVERSION) && (vldbversion != OVLDBVERSION)
-        && (vldbversion != VLDBVERSION_4)) {
+        && (vldbversion != VLDBVERSION_4) && (vldbversion != VLDBVERSION_5)) {
 	VLog(0,
-	    ("VLDB version %d doesn't match this software version(%d, %d or %d), quitting!\n",
-	     vldbversion, VLDBVERSION_4, VLDBVERSION, OVLDBVERSION));
+	    ("VLDB version %d doesn't match this software version(%d, %d, %d or %d), quitting!\n",
+	     vldbversion, VLDBVERSION_5, VLDBVERSION_4, VLDBVERSION,
+	     OVLDBVERSION));
 	ERROR_EXIT(VL_BADVERSION);
     }
 
-    maxnservers = ((vldbversion == 3 || vldbversion == 4) ? 13 : 8);
+    maxnservers = ((vldbversion == 3 || vldbversion == 4 || vldbversion == 5)
+		   ? 13 : 8);
 
   error_exit:
     /* all done */
@@ -384,7 +460,7 @@ CheckInit(struct ubik_trans *trans, int builddb)
 	return VL_EMPTY;
     }
     if ((vldbversion != VLDBVERSION) && (vldbversion != OVLDBVERSION)
-        && (vldbversion != VLDBVERSION_4)) {
+        && (vldbversion != VLDBVERSION_4) && (vldbversion != VLDBVERSION_5)) {
 	return VL_BADVERSION;
     }
 
@@ -525,7 +601,8 @@ FindExtentBlock(struct vl_ctx *ctx, afsUUID *uuidp,
 			0xff000000 | ((base << 16) & 0xff0000) | (j & 0xffff);
 		    *expp = exp;
 		    *basep = base;
-		    if (vldbversion != VLDBVERSION_4) {
+		    if (ntohl(ctx->cheader->vital_header.vldbversion) <
+			VLDBVERSION_4) {
 			ctx->cheader->vital_header.vldbversion =
 			    htonl(VLDBVERSION_4);
 			code = write_vital_vlheader(ctx);
@@ -609,15 +686,17 @@ afs_int32
 FindByID(struct vl_ctx *ctx, afs_uint32 volid, afs_int32 voltype,
 	 struct nvlentry *tentry, afs_int32 *error)
 {
-    afs_int32 typeindex, hashindex, blockindex;
+    afs_int32 typeindex, hashindex;
+    afs_uint32 blockindex;
 
     *error = 0;
-    hashindex = IDHash(volid);
+    hashindex = IDHash(volid, HashTableSize(ctx));
     if (voltype == -1) {
 /* Should we have one big hash table for volids as opposed to the three ones? */
 	for (typeindex = 0; typeindex < MAXTYPES; typeindex++) {
-	    for (blockindex = ntohl(ctx->cheader->VolidHash[typeindex][hashindex]);
-		 blockindex != NULLO;
+	    if ((*error = GetHashHead(ctx, typeindex, hashindex, &blockindex)))
+		return 0;
+	    for (; blockindex != NULLO;
 		 blockindex = tentry->nextIdHash[typeindex]) {
 		if (vlentryread
 		    (ctx->trans, blockindex, (char *)tentry, sizeof(nvlentry))) {
@@ -629,8 +708,9 @@ FindByID(struct vl_ctx *ctx, afs_uint32 volid, afs_int32 voltype,
 	    }
 	}
     } else {
-	for (blockindex = ntohl(ctx->cheader->VolidHash[voltype][hashindex]);
-	     blockindex != NULLO; blockindex = tentry->nextIdHash[voltype]) {
+	if ((*error = GetHashHead(ctx, voltype, hashindex, &blockindex)))
+	    return 0;
+	for (; blockindex != NULLO; blockindex = tentry->nextIdHash[voltype]) {
 	    if (vlentryread
 		(ctx->trans, blockindex, (char *)tentry, sizeof(nvlentry))) {
 		*error = VL_IO;
@@ -653,7 +733,7 @@ FindByName(struct vl_ctx *ctx, char *volname, struct nvlentry *tentry,
 	   afs_int32 *error)
 {
     afs_int32 hashindex;
-    afs_int32 blockindex;
+    afs_uint32 blockindex;
     char tname[VL_MAXNAMELEN];
 
     /* remove .backup or .readonly extensions for stupid backwards
@@ -673,9 +753,10 @@ FindByName(struct vl_ctx *ctx, char *volname, struct nvlentry *tentry,
 	strcpy(tname, volname);
 
     *error = 0;
-    hashindex = NameHash(tname);
-    for (blockindex = ntohl(ctx->cheader->VolnameHash[hashindex]);
-	 blockindex != NULLO; blockindex = tentry->nextNameHash) {
+    hashindex = NameHash(tname, HashTableSize(ctx));
+    if ((*error = GetHashHead(ctx, VL_NAMEHASH, hashindex, &blockindex)))
+	return 0;
+    for (; blockindex != NULLO; blockindex = tentry->nextNameHash) {
 	if (vlentryread(ctx->trans, blockindex, (char *)tentry, sizeof(nvlentry))) {
 	    *error = VL_IO;
 	    return 0;
@@ -767,11 +848,12 @@ int
 HashNDump(struct vl_ctx *ctx, int hashindex)
 {
     int i = 0;
-    int blockindex;
+    afs_uint32 blockindex;
     struct nvlentry tentry;
 
-    for (blockindex = ntohl(ctx->cheader->VolnameHash[hashindex]);
-	 blockindex != NULLO; blockindex = tentry.nextNameHash) {
+    if (GetHashHead(ctx, VL_NAMEHASH, hashindex, &blockindex))
+	return 0;
+    for (; blockindex != NULLO; blockindex = tentry.nextNameHash) {
 	if (vlentryread(ctx->trans, blockindex, (char *)&tentry, sizeof(nvlentry)))
 	    return 0;
 	i++;
@@ -787,11 +869,12 @@ int
 HashIdDump(struct vl_ctx *ctx, int hashindex)
 {
     int i = 0;
-    int blockindex;
+    afs_uint32 blockindex;
     struct nvlentry tentry;
 
-    for (blockindex = ntohl(ctx->cheader->VolidHash[0][hashindex]);
-	 blockindex != NULLO; blockindex = tentry.nextIdHash[0]) {
+    if (GetHashHead(ctx, RWVOL, hashindex, &blockindex))
+	return 0;
+    for (; blockindex != NULLO; blockindex = tentry.nextIdHash[0]) {
 	if (vlentryread(ctx->trans, blockindex, (char *)&tentry, sizeof(nvlentry)))
 	    return 0;
 	i++;
@@ -887,15 +970,11 @@ HashVolid(struct vl_ctx *ctx, afs_int32 voltype, afs_int32 blockindex,
 	return VL_IDALREADYHASHED;
     else if (errorcode)
 	return errorcode;
-    hashindex = IDHash(tentry->volumeId[voltype]);
-    tentry->nextIdHash[voltype] =
-	ntohl(ctx->cheader->VolidHash[voltype][hashindex]);
-    ctx->cheader->VolidHash[voltype][hashindex] = htonl(blockindex);
-    if (vlwrite
-	(ctx->trans, DOFFSET(0, ctx->cheader, &ctx->cheader->VolidHash[voltype][hashindex]),
-	 (char *)&ctx->cheader->VolidHash[voltype][hashindex], sizeof(afs_int32)))
-	return VL_IO;
-    return 0;
+    hashindex = IDHash(tentry->volumeId[voltype], HashTableSize(ctx));
+    if ((errorcode = GetHashHead(ctx, voltype, hashindex,
+				 &tentry->nextIdHash[voltype])))
+	return errorcode;
+    return SetHashHead(ctx, voltype, hashindex, blockindex);
 }
 
 
@@ -904,7 +983,8 @@ int
 UnhashVolid(struct vl_ctx *ctx, afs_int32 voltype, afs_int32 blockindex,
 	    struct nvlentry *aentry)
 {
-    int hashindex, nextblockindex, prevblockindex;
+    int hashindex, prevblockindex;
+    afs_uint32 nextblockindex;
     struct nvlentry tentry;
     afs_int32 code;
     afs_int32 temp;
@@ -912,20 +992,15 @@ UnhashVolid(struct vl_ctx *ctx, afs_int32 voltype, afs_int32 blockindex,
     if (aentry->volumeId[voltype] == NULLO)	/* Assume no volume id */
 	return 0;
     /* Take it out of the VolId[voltype] hash list */
-    hashindex = IDHash(aentry->volumeId[voltype]);
-    nextblockindex = ntohl(ctx->cheader->VolidHash[voltype][hashindex]);
+    hashindex = IDHash(aentry->volumeId[voltype], HashTableSize(ctx));
+    if ((code = GetHashHead(ctx, voltype, hashindex, &nextblockindex)))
+	return code;
     if (nextblockindex == blockindex) {
 	/* First on the hash list; just adjust pointers */
-	ctx->cheader->VolidHash[voltype][hashindex] =
-	    htonl(aentry->nextIdHash[voltype]);
-	code =
-	    vlwrite(ctx->trans,
-		    DOFFSET(0, ctx->cheader,
-			    &ctx->cheader->VolidHash[voltype][hashindex]),
-		    (char *)&ctx->cheader->VolidHash[voltype][hashindex],
-		    sizeof(afs_int32));
+	code = SetHashHead(ctx, voltype, hashindex,
+			   aentry->nextIdHash[voltype]);
 	if (code)
-	    return VL_IO;
+	    return code;
     } else {
 	while (nextblockindex != blockindex) {
 	    prevblockindex = nextblockindex;	/* always done once */
@@ -956,15 +1031,11 @@ HashVolname(struct vl_ctx *ctx, afs_int32 blockindex,
     afs_int32 code;
 
     /* Insert into volname's hash linked list */
-    hashindex = NameHash(aentry->name);
-    aentry->nextNameHash = ntohl(ctx->cheader->VolnameHash[hashindex]);
-    ctx->cheader->VolnameHash[hashindex] = htonl(blockindex);
-    code =
-	vlwrite(ctx->trans, DOFFSET(0, ctx->cheader, &ctx->cheader->VolnameHash[hashindex]),
-		(char *)&ctx->cheader->VolnameHash[hashindex], sizeof(afs_int32));
+    hashindex = NameHash(aentry->name, HashTableSize(ctx));
+    code = GetHashHead(ctx, VL_NAMEHASH, hashindex, &aentry->nextNameHash);
     if (code)
-	return VL_IO;
-    return 0;
+	return code;
+    return SetHashHead(ctx, VL_NAMEHASH, hashindex, blockindex);
 }
 
 
@@ -972,20 +1043,20 @@ int
 UnhashVolname(struct vl_ctx *ctx, afs_int32 blockindex,
 	      struct nvlentry *aentry)
 {
-    afs_int32 hashindex, nextblockindex, prevblockindex;
+    afs_int32 hashindex, prevblockindex, code;
+    afs_uint32 nextblockindex;
     struct nvlentry tentry;
     afs_int32 temp;
 
     /* Take it out of the Volname hash list */
-    hashindex = NameHash(aentry->name);
-    nextblockindex = ntohl(ctx->cheader->VolnameHash[hashindex]);
+    hashindex = NameHash(aentry->name, HashTableSize(ctx));
+    if ((code = GetHashHead(ctx, VL_NAMEHASH, hashindex, &nextblockindex)))
+	return code;
     if (nextblockindex == blockindex) {
 	/* First on the hash list; just adjust pointers */
-	ctx->cheader->VolnameHash[hashindex] = htonl(aentry->nextNameHash);
-	if (vlwrite
-	    (ctx->trans, DOFFSET(0, ctx->cheader, &ctx->cheader->VolnameHash[hashindex]),
-	     (char *)&ctx->cheader->VolnameHash[hashindex], sizeof(afs_int32)))
-	    return VL_IO;
+	code = SetHashHead(ctx, VL_NAMEHASH, hashindex, aentry->nextNameHash);
+	if (code)
+	    return code;
     } else {
 	while (nextblockindex != blockindex) {
 	    prevblockindex = nextblockindex;	/* always done at least once */
@@ -1039,6 +1110,17 @@ NextEntry(struct vl_ctx *ctx, afs_int32 blockindex,
 	     * This is a special mh extension block just simply skip over it
 	     */
 	    blockindex += VL_ADDREXTBLK_SIZE;
+	} else if (tentry->flags == VLHASHBLOCK) {
+	    /*
+	     * An extended hash table block (possibly one that has since been
+	     * replaced by a larger one); the hashsize field of its header
+	     * lines up with LockAfsId.
+	     */
+	    if (tentry->LockAfsId <= 0 || tentry->LockAfsId > VL_MAXHASHSIZE) {
+		*remaining = -1;
+		return 0;
+	    }
+	    blockindex += VL_HASHBLOCK_SIZE(tentry->LockAfsId);
 	} else {
 	    if (tentry->flags != VLFREE) {
 		/* estimate remaining number of entries, not including this one */
@@ -1054,6 +1136,344 @@ NextEntry(struct vl_ctx *ctx, afs_int32 blockindex,
 }
 
 
+/**
+ * Move the volume id and name hash tables into a new extended hash table
+ * block with hashsize buckets per table, and mark the database as
+ * VLDBVERSION_5.  Every entry is rethreaded onto the new chains.  Any
+ * previous extended hash table block is put back on the free list.
+ *
+ * @param[in] ctx       transaction context of a write transaction
+ * @param[in] hashsize  new number of buckets; should be prime
+ *
+ * @return operation status
+ *   @retval 0 success
+ */
+afs_int32
+ResizeHashTables(struct vl_ctx *ctx, afs_uint32 hashsize)
+{
+    struct vlhashblock hblock;
+    struct nvlentry tentry;
+    afs_uint32 *heads = NULL, *headp;
+    afs_int32 blockindex, remaining, code, error = 0;
+    afs_uint32 i, count = 0, oldaddr, oldend;
+    int typeindex;
+
+    if (hashsize < HASHSIZE || hashsize > VL_MAXHASHSIZE)
+	ERROR_EXIT(VL_BADINDEX);
+    /* Version 2 entries have room for fewer servers; upgrading the version
+     * would change how the entries are read */
+    if (ntohl(ctx->cheader->vital_header.vldbversion) < VLDBVERSION)
+	ERROR_EXIT(VL_BADVERSION);
+
+    /* The extended table is found through the first extension block */
+    if (!ctx->cheader->SIT) {
+	code = GetExtentBlock(ctx, 0);
+	if (code)
+	    ERROR_EXIT(code);
+    }
+
+    oldaddr = HashTableAddr(ctx);
+    oldend = oldaddr ? oldaddr + VL_HASHBLOCK_SIZE(HashTableSize(ctx)) : 0;
+
+    /* Sized to include the padding at the end of the block */
+    heads = calloc(1, VL_HASHBLOCK_SIZE(hashsize) - sizeof(hblock));
+    if (!heads)
+	ERROR_EXIT(VL_NOMEM);
+
+    /* Rethread every entry onto the new chains, building the new tables in
+     * memory.  Volume ids are hashed the same way ThreadVLentry does. */
+    for (blockindex = NextEntry(ctx, 0, &tentry, &remaining); blockindex;
+	 blockindex = NextEntry(ctx, blockindex, &tentry, &remaining)) {
+	for (typeindex = 0; typeindex < MAXTYPES; typeindex++) {
+	    if (typeindex != RWVOL && !tentry.volumeId[typeindex]) {
+		tentry.nextIdHash[typeindex] = 0;
+		continue;
+	    }
+	    headp = &heads[typeindex * hashsize +
+			   IDHash(tentry.volumeId[typeindex], hashsize)];
+	    tentry.nextIdHash[typeindex] = *headp;
+	    *headp = blockindex;
+	}
+	headp = &heads[VL_NAMEHASH * hashsize +
+		       NameHash(tentry.name, hashsize)];
+	tentry.nextNameHash = *headp;
+	*headp = blockindex;
+	if (vlentrywrite(ctx->trans, blockindex, (char *)&tentry,
+			 sizeof(nvlentry)))
+	    ERROR_EXIT(VL_IO);
+	if (((++count) % 50) == 0) {
+#ifndef AFS_PTHREAD_ENV
+	    IOMGR_Poll();
+#endif
+	}
+    }
+    if (remaining < 0)
+	ERROR_EXIT(VL_IO);
+
+    /* Write out the new block at the end of the database */
+    blockindex = ntohl(ctx->cheader->vital_header.eofPtr);
+    memset(&hblock, 0, sizeof(hblock));
+    hblock.flags = htonl(VLHASHBLOCK);
+    hblock.hashsize = htonl(hashsize);
+    if (vlwrite(ctx->trans, blockindex, (char *)&hblock, sizeof(hblock)))
+	ERROR_EXIT(VL_IO);
+    for (i = 0; i < (MAXTYPES + 1) * hashsize; i++)
+	heads[i] = htonl(heads[i]);
+    if (vlwrite(ctx->trans, blockindex + sizeof(hblock), (char *)heads,
+		VL_HASHBLOCK_SIZE(hashsize) - sizeof(hblock)))
+	ERROR_EXIT(VL_IO);
+    ctx->cheader->vital_header.eofPtr =
+	htonl(blockindex + VL_HASHBLOCK_SIZE(hashsize));
+    ctx->cheader->vital_header.vldbversion = htonl(VLDBVERSION_5);
+
+    /* Point the first extension block at it */
+    ctx->ex_addr[0]->ex_hashtable = htonl(blockindex);
+    ctx->ex_addr[0]->ex_hashsize = htonl(hashsize);
+    if (vlwrite(ctx->trans, ntohl(ctx->cheader->SIT), ctx->ex_addr[0],
+		sizeof(struct extentaddr)))
+	ERROR_EXIT(VL_IO);
+
+    /* Cut the old block up into free entries; the header is written once
+     * below rather than by FreeBlock for every entry */
+    for (; oldaddr < oldend; oldaddr += sizeof(nvlentry)) {
+	memset(&tentry, 0, sizeof(nvlentry));
+	tentry.nextIdHash[0] = ctx->cheader->vital_header.freePtr;
+	tentry.flags = htonl(VLFREE);
+	if (vlwrite(ctx->trans, oldaddr, (char *)&tentry, sizeof(nvlentry)))
+	    ERROR_EXIT(VL_IO);
+	ctx->cheader->vital_header.freePtr = htonl(oldaddr);
+	ctx->cheader->vital_header.frees++;
+    }
+    code = write_vital_vlheader(ctx);
+    if (code)
+	ERROR_EXIT(code);
+
+    /* The tables in the header are no longer used */
+    memset(ctx->cheader->VolnameHash, 0, sizeof(ctx->cheader->VolnameHash));
+    memset(ctx->cheader->VolidHash, 0, sizeof(ctx->cheader->VolidHash));
+    if (vlwrite(ctx->trans, DOFFSET(0, ctx->cheader, ctx->cheader->VolnameHash),
+		(char *)ctx->cheader->VolnameHash,
+		sizeof(ctx->cheader->VolnameHash) +
+		sizeof(ctx->cheader->VolidHash)))
+	ERROR_EXIT(VL_IO);
+
+  error_exit:
+    free(heads);
+    return error;
+}
+
+/*
+ * In-memory secondary index of the vldb entries by server and by partition,
+ * so that the list-by-attributes calls only have to read the entries that
+ * can possibly match instead of walking the whole database.  Each list holds
+ * the block indexes of the matching entries in ascending order, which is the
+ * same order NextEntry returns them in.
+ *
+ * The index is built lazily from a read transaction the first time it is
+ * needed, and is thrown away whenever the cached database version changes
+ * (UpdateCache) or a write transaction commits (vlsynccache).  Both of those
+ * happen with the ubik cache lock held exclusively, so an index found valid
+ * during a transaction stays valid until that transaction ends.
+ */
+struct vl_attrindex {
+    afs_int32 *entries;		/* block indexes, ascending */
+    afs_int32 count;		/* number of valid entries */
+    afs_int32 alloc;		/* allocated size of entries */
+};
+
+static struct vl_attrindex serverIndex[MAXSERVERID + 1];
+static struct vl_attrindex partitionIndex[MAXPARTITIONID + 1];
+static int attrIndexValid = 0;
+static struct Lock attrIndexLock;
+
+void
+InitAttrIndex(void)
+{
+    Lock_Init(&attrIndexLock);
+}
+
+/* Forget the current index; it is rebuilt on next use. */
+static void
+InvalidateAttrIndex(void)
+{
+    attrIndexValid = 0;
+}
+
+static int
+AttrIndexAdd(struct vl_attrindex *aindex, afs_int32 blockindex)
+{
+    afs_int32 *tentries;
+
+    /* entries are added in ascending order, so a duplicate is always last */
+    if (aindex->count > 0 && aindex->entries[aindex->count - 1] == blockindex)
+	return 0;
+    if (aindex->count >= aindex->alloc) {
+	tentries = realloc(aindex->entries,
+			   (aindex->alloc + VLDBALLOCCOUNT) * sizeof(afs_int32));
+	if (!tentries)
+	    return VL_NOMEM;
+	aindex->entries = tentries;
+	aindex->alloc += VLDBALLOCCOUNT;
+    }
+    aindex->entries[aindex->count++] = blockindex;
+    return 0;
+}
+
+/* Walk the whole database once and populate the server and partition
+ * indexes.  Must be called with attrIndexLock write-locked. */
+static int
+BuildAttrIndex(struct vl_ctx *ctx)
+{
+    struct nvlentry tentry;
+    afs_int32 blockindex = 0, count = 0;
+    int i, k, code;
+
+    for (i = 0; i <= MAXSERVERID; i++)
+	serverIndex[i].count = 0;
+    for (i = 0; i <= MAXPARTITIONID; i++)
+	partitionIndex[i].count = 0;
+
+    while ((blockindex = NextEntry(ctx, blockindex, &tentry, &count))) {
+	for (k = 0; k < NMAXNSERVERS; k++) {
+	    if (tentry.serverNumber[k] == BADSERVERID)
+		break;
+	    code = AttrIndexAdd(&serverIndex[tentry.serverNumber[k]],
+				blockindex);
+	    if (!code)
+		code = AttrIndexAdd(&partitionIndex[tentry.serverPartition[k]],
+				    blockindex);
+	    if (code)
+		return code;
+	}
+    }
+    if (count < 0)
+	return VL_IO;
+
+    attrIndexValid = 1;
+    return 0;
+}
+
+/**
+ * Prepare to iterate over the entries that may match a list-by-attributes
+ * query.
+ *
+ * @param[in]  ctx          transaction context
+ * @param[in]  attributes   the query; only the server and partition parts
+ *                          are used
+ * @param[in]  serverindex  server index of attributes->server, or -1 if it
+ *                          is not known to the vldb
+ * @param[in]  startindex   only return entries after this block index
+ *                          (0 to start at the beginning)
+ * @param[out] iter         iterator to pass to NextAttrEntry
+ *
+ * @note Entries returned by NextAttrEntry are candidates only; the caller
+ *       must still check them against the query.  When neither a server nor
+ *       a partition is asked for, every entry in the database is returned.
+ *
+ * @return operation status
+ *   @retval 0 success
+ */
+int
+InitAttrIter(struct vl_ctx *ctx, struct VldbListByAttributes *attributes,
+	     int serverindex, afs_int32 startindex, struct vl_attriter *iter)
+{
+    struct vl_attrindex *aindex;
+    afs_int32 partition = -1;
+    afs_int32 lo, hi, mid;
+    int code = 0;
+
+    memset(iter, 0, sizeof(*iter));
+    iter->blockindex = startindex;
+    if (!(attributes->Mask & VLLIST_SERVER))
+	serverindex = -1;
+    if (attributes->Mask & VLLIST_PARTITION)
+	partition = attributes->partition;
+    if (!(attributes->Mask & (VLLIST_SERVER | VLLIST_PARTITION)))
+	return 0;		/* plain sequential scan */
+
+    iter->useindex = 1;
+    if ((attributes->Mask & VLLIST_SERVER) && serverindex < 0)
+	return 0;		/* unknown server; nothing can match */
+    if (serverindex < 0 && (partition < 0 || partition > MAXPARTITIONID))
+	return 0;		/* no such partition; nothing can match */
+
+    ObtainReadLock(&attrIndexLock);
+    if (!attrIndexValid) {
+	ReleaseReadLock(&attrIndexLock);
+	ObtainWriteLock(&attrIndexLock);
+	if (!attrIndexValid)
+	    code = BuildAttrIndex(ctx);
+	ReleaseWriteLock(&attrIndexLock);
+	if (code)
+	    return code;
+	ObtainReadLock(&attrIndexLock);
+    }
+
+    /* Use whichever list is shorter; the caller rechecks the entry anyway */
+    if (serverindex < 0)
+	aindex = &partitionIndex[partition];
+    else if (partition < 0 || partition > MAXPARTITIONID
+	     || (serverIndex[serverindex].count
+		 <= partitionIndex[partition].count))
+	aindex = &serverIndex[serverindex];
+    else
+	aindex = &partitionIndex[partition];
+    iter->entries = aindex->entries;
+    iter->count = aindex->count;
+    ReleaseReadLock(&attrIndexLock);
+
+    /* skip the entries already returned by a previous call */
+    lo = 0;
+    hi = iter->count;
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	if (iter->entries[mid] <= startindex)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    iter->next = lo;
+    return 0;
+}
+
+/**
+ * Return the next candidate entry of a list-by-attributes query.
+ *
+ * @param[in]  ctx    transaction context
+ * @param[in]  iter   iterator set up by InitAttrIter
+ * @param[out] tentry the entry read
+ * @param[out] error  0 at the end of the entries, or VL_IO if an entry
+ *                    could not be read
+ *
+ * @return block index of the entry, or 0 if there are no more entries or
+ *         an entry could not be read
+ */
+afs_int32
+NextAttrEntry(struct vl_ctx *ctx, struct vl_attriter *iter,
+	      struct nvlentry *tentry, afs_int32 *error)
+{
+    afs_int32 count;
+
+    *error = 0;
+    if (!iter->useindex) {
+	iter->blockindex = NextEntry(ctx, iter->blockindex, tentry, &count);
+	if (count < 0)
+	    *error = VL_IO;
+	return iter->blockindex;
+    }
+
+    if (iter->next >= iter->count)
+	return 0;
+    iter->blockindex = iter->entries[iter->next++];
+    if (vlentryread(ctx->trans, iter->blockindex, (char *)tentry,
+		    sizeof(nvlentry))) {
+	*error = VL_IO;
+	return 0;
+    }
+    return iter->blockindex;
+}
+
+
 /* Routine to verify that index is a legal offset to a vldb entry in the
  * table
  */
@@ -1114,7 +1534,9 @@ vlsetcache(struct vl_ctx *ctx, int locktype)
 int
 vlsynccache(void)
 {
+    InvalidateAttrIndex();
     memcpy(rd_HostAddress, wr_HostAddress, sizeof(rd_HostAddress));
     memcpy(&rd_cheader, &wr_cheader, sizeof(rd_cheader));
+    vldbversion = ntohl(rd_cheader.vital_header.vldbversion);
     return vlexcpy(rd_ex_addr, wr_ex_addr);
 }
@@ -0,0 +1,478 @@
+/*
+ * Copyright (c) 2026 The OpenAFS Contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR `AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * demand attach fs
+ * persistent volume attach index
+ *
+ * Attaching a volume means reading its volume header file and then its
+ * volume info, and after a restart the fileserver does this for every
+ * volume clients ask for.  At a clean shutdown every volume has just been
+ * taken offline and its volume info written, so we remember both, and
+ * write them all into the attach index next to the fileserver state
+ * dump.  At the next startup the first attach of each volume takes its
+ * headers from the index instead of from disk.
+ *
+ * The index is removed as soon as it is read, so that it is never used
+ * after a crash.  A partition's entries are ignored if the partition
+ * directory was changed after the index was written, which catches
+ * volumes created or removed while we were down.  An entry is dropped
+ * when another program asks for the volume over FSSYNC, since it may
+ * then change the volume behind our back.  The salvager removes the
+ * index if it salvages a partition without us.
+ */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#ifdef AFS_DEMAND_ATTACH_FS
+
+#include <afs/opr.h>
+#include <opr/jhash.h>
+#include <rx/rx_queue.h>
+#include <opr/lock.h>
+#include <lock.h>
+#include <afs/afsutil.h>
+#include <afs/dirpath.h>
+#include "nfs.h"
+#include <afs/afsint.h>
+#include "ihandle.h"
+#include "vnode.h"
+#include "volume.h"
+#include "partition.h"
+#include "common.h"
+#include "attach_index.h"
+
+#define VATTACH_INDEX_MAGIC	0x41544958	/* "ATIX" */
+#define VATTACH_INDEX_VERSION	1
+
+/* on-disk file header */
+struct VAttachIndexHeader {
+    afs_uint32 magic;
+    afs_uint32 version;
+    afs_uint32 nparts;
+    afs_uint32 nvols;
+    afs_uint32 checksum;	/* of everything following the header */
+    afs_uint32 reserved[3];
+};
+
+/* on-disk partition record; followed by nvols struct VAttachIndexVol */
+struct VAttachIndexPart {
+    char name[VMAXPATHLEN];
+    afs_uint32 nvols;
+    afs_uint32 reserved;
+    afs_uint64 ino;		/* partition directory inode number, */
+    afs_int64 mtime;		/* mtime and ctime when the index was written */
+    afs_int64 ctime;
+};
+
+#define VATTACH_INDEX_HASH_BITS	14
+#define VATTACH_INDEX_HASH_SIZE	opr_jhash_size(VATTACH_INDEX_HASH_BITS)
+#define VATTACH_INDEX_HASH(volid) \
+    (opr_jhash_int((volid), 0) & opr_jhash_mask(VATTACH_INDEX_HASH_BITS))
+
+/* protected by VOL_LOCK once the volume package is running */
+static struct VAttachIndexEntry *VAttachIndexHash[VATTACH_INDEX_HASH_SIZE];
+static int VAttachIndexCount;
+
+/* buffered sequential i/o on the index file, with a running checksum */
+struct VAttachIndexIO {
+    FD_t fd;
+    afs_uint32 checksum;
+    size_t len;
+    size_t off;
+    char buf[64 * 1024];
+};
+
+static struct VAttachIndexEntry **
+VAttachIndexFind_r(VolumeId volid)
+{
+    struct VAttachIndexEntry **ep;
+
+    ep = &VAttachIndexHash[VATTACH_INDEX_HASH(volid)];
+    while (*ep && (*ep)->vol.id != volid)
+	ep = &(*ep)->next;
+    return ep;
+}
+
+static int
+VAttachIndexRead(struct VAttachIndexIO *io, void *to, size_t size)
+{
+    char *p = to;
+    size_t n;
+    ssize_t nBytes;
+
+    while (size) {
+	if (io->off == io->len) {
+	    nBytes = OS_READ(io->fd, io->buf, sizeof(io->buf));
+	    if (nBytes <= 0)
+		return -1;
+	    io->len = nBytes;
+	    io->off = 0;
+	}
+	n = min(size, io->len - io->off);
+	memcpy(p, io->buf + io->off, n);
+	io->off += n;
+	p += n;
+	size -= n;
+    }
+    io->checksum = opr_jhash(to, (p - (char *)to) / sizeof(afs_uint32),
+			     io->checksum);
+    return 0;
+}
+
+static int
+VAttachIndexFlush(struct VAttachIndexIO *io)
+{
+    if (io->len && OS_WRITE(io->fd, io->buf, io->len) != io->len)
+	return -1;
+    io->len = 0;
+    return 0;
+}
+
+static int
+VAttachIndexWrite(struct VAttachIndexIO *io, void *from, size_t size)
+{
+    char *p = from;
+    size_t n;
+
+    io->checksum = opr_jhash(from, size / sizeof(afs_uint32), io->checksum);
+    while (size) {
+	if (io->len == sizeof(io->buf) && VAttachIndexFlush(io))
+	    return -1;
+	n = min(size, sizeof(io->buf) - io->len);
+	memcpy(io->buf + io->len, p, n);
+	io->len += n;
+	p += n;
+	size -= n;
+    }
+    return 0;
+}
+
+static int
+VAttachIndexPartitionUnchanged(struct DiskPartition64 *dp,
+			       struct VAttachIndexPart *part)
+{
+    struct stat status;
+
+    if (stat(VPartitionPath(dp), &status) < 0)
+	return 0;
+    return status.st_ino == part->ino && status.st_mtime == part->mtime
+	&& status.st_ctime == part->ctime;
+}
+
+static void
+VAttachIndexClear(void)
+{
+    struct VAttachIndexEntry *ep, *np;
+    int i;
+
+    for (i = 0; i < VATTACH_INDEX_HASH_SIZE; i++) {
+	for (ep = VAttachIndexHash[i]; ep; ep = np) {
+	    np = ep->next;
+	    free(ep);
+	}
+	VAttachIndexHash[i] = NULL;
+    }
+    VAttachIndexCount = 0;
+}
+
+/**
+ * read the attach index written at the last shutdown, and remove it.
+ *
+ * @param[in] restore  0 to just remove the index without using it
+ *
+ * @note called once by the fileserver before pre-attaching volumes
+ */
+void
+VAttachIndex_Load(int restore)
+{
+    struct VAttachIndexIO *io;
+    struct VAttachIndexHeader hdr;
+    struct VAttachIndexPart part;
+    struct VAttachIndexEntry *ep, **epp;
+    struct DiskPartition64 *dp;
+    const char *path = AFSDIR_SERVER_FSATTACH_FILEPATH;
+    afs_uint32 i, j, nvols = 0;
+    int valid;
+
+    io = malloc(sizeof(*io));
+    if (io == NULL)
+	return;
+    io->fd = OS_OPEN(path, O_RDONLY, 0);
+    if (io->fd == INVALID_FD) {
+	if (errno != ENOENT)
+	    Log("VAttachIndex: cannot open %s (errno %d); attaching volumes "
+		"from disk\n", path, errno);
+	free(io);
+	return;
+    }
+    if (OS_UNLINK(path) < 0) {
+	/* if it stays around, we might believe it after a crash */
+	Log("VAttachIndex: cannot remove %s (errno %d); not using it\n",
+	    path, errno);
+	restore = 0;
+    }
+    if (!restore)
+	goto done;
+
+    io->len = io->off = 0;
+    io->checksum = 0;
+    if (VAttachIndexRead(io, &hdr, sizeof(hdr))
+	|| hdr.magic != VATTACH_INDEX_MAGIC
+	|| hdr.version != VATTACH_INDEX_VERSION) {
+	Log("VAttachIndex: %s is not a valid attach index; ignoring it\n",
+	    path);
+	goto done;
+    }
+    io->checksum = 0;
+
+    for (i = 0; i < hdr.nparts; i++) {
+	if (VAttachIndexRead(io, &part, sizeof(part)))
+	    goto bad;
+	part.name[sizeof(part.name) - 1] = '\0';
+	dp = VGetPartition(part.name, 0);
+	valid = dp && VAttachIndexPartitionUnchanged(dp, &part);
+	if (!valid)
+	    Log("VAttachIndex: partition %s changed since %s was written; "
+		"attaching its volumes from disk\n", part.name, path);
+	for (j = 0; j < part.nvols; j++) {
+	    ep = malloc(sizeof(*ep));
+	    if (ep == NULL)
+		goto bad;
+	    if (VAttachIndexRead(io, &ep->vol, sizeof(ep->vol))) {
+		free(ep);
+		goto bad;
+	    }
+	    epp = VAttachIndexFind_r(ep->vol.id);
+	    if (!valid || *epp) {
+		/* duplicate ids are left for the normal attach path
+		 * to complain about */
+		free(ep);
+		continue;
+	    }
+	    ep->dp = dp;
+	    ep->next = NULL;
+	    *epp = ep;
+	    nvols++;
+	}
+    }
+    if (io->checksum != hdr.checksum) {
+	Log("VAttachIndex: checksum mismatch in %s; ignoring it\n", path);
+	VAttachIndexClear();
+	goto done;
+    }
+    VAttachIndexCount = nvols;
+    Log("VAttachIndex: loaded %u of %u volumes from %s\n",
+	nvols, hdr.nvols, path);
+    goto done;
+
+ bad:
+    Log("VAttachIndex: %s is truncated; ignoring it\n", path);
+    VAttachIndexClear();
+ done:
+    OS_CLOSE(io->fd);
+    free(io);
+}
+
+/**
+ * take a volume's entry out of the attach index.
+ *
+ * @param[in] dp     partition the volume is being attached from
+ * @param[in] volid  volume id
+ *
+ * @return entry, which the caller must free, or NULL if there is none
+ *
+ * @pre VOL_LOCK held
+ */
+struct VAttachIndexEntry *
+VAttachIndex_Take_r(struct DiskPartition64 *dp, VolumeId volid)
+{
+    struct VAttachIndexEntry *ep, **epp;
+
+    epp = VAttachIndexFind_r(volid);
+    ep = *epp;
+    if (ep == NULL)
+	return NULL;
+    *epp = ep->next;
+    VAttachIndexCount--;
+
+    if (ep->dp != dp || ep->vol.data.id != volid
+	|| ep->vol.data.stamp.magic != VOLUMEINFOMAGIC
+	|| ep->vol.data.stamp.version != VOLUMEINFOVERSION) {
+	free(ep);
+	return NULL;
+    }
+    return ep;
+}
+
+/**
+ * remember a volume whose headers have just been written at shutdown.
+ *
+ * @param[in] vp  volume object, with its header loaded
+ *
+ * @pre VOL_LOCK held
+ */
+void
+VAttachIndex_Put_r(Volume *vp)
+{
+    struct VAttachIndexEntry *ep, **epp;
+
+    epp = VAttachIndexFind_r(vp->hashid);
+    ep = *epp;
+    if (ep == NULL) {
+	ep = malloc(sizeof(*ep));
+	if (ep == NULL)
+	    return;
+	ep->next = NULL;
+	*epp = ep;
+	VAttachIndexCount++;
+    }
+    ep->dp = vp->partition;
+    ep->vol.id = vp->hashid;
+    ep->vol.parent = vp->diskDataHandle->ih_vid;
+    ep->vol.volumeInfo = vp->diskDataHandle->ih_ino;
+    ep->vol.smallVnodeIndex = vp->vnodeIndex[vSmall].handle->ih_ino;
+    ep->vol.largeVnodeIndex = vp->vnodeIndex[vLarge].handle->ih_ino;
+    ep->vol.linkTable = vp->linkHandle->ih_ino;
+    memcpy(&ep->vol.data, &V_disk(vp), sizeof(ep->vol.data));
+}
+
+/**
+ * forget what the attach index says about a volume.
+ *
+ * @param[in] volid  volume id
+ *
+ * @pre VOL_LOCK held
+ */
+void
+VAttachIndex_Forget_r(VolumeId volid)
+{
+    struct VAttachIndexEntry *ep, **epp;
+
+    epp = VAttachIndexFind_r(volid);
+    ep = *epp;
+    if (ep) {
+	*epp = ep->next;
+	VAttachIndexCount--;
+	free(ep);
+    }
+}
+
+/**
+ * write the attach index.
+ *
+ * @note called at the end of fileserver shutdown, once every volume has
+ *       been taken offline
+ *
+ * @pre VOL_LOCK held
+ */
+void
+VAttachIndex_Save_r(void)
+{
+    struct VAttachIndexIO *io;
+    struct VAttachIndexHeader hdr;
+    struct VAttachIndexPart part;
+    struct VAttachIndexEntry *ep;
+    struct DiskPartition64 *dp;
+    struct stat status;
+    const char *path = AFSDIR_SERVER_FSATTACH_FILEPATH;
+    char tpath[AFSDIR_PATH_MAX];
+    int i;
+
+    if (VAttachIndexCount == 0)
+	return;
+
+    io = malloc(sizeof(*io));
+    if (io == NULL)
+	return;
+    snprintf(tpath, sizeof(tpath), "%s.new", path);
+    io->fd = OS_OPEN(tpath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (io->fd == INVALID_FD) {
+	Log("VAttachIndex: cannot create %s (errno %d)\n", tpath, errno);
+	free(io);
+	return;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = VATTACH_INDEX_MAGIC;
+    hdr.version = VATTACH_INDEX_VERSION;
+    io->len = 0;
+    if (VAttachIndexWrite(io, &hdr, sizeof(hdr)))
+	goto bad;
+    io->checksum = 0;
+
+    for (dp = DiskPartitionList; dp; dp = dp->next) {
+	memset(&part, 0, sizeof(part));
+	for (i = 0; i < VATTACH_INDEX_HASH_SIZE; i++) {
+	    for (ep = VAttachIndexHash[i]; ep; ep = ep->next) {
+		if (ep->dp == dp)
+		    part.nvols++;
+	    }
+	}
+	if (part.nvols == 0 || stat(VPartitionPath(dp), &status) < 0)
+	    continue;
+	strlcpy(part.name, VPartitionPath(dp), sizeof(part.name));
+	part.ino = status.st_ino;
+	part.mtime = status.st_mtime;
+	part.ctime = status.st_ctime;
+	if (VAttachIndexWrite(io, &part, sizeof(part)))
+	    goto bad;
+	for (i = 0; i < VATTACH_INDEX_HASH_SIZE; i++) {
+	    for (ep = VAttachIndexHash[i]; ep; ep = ep->next) {
+		if (ep->dp == dp && VAttachIndexWrite(io, &ep->vol,
+						      sizeof(ep->vol)))
+		    goto bad;
+	    }
+	}
+	hdr.nparts++;
+	hdr.nvols += part.nvols;
+    }
+    hdr.checksum = io->checksum;
+    if (VAttachIndexFlush(io)
+	|| OS_PWRITE(io->fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)
+	|| OS_SYNC(io->fd) < 0)
+	goto bad;
+    OS_CLOSE(io->fd);
+    free(io);
+    if (rename(tpath, path) < 0) {
+	Log("VAttachIndex: cannot rename %s to %s (errno %d)\n", tpath,
+	    path, errno);
+	OS_UNLINK(tpath);
+	return;
+    }
+    Log("VAttachIndex: wrote %u volumes on %u partitions to %s\n",
+	hdr.nvols, hdr.nparts, path);
+    return;
+
+ bad:
+    Log("VAttachIndex: error %d writing %s\n", errno, tpath);
+    OS_CLOSE(io->fd);
+    free(io);
+    OS_UNLINK(tpath);
+}
+
+#endif /* AFS_DEMAND_ATTACH_FS */
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2026 The OpenAFS Contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR `AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * demand attach fs
+ * persistent volume attach index
+ */
+
+#ifndef _AFS_VOL_ATTACH_INDEX_H
+#define _AFS_VOL_ATTACH_INDEX_H 1
+
+#include "partition.h"
+
+/*
+ * What the attach index remembers about one volume: the inodes named in
+ * its volume header file, and its volume info as last written to disk.
+ * This is also the on-disk record format, so keep it a multiple of 4
+ * bytes long.
+ */
+struct VAttachIndexVol {
+    VolumeId id;
+    VolumeId parent;
+    afs_uint64 volumeInfo;
+    afs_uint64 smallVnodeIndex;
+    afs_uint64 largeVnodeIndex;
+    afs_uint64 linkTable;
+    VolumeDiskData data;
+};
+
+struct VAttachIndexEntry {
+    struct VAttachIndexEntry *next;	/* hash chain */
+    struct DiskPartition64 *dp;
+    struct VAttachIndexVol vol;
+};
+
+extern void VAttachIndex_Load(int restore);
+extern struct VAttachIndexEntry *VAttachIndex_Take_r(struct DiskPartition64 *dp,
+						     VolumeId volid);
+extern void VAttachIndex_Put_r(Volume *vp);
+extern void VAttachIndex_Forget_r(VolumeId volid);
+extern void VAttachIndex_Save_r(void);
+
+#endif /* _AFS_VOL_ATTACH_INDEX_H */
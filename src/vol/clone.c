@@ -162,8 +162,10 @@ DoCloneIndex(Volume * rwvp, Volume * clvp, VnodeClass class, int reclone)
     struct clone_rock decRock;
     afs_foff_t offset = 0;
     afs_int32 dircloned, inodeinced;
+    int haveclvnode, clskipped = 0;
     afs_int32 filecount = 0, diskused = 0;
     afs_ino_str_t stmp;
+    int linkbatch = 0;
 
     struct VnodeClassInfo *vcp = &VnodeClassInfo[class];
     /*
@@ -187,6 +189,11 @@ DoCloneIndex(Volume * rwvp, Volume * clvp, VnodeClass class, int reclone)
     decRock.h = V_linkHandle(rwvp);
     decRock.vol = V_parentId(rwvp);
 
+    /* Keep the link count increments in memory until the clone's index
+     * has been written; if the batch can't be set up, IH_INC still works,
+     * just more slowly. */
+    linkbatch = (IH_BEGIN_LINKBATCH(V_linkHandle(rwvp)) == 0);
+
     /* Open the RW volume's index file and seek to beginning */
     IH_COPY(rwH, rwvp->vnodeIndex[class].handle);
     rwFd = IH_OPEN(rwH);
@@ -236,8 +243,10 @@ DoCloneIndex(Volume * rwvp, Volume * clvp, VnodeClass class, int reclone)
 	if (reclone && !STREAM_EOF(clfilein)
 	    && (STREAM_READ(clvnode, vcp->diskSize, 1, clfilein) == 1)) {
 	    clinode = VNDISK_GET_INO(clvnode);
+	    haveclvnode = 1;
 	} else {
 	    clinode = 0;
+	    haveclvnode = 0;
 	}
 
 	if (rwvnode->type != vNull) {
@@ -265,8 +274,10 @@ DoCloneIndex(Volume * rwvp, Volume * clvp, VnodeClass class, int reclone)
 		inodeinced = 1;
 	    }
 
-	    /* If a directory, mark vnode in old volume as cloned */
-	    if ((rwvnode->type == vDirectory) && ReadWriteOriginal) {
+	    /* If a directory, mark vnode in old volume as cloned, unless an
+	     * earlier clone already did and it has not been written since */
+	    if ((rwvnode->type == vDirectory) && ReadWriteOriginal
+		&& !rwvnode->cloned) {
 #ifdef DVINC
 		/*
 		 * It is my firmly held belief that immediately after
@@ -300,9 +311,23 @@ DoCloneIndex(Volume * rwvp, Volume * clvp, VnodeClass class, int reclone)
 	    }
 	}
 
-	/* Overwrite the vnode entry in the clone volume */
+	/* Overwrite the vnode entry in the clone volume. When recloning,
+	 * vnodes which have not changed since the last clone are left alone;
+	 * the stream is repositioned before the next vnode that has. */
 	rwvnode->cloned = 0;
-	code = STREAM_WRITE(rwvnode, vcp->diskSize, 1, clfileout);
+	if (haveclvnode && memcmp(rwvnode, clvnode, vcp->diskSize) == 0) {
+	    clskipped = 1;
+	    code = 1;
+	} else {
+	    code = 1;
+	    if (clskipped) {
+		if (STREAM_ASEEK(clfileout, offset) == -1)
+		    code = 0;
+		clskipped = 0;
+	    }
+	    if (code == 1)
+		code = STREAM_WRITE(rwvnode, vcp->diskSize, 1, clfileout);
+	}
 	if (code != 1) {
 	  clonefailed:
 	    /* Couldn't clone, go back and decrement the inode's link count */
@@ -350,6 +375,11 @@ DoCloneIndex(Volume * rwvp, Volume * clvp, VnodeClass class, int reclone)
      * and shouldn't do the idecs.
      */
   error_exit:
+    if (linkbatch && IH_END_LINKBATCH(V_linkHandle(rwvp)) != 0) {
+	VForceOffline(rwvp);
+	if (!error)
+	    error = EIO;
+    }
     if (rwfile)
 	STREAM_CLOSE(rwfile);
     if (clfilein)
@@ -397,9 +427,12 @@ DoCloneIndex(Volume * rwvp, Volume * clvp, VnodeClass class, int reclone)
      * (see above fclose and fsync). No matter what happens, we
      * no longer need to keep these references around.
      */
+    linkbatch = (IH_BEGIN_LINKBATCH(V_linkHandle(rwvp)) == 0);
     code = ci_Apply(&decHead, IDecProc, (char *)&decRock);
     if (!error)
 	error = code;
+    if (linkbatch && IH_END_LINKBATCH(V_linkHandle(rwvp)) != 0 && !error)
+	error = EIO;
     ci_Destroy(&decHead);
 
     if (ReadWriteOriginal && filecount > 0)
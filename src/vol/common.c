@@ -50,6 +50,7 @@ Abort(const char *format, ...)
     va_start(args, format);
     vViceLog(0, (format, args));
     va_end(args);
+    FlushLog();
     abort();
 }
 
@@ -67,6 +67,7 @@
 #include "volume_inline.h"
 #include "partition.h"
 #include "vg_cache.h"
+#include "attach_index.h"
 #include "common.h"
 
 #ifdef HAVE_POLL
@@ -591,6 +592,23 @@ FSYNC_com_VolOp(osi_socket fd, SYNC_command * com, SYNC_response * res)
                   (int)fd, afs_printable_uint32_lu(vcom.vop->volume),
                   vcom.vop->partName));
 
+#ifdef AFS_DEMAND_ATTACH_FS
+    switch (com->hdr.command) {
+    case FSYNC_VOL_LISTVOLUMES:
+    case FSYNC_VOL_QUERY:
+    case FSYNC_VOL_QUERY_HDR:
+    case FSYNC_VOL_QUERY_VOP:
+    case FSYNC_VG_QUERY:
+    case FSYNC_VG_SCAN:
+    case FSYNC_VG_SCAN_ALL:
+	break;
+    default:
+	/* the volume may change behind our back from here on, so what
+	 * we remembered about it at our last shutdown is no good */
+	VAttachIndex_Forget_r(vcom.vop->volume);
+    }
+#endif /* AFS_DEMAND_ATTACH_FS */
+
     switch (com->hdr.command) {
     case FSYNC_VOL_ON:
     case FSYNC_VOL_ATTACH:
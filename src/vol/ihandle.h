@@ -56,6 +56,8 @@
  *	file descriptor.
  * IH_IREAD/IH_IWRITE - read/write an Inode.
  * IH_INC/IH_DEC - increment/decrement the link count.
+ * IH_BEGIN_LINKBATCH/IH_END_LINKBATCH - hold link count changes for a volume
+ *	group in memory until the batch ends.
  *
  * Replacements for C runtime file operations
  * FDH_READ/FDH_WRITE - read/write using the file descriptor.
@@ -507,6 +509,13 @@ extern int OS_TRUNC(FD_t FD, OFFT L);
 # endif /* AFS_NT40_ENV */
 # define IH_INC(H, I, P) namei_inc(H, I, P)
 # define IH_DEC(H, I, P) namei_dec(H, I, P)
+# ifdef AFS_NT40_ENV
+#  define IH_BEGIN_LINKBATCH(H) 0
+#  define IH_END_LINKBATCH(H) 0
+# else
+#  define IH_BEGIN_LINKBATCH(H) namei_BeginLinkCountBatch(H)
+#  define IH_END_LINKBATCH(H) namei_EndLinkCountBatch(H)
+# endif
 # define IH_IREAD(H, O, B, S) namei_iread(H, O, B, S)
 # define IH_IWRITE(H, O, B, S) namei_iwrite(H, O, B, S)
 # define IH_CREATE(H, D, P, N, P1, P2, P3, P4) \
@@ -545,6 +554,9 @@ extern Inode ih_icreate(IHandle_t * ih, int dev, char *part, Inode nI, int p1,
 
 # define OS_SYNC(FD) fsync(FD)
 
+# define IH_BEGIN_LINKBATCH(H) 0
+# define IH_END_LINKBATCH(H) 0
+
 # ifdef AFS_LINUX22_ENV
 #  define IH_INC(H, I, P) -1
 #  define IH_DEC(H, I, P) -1
@@ -71,6 +71,10 @@
 int Testing=0;
 
 static void namei_UnlockLinkCount(FdHandle_t * fdP, Inode ino);
+#ifndef AFS_NT40_ENV
+static int namei_AdjustBatchedLinkCount(IHandle_t *lh, Inode ino, int delta,
+					int *countp);
+#endif
 
 afs_sfsize_t
 namei_iread(IHandle_t * h, afs_foff_t offset, char *buf, afs_fsize_t size)
@@ -1151,7 +1155,26 @@ namei_dec(IHandle_t * ih, Inode ino, int p1)
 	}
 
 	/* If it's the link table itself, decrement the link count. */
+#ifndef AFS_NT40_ENV
+	if (type == VI_LINKTABLE) {
+	    code = namei_AdjustBatchedLinkCount(tmp, (Inode) 0, -1, &count);
+	    if (code < 0) {
+		FDH_REALLYCLOSE(fdP);
+		IH_RELEASE(tmp);
+		return -1;
+	    }
+	    if (code == 0 && count > 0) {
+		FDH_CLOSE(fdP);
+		IH_RELEASE(tmp);
+		return 0;
+	    }
+	    /* with a batch, fall through to remove the table if this was
+	     * its last reference */
+	}
+	if (type == VI_LINKTABLE && code) {
+#else
 	if (type == VI_LINKTABLE) {
+#endif
 	  if ((count = namei_GetLinkCount(fdP, (Inode) 0, 1, 0, 1)) < 0) {
 		FDH_REALLYCLOSE(fdP);
 		IH_RELEASE(tmp);
@@ -1201,6 +1224,16 @@ namei_dec(IHandle_t * ih, Inode ino, int p1)
 	    }
 	}
     } else {
+	fdP = NULL;
+#ifndef AFS_NT40_ENV
+	code = namei_AdjustBatchedLinkCount(ih, ino, -1, &count);
+	if (code < 0)
+	    return -1;
+	if (code == 0)
+	    goto adjusted;
+	code = 0;
+#endif
+
 	/* Get a file descriptor handle for this Inode */
 	fdP = IH_OPEN(ih);
 	if (fdP == NULL) {
@@ -1213,8 +1246,11 @@ namei_dec(IHandle_t * ih, Inode ino, int p1)
 	}
 
 	count--;
+#ifndef AFS_NT40_ENV
+      adjusted:
+#endif
 	if (count >= 0) {
-	    if (namei_SetLinkCount(fdP, ino, count, 1) < 0) {
+	    if (fdP && namei_SetLinkCount(fdP, ino, count, 1) < 0) {
 		FDH_REALLYCLOSE(fdP);
 		return -1;
 	    }
@@ -1227,7 +1263,7 @@ namei_dec(IHandle_t * ih, Inode ino, int p1)
 
 	    /* If we're less than 0, someone presumably unlinked;
 	       don't bother setting count to 0, but we need to drop a lock */
-	    if (namei_SetLinkCount(fdP, ino, 0, 1) < 0) {
+	    if (fdP && namei_SetLinkCount(fdP, ino, 0, 1) < 0) {
 		FDH_REALLYCLOSE(fdP);
 		return -1;
 	    }
@@ -1240,7 +1276,8 @@ namei_dec(IHandle_t * ih, Inode ino, int p1)
 	    IH_RELEASE(th);
 	    code = OS_UNLINK(name.n_path);
 	}
-	FDH_CLOSE(fdP);
+	if (fdP)
+	    FDH_CLOSE(fdP);
     }
 
     return code;
@@ -1260,6 +1297,18 @@ namei_inc(IHandle_t * h, Inode ino, int p1)
 	ino = (Inode) 0;
     }
 
+#ifndef AFS_NT40_ENV
+    code = namei_AdjustBatchedLinkCount(h, ino, 1, &count);
+    if (code <= 0) {
+	if (code == 0 && count > 7) {
+	    errno = OS_ERROR(EINVAL);
+	    code = -1;
+	}
+	return code;
+    }
+    code = 0;
+#endif
+
     /* Get a file descriptor handle for this Inode */
     fdP = IH_OPEN(h);
     if (fdP == NULL) {
@@ -1518,6 +1567,365 @@ pthread_mutex_t _namei_glc_lock = PTHREAD_MUTEX_INITIALIZER;
 #define NAMEI_GLC_UNLOCK
 #endif /* !AFS_PTHREAD_ENV */
 
+#ifndef AFS_NT40_ENV
+/*
+ * Link count batches.
+ *
+ * Every IH_INC and IH_DEC normally locks the link table, reads and
+ * rewrites one row, and fsyncs the table. Operations that adjust many link
+ * counts in one volume group, such as cloning or purging a volume, can
+ * instead bracket their work with IH_BEGIN_LINKBATCH/IH_END_LINKBATCH.
+ * The link table is then locked once and read into memory; link count
+ * reads and updates for that volume group use the in-memory rows, and the
+ * changed rows are written back and synced once when the batch ends.
+ *
+ * If we crash during a batch the link table may lag behind the vnode
+ * indices, just as it can when we crash in the middle of a clone today;
+ * callers only batch work which leaves the volume in need of a salvage
+ * until it completes, and the salvager recomputes the link counts.
+ */
+struct namei_lc_batch {
+    struct namei_lc_batch *next;
+    IHandle_t *ih;              /* link table handle */
+    FdHandle_t *fdP;            /* locked link table descriptor */
+    unsigned short *rows;       /* link table rows, by vnode number */
+    int nrows;                  /* number of valid rows */
+    int maxrows;                /* allocated size of rows */
+    int dirtyLow;               /* first changed row */
+    int dirtyHigh;              /* last changed row, or -1 if none */
+    int refCount;               /* number of outstanding begins */
+    int loading;                /* the link table is still being read */
+};
+
+static struct namei_lc_batch *namei_lcBatches;	/* under NAMEI_LCB_LOCK */
+
+#ifdef AFS_PTHREAD_ENV
+static pthread_mutex_t namei_lcb_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t namei_lcb_cv = PTHREAD_COND_INITIALIZER;
+#define NAMEI_LCB_LOCK opr_mutex_enter(&namei_lcb_lock)
+#define NAMEI_LCB_UNLOCK opr_mutex_exit(&namei_lcb_lock)
+#define NAMEI_LCB_WAIT opr_cv_wait(&namei_lcb_cv, &namei_lcb_lock)
+#define NAMEI_LCB_BROADCAST opr_cv_broadcast(&namei_lcb_cv)
+#else /* !AFS_PTHREAD_ENV */
+#define NAMEI_LCB_LOCK
+#define NAMEI_LCB_UNLOCK
+#define NAMEI_LCB_WAIT
+#define NAMEI_LCB_BROADCAST
+#endif /* !AFS_PTHREAD_ENV */
+
+/**
+ * find the link count batch for a volume group, even one still loading.
+ *
+ * @param[in] ih  any handle in the volume group, or NULL
+ *
+ * @return the batch, or NULL if the volume group has none
+ *
+ * @pre NAMEI_LCB_LOCK is held
+ *
+ * @internal
+ */
+static struct namei_lc_batch *
+namei_LookupLCBatch_r(IHandle_t *ih)
+{
+    struct namei_lc_batch *b;
+
+    if (ih == NULL)
+	return NULL;
+    for (b = namei_lcBatches; b; b = b->next) {
+	if (b->ih->ih_dev == ih->ih_dev && b->ih->ih_vid == ih->ih_vid)
+	    return b;
+    }
+    return NULL;
+}
+
+/**
+ * find the active link count batch for a volume group.
+ *
+ * If the batch is still reading the link table, wait until it is done.
+ *
+ * @param[in] ih  any handle in the volume group, or NULL
+ *
+ * @return the batch, or NULL if the volume group has none
+ *
+ * @pre NAMEI_LCB_LOCK is held; it may be dropped while waiting
+ *
+ * @internal
+ */
+static struct namei_lc_batch *
+namei_FindLCBatch_r(IHandle_t *ih)
+{
+    struct namei_lc_batch *b;
+
+    while ((b = namei_LookupLCBatch_r(ih)) != NULL && b->loading)
+	NAMEI_LCB_WAIT;
+    return b;
+}
+
+/**
+ * make sure a batch has room for a given row, zero filling any new rows.
+ *
+ * @return operation status
+ *    @retval 0 success
+ *    @retval -1 out of memory
+ *
+ * @internal
+ */
+static int
+namei_GrowLCBatch_r(struct namei_lc_batch *b, int row)
+{
+    unsigned short *rows;
+    int max;
+
+    if (row < b->nrows)
+	return 0;
+    if (row >= b->maxrows) {
+	max = b->maxrows ? b->maxrows : 1024;
+	while (max <= row)
+	    max *= 2;
+	rows = realloc(b->rows, max * sizeof(*rows));
+	if (rows == NULL)
+	    return -1;
+	b->rows = rows;
+	b->maxrows = max;
+    }
+    memset(&b->rows[b->nrows], 0, (row + 1 - b->nrows) * sizeof(*b->rows));
+    b->nrows = row + 1;
+    return 0;
+}
+
+/**
+ * change a row of a batched link table.
+ *
+ * @pre NAMEI_LCB_LOCK is held
+ *
+ * @internal
+ */
+static void
+namei_SetLCBatchRow_r(struct namei_lc_batch *b, int row, unsigned short value)
+{
+    b->rows[row] = value;
+    if (b->dirtyHigh < 0) {
+	b->dirtyLow = b->dirtyHigh = row;
+    } else {
+	b->dirtyLow = min(b->dirtyLow, row);
+	b->dirtyHigh = max(b->dirtyHigh, row);
+    }
+}
+
+/**
+ * start caching the link counts of a volume group in memory.
+ *
+ * Batches nest; the link table is written back when the last batch for
+ * the volume group ends. Within a process, every thread's link count
+ * operations on the volume group use the batch while it is active. Other
+ * processes wait on the link table lock until it ends.
+ *
+ * The batch is published, marked as loading, before the link table is
+ * opened, so a concurrent begin for the same volume group shares it
+ * rather than opening and locking the table a second time; link count
+ * operations wait until the rows have been read.
+ *
+ * @param[in] lh  link table handle for the volume group
+ *
+ * @return operation status
+ *    @retval 0 success
+ *    @retval -1 error; link counts are handled without a batch
+ */
+int
+namei_BeginLinkCountBatch(IHandle_t *lh)
+{
+    struct namei_lc_batch *b, **bp;
+    afs_sfsize_t size;
+    ssize_t len;
+
+    NAMEI_LCB_LOCK;
+    b = namei_LookupLCBatch_r(lh);
+    if (b) {
+	b->refCount++;
+	NAMEI_LCB_UNLOCK;
+	return 0;
+    }
+    b = calloc(1, sizeof(*b));
+    if (b == NULL) {
+	NAMEI_LCB_UNLOCK;
+	return -1;
+    }
+    b->dirtyHigh = -1;
+    b->refCount = 1;
+    b->loading = 1;
+    IH_COPY(b->ih, lh);
+    b->next = namei_lcBatches;
+    namei_lcBatches = b;
+    NAMEI_LCB_UNLOCK;
+
+    b->fdP = IH_OPEN(b->ih);
+    if (b->fdP == NULL)
+	goto error;
+    if (FDH_LOCKFILE(b->fdP, 0) != 0) {
+	FDH_REALLYCLOSE(b->fdP);
+	b->fdP = NULL;
+	goto error;
+    }
+
+    size = FDH_SIZE(b->fdP);
+    if (size < 0)
+	goto error_locked;
+    if (size > 8 && namei_GrowLCBatch_r(b, (size - 8) / sizeof(short) - 1))
+	goto error_locked;
+    if (b->nrows > 0) {
+	len = b->nrows * sizeof(short);
+	if (FDH_PREAD(b->fdP, (char *)b->rows, len, 8) != len)
+	    goto error_locked;
+    }
+
+    NAMEI_LCB_LOCK;
+    b->loading = 0;
+    NAMEI_LCB_BROADCAST;
+    NAMEI_LCB_UNLOCK;
+    return 0;
+
+  error_locked:
+    FDH_UNLOCKFILE(b->fdP, 0);
+    FDH_REALLYCLOSE(b->fdP);
+  error:
+    /* withdraw the batch; anyone who shared it carries on without one */
+    NAMEI_LCB_LOCK;
+    for (bp = &namei_lcBatches; *bp != b; bp = &(*bp)->next)
+	;
+    *bp = b->next;
+    NAMEI_LCB_BROADCAST;
+    NAMEI_LCB_UNLOCK;
+    Log("namei_BeginLinkCountBatch: unable to read link table of volume "
+	"group %" AFS_VOLID_FMT " (errno %d)\n",
+	afs_printable_VolumeId_lu(lh->ih_vid), errno);
+    IH_RELEASE(b->ih);
+    free(b->rows);
+    free(b);
+    return -1;
+}
+
+/**
+ * end a link count batch, writing back the link counts it changed.
+ *
+ * @param[in] lh  link table handle for the volume group
+ *
+ * @return operation status
+ *    @retval 0 success, or there was no batch to end
+ *    @retval -1 the link table could not be written
+ */
+int
+namei_EndLinkCountBatch(IHandle_t *lh)
+{
+    struct namei_lc_batch *b, **bp;
+    ssize_t len;
+    int code = 0;
+
+    NAMEI_LCB_LOCK;
+    b = namei_FindLCBatch_r(lh);
+    if (b == NULL || --b->refCount > 0) {
+	NAMEI_LCB_UNLOCK;
+	return 0;
+    }
+    for (bp = &namei_lcBatches; *bp != b; bp = &(*bp)->next)
+	;
+    *bp = b->next;
+    NAMEI_LCB_UNLOCK;
+
+    if (b->dirtyHigh >= 0) {
+	len = (b->dirtyHigh - b->dirtyLow + 1) * sizeof(short);
+	if (FDH_PWRITE(b->fdP, (char *)&b->rows[b->dirtyLow], len,
+		       8 + b->dirtyLow * sizeof(short)) != len
+	    || FDH_SYNC(b->fdP) != 0) {
+	    Log("namei_EndLinkCountBatch: unable to write link table of "
+		"volume group %" AFS_VOLID_FMT " (errno %d)\n",
+		afs_printable_VolumeId_lu(lh->ih_vid), errno);
+	    code = -1;
+	}
+    }
+    FDH_UNLOCKFILE(b->fdP, 0);
+    if (code)
+	FDH_REALLYCLOSE(b->fdP);
+    else
+	FDH_CLOSE(b->fdP);
+    IH_RELEASE(b->ih);
+    free(b->rows);
+    free(b);
+    return code;
+}
+
+/**
+ * look up the batch, row and column for an inode's link count.
+ *
+ * @param[in]  ih     link table handle, or NULL
+ * @param[in]  ino    inode number
+ * @param[out] row    link table row
+ * @param[out] index  bit offset of the inode's column within the row
+ *
+ * @return the batch, or NULL if the volume group has none
+ *
+ * @pre NAMEI_LCB_LOCK is held
+ *
+ * @internal
+ */
+static struct namei_lc_batch *
+namei_GetLCBatchSlot_r(IHandle_t *ih, Inode ino, int *row, int *index)
+{
+    struct namei_lc_batch *b;
+    afs_foff_t offset;
+
+    b = namei_FindLCBatch_r(ih);
+    if (b) {
+	namei_GetLCOffsetAndIndexFromIno(ino, &offset, index);
+	*row = (int)((offset - 8) >> LINKTABLE_SHIFT);
+    }
+    return b;
+}
+
+/**
+ * add delta to an inode's link count in a batched link table.
+ *
+ * The stored count is clamped to 0 through 7; the unclamped result is
+ * returned so callers can report underflow and overflow as they do
+ * without a batch.
+ *
+ * @param[in]  lh      link table handle
+ * @param[in]  ino     inode number
+ * @param[in]  delta   amount to add to the link count
+ * @param[out] countp  new link count, before clamping
+ *
+ * @return operation status
+ *    @retval 1 the volume group has no batch; nothing was done
+ *    @retval 0 success
+ *    @retval -1 the inode has no row in the link table
+ *
+ * @internal
+ */
+static int
+namei_AdjustBatchedLinkCount(IHandle_t *lh, Inode ino, int delta, int *countp)
+{
+    struct namei_lc_batch *b;
+    unsigned short value;
+    int row, index, count, code = 0;
+
+    NAMEI_LCB_LOCK;
+    b = namei_GetLCBatchSlot_r(lh, ino, &row, &index);
+    if (b == NULL) {
+	code = 1;
+    } else if (row >= b->nrows) {
+	code = -1;
+    } else {
+	value = b->rows[row];
+	count = ((value >> index) & NAMEI_TAGMASK) + delta;
+	value &= (unsigned short)~(NAMEI_TAGMASK << index);
+	value |= (unsigned short)(max(0, min(count, 7)) << index);
+	namei_SetLCBatchRow_r(b, row, value);
+	*countp = count;
+    }
+    NAMEI_LCB_UNLOCK;
+    return code;
+}
+#endif /* !AFS_NT40_ENV */
+
 /**
  * get the link count of an inode.
  *
@@ -1547,6 +1955,37 @@ namei_GetLinkCount(FdHandle_t * h, Inode ino, int lockit, int fixup, int nowrite
     /* there's no linktable yet. the salvager will create one later */
     if (h->fd_fd == INVALID_FD && fixup)
        return 1;
+
+#ifndef AFS_NT40_ENV
+    {
+	struct namei_lc_batch *b;
+	int brow, count = -1;
+
+	NAMEI_LCB_LOCK;
+	b = namei_GetLCBatchSlot_r(h->fd_ih, ino, &brow, &index);
+	if (b && brow >= b->nrows) {
+	    /* past the end of the link table */
+	    if (fixup && nowrite) {
+		count = 1;
+	    } else if (fixup && !namei_GrowLCBatch_r(b, brow)) {
+		namei_SetLCBatchRow_r(b, brow, 1 << index);
+		count = 1;
+	    }
+	} else if (b) {
+	    row = b->rows[brow];
+	    count = (row >> index) & NAMEI_TAGMASK;
+	    if (fixup && !count) {
+		if (!nowrite)
+		    namei_SetLCBatchRow_r(b, brow, row | (1 << index));
+		count = 1;
+	    }
+	}
+	NAMEI_LCB_UNLOCK;
+	if (b)
+	    return count;
+    }
+#endif /* !AFS_NT40_ENV */
+
     namei_GetLCOffsetAndIndexFromIno(ino, &offset, &index);
 
     if (lockit) {
@@ -1621,6 +2060,31 @@ GetFreeTag(IHandle_t * ih, int vno)
     short row;
     ssize_t nBytes;
 
+#ifndef AFS_NT40_ENV
+    {
+	struct namei_lc_batch *b;
+
+	col = -1;
+	NAMEI_LCB_LOCK;
+	b = namei_FindLCBatch_r(ih);
+	if (b && namei_GrowLCBatch_r(b, vno) == 0) {
+	    row = b->rows[vno];
+	    for (col = 0; col < NAMEI_MAXVOLS; col++) {
+		if ((row & (7 << (col * 3))) == 0)
+		    break;
+	    }
+	    if (col < NAMEI_MAXVOLS) {
+		namei_SetLCBatchRow_r(b, vno, row | (1 << (col * 3)));
+	    } else {
+		errno = ENOSPC;
+		col = -1;
+	    }
+	}
+	NAMEI_LCB_UNLOCK;
+	if (b)
+	    return col;
+    }
+#endif /* !AFS_NT40_ENV */
 
     fdP = IH_OPEN(ih);
     if (fdP == NULL)
@@ -1686,6 +2150,27 @@ namei_SetLinkCount(FdHandle_t * fdP, Inode ino, int count, int locked)
 
     namei_GetLCOffsetAndIndexFromIno(ino, &offset, &index);
 
+#ifndef AFS_NT40_ENV
+    {
+	struct namei_lc_batch *b;
+	int brow;
+
+	nBytes = -1;
+	NAMEI_LCB_LOCK;
+	b = namei_GetLCBatchSlot_r(fdP->fd_ih, ino, &brow, &index);
+	if (b && namei_GrowLCBatch_r(b, brow) == 0) {
+	    row = b->rows[brow];
+	    row &= (unsigned short)~(7 << index);
+	    row |= (unsigned short)(count << index);
+	    namei_SetLCBatchRow_r(b, brow, row);
+	    nBytes = 0;
+	}
+	NAMEI_LCB_UNLOCK;
+	if (b)
+	    return (int)nBytes;
+    }
+#endif /* !AFS_NT40_ENV */
+
     if (!locked) {
 	if (FDH_LOCKFILE(fdP, offset) != 0) {
 	    return -1;
@@ -1730,6 +2215,19 @@ namei_UnlockLinkCount(FdHandle_t * fdP, Inode ino)
 
     namei_GetLCOffsetAndIndexFromIno(ino, &offset, &index);
 
+#ifndef AFS_NT40_ENV
+    {
+	struct namei_lc_batch *b;
+
+	/* batched link tables stay locked until the batch ends */
+	NAMEI_LCB_LOCK;
+	b = namei_FindLCBatch_r(fdP->fd_ih);
+	NAMEI_LCB_UNLOCK;
+	if (b)
+	    return;
+    }
+#endif /* !AFS_NT40_ENV */
+
     FDH_UNLOCKFILE(fdP, offset);
 }
 
@@ -1850,6 +2348,318 @@ ListViceInodes(char *devname, char *mountedOn, FD_t inodeFile,
 }
 
 
+#if defined(AFS_PTHREAD_ENV) && !defined(AFS_NT40_ENV)
+/** @addtogroup afs_vol_namei_parlist */
+/*@{*/
+
+/**
+ * an inode found by a walk thread, waiting to be passed to writeFun.
+ */
+struct namei_list_entry {
+    struct ViceInodeInfo info;
+    char *dir;
+    char *name;
+};
+
+/**
+ * the inodes a walk thread has found in the volume group it is listing.
+ */
+struct namei_list_buffer {
+    struct namei_list_entry *entries;
+    int nentries;
+    int maxentries;
+};
+
+/**
+ * state shared by the threads of a parallel namei_ListAFSFiles.
+ */
+struct namei_list_state {
+    pthread_mutex_t lock;       /**< protects next, ninodes, error, and
+                                 *   calls to writeFun */
+    IHandle_t ih;               /**< handle for the partition */
+    VolumeId *vids;             /**< volume group directories to list */
+    int nvids;                  /**< number of entries in vids */
+    int next;                   /**< next vids entry to be listed */
+
+    /** function which will write inode metadata to fp */
+    int (*writeFun) (FD_t, struct ViceInodeInfo *, char *, char *);
+    FD_t fp;                    /**< file pointer for writeFun */
+
+    /** inode filter function */
+    int (*judgeFun) (struct ViceInodeInfo *, VolumeId, void *);
+    void *rock;                 /**< pointer passed to judgeFun */
+    int ninodes;                /**< number of inodes written so far */
+    int error;                  /**< asserted when a thread has failed */
+};
+
+static int namei_listThreads = 1;
+
+static pthread_once_t listbuf_once = PTHREAD_ONCE_INIT;
+static pthread_key_t listbuf_key;
+
+/**
+ * set the number of threads used to walk a whole partition.
+ *
+ * With more than one thread, namei_ListAFSFiles lists several volume
+ * groups at once. Each volume group is still handed to writeFun in one
+ * piece, one volume group at a time, but judgeFun may be called from
+ * several threads at once.
+ *
+ * @param[in] nThreads  number of threads; 1 walks the partition in the
+ *                      calling thread
+ */
+void
+namei_SetListThreads(int nThreads)
+{
+    namei_listThreads = (nThreads < 1 ? 1 : nThreads);
+}
+
+/**
+ * create the listbuf_key key for a walk thread's inode buffer.
+ */
+static void
+_namei_listbuf_keycreate(void)
+{
+    opr_Verify(pthread_key_create(&listbuf_key, NULL) == 0);
+}
+
+/**
+ * writeFun used by walk threads; save an inode in this thread's buffer.
+ *
+ * @return operation status
+ *    @retval 0 success
+ *    @retval -2 out of memory
+ *
+ * @internal
+ */
+static int
+_namei_listbuf_write(FD_t fp, struct ViceInodeInfo *info, char *dir,
+		     char *name)
+{
+    struct namei_list_buffer *buf = pthread_getspecific(listbuf_key);
+    struct namei_list_entry *entry;
+
+    if (buf->nentries == buf->maxentries) {
+	int max = buf->maxentries ? buf->maxentries * 2 : 256;
+	struct namei_list_entry *entries;
+
+	entries = realloc(buf->entries, max * sizeof(*entries));
+	if (entries == NULL)
+	    return -2;
+	buf->entries = entries;
+	buf->maxentries = max;
+    }
+    entry = &buf->entries[buf->nentries];
+    entry->info = *info;
+    entry->dir = strdup(dir);
+    entry->name = strdup(name);
+    if (entry->dir == NULL || entry->name == NULL) {
+	free(entry->dir);
+	free(entry->name);
+	return -2;
+    }
+    buf->nentries++;
+    return 0;
+}
+
+/**
+ * pass the inodes in a walk thread's buffer on to the caller's writeFun.
+ *
+ * Once any thread has failed, the inodes are discarded instead.
+ *
+ * @param[in] state  the parallel listing state
+ * @param[in] buf    the buffer to flush; it is left empty
+ *
+ * @pre state->lock is held
+ *
+ * @return operation status
+ *    @retval 0 success
+ *    @retval -1 writeFun failed
+ *
+ * @internal
+ */
+static int
+_namei_listbuf_flush(struct namei_list_state *state,
+		     struct namei_list_buffer *buf)
+{
+    int i, code, ret = 0;
+    struct namei_list_entry *entry;
+
+    for (i = 0, entry = buf->entries; i < buf->nentries; i++, entry++) {
+	if (!ret && !state->error) {
+	    code = (*state->writeFun) (state->fp, &entry->info, entry->dir,
+				       entry->name);
+	    if (code < 0) {
+		Log("namei_ListAFSFiles: writeFun returned %d\n", code);
+		ret = -1;
+	    }
+	}
+	free(entry->dir);
+	free(entry->name);
+    }
+    buf->nentries = 0;
+    return ret;
+}
+
+/**
+ * walk thread; list volume groups until there are none left.
+ *
+ * @param[in] rock  the struct namei_list_state
+ *
+ * @internal
+ */
+static void *
+_namei_list_thread(void *rock)
+{
+    struct namei_list_state *state = rock;
+    struct namei_list_buffer buf;
+    IHandle_t myIH = state->ih;
+    int code;
+
+    memset(&buf, 0, sizeof(buf));
+    opr_Verify(pthread_setspecific(listbuf_key, &buf) == 0);
+
+    opr_mutex_enter(&state->lock);
+    while (!state->error && state->next < state->nvids) {
+	myIH.ih_vid = state->vids[state->next++];
+	opr_mutex_exit(&state->lock);
+
+	code = namei_ListAFSSubDirs(&myIH, _namei_listbuf_write, state->fp,
+				    state->judgeFun, 0, state->rock);
+
+	opr_mutex_enter(&state->lock);
+	if (code < 0)
+	    state->error = 1;
+	if (_namei_listbuf_flush(state, &buf) < 0)
+	    state->error = 1;
+	if (!state->error)
+	    state->ninodes += code;
+    }
+    opr_mutex_exit(&state->lock);
+
+    free(buf.entries);
+    opr_Verify(pthread_setspecific(listbuf_key, NULL) == 0);
+    return NULL;
+}
+
+/**
+ * list the volume group directories of a partition using several threads.
+ *
+ * The two levels of hash directories are read first, and the threads then
+ * take volume groups from that list until it is exhausted. A thread saves
+ * the inodes of a volume group in memory and passes them to writeFun once
+ * the whole volume group has been examined, so each volume group's inodes
+ * stay together in fp, as they do in a single threaded walk.
+ *
+ * @param[in] ih        handle for the partition
+ * @param[in] path      path of the partition's AFSIDat directory
+ * @param[in] writeFun  function which writes inode metadata to fp
+ * @param[in] fp        file stream where inode metadata is sent
+ * @param[in] judgeFun  filter function pointer
+ * @param[in] rock      opaque pointer passed into judgeFun
+ *
+ * @return operation status
+ *    @retval <0 error
+ *    @retval >=0 number of matching files found
+ *
+ * @internal
+ */
+static int
+_namei_ListAFSFilesParallel(IHandle_t *ih, char *path,
+			    int (*writeFun) (FD_t, struct ViceInodeInfo *,
+					     char *, char *),
+			    FD_t fp,
+			    int (*judgeFun) (struct ViceInodeInfo *, VolumeId,
+					     void *),
+			    void *rock)
+{
+    struct namei_list_state state;
+    pthread_t *tids = NULL;
+    int maxvids = 0, nthreads = 0, i, code;
+    DIR *dirp1, *dirp2;
+    struct dirent *dp1, *dp2;
+    char path2[512];
+    VolumeId vid;
+
+    opr_Verify(pthread_once(&listbuf_once, _namei_listbuf_keycreate) == 0);
+
+    memset(&state, 0, sizeof(state));
+    state.ih = *ih;
+    state.writeFun = writeFun;
+    state.fp = fp;
+    state.judgeFun = judgeFun;
+    state.rock = rock;
+
+    dirp1 = opendir(path);
+    if (!dirp1)
+	return 0;
+    while ((dp1 = readdir(dirp1))) {
+	if (*dp1->d_name == '.')
+	    continue;
+	snprintf(path2, sizeof(path2), "%s" OS_DIRSEP "%s", path,
+		 dp1->d_name);
+	dirp2 = opendir(path2);
+	if (!dirp2)
+	    continue;
+	while ((dp2 = readdir(dirp2))) {
+	    if (*dp2->d_name == '.')
+		continue;
+	    if (DecodeVolumeName(dp2->d_name, &vid))
+		continue;
+	    if (state.nvids == maxvids) {
+		VolumeId *vids;
+
+		maxvids = maxvids ? maxvids * 2 : 1024;
+		vids = realloc(state.vids, maxvids * sizeof(*vids));
+		if (vids == NULL) {
+		    Log("namei_ListAFSFiles: out of memory listing %s\n",
+			path);
+		    closedir(dirp2);
+		    closedir(dirp1);
+		    free(state.vids);
+		    return -1;
+		}
+		state.vids = vids;
+	    }
+	    state.vids[state.nvids++] = vid;
+	}
+	closedir(dirp2);
+    }
+    closedir(dirp1);
+
+    opr_mutex_init(&state.lock);
+
+    /* The calling thread is one of the walk threads. */
+    if (namei_listThreads > 1 && state.nvids > 1) {
+	tids = calloc(namei_listThreads - 1, sizeof(*tids));
+	for (i = 0; tids != NULL && i < namei_listThreads - 1
+		 && i < state.nvids - 1; i++) {
+	    code = pthread_create(&tids[i], NULL, _namei_list_thread, &state);
+	    if (code) {
+		Log("namei_ListAFSFiles: unable to start walk thread "
+		    "(error %d); continuing with %d\n", code, nthreads + 1);
+		break;
+	    }
+	    nthreads++;
+	}
+    }
+    _namei_list_thread(&state);
+    for (i = 0; i < nthreads; i++) {
+	opr_Verify(pthread_join(tids[i], NULL) == 0);
+    }
+
+    opr_mutex_destroy(&state.lock);
+    free(tids);
+    free(state.vids);
+
+    if (state.error)
+	return -1;
+    return state.ninodes;
+}
+
+/*@}*/
+#endif /* AFS_PTHREAD_ENV && !AFS_NT40_ENV */
+
 /**
  * Collect all the matching AFS files on the drive.
  * If singleVolumeNumber is non-zero, just return files for that volume.
@@ -1910,6 +2720,11 @@ namei_ListAFSFiles(char *dev,
     } else {
 	/* Find all volume data directories and descend through them. */
 	namei_HandleToInodeDir(&name, &ih);
+#if defined(AFS_PTHREAD_ENV) && !defined(AFS_NT40_ENV)
+	if (namei_listThreads > 1)
+	    return _namei_ListAFSFilesParallel(&ih, name.n_path, writeFun, fp,
+					       judgeFun, rock);
+#endif
 	ninodes = 0;
 	dirp1 = opendir(name.n_path);
 	if (!dirp1)
@@ -2512,6 +3327,7 @@ namei_ListAFSSubDirs(IHandle_t * dirIH,
     (void)strcat(path1, NAMEI_SPECDIR);
 
     linkHandle.fd_fd = INVALID_FD;
+    linkHandle.fd_ih = NULL;
 #ifdef AFS_SALSRV_ENV
     opr_Verify(pthread_once(&wq_once, _namei_wq_keycreate) == 0);
 
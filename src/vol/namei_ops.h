@@ -35,6 +35,10 @@ extern int namei_dec(IHandle_t * h, Inode ino, int p1);
 extern int namei_inc(IHandle_t * h, Inode ino, int p1);
 extern int namei_GetLinkCount(FdHandle_t * h, Inode ino, int lockit, int fixup, int nowrite);
 extern int namei_SetLinkCount(FdHandle_t * h, Inode ino, int count, int locked);
+#ifndef AFS_NT40_ENV
+extern int namei_BeginLinkCountBatch(IHandle_t * lh);
+extern int namei_EndLinkCountBatch(IHandle_t * lh);
+#endif
 extern int namei_ViceREADME(char *partition);
 extern int namei_FixSpecialOGM(FdHandle_t *h, int check);
 #include "nfs.h"
@@ -87,6 +91,9 @@ int namei_replace_file_by_hardlink(IHandle_t *hLink, IHandle_t *hTarget);
 #  include <afs/work_queue.h>
 extern void namei_SetWorkQueue(struct afs_work_queue *wq);
 # endif
+# if defined(AFS_PTHREAD_ENV) && !defined(AFS_NT40_ENV)
+extern void namei_SetListThreads(int nThreads);
+# endif
 
 #endif /* AFS_NAMEI_ENV */
 
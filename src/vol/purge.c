@@ -108,6 +108,7 @@ ObliterateRegion(Volume * avp, VnodeClass aclass, StreamHandle_t * afile,
     char buf[SIZEOF_LARGEDISKVNODE];
     int hitEOF;
     int i;
+    int linkbatch;
     afs_int32 code;
     struct VnodeDiskObject *vnode = (struct VnodeDiskObject *)buf;
 
@@ -151,10 +152,18 @@ ObliterateRegion(Volume * avp, VnodeClass aclass, StreamHandle_t * afile,
     OS_SYNC(afile->str_fd);
 
     /* finally, do the idec's */
+    linkbatch = (IH_BEGIN_LINKBATCH(V_linkHandle(avp)) == 0);
     for (i = 0; i < iindex; i++) {
 	IH_DEC(V_linkHandle(avp), inodes[i], V_parentId(avp));
 	DOPOLL;
     }
+    if (linkbatch && IH_END_LINKBATCH(V_linkHandle(avp)) != 0) {
+	Log("ObliterateRegion: unable to update link counts of volume %"
+	    AFS_VOLID_FMT "; forcing it offline for salvage\n",
+	    afs_printable_VolumeId_lu(V_id(avp)));
+	VForceOffline(avp);
+	goto fail;
+    }
 
     /* return the new offset */
     *aoffset = offset;
@@ -238,6 +238,19 @@ handleit(struct cmd_syndesc *as, void *arock)
 	    }
 	}
     }
+    if ((ti = as->parms[22].items)) {	/* -workers # */
+	Workers = atoi(ti->data);
+	if (Workers < 1)
+	    Workers = 1;
+	if (Workers > MAXPARALLEL) {
+	    printf("Setting parallel volume group salvages to maximum of %d \n",
+		   MAXPARALLEL);
+	    Workers = MAXPARALLEL;
+	}
+#if defined(AFS_NAMEI_ENV) && defined(AFS_PTHREAD_ENV) && !defined(AFS_NT40_ENV)
+	namei_SetListThreads(Workers);
+#endif
+    }
     if ((ti = as->parms[11].items)) {	/* -tmpdir */
 	DIR *dirp;
 
@@ -544,6 +557,8 @@ main(int argc, char **argv)
 #endif /* FAST_RESTART */
     cmd_Seek(ts, 21); /* skip DontSalvage and forceDAFS if needed */
     cmd_AddParm(ts, "-f", CMD_FLAG, CMD_OPTIONAL, "Alias for -force");
+    cmd_AddParm(ts, "-workers", CMD_SINGLE, CMD_OPTIONAL,
+		"# of max parallel volume group salvaging per partition");
     err = cmd_Dispatch(argc, argv);
     Exit(err);
     return 0; /* not reached */
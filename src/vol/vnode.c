@@ -38,6 +38,7 @@
 #include "lock.h"
 #include "lwp.h"
 #include <afs/afssyscalls.h>
+#include <afs/srvtrace.h>
 #include "ihandle.h"
 #include "vnode.h"
 #include "volume.h"
@@ -1132,6 +1133,7 @@ VGetVnode(Error * ec, Volume * vp, VnodeId vnodeNumber, int locktype)
     VOL_LOCK;
     retVal = VGetVnode_r(ec, vp, vnodeNumber, locktype);
     VOL_UNLOCK;
+    SrvTrace4(SRVT_GETVNODE, vp->hashid, vnodeNumber, locktype, *ec);
     return retVal;
 }
 
@@ -205,6 +205,7 @@ int ShowRootFiles;		/* -r flag */
 int RebuildDirs;		/* -sal flag */
 int Parallel = 4;		/* -para X flag */
 int PartsPerDisk = 8;		/* Salvage up to 8 partitions on same disk sequentially */
+int Workers = 1;		/* -workers X flag */
 int forceR = 0;			/* -b flag */
 int ShowLog = 0;		/* -showlog flag */
 char *ShowLogFilename = NULL;    /* log file name for -showlog */
@@ -222,6 +223,8 @@ int canfork = 1;
 
 #define	MAXPARALLEL	32
 
+#define SALVAGE_PROGRESS_INTERVAL 60	/* seconds between progress reports */
+
 int OKToZap;			/* -o flag */
 int ForceSalvage;		/* If salvage should occur despite the DONT_SALVAGE flag
 				 * in the volume header */
@@ -270,6 +273,11 @@ struct SalvInfo {
                                                 *   at */
     int useFSYNC; /**< 0 if the fileserver is unavailable; 1 if we should try
                    *   to contact the fileserver over FSYNC */
+
+    int nVolumeGroups;       /**< Number of volume groups in the inode summary */
+    int nWorkers;            /**< Number of child processes currently
+                              *   salvaging a volume group */
+    time_t progressTime;     /**< When we last logged our progress */
 };
 
 char *tmpdir = NULL;
@@ -284,6 +292,8 @@ static int AskVolumeSummary(struct SalvInfo *salvinfo,
                             VolumeId singleVolumeNumber);
 static void MaybeAskOnline(struct SalvInfo *salvinfo, VolumeId volumeId);
 static void AskError(struct SalvInfo *salvinfo, VolumeId volumeId);
+static void WaitForVolumeGroup(struct SalvInfo *salvinfo);
+static void ReportProgress(struct SalvInfo *salvinfo, int nStarted);
 
 #ifdef AFS_DEMAND_ATTACH_FS
 static int LockVolume(struct SalvInfo *salvinfo, VolumeId volumeId);
@@ -706,7 +716,7 @@ SalvageFileSys1(struct DiskPartition64 *partP, VolumeId singleVolumeNumber)
     static char tmpDevName[100];
     static char wpath[100];
     struct VolumeSummary *vsp, *esp;
-    int i, j;
+    int i, j, k;
     int code;
     int tries = 0;
     struct SalvInfo l_salvinfo;
@@ -773,6 +783,15 @@ SalvageFileSys1(struct DiskPartition64 *partP, VolumeId singleVolumeNumber)
     } else {
 	salvinfo->useFSYNC = 0;
 	VLockPartition(partP->name);
+#ifdef AFS_DEMAND_ATTACH_FS
+	/* the fileserver's attach index describes these volumes as they
+	 * were when it last shut down; we are about to change them */
+	if (!Testing && unlink(AFSDIR_SERVER_FSATTACH_FILEPATH) < 0
+	    && errno != ENOENT) {
+	    Log("Error %d when trying to unlink attach index %s\n", errno,
+		AFSDIR_SERVER_FSATTACH_FILEPATH);
+	}
+#endif
 	if (ForceSalvage) {
 	    ForceSalvage = 1;
 	} else {
@@ -881,8 +900,15 @@ SalvageFileSys1(struct DiskPartition64 *partP, VolumeId singleVolumeNumber)
 	canfork = 0;
     }
 
-    for (i = j = 0, vsp = salvinfo->volumeSummaryp, esp = vsp + salvinfo->nVolumes;
-	 i < salvinfo->nVolumesInInodeFile; i = j) {
+    for (i = 0; i < salvinfo->nVolumesInInodeFile; i++) {
+	if (i == 0 || salvinfo->inodeSummary[i].RWvolumeId !=
+		      salvinfo->inodeSummary[i - 1].RWvolumeId)
+	    salvinfo->nVolumeGroups++;
+    }
+    salvinfo->progressTime = time(NULL);
+
+    for (i = j = 0, k = 0, vsp = salvinfo->volumeSummaryp, esp = vsp + salvinfo->nVolumes;
+	 i < salvinfo->nVolumesInInodeFile; i = j, k++) {
 	VolumeId rwvid = salvinfo->inodeSummary[i].RWvolumeId;
 	for (j = i;
 	     j < salvinfo->nVolumesInInodeFile && salvinfo->inodeSummary[j].RWvolumeId == rwvid;
@@ -917,8 +943,14 @@ SalvageFileSys1(struct DiskPartition64 *partP, VolumeId singleVolumeNumber)
 	DoSalvageVolumeGroup(salvinfo, &salvinfo->inodeSummary[i], j - i);
 #endif /* AFS_NT40_ENV */
 
+	if (!singleVolumeNumber && !Showmode)
+	    ReportProgress(salvinfo, k + 1);
     }
 
+    /* Wait for the volume groups still being salvaged by our children */
+    while (salvinfo->nWorkers > 0)
+	WaitForVolumeGroup(salvinfo);
+
     /* Delete any additional volumes that were listed in the partition but which didn't have any corresponding inodes */
     for (; vsp < esp; vsp++) {
 	if (vsp->unused)
@@ -1148,6 +1180,211 @@ OnlyOneVolume(struct ViceInodeInfo *inodeinfo, VolumeId singleVolumeNumber, void
     return (inodeinfo->u.vnode.volumeId == singleVolumeNumber);
 }
 
+/* Number of inode records read at a time when looking for the volume
+ * groups in the inode file */
+#define SALVAGE_INODE_SCAN_BATCH 4096
+
+/* A run of consecutive inode file records belonging to one volume group */
+struct InodeRun {
+    VolumeId rwvolumeId;
+    int index;
+    int nInodes;
+};
+
+/* The read-write volume id an inode is sorted under by CompareInodes */
+static VolumeId
+InodeRWVolumeId(struct ViceInodeInfo *ip)
+{
+    if (ip->u.vnode.vnodeNumber == INODESPECIAL)
+	return ip->u.special.parentId;
+    return ip->u.vnode.volumeId;
+}
+
+static int
+CompareInodeRuns(const void *_p1, const void *_p2)
+{
+    const struct InodeRun *p1 = _p1;
+    const struct InodeRun *p2 = _p2;
+
+    if (p1->rwvolumeId < p2->rwvolumeId)
+	return -1;
+    if (p1->rwvolumeId > p2->rwvolumeId)
+	return 1;
+    return 0;
+}
+
+/* Write an InodeSummary for each volume in the sorted inodes ip[0..nInodes),
+ * which start at record number index of the inode file. */
+static int
+WriteInodeSummaries(struct SalvInfo *salvinfo, FD_t summaryFile,
+		    struct ViceInodeInfo *ip, int nInodes, int index)
+{
+    struct InodeSummary summary;
+
+    memset(&summary, 0, sizeof(summary));
+    summary.index = index;
+    while (nInodes) {
+	CountVolumeInodes(ip, nInodes, &summary);
+	if (OS_WRITE(summaryFile, &summary, sizeof(summary)) != sizeof(summary)) {
+	    Log("Difficulty writing summary file (errno = %d); %s not salvaged\n", errno, salvinfo->fileSysPath);
+	    return -1;
+	}
+	summary.index += (summary.nInodes);
+	nInodes -= summary.nInodes;
+	ip += summary.nInodes;
+    }
+    return 0;
+}
+
+/* Sort the whole inode file at once and summarize it. Memory use is
+ * proportional to the number of inodes on the partition. */
+static int
+SummarizeAllInodes(struct SalvInfo *salvinfo, FD_t summaryFile, int nInodes)
+{
+    struct ViceInodeInfo *ip;
+    afs_sfsize_t size = (afs_sfsize_t)nInodes * sizeof(struct ViceInodeInfo);
+    int code;
+
+    ip = malloc(size);
+    if (ip == NULL) {
+	OS_CLOSE(summaryFile);
+	Abort
+	    ("Unable to allocate enough space to read inode table; %s not salvaged\n",
+	     salvinfo->fileSysPath);
+    }
+    if (OS_PREAD(salvinfo->inodeFd, ip, size, 0) != size) {
+	OS_CLOSE(summaryFile);
+	Abort("Unable to read inode table; %s not salvaged\n",
+	      salvinfo->fileSysPath);
+    }
+    qsort(ip, nInodes, sizeof(struct ViceInodeInfo), CompareInodes);
+    if (OS_PWRITE(salvinfo->inodeFd, ip, size, 0) != size) {
+	OS_CLOSE(summaryFile);
+	Abort("Unable to rewrite inode table; %s not salvaged\n",
+	      salvinfo->fileSysPath);
+    }
+    code = WriteInodeSummaries(salvinfo, summaryFile, ip, nInodes, 0);
+    free(ip);
+    return code;
+}
+
+#ifdef AFS_NAMEI_ENV
+/* Summarize the inode file one volume group at a time.
+ *
+ * The namei directory walk lists all the inodes of a volume group
+ * together, so the inode file is a series of runs, one per volume group,
+ * in directory hash order. Each run is sorted in place and summarized in
+ * turn, so only the largest volume group needs to be held in memory. The
+ * runs are visited in read-write volume id order, so the summaries come
+ * out in the same order as a sort of the whole file would give them.
+ *
+ * Returns 1 without changing anything if some volume group is not listed
+ * contiguously, in which case the caller must sort the whole file.
+ */
+static int
+SummarizeVolumeGroups(struct SalvInfo *salvinfo, FD_t summaryFile,
+		      int nInodes)
+{
+    struct ViceInodeInfo *ip = NULL;
+    struct InodeRun *runs = NULL, *run;
+    int nRuns = 0, maxRuns = 0;
+    int maxRunInodes = 0, nAlloc;
+    int i, n, batch;
+    afs_sfsize_t size;
+    int code = 0;
+
+    /* Find the runs */
+    nAlloc = SALVAGE_INODE_SCAN_BATCH;
+    ip = malloc(nAlloc * sizeof(struct ViceInodeInfo));
+    if (ip == NULL) {
+	OS_CLOSE(summaryFile);
+	Abort("Unable to allocate inode scan buffer; %s not salvaged\n",
+	      salvinfo->fileSysPath);
+    }
+    for (i = 0; i < nInodes; i += batch) {
+	batch = min(nInodes - i, SALVAGE_INODE_SCAN_BATCH);
+	size = (afs_sfsize_t)batch * sizeof(struct ViceInodeInfo);
+	if (OS_PREAD(salvinfo->inodeFd, ip, size,
+		     (afs_foff_t)i * sizeof(struct ViceInodeInfo)) != size) {
+	    OS_CLOSE(summaryFile);
+	    Abort("Unable to read inode table; %s not salvaged\n",
+		  salvinfo->fileSysPath);
+	}
+	for (n = 0; n < batch; n++) {
+	    VolumeId rwid = InodeRWVolumeId(&ip[n]);
+
+	    if (nRuns > 0 && runs[nRuns - 1].rwvolumeId == rwid) {
+		runs[nRuns - 1].nInodes++;
+		continue;
+	    }
+	    if (nRuns == maxRuns) {
+		maxRuns = maxRuns ? maxRuns * 2 : 64;
+		runs = realloc(runs, maxRuns * sizeof(struct InodeRun));
+		if (runs == NULL) {
+		    OS_CLOSE(summaryFile);
+		    Abort("Unable to allocate volume group table; %s not salvaged\n",
+			  salvinfo->fileSysPath);
+		}
+	    }
+	    runs[nRuns].rwvolumeId = rwid;
+	    runs[nRuns].index = i + n;
+	    runs[nRuns].nInodes = 1;
+	    nRuns++;
+	}
+    }
+
+    qsort(runs, nRuns, sizeof(struct InodeRun), CompareInodeRuns);
+    for (i = 0; i < nRuns; i++) {
+	if (i > 0 && runs[i].rwvolumeId == runs[i - 1].rwvolumeId) {
+	    Log("Inodes of volume group %" AFS_VOLID_FMT " are not listed together; sorting all inodes of %s\n",
+		afs_printable_VolumeId_lu(runs[i].rwvolumeId),
+		salvinfo->fileSysPath);
+	    code = 1;
+	    goto done;
+	}
+	maxRunInodes = max(maxRunInodes, runs[i].nInodes);
+    }
+
+    /* Sort and summarize each run */
+    if (maxRunInodes > nAlloc) {
+	free(ip);
+	nAlloc = maxRunInodes;
+	ip = malloc(nAlloc * sizeof(struct ViceInodeInfo));
+	if (ip == NULL) {
+	    OS_CLOSE(summaryFile);
+	    Abort
+		("Unable to allocate enough space to read inode table; %s not salvaged\n",
+		 salvinfo->fileSysPath);
+	}
+    }
+    for (i = 0, run = runs; i < nRuns; i++, run++) {
+	afs_foff_t offset = (afs_foff_t)run->index * sizeof(struct ViceInodeInfo);
+
+	size = (afs_sfsize_t)run->nInodes * sizeof(struct ViceInodeInfo);
+	if (OS_PREAD(salvinfo->inodeFd, ip, size, offset) != size) {
+	    OS_CLOSE(summaryFile);
+	    Abort("Unable to read inode table; %s not salvaged\n",
+		  salvinfo->fileSysPath);
+	}
+	qsort(ip, run->nInodes, sizeof(struct ViceInodeInfo), CompareInodes);
+	if (OS_PWRITE(salvinfo->inodeFd, ip, size, offset) != size) {
+	    OS_CLOSE(summaryFile);
+	    Abort("Unable to rewrite inode table; %s not salvaged\n",
+		  salvinfo->fileSysPath);
+	}
+	code = WriteInodeSummaries(salvinfo, summaryFile, ip, run->nInodes,
+				   run->index);
+	if (code)
+	    break;
+    }
+
+  done:
+    free(ip);
+    free(runs);
+    return code;
+}
+#endif /* AFS_NAMEI_ENV */
+
 /* GetInodeSummary
  *
  * Collect list of inodes in file named by path. If a truly fatal error,
@@ -1159,8 +1396,6 @@ GetInodeSummary(struct SalvInfo *salvinfo, FD_t inodeFile, VolumeId singleVolume
 {
     int forceSal, err;
     int code;
-    struct ViceInodeInfo *ip, *ip_save;
-    struct InodeSummary summary;
     char summaryFileName[50];
     FD_t summaryFile = INVALID_FD;
 #ifdef AFS_NT40_ENV
@@ -1271,39 +1506,18 @@ GetInodeSummary(struct SalvInfo *salvinfo, FD_t inodeFile, VolumeId singleVolume
 	    deleted = 1;
 	    goto error;
 	}
-	ip = malloc(nInodes*sizeof(struct ViceInodeInfo));
-	if (ip == NULL) {
-	    OS_CLOSE(summaryFile);
-	    Abort
-		("Unable to allocate enough space to read inode table; %s not salvaged\n",
-		 dev);
-	}
-	if (OS_READ(salvinfo->inodeFd, ip, st_size) != st_size) {
-	    OS_CLOSE(summaryFile);
-	    Abort("Unable to read inode table; %s not salvaged\n", dev);
-	}
-	qsort(ip, nInodes, sizeof(struct ViceInodeInfo), CompareInodes);
-	if (OS_SEEK(salvinfo->inodeFd, 0, SEEK_SET) == -1
-	    || OS_WRITE(salvinfo->inodeFd, ip, st_size) != st_size) {
+#ifdef AFS_NAMEI_ENV
+	code = SummarizeVolumeGroups(salvinfo, summaryFile, nInodes);
+#else
+	code = 1;
+#endif
+	if (code > 0)
+	    code = SummarizeAllInodes(salvinfo, summaryFile, nInodes);
+	if (code < 0) {
 	    OS_CLOSE(summaryFile);
-	    Abort("Unable to rewrite inode table; %s not salvaged\n", dev);
-	}
-	summary.index = 0;
-	ip_save = ip;
-	while (nInodes) {
-	    CountVolumeInodes(ip, nInodes, &summary);
-	    if (OS_WRITE(summaryFile, &summary, sizeof(summary)) != sizeof(summary)) {
-		Log("Difficulty writing summary file (errno = %d); %s not salvaged\n", errno, dev);
-		OS_CLOSE(summaryFile);
-		retcode = -1;
-		goto error;
-	    }
-	    summary.index += (summary.nInodes);
-	    nInodes -= summary.nInodes;
-	    ip += summary.nInodes;
+	    retcode = -1;
+	    goto error;
 	}
-	free(ip_save);
-	ip = ip_save = NULL;
 	/* Following fflush is not fclose, because if it was debug mode would not work */
 	if (OS_SYNC(summaryFile) == -1) {
 	    Log("Unable to write summary file (errno = %d); %s not salvaged\n", errno, dev);
@@ -1993,7 +2207,12 @@ DoSalvageVolumeGroup(struct SalvInfo *salvinfo, struct InodeSummary *isp, int nV
     if (ShowMounts && !haveRWvolume)
 	return;
     if (canfork && !debug && Fork() != 0) {
-	(void)Wait("Salvage volume group");
+	/* The child salvages this group; keep at most Workers of them
+	 * running at once.  Volume groups share no inodes or headers, so
+	 * they can safely be salvaged side by side. */
+	salvinfo->nWorkers++;
+	while (salvinfo->nWorkers >= Workers)
+	    WaitForVolumeGroup(salvinfo);
 	return;
     }
     for (i = 0, totalInodes = 0; i < nVols; i++)
@@ -2003,10 +2222,11 @@ DoSalvageVolumeGroup(struct SalvInfo *salvinfo, struct InodeSummary *isp, int nV
     allInodes = inodes - isp->index;	/* this would the base of all the inodes
 					 * for the partition, if all the inodes
 					 * had been read into memory */
-    opr_Verify(OS_SEEK
-	   (salvinfo->inodeFd, isp->index * sizeof(struct ViceInodeInfo),
-	    SEEK_SET) != -1);
-    opr_Verify(OS_READ(salvinfo->inodeFd, inodes, size) == size);
+    /* Other volume group children may be reading the inode file too, so
+     * don't move the shared file offset */
+    opr_Verify(OS_PREAD
+	   (salvinfo->inodeFd, inodes, size,
+	    isp->index * sizeof(struct ViceInodeInfo)) == size);
 
     /* Don't try to salvage a read write volume if there isn't one on this
      * partition */
@@ -2203,6 +2423,39 @@ DoSalvageVolumeGroup(struct SalvInfo *salvinfo, struct InodeSummary *isp, int nV
     }
 }
 
+/**
+ * wait for one of the children salvaging a volume group to finish.
+ *
+ * @param[in] salvinfo  salvage job info
+ */
+static void
+WaitForVolumeGroup(struct SalvInfo *salvinfo)
+{
+    (void)Wait("Salvage volume group");
+    salvinfo->nWorkers--;
+}
+
+/**
+ * log how far along the partition salvage is, at most once every
+ * SALVAGE_PROGRESS_INTERVAL seconds.
+ *
+ * @param[in] salvinfo  salvage job info
+ * @param[in] nStarted  number of volume groups handed out so far
+ */
+static void
+ReportProgress(struct SalvInfo *salvinfo, int nStarted)
+{
+    time_t now = time(NULL);
+
+    if (now < salvinfo->progressTime + SALVAGE_PROGRESS_INTERVAL)
+	return;
+    salvinfo->progressTime = now;
+
+    Log("%s: %d of %d volume groups salvaged (%d in progress)\n",
+	salvinfo->fileSysPartition->name, nStarted - salvinfo->nWorkers,
+	salvinfo->nVolumeGroups, salvinfo->nWorkers);
+}
+
 int
 QuickCheck(struct SalvInfo *salvinfo, struct InodeSummary *isp, int nVols)
 {
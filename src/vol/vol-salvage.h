@@ -126,6 +126,7 @@ extern int ShowRootFiles;		/* -r flag */
 extern int RebuildDirs;		        /* -sal flag */
 extern int Parallel;		        /* -para X flag */
 extern int PartsPerDisk;		/* Salvage up to 8 partitions on same disk sequentially */
+extern int Workers;			/* -workers X flag */
 extern int forceR;			/* -b flag */
 extern int ShowLog;		        /* -showlog flag */
 extern int ShowSuid;		        /* -showsuid flag */
@@ -112,6 +112,7 @@
 #include "volume_inline.h"
 #include "common.h"
 #include "vutils.h"
+#include "attach_index.h"
 #include <afs/dir.h>
 
 #ifdef AFS_PTHREAD_ENV
@@ -482,6 +483,8 @@ VOptDefaults(ProgramType pt, VolumePackageOptions *opts)
     opts->offline_shutdown_timeout = -1;
     opts->usage_threshold = 128;
     opts->usage_rate_limit = 5;
+    opts->attach_index_save = 0;
+    opts->attach_index_restore = 0;
 
 #ifdef FAST_RESTART
     opts->unsafe_attach = 1;
@@ -833,6 +836,10 @@ VInitAttachVolumes(ProgramType pt)
 	pthread_t tid;
 	pthread_attr_t attrs;
 
+#ifdef FSSYNC_BUILD_SERVER
+	VAttachIndex_Load(vol_opts.attach_index_restore);
+#endif
+
 	/* create partition work queue */
         queue_Init(&pq);
 	opr_cv_init(&pq.cv);
@@ -1325,6 +1332,12 @@ VShutdown_r(void)
 	}
     }
 
+#ifdef FSSYNC_BUILD_SERVER
+    if (programType == fileServer && vol_opts.attach_index_save) {
+	VAttachIndex_Save_r();
+    }
+#endif
+
     Log("VShutdown:  complete.\n");
 }
 
@@ -2830,6 +2843,7 @@ attach_volume_header(Error *ec, Volume *vp, struct DiskPartition64 *partp,
 {
     struct VolumeDiskHeader diskHeader;
     struct VolumeHeader header;
+    struct VAttachIndexEntry *indexed = NULL;
     int code;
     int first_try = 1;
     int lock_tries = 0, checkout_tries = 0;
@@ -2861,7 +2875,21 @@ attach_volume_header(Error *ec, Volume *vp, struct DiskPartition64 *partp,
 	goto done;
     }
 
-    if (VReadVolumeDiskHeader(volid, partp, NULL)) {
+#if defined(AFS_DEMAND_ATTACH_FS) && defined(FSSYNC_BUILD_SERVER)
+    if (first_try && !peek && programType == fileServer) {
+	/* if we remembered this volume's headers at our last shutdown, and
+	 * nobody has touched it since, we need not read them again */
+	VOL_LOCK;
+	indexed = VAttachIndex_Take_r(partp, volid);
+	VOL_UNLOCK;
+	if (indexed) {
+	    use_locktype = VVolLockType(mode,
+					VolumeWriteable2(indexed->vol.data));
+	}
+    }
+#endif
+
+    if (!indexed && VReadVolumeDiskHeader(volid, partp, NULL)) {
 	/* short-circuit the 'volume does not exist' case */
 	*ec = VNOVOL;
 	goto done;
@@ -2921,17 +2949,27 @@ attach_volume_header(Error *ec, Volume *vp, struct DiskPartition64 *partp,
     }
 #endif /* AFS_DEMAND_ATTACH_FS */
 
-    code = VReadVolumeDiskHeader(volid, partp, &diskHeader);
-    if (code) {
-	if (code == EIO) {
-	    *ec = VSALVAGE;
-	} else {
-	    *ec = VNOVOL;
+    if (indexed) {
+	memset(&header, 0, sizeof(header));
+	header.id = volid;
+	header.parent = indexed->vol.parent;
+	header.volumeInfo = indexed->vol.volumeInfo;
+	header.smallVnodeIndex = indexed->vol.smallVnodeIndex;
+	header.largeVnodeIndex = indexed->vol.largeVnodeIndex;
+	header.linkTable = indexed->vol.linkTable;
+    } else {
+	code = VReadVolumeDiskHeader(volid, partp, &diskHeader);
+	if (code) {
+	    if (code == EIO) {
+		*ec = VSALVAGE;
+	    } else {
+		*ec = VNOVOL;
+	    }
+	    goto done;
 	}
-	goto done;
-    }
 
-    DiskToVolumeHeader(&header, &diskHeader);
+	DiskToVolumeHeader(&header, &diskHeader);
+    }
 
     IH_INIT(vp->vnodeIndex[vLarge].handle, partp->device, header.parent,
 	    header.largeVnodeIndex);
@@ -2972,8 +3010,13 @@ attach_volume_header(Error *ec, Volume *vp, struct DiskPartition64 *partp,
 	}
     }
 #endif /* AFS_DEMAND_ATTACH_FS && FSSYNC_BUILD_CLIENT */
-    (void)ReadHeader(ec, V_diskDataHandle(vp), (char *)&V_disk(vp),
-		     sizeof(V_disk(vp)), VOLUMEINFOMAGIC, VOLUMEINFOVERSION);
+    if (indexed) {
+	memcpy(&V_disk(vp), &indexed->vol.data, sizeof(V_disk(vp)));
+    } else {
+	(void)ReadHeader(ec, V_diskDataHandle(vp), (char *)&V_disk(vp),
+			 sizeof(V_disk(vp)), VOLUMEINFOMAGIC,
+			 VOLUMEINFOVERSION);
+    }
 
 #ifdef AFS_DEMAND_ATTACH_FS
     /* update stats */
@@ -3042,6 +3085,10 @@ attach_volume_header(Error *ec, Volume *vp, struct DiskPartition64 *partp,
 	}
     }
 
+    if (indexed) {
+	free(indexed);
+	indexed = NULL;
+    }
     if (*ec) {
 	VOL_LOCK;
 	FreeVolumeHeader(vp);
@@ -5171,6 +5218,12 @@ VCheckOffline(Volume * vp)
 
 	/* perform async operations */
 	VUpdateVolume_r(&error, vp, 0);
+#ifdef FSSYNC_BUILD_SERVER
+	if (vol_shutting_down && !error && vol_opts.attach_index_save) {
+	    /* what we just wrote is what the next startup will find */
+	    VAttachIndex_Put_r(vp);
+	}
+#endif
 	VCloseVolumeHandles_r(vp);
 
 	if (GetLogLevel() != 0) {
@@ -7152,6 +7205,25 @@ VLRU_SetOptions(int option, afs_uint32 val)
     VLRU_ComputeConstants();
 }
 
+/**
+ * get the number of volumes on each VLRU queue.
+ *
+ * @param[out] lens  queue lengths, indexed by VLRUQueueName
+ *
+ * @note the lengths are read without VOL_LOCK, so they may be slightly
+ *       out of date; they are meant for monitoring.
+ *
+ * @note DAFS only
+ */
+void
+VLRU_GetQueueLengths(afs_uint32 lens[VLRU_QUEUE_INVALID])
+{
+    int idx;
+
+    for (idx = VLRU_QUEUE_NEW; idx < VLRU_QUEUE_INVALID; idx++)
+	lens[idx] = volume_LRU.q[idx].len;
+}
+
 /**
  * compute VLRU internal timing parameters.
  *
@@ -274,6 +274,10 @@ typedef struct VolumePackageOptions {
     afs_int32 usage_threshold;    /*< number of accesses before writing volume header */
     afs_int32 usage_rate_limit;   /*< minimum number of seconds before writing volume
                                    *  header, after usage_threshold is exceeded */
+    afs_int32 attach_index_save;  /**< write the attach index at shutdown (DAFS) */
+    afs_int32 attach_index_restore;
+                                  /**< attach volumes from the attach index
+                                   *   written at the last shutdown (DAFS) */
 } VolumePackageOptions;
 
 /* Magic numbers and version stamps for each type of file */
@@ -880,6 +884,7 @@ extern int VDisconnectSALV_r(void);
 extern void VPrintExtendedCacheStats(int flags);
 extern void VPrintExtendedCacheStats_r(int flags);
 extern void VLRU_SetOptions(int option, afs_uint32 val);
+extern void VLRU_GetQueueLengths(afs_uint32 lens[VLRU_QUEUE_INVALID]);
 extern int VRequestSalvage_r(Error * ec, Volume * vp, int reason, int flags);
 extern int VUpdateSalvagePriority_r(Volume * vp);
 extern int VRegisterVolOp_r(Volume * vp, FSSYNC_VolOp_info * vopinfo);
@@ -67,6 +67,8 @@ struct DumpHeader {
  *     1       0x01    D_DUMPHEADER
  *     2       0x02    D_VOLUMEHEADER
  *     4       0x04    D_DUMPEND
+ *     'D'     0x44    dump contains block deltas      *
+ *     'Z'     0x5a    compression method              *
  *     'n'     0x6e    V_name
  *     't'     0x74    fromtime, V_backupDate
  *     'v'     0x76    V_id / V_parentId               *
@@ -111,6 +113,7 @@ struct DumpHeader {
  *     3       0x03    D_VNODE
  *     4       0x04    D_DUMPEND
  *     'A'     0x41    VVnodeDiskACL
+ *     'B'     0x42    file block delta                *
  *     'a'     0x61    author                          *
  *     'b'     0x62    modeBits
  *     'f'     0x66    small file
@@ -126,3 +129,29 @@ struct DumpHeader {
  *     'v'     0x76    dataVersion                     *
  *     126     0x7e    next tag critical               *
  */
+
+/*
+ * A block delta ('B', always marked critical) replaces a 'f' or 'h' file
+ * entry in a dump made against a base volume.  It holds, in network order:
+ *
+ *     afs_uint32  dataVersion of the base vnode
+ *     afs_uint64  length of the base file
+ *     afs_uint64  length of the new file
+ *
+ * followed by any number of extents, each of which is
+ *
+ *     afs_uint64  offset
+ *     afs_uint32  length
+ *     char        data[length]
+ *
+ * The restoring side copies the file of its existing vnode, which must match
+ * the base, writes the extents over it and truncates it to the new length.
+ */
+#define DUMP_DELTA_HDRSIZE	20
+#define DUMP_DELTA_EXTSIZE	12
+
+/*
+ * A 'Z' tag (always marked critical, and the last tag of the dump header)
+ * holds a single byte naming how the rest of the dump is compressed.
+ */
+#define DUMP_COMPRESS_ZLIB	1	/* one zlib (RFC 1950) stream */
@@ -15,6 +15,12 @@
 #include <ctype.h>
 
 #include <afs/opr.h>
+#ifdef AFS_PTHREAD_ENV
+# include <opr/lock.h>
+#endif
+#ifdef HAVE_ZLIB
+# include <zlib.h>
+#endif
 #include <rx/rx.h>
 #include <rx/rx_queue.h>
 #include <afs/afsint.h>
@@ -70,6 +76,11 @@ static int ReadVnodes(struct iod *iodp, Volume * vp, int incremental,
 static afs_fsize_t volser_WriteFile(int vn, struct iod *iodp,
 				    FdHandle_t * handleP, int tag,
 				    Error * status);
+static int volser_WriteDelta(int vn, struct iod *iodp, Volume * vp,
+			     struct VnodeDiskObject *vnode,
+			     afs_size_t taglen, Inode * nearInodep);
+static int iod_StartUnzip(struct iod *iodp, int method);
+static void iod_EndZip(struct iod *iodp, int abort);
 
 static int SizeDumpDumpHeader(struct iod *iodp, Volume * vp,
 			      afs_int32 fromtime,
@@ -136,6 +147,10 @@ iod_Init(struct iod *iodp, struct rx_call *call)
     iodp->haveOldChar = 0;
     iodp->ncalls = 1;
     iodp->calls = (struct rx_call **)0;
+    iodp->multi = NULL;
+    iodp->deltaBase = NULL;
+    iodp->deltaIndex = NULL;
+    iodp->zip = NULL;
 }
 
 static void
@@ -148,10 +163,291 @@ iod_InitMulti(struct iod *iodp, struct rx_call **calls, int ncalls,
     iodp->ncalls = ncalls;
     iodp->codes = codes;
     iodp->call = (struct rx_call *)0;
+    iodp->multi = NULL;
+    iodp->deltaBase = NULL;
+    iodp->deltaIndex = NULL;
+    iodp->zip = NULL;
 }
 
-/* N.B. iod_Read doesn't check for oldchar (see previous comment) */
-#define iod_Read(iodp, buf, nbytes) rx_Read((iodp)->call, buf, nbytes)
+static afs_uint64
+iod_Now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (afs_uint64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+#ifdef AFS_PTHREAD_ENV
+/*
+ * When a dump is forwarded to several sites, each call is fed by its own
+ * sender thread.  The dump is generated once into reference counted chunks,
+ * and every chunk is queued to each destination that is still alive.  A
+ * destination that is slow to accept data only holds up the dump (and so
+ * the other destinations) once it is IOD_MULTI_MAXQUEUE chunks behind.
+ */
+#define IOD_MULTI_CHUNKSIZE	(64 * 1024)
+#define IOD_MULTI_MAXQUEUE	64
+
+struct iod_chunk {
+    int refCount;		/* destinations which still have to send it */
+    int len;
+    char data[IOD_MULTI_CHUNKSIZE];
+};
+
+struct iod_dest {
+    struct iod_multi *multi;
+    struct rx_call *call;
+    int *code;			/* where to record a failure */
+    pthread_t tid;
+    struct iod_chunk *queue[IOD_MULTI_MAXQUEUE];
+    int head;			/* index of the next chunk to send */
+    int count;			/* number of chunks queued */
+    int dead;			/* rx_Write failed; drop everything */
+    afs_uint64 bytes;		/* bytes sent */
+    afs_uint64 sendTime;	/* usecs spent in rx_Write */
+    afs_uint64 doneTime;	/* usecs from start until the last chunk */
+};
+
+struct iod_multi {
+    pthread_mutex_t lock;
+    pthread_cond_t dataCV;	/* chunks queued, or done */
+    pthread_cond_t spaceCV;	/* chunks sent */
+    struct iod_chunk *cur;	/* chunk being filled by iod_Write */
+    struct iod_dest *dests;
+    int ndests;
+    int done;			/* no more chunks will be queued */
+    int abort;			/* drop queued chunks instead of sending */
+    afs_uint64 startTime;
+    afs_uint64 stallTime;	/* usecs the dump waited for a destination */
+};
+
+/* Drop a destination's reference to a chunk.  Called with the lock held. */
+static void
+iod_PutChunk_r(struct iod_chunk *chunk)
+{
+    if (--chunk->refCount == 0)
+	free(chunk);
+}
+
+static void *
+iod_SendThread(void *rock)
+{
+    struct iod_dest *dest = rock;
+    struct iod_multi *multi = dest->multi;
+    struct iod_chunk *chunk;
+    afs_uint64 start;
+    int len, code;
+
+    opr_mutex_enter(&multi->lock);
+    for (;;) {
+	while (dest->count == 0 && !multi->done)
+	    opr_cv_wait(&multi->dataCV, &multi->lock);
+	if (multi->abort)
+	    break;
+	if (dest->count == 0) {
+	    /* Send the last partial packet now, rather than when the caller
+	     * gets around to ending this call after the slowest destination
+	     * has caught up, so this site can finish its restore. */
+	    opr_mutex_exit(&multi->lock);
+	    rx_FlushWrite(dest->call);
+	    opr_mutex_enter(&multi->lock);
+	    break;
+	}
+	chunk = dest->queue[dest->head];
+	len = chunk->len;
+	opr_mutex_exit(&multi->lock);
+
+	start = iod_Now();
+	code = rx_Write(dest->call, chunk->data, len);
+	dest->sendTime += iod_Now() - start;
+
+	opr_mutex_enter(&multi->lock);
+	dest->head = (dest->head + 1) % IOD_MULTI_MAXQUEUE;
+	dest->count--;
+	iod_PutChunk_r(chunk);
+	if (code != len) {
+	    /* everything gets merged into a single error, as in iod_Write */
+	    *dest->code = VOLSERDUMPERROR;
+	    dest->dead = 1;
+	    break;
+	}
+	dest->bytes += len;
+	opr_cv_broadcast(&multi->spaceCV);
+    }
+    while (dest->count > 0) {
+	iod_PutChunk_r(dest->queue[dest->head]);
+	dest->head = (dest->head + 1) % IOD_MULTI_MAXQUEUE;
+	dest->count--;
+    }
+    dest->doneTime = iod_Now() - multi->startTime;
+    opr_cv_broadcast(&multi->spaceCV);
+    opr_mutex_exit(&multi->lock);
+    return NULL;
+}
+
+/* Queue the chunk being filled to every destination still alive.  Returns
+ * the number of such destinations. */
+static int
+iod_QueueChunk(struct iod_multi *multi)
+{
+    struct iod_chunk *chunk = multi->cur;
+    afs_uint64 start = 0;
+    int i, full, nalive;
+
+    multi->cur = NULL;
+    opr_mutex_enter(&multi->lock);
+    for (;;) {
+	for (full = 0, i = 0; i < multi->ndests; i++) {
+	    if (!multi->dests[i].dead
+		&& multi->dests[i].count == IOD_MULTI_MAXQUEUE)
+		full = 1;
+	}
+	if (!full)
+	    break;
+	if (!start)
+	    start = iod_Now();
+	opr_cv_wait(&multi->spaceCV, &multi->lock);
+    }
+    if (start)
+	multi->stallTime += iod_Now() - start;
+
+    chunk->refCount = 0;
+    for (i = 0; i < multi->ndests; i++) {
+	struct iod_dest *dest = &multi->dests[i];
+
+	if (dest->dead)
+	    continue;
+	dest->queue[(dest->head + dest->count) % IOD_MULTI_MAXQUEUE] = chunk;
+	dest->count++;
+	chunk->refCount++;
+    }
+    nalive = chunk->refCount;
+    if (nalive == 0)
+	free(chunk);
+    else
+	opr_cv_broadcast(&multi->dataCV);
+    opr_mutex_exit(&multi->lock);
+
+    return nalive;
+}
+
+static int
+iod_WriteMulti(struct iod_multi *multi, char *buf, int nbytes)
+{
+    int n, left = nbytes;
+
+    while (left > 0) {
+	if (!multi->cur) {
+	    multi->cur = malloc(sizeof(struct iod_chunk));
+	    if (!multi->cur)
+		return 0;
+	    multi->cur->len = 0;
+	}
+	n = IOD_MULTI_CHUNKSIZE - multi->cur->len;
+	if (n > left)
+	    n = left;
+	memcpy(multi->cur->data + multi->cur->len, buf, n);
+	multi->cur->len += n;
+	buf += n;
+	left -= n;
+	if (multi->cur->len == IOD_MULTI_CHUNKSIZE
+	    && iod_QueueChunk(multi) == 0)
+	    return 0;
+    }
+    return nbytes;
+}
+
+/* Send what is left of the dump, or drop it if abort is set, and wait for
+ * the sender threads to finish. */
+static void
+iod_EndMulti(struct iod *iodp, int abort)
+{
+    struct iod_multi *multi = iodp->multi;
+    struct iod_dest *dest;
+    int i;
+
+    if (!multi)
+	return;
+    if (multi->cur) {
+	if (abort)
+	    free(multi->cur);
+	else
+	    (void)iod_QueueChunk(multi);
+	multi->cur = NULL;
+    }
+    opr_mutex_enter(&multi->lock);
+    multi->done = 1;
+    multi->abort = abort;
+    opr_cv_broadcast(&multi->dataCV);
+    opr_mutex_exit(&multi->lock);
+
+    for (i = 0; i < multi->ndests; i++) {
+	dest = &multi->dests[i];
+	if (!dest->call)
+	    continue;
+	opr_Verify(pthread_join(dest->tid, NULL) == 0);
+	Log("1 Volser: ForwardMulti: destination %d: %llu bytes, "
+	    "%llu ms sending, done after %llu ms%s\n", i,
+	    (unsigned long long)dest->bytes,
+	    (unsigned long long)dest->sendTime / 1000,
+	    (unsigned long long)dest->doneTime / 1000,
+	    dest->dead ? " (failed)" : "");
+    }
+    Log("1 Volser: ForwardMulti: dump waited %llu ms for the "
+	"slowest destination\n",
+	(unsigned long long)multi->stallTime / 1000);
+
+    opr_cv_destroy(&multi->dataCV);
+    opr_cv_destroy(&multi->spaceCV);
+    opr_mutex_destroy(&multi->lock);
+    free(multi->dests);
+    free(multi);
+    iodp->multi = NULL;
+}
+
+/* Start a sender thread for each call which has not already failed.  If
+ * that is not possible, the dump is written to the calls directly. */
+static void
+iod_StartMulti(struct iod *iodp)
+{
+    struct iod_multi *multi;
+    int i;
+
+    multi = calloc(1, sizeof(*multi));
+    if (!multi)
+	return;
+    multi->dests = calloc(iodp->ncalls, sizeof(struct iod_dest));
+    if (!multi->dests) {
+	free(multi);
+	return;
+    }
+    opr_mutex_init(&multi->lock);
+    opr_cv_init(&multi->dataCV);
+    opr_cv_init(&multi->spaceCV);
+    multi->ndests = iodp->ncalls;
+    multi->startTime = iod_Now();
+    iodp->multi = multi;
+
+    for (i = 0; i < iodp->ncalls; i++) {
+	struct iod_dest *dest = &multi->dests[i];
+
+	dest->multi = multi;
+	dest->code = &iodp->codes[i];
+	if (!iodp->calls[i] || *dest->code) {
+	    dest->dead = 1;
+	    continue;
+	}
+	dest->call = iodp->calls[i];
+	if (pthread_create(&dest->tid, NULL, iod_SendThread, dest) != 0) {
+	    dest->call = NULL;
+	    dest->dead = 1;
+	    iod_EndMulti(iodp, 1);
+	    return;
+	}
+    }
+}
+#endif /* AFS_PTHREAD_ENV */
 
 /* For the single dump case, it's ok to just return the "bytes written"
  * that rx_Write returns, since all the callers of iod_Write abort when
@@ -160,7 +456,7 @@ iod_InitMulti(struct iod *iodp, struct rx_call **calls, int ncalls,
  * connection timed out, but if they all time out, then we should give up.
  */
 static int
-iod_Write(struct iod *iodp, char *buf, int nbytes)
+iod_WriteRaw(struct iod *iodp, char *buf, int nbytes)
 {
     int code, i;
     int one_success = 0;
@@ -173,6 +469,11 @@ iod_Write(struct iod *iodp, char *buf, int nbytes)
 	return code;
     }
 
+#ifdef AFS_PTHREAD_ENV
+    if (iodp->multi)
+	return iod_WriteMulti(iodp->multi, buf, nbytes);
+#endif
+
     for (i = 0; i < iodp->ncalls; i++) {
 	if (iodp->calls[i] && !iodp->codes[i]) {
 	    code = rx_Write(iodp->calls[i], buf, nbytes);
@@ -191,6 +492,115 @@ iod_Write(struct iod *iodp, char *buf, int nbytes)
 	return 0;
 }
 
+#ifdef HAVE_ZLIB
+/*
+ * Everything after the dump header of a compressed dump is one zlib
+ * stream.  It is compressed once, before a ForwardMultiple hands it to
+ * each destination.
+ */
+#define IOD_ZIP_BUFSIZE	(64 * 1024)
+#define IOD_ZIP_LEVEL	Z_BEST_SPEED	/* so we keep up with fast links */
+
+struct iod_zip {
+    z_stream zs;
+    int deflating;		/* compressing writes, else inflating reads */
+    int eof;			/* end of the compressed stream seen */
+    afs_uint64 rawBytes;	/* bytes before compression */
+    afs_uint64 zipBytes;	/* bytes after compression */
+    afs_uint64 zipTime;		/* usecs spent in zlib */
+    unsigned char buf[IOD_ZIP_BUFSIZE];
+};
+
+/* Send the compressed data collected so far. */
+static int
+iod_ZipFlush(struct iod *iodp)
+{
+    struct iod_zip *zip = iodp->zip;
+    int n = IOD_ZIP_BUFSIZE - zip->zs.avail_out;
+
+    zip->zs.next_out = zip->buf;
+    zip->zs.avail_out = IOD_ZIP_BUFSIZE;
+    zip->zipBytes += n;
+    if (n > 0 && iod_WriteRaw(iodp, (char *)zip->buf, n) != n)
+	return VOLSERDUMPERROR;
+    return 0;
+}
+
+static int
+iod_ZipWrite(struct iod *iodp, char *buf, int nbytes)
+{
+    struct iod_zip *zip = iodp->zip;
+    afs_uint64 start;
+    int code;
+
+    zip->zs.next_in = (unsigned char *)buf;
+    zip->zs.avail_in = nbytes;
+    while (zip->zs.avail_in > 0) {
+	start = iod_Now();
+	code = deflate(&zip->zs, Z_NO_FLUSH);
+	zip->zipTime += iod_Now() - start;
+	if (code != Z_OK)
+	    return 0;
+	if (zip->zs.avail_out == 0 && iod_ZipFlush(iodp))
+	    return 0;
+    }
+    zip->rawBytes += nbytes;
+    return nbytes;
+}
+
+static int
+iod_ZipRead(struct iod *iodp, char *buf, int nbytes)
+{
+    struct iod_zip *zip = iodp->zip;
+    int code, n;
+
+    zip->zs.next_out = (unsigned char *)buf;
+    zip->zs.avail_out = nbytes;
+    while (zip->zs.avail_out > 0 && !zip->eof) {
+	if (zip->zs.avail_in == 0) {
+	    n = rx_Read(iodp->call, (char *)zip->buf, IOD_ZIP_BUFSIZE);
+	    if (n <= 0)
+		break;
+	    zip->zs.next_in = zip->buf;
+	    zip->zs.avail_in = n;
+	    zip->zipBytes += n;
+	}
+	code = inflate(&zip->zs, Z_NO_FLUSH);
+	if (code == Z_STREAM_END) {
+	    zip->eof = 1;
+	} else if (code != Z_OK) {
+	    Log("1 Volser: Corrupt compressed dump stream: %s\n",
+		zip->zs.msg ? zip->zs.msg : "unknown error");
+	    zip->eof = 1;
+	}
+    }
+    n = nbytes - zip->zs.avail_out;
+    zip->rawBytes += n;
+    return n;
+}
+#endif /* HAVE_ZLIB */
+
+static int
+iod_Write(struct iod *iodp, char *buf, int nbytes)
+{
+#ifdef HAVE_ZLIB
+    if (iodp->zip)
+	return iod_ZipWrite(iodp, buf, nbytes);
+#endif
+    return iod_WriteRaw(iodp, buf, nbytes);
+}
+
+/* N.B. iod_Read doesn't check for oldchar (see previous comment) */
+static int
+iod_Read(struct iod *iodp, char *buf, int nbytes)
+{
+#ifdef HAVE_ZLIB
+    if (iodp->zip)
+	return iod_ZipRead(iodp, buf, nbytes);
+#endif
+    return rx_Read(iodp->call, buf, nbytes);
+}
+
 static void
 iod_ungetc(struct iod *iodp, int achar)
 {
@@ -665,7 +1075,6 @@ DumpStandardTag(struct iod *iodp, char tag, afs_uint32 section)
     return 0;
 }
 
-AFS_UNUSED
 static afs_int32
 DumpStandardTagLen(struct iod *iodp, char tag, afs_uint32 section,
                         afs_size_t length)
@@ -836,6 +1245,185 @@ DumpFile(struct iod *iodp, int vnode, FdHandle_t * handleP)
     return error;
 }
 
+/*
+ * Block deltas are computed by comparing the file with the file of the same
+ * vnode in the base volume, DELTA_BLOCKSIZE bytes at a time.  Changed blocks
+ * that touch are sent as one extent.
+ */
+#define DELTA_BLOCKSIZE	8192
+#define DELTA_READSIZE	65536
+#define DELTA_MAXEXTENT	0x40000000
+
+struct delta_extent {
+    afs_foff_t offset;
+    afs_uint32 length;
+};
+
+/*
+ * Dump a file as a block delta against the base volume if that is worth
+ * doing.  Falls back to DumpFile when the base has no usable copy of the
+ * vnode or when more than half of the file has changed.
+ */
+static int
+DumpFileDelta(struct iod *iodp, int vnode, struct VnodeDiskObject *v,
+	      FdHandle_t * handleP)
+{
+    char basebuf[SIZEOF_SMALLDISKVNODE];
+    struct VnodeDiskObject *basev = (struct VnodeDiskObject *)basebuf;
+    struct VnodeClassInfo *vcp = &VnodeClassInfo[vSmall];
+    struct delta_extent *ext = NULL, *tex;
+    int next = 0, maxext = 0, i;
+    IHandle_t *bihP = NULL;
+    FdHandle_t *bfdP = NULL;
+    char *nbuf = NULL, *bbuf = NULL;
+    afs_sfsize_t baseLen, newLen, changed = 0, n, bn, b, blen;
+    afs_foff_t off;
+    afs_size_t taglen;
+    afs_uint32 hi, lo;
+    afs_ino_str_t stmp;
+    char tbuffer[DUMP_DELTA_HDRSIZE];
+    byte *p;
+    int code = 0, full = 0;
+
+    if (FDH_PREAD(iodp->deltaIndex, basev, vcp->diskSize,
+		  vnodeIndexOffset(vcp, vnode)) != vcp->diskSize
+	|| basev->type != vFile || basev->uniquifier != v->uniquifier
+	|| !VNDISK_GET_INO(basev))
+	return DumpFile(iodp, vnode, handleP);
+
+    VNDISK_GET_LEN(baseLen, basev);
+    VNDISK_GET_LEN(newLen, v);
+
+    /* Only the metadata changed; the file is still shared with the base. */
+    if (VNDISK_GET_INO(basev) == VNDISK_GET_INO(v) && baseLen == newLen)
+	goto emit;
+
+    IH_INIT(bihP, iodp->device, iodp->parentId, VNDISK_GET_INO(basev));
+    bfdP = IH_OPEN(bihP);
+    nbuf = malloc(DELTA_READSIZE);
+    bbuf = malloc(DELTA_READSIZE);
+    if (bfdP == NULL || nbuf == NULL || bbuf == NULL
+	|| FDH_SIZE(bfdP) != baseLen) {
+	full = 1;
+	goto done;
+    }
+
+    for (off = 0; off < newLen && !full; off += n) {
+	n = newLen - off;
+	if (n > DELTA_READSIZE)
+	    n = DELTA_READSIZE;
+	if (FDH_PREAD(handleP, nbuf, n, off) != n) {
+	    full = 1;
+	    break;
+	}
+	bn = 0;
+	if (off < baseLen) {
+	    bn = baseLen - off;
+	    if (bn > n)
+		bn = n;
+	    if (FDH_PREAD(bfdP, bbuf, bn, off) != bn) {
+		full = 1;
+		break;
+	    }
+	}
+	for (b = 0; b < n; b += DELTA_BLOCKSIZE) {
+	    blen = n - b;
+	    if (blen > DELTA_BLOCKSIZE)
+		blen = DELTA_BLOCKSIZE;
+	    if (b + blen <= bn && memcmp(nbuf + b, bbuf + b, blen) == 0)
+		continue;
+	    changed += blen;
+	    if (changed > newLen / 2) {
+		full = 1;
+		break;
+	    }
+	    if (next > 0 && ext[next - 1].offset + ext[next - 1].length
+		== off + b && ext[next - 1].length + blen <= DELTA_MAXEXTENT) {
+		ext[next - 1].length += blen;
+		continue;
+	    }
+	    if (next == maxext) {
+		maxext = maxext ? maxext * 2 : 16;
+		tex = realloc(ext, maxext * sizeof(*ext));
+		if (tex == NULL) {
+		    full = 1;
+		    break;
+		}
+		ext = tex;
+	    }
+	    ext[next].offset = off + b;
+	    ext[next].length = blen;
+	    next++;
+	}
+#ifndef AFS_PTHREAD_ENV
+	IOMGR_Poll();
+#endif
+    }
+    if (full)
+	goto done;
+
+  emit:
+    taglen = DUMP_DELTA_HDRSIZE;
+    for (i = 0; i < next; i++)
+	taglen += DUMP_DELTA_EXTSIZE + ext[i].length;
+    code = DumpTag(iodp, 0x7e);
+    if (!code)
+	code = DumpStandardTagLen(iodp, 'B', 2, taglen);
+    if (!code) {
+	p = (byte *)tbuffer;
+	afs_putint32(p, basev->dataVersion);
+	SplitInt64(baseLen, hi, lo);
+	afs_putint32(p, hi);
+	afs_putint32(p, lo);
+	SplitInt64(newLen, hi, lo);
+	afs_putint32(p, hi);
+	afs_putint32(p, lo);
+	if (iod_Write(iodp, tbuffer, DUMP_DELTA_HDRSIZE) != DUMP_DELTA_HDRSIZE)
+	    code = VOLSERDUMPERROR;
+    }
+    for (i = 0; i < next && !code; i++) {
+	p = (byte *)tbuffer;
+	SplitInt64(ext[i].offset, hi, lo);
+	afs_putint32(p, hi);
+	afs_putint32(p, lo);
+	afs_putint32(p, ext[i].length);
+	if (iod_Write(iodp, tbuffer, DUMP_DELTA_EXTSIZE) != DUMP_DELTA_EXTSIZE) {
+	    code = VOLSERDUMPERROR;
+	    break;
+	}
+	for (off = 0; off < ext[i].length; off += n) {
+	    n = ext[i].length - off;
+	    if (n > DELTA_READSIZE)
+		n = DELTA_READSIZE;
+	    /* The volume is busy while we dump it, so the data read during
+	     * the comparison above cannot have changed. */
+	    if (FDH_PREAD(handleP, nbuf, n, ext[i].offset + off) != n) {
+		Log("1 Volser: DumpFileDelta: Error reading inode %s for vnode %d: %s\n",
+		    PrintInode(stmp, handleP->fd_ih->ih_ino), vnode,
+		    afs_error_message(errno));
+		code = VOLSERDUMPERROR;
+		break;
+	    }
+	    if (iod_Write(iodp, nbuf, n) != n) {
+		code = VOLSERDUMPERROR;
+		break;
+	    }
+	}
+    }
+
+  done:
+    if (bfdP)
+	FDH_CLOSE(bfdP);
+    if (bihP)
+	IH_RELEASE(bihP);
+    free(nbuf);
+    free(bbuf);
+    free(ext);
+    if (full)
+	return DumpFile(iodp, vnode, handleP);
+    return code;
+}
+
 static int
 DumpVolumeHeader(struct iod *iodp, Volume * vp)
 {
@@ -913,12 +1501,121 @@ DumpEnd(struct iod *iodp)
     return (DumpInt32(iodp, D_DUMPEND, DUMPENDMAGIC));
 }
 
+/*
+ * Compress the rest of the dump.  The 'Z' tag is critical so that
+ * restorers which cannot decompress refuse the dump instead of
+ * misreading it.  If the compressor cannot be set up, the dump is
+ * simply sent uncompressed.
+ */
+static int
+iod_StartZip(struct iod *iodp)
+{
+#ifdef HAVE_ZLIB
+    struct iod_zip *zip;
+    char method = DUMP_COMPRESS_ZLIB;
+    int code;
+
+    zip = calloc(1, sizeof(*zip));
+    if (zip == NULL)
+	return 0;
+    if (deflateInit(&zip->zs, IOD_ZIP_LEVEL) != Z_OK) {
+	Log("1 Volser: Unable to start compressing dump; sending it uncompressed\n");
+	free(zip);
+	return 0;
+    }
+    zip->deflating = 1;
+    zip->zs.next_out = zip->buf;
+    zip->zs.avail_out = IOD_ZIP_BUFSIZE;
+
+    code = DumpTag(iodp, 0x7e);
+    if (!code)
+	code = DumpStandardTagLen(iodp, 'Z', 0, 1);
+    if (!code && iod_Write(iodp, &method, 1) != 1)
+	code = VOLSERDUMPERROR;
+    if (code) {
+	deflateEnd(&zip->zs);
+	free(zip);
+	return code;
+    }
+    iodp->zip = zip;
+#endif
+    return 0;
+}
+
+/* Decompress the rest of the dump, which was compressed with method. */
+static int
+iod_StartUnzip(struct iod *iodp, int method)
+{
+#ifdef HAVE_ZLIB
+    struct iod_zip *zip;
+
+    if (method != DUMP_COMPRESS_ZLIB) {
+	Log("1 Volser: Dump compressed with unknown method %d\n", method);
+	return VOLSERREAD_DUMPERROR;
+    }
+    zip = calloc(1, sizeof(*zip));
+    if (zip == NULL)
+	return ENOMEM;
+    if (inflateInit(&zip->zs) != Z_OK) {
+	Log("1 Volser: Unable to start decompressing dump\n");
+	free(zip);
+	return VOLSERREAD_DUMPERROR;
+    }
+    iodp->zip = zip;
+    return 0;
+#else
+    Log("1 Volser: Dump is compressed, but this server was built without zlib\n");
+    return VOLSERREAD_DUMPERROR;
+#endif
+}
+
+/*
+ * Finish a compressed stream and release its state.  Unless abort is
+ * set, the last of the compressed data is sent.
+ */
+static void
+iod_EndZip(struct iod *iodp, int abort)
+{
+#ifdef HAVE_ZLIB
+    struct iod_zip *zip = iodp->zip;
+    afs_uint64 start;
+    int code = Z_OK;
+
+    if (zip == NULL)
+	return;
+    if (zip->deflating) {
+	zip->zs.next_in = NULL;
+	zip->zs.avail_in = 0;
+	while (!abort && code == Z_OK) {
+	    start = iod_Now();
+	    code = deflate(&zip->zs, Z_FINISH);
+	    zip->zipTime += iod_Now() - start;
+	    if ((code == Z_OK || code == Z_STREAM_END) && iod_ZipFlush(iodp))
+		break;
+	}
+	if (!abort && code == Z_STREAM_END)
+	    Log("1 Volser: Compressed dump from %llu to %llu bytes (%llu%%) in %llu ms, %llu MB/s\n",
+		zip->rawBytes, zip->zipBytes,
+		zip->rawBytes ? zip->zipBytes * 100 / zip->rawBytes : 0,
+		zip->zipTime / 1000,
+		zip->zipTime ? zip->rawBytes / zip->zipTime : 0);
+	deflateEnd(&zip->zs);
+    } else {
+	Log("1 Volser: Decompressed dump from %llu to %llu bytes\n",
+	    zip->zipBytes, zip->rawBytes);
+	inflateEnd(&zip->zs);
+    }
+    iodp->zip = NULL;
+    free(zip);
+#endif
+}
+
 /* Guts of the dump code */
 
 /* Dump a whole volume */
 int
 DumpVolume(struct rx_call *call, Volume * vp,
-	   afs_int32 fromtime, int dumpAllDirs)
+	   afs_int32 fromtime, int dumpAllDirs, int compress)
 {
     struct iod iod;
     int code = 0;
@@ -928,6 +1625,9 @@ DumpVolume(struct rx_call *call, Volume * vp,
     if (!code)
 	code = DumpDumpHeader(iodp, vp, fromtime);
 
+    if (!code && compress)
+	code = iod_StartZip(iodp);
+
     if (!code)
 	code = DumpPartial(iodp, vp, fromtime, dumpAllDirs);
 
@@ -935,6 +1635,50 @@ DumpVolume(struct rx_call *call, Volume * vp,
     if (rx_Error(iodp->call)) {
 	Log("1 Volser: DumpVolume: Rx call failed during dump, error %d\n",
 	    rx_Error(iodp->call));
+	iod_EndZip(iodp, 1);
+	return VOLSERDUMPERROR;
+    }
+    if (!code)
+	code = DumpEnd(iodp);
+    iod_EndZip(iodp, code != 0);
+
+    return code;
+}
+
+/*
+ * Dump a volume, sending the files that differ from those of basevp, a
+ * clone of the same volume whose contents the receiver already has, as
+ * block deltas.
+ */
+int
+DumpVolumeDelta(struct rx_call *call, Volume * vp, Volume * basevp,
+		afs_int32 fromtime)
+{
+    struct iod iod;
+    int code = 0;
+    struct iod *iodp = &iod;
+    iod_Init(iodp, call);
+
+    iodp->deltaBase = basevp;
+    iodp->deltaIndex = IH_OPEN(basevp->vnodeIndex[vSmall].handle);
+    if (iodp->deltaIndex == NULL) {
+	Log("1 Volser: DumpVolumeDelta: Unable to open the vnode index of volume %" AFS_VOLID_FMT "; error %d\n",
+	    afs_printable_VolumeId_lu(V_id(basevp)), errno);
+	return VOLSERDUMPERROR;
+    }
+
+    if (!code)
+	code = DumpDumpHeader(iodp, vp, fromtime);
+
+    if (!code)
+	code = DumpPartial(iodp, vp, fromtime, 0);
+
+    FDH_CLOSE(iodp->deltaIndex);
+    iodp->deltaIndex = NULL;
+
+    if (rx_Error(iodp->call)) {
+	Log("1 Volser: DumpVolumeDelta: Rx call failed during dump, error %d\n",
+	    rx_Error(iodp->call));
 	return VOLSERDUMPERROR;
     }
     if (!code)
@@ -946,18 +1690,28 @@ DumpVolume(struct rx_call *call, Volume * vp,
 /* Dump a volume to multiple places*/
 int
 DumpVolMulti(struct rx_call **calls, int ncalls, Volume * vp,
-	     afs_int32 fromtime, int dumpAllDirs, int *codes)
+	     afs_int32 fromtime, int dumpAllDirs, int compress, int *codes)
 {
     struct iod iod;
     int code = 0;
     iod_InitMulti(&iod, calls, ncalls, codes);
+#ifdef AFS_PTHREAD_ENV
+    if (ncalls > 1)
+	iod_StartMulti(&iod);
+#endif
 
     if (!code)
 	code = DumpDumpHeader(&iod, vp, fromtime);
+    if (!code && compress)
+	code = iod_StartZip(&iod);
     if (!code)
 	code = DumpPartial(&iod, vp, fromtime, dumpAllDirs);
     if (!code)
 	code = DumpEnd(&iod);
+    iod_EndZip(&iod, code != 0);
+#ifdef AFS_PTHREAD_ENV
+    iod_EndMulti(&iod, code != 0);
+#endif
     return code;
 }
 
@@ -1059,6 +1813,12 @@ DumpDumpHeader(struct iod *iodp, Volume * vp,
     }
     if (!code)
 	code = DumpArrayInt32(iodp, 't', (afs_uint32 *) dumpTimes, 2);
+    if (!code && iodp->deltaBase) {
+	/* Older restorers cannot apply deltas; make them refuse the dump. */
+	code = DumpTag(iodp, 0x7e);
+	if (!code)
+	    code = DumpStandardTagLen(iodp, 'D', 0, 0);
+    }
     return code;
 }
 
@@ -1133,7 +1893,10 @@ DumpVnode(struct iod *iodp, struct VnodeDiskObject *v, VolumeId volid,
 		(unsigned long)indexlen, (unsigned long)disklen);
 	    return VOLSERREAD_DUMPERROR;
 	}
-	code = DumpFile(iodp, vnodeNumber, fdP);
+	if (iodp->deltaBase && v->type == vFile)
+	    code = DumpFileDelta(iodp, vnodeNumber, v, fdP);
+	else
+	    code = DumpFile(iodp, vnodeNumber, fdP);
 	FDH_CLOSE(fdP);
 	IH_RELEASE(ihP);
     }
@@ -1258,14 +2021,18 @@ RestoreVolume(struct rx_call *call, Volume * avp, int incremental,
 
     if (!ReadDumpHeader(iodp, &header)) {
 	Log("1 Volser: RestoreVolume: Error reading header file for dump; aborted\n");
-	return VOLSERREAD_DUMPERROR;
+	error = VOLSERREAD_DUMPERROR;
+	goto out;
     }
     if (iod_getc(iodp) != D_VOLUMEHEADER) {
 	Log("1 Volser: RestoreVolume: Volume header missing from dump; not restored\n");
-	return VOLSERREAD_DUMPERROR;
+	error = VOLSERREAD_DUMPERROR;
+	goto out;
+    }
+    if (ReadVolumeHeader(iodp, &vol) == VOLSERREAD_DUMPERROR) {
+	error = VOLSERREAD_DUMPERROR;
+	goto out;
     }
-    if (ReadVolumeHeader(iodp, &vol) == VOLSERREAD_DUMPERROR)
-	return VOLSERREAD_DUMPERROR;
 
     if (!delo)
 	delo = ProcessIndex(vp, vLarge, &b1, &s1, 0);
@@ -1343,6 +2110,7 @@ RestoreVolume(struct rx_call *call, Volume * avp, int incremental,
 	goto out;
     }
   out:
+    iod_EndZip(iodp, 1);
     /* Free the malloced space above */
     if (b1)
 	free(b1);
@@ -1498,6 +2266,25 @@ ReadVnodes(struct iod *iodp, Volume * vp, int incremental,
 		    }
 		    break;
 		}
+	    case 'B':{
+		    afs_size_t taglen;
+
+		    if (ReadStandardTagLen(iodp, tag, 2, &taglen) != 1)
+			return VOLSERREAD_DUMPERROR;
+		    if (saw_f) {
+			Log("Volser: ReadVnodes: warning: ignoring duplicate "
+			    "file entries for vnode %lu in dump\n",
+			    (unsigned long)vnodeNumber);
+			if (!SkipData(iodp, taglen))
+			    return VOLSERREAD_DUMPERROR;
+			break;
+		    }
+		    saw_f = 1;
+		    if (volser_WriteDelta(vnodeNumber, iodp, vp, vnode, taglen,
+					  &nearInode))
+			return VOLSERREAD_DUMPERROR;
+		    break;
+		}
             case 0x7e:
                 critical = 2;
                 break;
@@ -1618,6 +2405,165 @@ volser_WriteFile(int vn, struct iod *iodp, FdHandle_t * handleP, int tag,
     return (written);
 }
 
+/*
+ * Apply a block delta read from the dump to the file of the existing vnode
+ * vn.  The result goes to a new inode, which is stored in vnode; the old
+ * inode is released by our caller when it replaces the vnode.
+ */
+static int
+volser_WriteDelta(int vn, struct iod *iodp, Volume * vp,
+		  struct VnodeDiskObject *vnode, afs_size_t taglen,
+		  Inode * nearInodep)
+{
+    struct VnodeDiskObject oldvnode;
+    struct VnodeClassInfo *vcp = &VnodeClassInfo[vSmall];
+    afs_uint32 baseDV, hi, lo, length;
+    afs_fsize_t baseLen, newLen, oldLen, offset, done, size;
+    IHandle_t *oldH = NULL, *tmpH = NULL;
+    FdHandle_t *oldfdP = NULL, *fdP = NULL, *ifdP;
+    Inode ino = 0;
+    char *p = NULL;
+    ssize_t n;
+    int code = VOLSERREAD_DUMPERROR;
+
+    if (taglen < DUMP_DELTA_HDRSIZE || !ReadInt32(iodp, &baseDV)
+	|| !ReadInt32(iodp, &hi) || !ReadInt32(iodp, &lo))
+	goto bad;
+    FillInt64(baseLen, hi, lo);
+    if (!ReadInt32(iodp, &hi) || !ReadInt32(iodp, &lo))
+	goto bad;
+    FillInt64(newLen, hi, lo);
+    taglen -= DUMP_DELTA_HDRSIZE;
+
+    /* The delta can only be applied to the file it was made against. */
+    if (vnodeIdToClass(vn) != vSmall)
+	goto mismatch;
+    ifdP = IH_OPEN(vp->vnodeIndex[vSmall].handle);
+    if (ifdP == NULL) {
+	Log("1 Volser: ReadVnodes: Error opening vnode index: %s; restore aborted\n",
+	    afs_error_message(errno));
+	V_needsSalvaged(vp) = 1;
+	return VOLSERREAD_DUMPERROR;
+    }
+    n = FDH_PREAD(ifdP, &oldvnode, sizeof(oldvnode),
+		  vnodeIndexOffset(vcp, vn));
+    FDH_CLOSE(ifdP);
+    if (n != sizeof(oldvnode) || oldvnode.type != vFile
+	|| oldvnode.uniquifier != vnode->uniquifier
+	|| oldvnode.dataVersion != baseDV || !VNDISK_GET_INO(&oldvnode))
+	goto mismatch;
+    VNDISK_GET_LEN(oldLen, &oldvnode);
+    if (oldLen != baseLen)
+	goto mismatch;
+
+    /* Nothing but the metadata changed, so keep sharing the old file. */
+    if (taglen == 0 && baseLen == newLen) {
+	IH_INC(V_linkHandle(vp), VNDISK_GET_INO(&oldvnode), V_parentId(vp));
+	VNDISK_SET_INO(vnode, VNDISK_GET_INO(&oldvnode));
+	VNDISK_SET_LEN(vnode, newLen);
+	return 0;
+    }
+
+    IH_INIT(oldH, V_device(vp), V_parentId(vp), VNDISK_GET_INO(&oldvnode));
+    oldfdP = IH_OPEN(oldH);
+    if (oldfdP == NULL) {
+	Log("1 Volser: ReadVnodes: Unable to open the file of vnode %d: %s; restore aborted\n",
+	    vn, afs_error_message(errno));
+	goto fail;
+    }
+    tmpH = IH_CREATE_INIT(V_linkHandle(vp), V_device(vp),
+			  VPartitionPath(V_partition(vp)), *nearInodep,
+			  V_parentId(vp), vn, vnode->uniquifier,
+			  vnode->dataVersion);
+    if (!tmpH) {
+	Log("1 Volser: ReadVnodes: IH_CREATE: %s - restore aborted\n",
+	    afs_error_message(errno));
+	goto fail;
+    }
+    ino = tmpH->ih_ino;
+    *nearInodep = ino;
+    fdP = IH_OPEN(tmpH);
+    p = malloc(DELTA_READSIZE);
+    if (fdP == NULL || p == NULL) {
+	Log("1 Volser: ReadVnodes: IH_OPEN: %s - restore aborted\n",
+	    afs_error_message(errno));
+	goto fail;
+    }
+
+    /* Start from the old contents, ... */
+    for (offset = 0; offset < baseLen && offset < newLen; offset += size) {
+	size = (baseLen < newLen ? baseLen : newLen) - offset;
+	if (size > DELTA_READSIZE)
+	    size = DELTA_READSIZE;
+	if (FDH_PREAD(oldfdP, p, size, offset) != size
+	    || FDH_PWRITE(fdP, p, size, offset) != size) {
+	    Log("1 Volser: ReadVnodes: Error copying the file of vnode %d: %s; restore aborted\n",
+		vn, afs_error_message(errno));
+	    goto fail;
+	}
+    }
+
+    /* ... then write the changed extents over them. */
+    while (taglen > 0) {
+	if (taglen < DUMP_DELTA_EXTSIZE || !ReadInt32(iodp, &hi)
+	    || !ReadInt32(iodp, &lo) || !ReadInt32(iodp, &length))
+	    goto bad;
+	FillInt64(offset, hi, lo);
+	taglen -= DUMP_DELTA_EXTSIZE;
+	if (length > taglen || offset > newLen || length > newLen - offset)
+	    goto bad;
+	taglen -= length;
+	for (done = 0; done < length; done += size) {
+	    size = length - done;
+	    if (size > DELTA_READSIZE)
+		size = DELTA_READSIZE;
+	    if (iod_Read(iodp, p, size) != size)
+		goto bad;
+	    if (FDH_PWRITE(fdP, p, size, offset + done) != size) {
+		Log("1 Volser: ReadVnodes: Error writing (%u) bytes to vnode %d; %s; restore aborted\n",
+		    (unsigned)size, vn, afs_error_message(errno));
+		goto fail;
+	    }
+	}
+    }
+    if (FDH_TRUNC(fdP, newLen) < 0) {
+	Log("1 Volser: ReadVnodes: Error truncating vnode %d: %s; restore aborted\n",
+	    vn, afs_error_message(errno));
+	goto fail;
+    }
+
+    VNDISK_SET_INO(vnode, ino);
+    VNDISK_SET_LEN(vnode, newLen);
+    code = 0;
+    goto done;
+
+  mismatch:
+    Log("1 Volser: ReadVnodes: vnode %d does not match the base of its block delta; restore aborted\n",
+	vn);
+    return VOLSERREAD_DUMPERROR;
+
+  bad:
+    Log("1 Volser: ReadVnodes: Malformed block delta for vnode %d; restore aborted\n",
+	vn);
+  fail:
+    V_needsSalvaged(vp) = 1;
+  done:
+    if (fdP)
+	FDH_REALLYCLOSE(fdP);
+    if (tmpH)
+	IH_RELEASE(tmpH);
+    if (oldfdP)
+	FDH_CLOSE(oldfdP);
+    if (oldH)
+	IH_RELEASE(oldH);
+    free(p);
+    if (code && ino) {
+	Log("1 Volser: ReadVnodes: IDEC inode %llu\n", (afs_uintmax_t) ino);
+	IH_DEC(V_linkHandle(vp), ino, V_parentId(vp));
+    }
+    return code;
+}
+
 static int
 ReadDumpHeader(struct iod *iodp, struct DumpHeader *hp)
 {
@@ -1652,6 +2598,25 @@ ReadDumpHeader(struct iod *iodp, struct DumpHeader *hp)
 		    || !ReadInt32(iodp, (afs_uint32 *) & hp->dumpTimes[i].to))
 		    return 0;
 	    break;
+	case 'D':{
+		/* block deltas follow; ReadVnodes handles them */
+		afs_size_t taglen;
+		if (ReadStandardTagLen(iodp, tag, 0, &taglen) != 1
+		    || !SkipData(iodp, taglen))
+		    return 0;
+		break;
+	    }
+	case 'Z':{
+		/* the rest of the dump is compressed */
+		afs_size_t taglen;
+		int method;
+		if (ReadStandardTagLen(iodp, tag, 0, &taglen) != 1
+		    || taglen < 1 || (method = iod_getc(iodp)) == EOF
+		    || !SkipData(iodp, taglen - 1)
+		    || iod_StartUnzip(iodp, method))
+		    return 0;
+		break;
+	    }
         case 0x7e:
             critical = 2;
             break;
@@ -19,6 +19,9 @@
  * of characters (i.e. characters should not double both as an end marker
  * and a begin marker)
  */
+struct iod_multi;
+struct iod_zip;
+
 struct iod {
     struct rx_call *call;	/* call to which to write, might be an array */
     int device;			/* dump device ID for volume */
@@ -27,13 +30,19 @@ struct iod {
     struct rx_call **calls;	/* array of pointers to calls */
     int ncalls;			/* how many calls/codes in array */
     int *codes;			/* one return code for each call */
+    struct iod_multi *multi;	/* per-call senders, if any */
+    Volume *deltaBase;		/* send file changes against this clone */
+    FdHandle_t *deltaIndex;	/* small vnode index of deltaBase */
+    struct iod_zip *zip;	/* compression state, if any */
     char haveOldChar;		/* state for pushing back a character */
     char oldChar;
 };
 
-extern int DumpVolume(struct rx_call *call, Volume *vp, afs_int32, int);
+extern int DumpVolume(struct rx_call *call, Volume *vp, afs_int32, int,
+		      int);
+extern int DumpVolumeDelta(struct rx_call *, Volume *, Volume *, afs_int32);
 extern int DumpVolMulti(struct rx_call **, int, Volume *, afs_int32, int,
-		        int *);
+		        int, int *);
 extern int RestoreVolume(struct rx_call *, Volume *, int,
 			 struct restoreCookie *);
 extern int SizeDumpVolume(struct rx_call *, Volume *, afs_int32, int,
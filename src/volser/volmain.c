@@ -47,6 +47,7 @@
 #include <ubik.h>
 #include <afs/audit.h>
 #include <afs/afsutil.h>
+#include <afs/srvtrace.h>
 #include <afs/cmd.h>
 #include <lwp.h>
 
@@ -96,9 +97,13 @@ afs_uint32 SHostAddrs[ADDRSPERSITE];
 static void
 MyBeforeProc(struct rx_call *acall)
 {
+    struct rx_peer *peer = rx_PeerOf(rx_ConnectionOf(acall));
+
     VTRANS_LOCK;
     runningCalls++;
     VTRANS_UNLOCK;
+    SrvTrace2(SRVT_VOL_RPC_START, ntohl(rx_HostOf(peer)),
+	      ntohs(rx_PortOf(peer)));
     return;
 }
 
@@ -108,6 +113,7 @@ MyAfterProc(struct rx_call *acall, afs_int32 code)
     VTRANS_LOCK;
     runningCalls--;
     VTRANS_UNLOCK;
+    SrvTrace1(SRVT_VOL_RPC_END, code);
     return;
 }
 
@@ -236,6 +242,7 @@ enum optionsList {
     OPT_threads,
     OPT_auditlog,
     OPT_audit_interface,
+    OPT_srvtrace,
     OPT_nojumbo,
     OPT_jumbo,
     OPT_rxmaxmtu,
@@ -253,7 +260,10 @@ enum optionsList {
     OPT_config,
     OPT_restricted_query,
     OPT_transarc_logs,
-    OPT_s2s_crypt
+    OPT_buffered_logs,
+    OPT_log_format,
+    OPT_s2s_crypt,
+    OPT_list_cache_ttl
 };
 
 static int
@@ -282,6 +292,8 @@ ParseArgs(int argc, char **argv) {
 	   CMD_OPTIONAL, "location of audit log");
     cmd_AddParmAtOffset(opts, OPT_audit_interface, "-audit-interface",
 	   CMD_SINGLE, CMD_OPTIONAL, "interface to use for audit logging");
+    cmd_AddParmAtOffset(opts, OPT_srvtrace, "-srvtrace", CMD_SINGLE,
+	   CMD_OPTIONAL, "location of binary trace file");
     cmd_AddParmAtOffset(opts, OPT_nojumbo, "-nojumbo", CMD_FLAG, CMD_OPTIONAL,
 	    "disable jumbograms");
     cmd_AddParmAtOffset(opts, OPT_jumbo, "-jumbo", CMD_FLAG, CMD_OPTIONAL,
@@ -308,6 +320,10 @@ ParseArgs(int argc, char **argv) {
 #endif
     cmd_AddParmAtOffset(opts, OPT_transarc_logs, "-transarc-logs", CMD_FLAG,
 			CMD_OPTIONAL, "enable Transarc style logging");
+    cmd_AddParmAtOffset(opts, OPT_buffered_logs, "-buffered-logs", CMD_FLAG,
+			CMD_OPTIONAL, "write log messages from a background thread");
+    cmd_AddParmAtOffset(opts, OPT_log_format, "-log-format", CMD_SINGLE,
+			CMD_OPTIONAL, "plain | keyvalue");
     cmd_AddParmAtOffset(opts, OPT_sync, "-sync",
 	    CMD_SINGLE, CMD_OPTIONAL, "always | onclose | never");
     cmd_AddParmAtOffset(opts, OPT_logfile, "-logfile", CMD_SINGLE,
@@ -318,6 +334,9 @@ ParseArgs(int argc, char **argv) {
 	    CMD_SINGLE, CMD_OPTIONAL, "anyuser | admin");
     cmd_AddParmAtOffset(opts, OPT_s2s_crypt, "-s2scrypt",
 	    CMD_SINGLE, CMD_OPTIONAL, "always | inherit | never");
+    cmd_AddParmAtOffset(opts, OPT_list_cache_ttl, "-list-cache-ttl",
+	    CMD_SINGLE, CMD_OPTIONAL,
+	    "seconds to reuse volume headers when listing partitions");
 
     code = cmd_Parse(argc, argv, &opts);
     if (code == CMD_HELP) {
@@ -350,6 +369,14 @@ ParseArgs(int argc, char **argv) {
 	    fprintf(stderr, "Invalid options: -syslog and -transarc-logs are exclusive.\n");
 	    return -1;
 	}
+	if (cmd_OptionPresent(opts, OPT_buffered_logs)) {
+	    fprintf(stderr, "Invalid options: -syslog and -buffered-logs are exclusive.\n");
+	    return -1;
+	}
+	if (cmd_OptionPresent(opts, OPT_log_format)) {
+	    fprintf(stderr, "Invalid options: -syslog and -log-format are exclusive.\n");
+	    return -1;
+	}
 	logopts.lopt_dest = logDest_syslog;
 	logopts.lopt_facility = LOG_DAEMON;
 	logopts.lopt_tag = "volserver";
@@ -366,6 +393,20 @@ ParseArgs(int argc, char **argv) {
 	    cmd_OptionAsString(opts, OPT_logfile, (char**)&logopts.lopt_filename);
 	else
 	    logopts.lopt_filename = AFSDIR_SERVER_VOLSERLOG_FILEPATH;
+	if (cmd_OptionAsFlag(opts, OPT_buffered_logs, &optval) == 0)
+	    logopts.lopt_buffered = optval;
+	if (cmd_OptionAsString(opts, OPT_log_format, &optstring) == 0) {
+	    if (strcmp(optstring, "plain") == 0)
+		logopts.lopt_format = logFormat_plain;
+	    else if (strcmp(optstring, "keyvalue") == 0)
+		logopts.lopt_format = logFormat_keyvalue;
+	    else {
+		fprintf(stderr, "Invalid log format '%s'\n", optstring);
+		return -1;
+	    }
+	    free(optstring);
+	    optstring = NULL;
+	}
     }
     cmd_OptionAsInt(opts, OPT_debug, &logopts.lopt_logLevel);
 
@@ -387,6 +428,16 @@ ParseArgs(int argc, char **argv) {
 	free(optstring);
 	optstring = NULL;
     }
+    if (cmd_OptionAsString(opts, OPT_srvtrace, &optstring) == 0) {
+	code = SrvTrace_Open(optstring);
+	if (code) {
+	    printf("Unable to open trace file '%s': %s\n", optstring,
+		   strerror(code));
+	    return -1;
+	}
+	free(optstring);
+	optstring = NULL;
+    }
     if (cmd_OptionAsInt(opts, OPT_threads, &lwps) == 0) {
 	if (lwps > MAXLWP) {
 	    printf("Warning: '-p %d' is too big; using %d instead\n", lwps, MAXLWP);
@@ -429,6 +480,13 @@ ParseArgs(int argc, char **argv) {
 	}
 	free(s2s_crypt_behavior);
     }
+    if (cmd_OptionAsInt(opts, OPT_list_cache_ttl, &optval) == 0) {
+	if (optval < 0) {
+	    printf("invalid argument for -list-cache-ttl: %d\n", optval);
+	    return -1;
+	}
+	volSummaryTTL = optval;
+    }
 
     return 0;
 }
@@ -93,8 +93,9 @@ static afs_int32 VolGetNthVolume(struct rx_call *, afs_int32, afs_uint32 *,
 static afs_int32 VolGetFlags(struct rx_call *, afs_int32, afs_int32 *);
 static afs_int32 VolSetFlags(struct rx_call *, afs_int32, afs_int32 );
 static afs_int32 VolForward(struct rx_call *, afs_int32, afs_int32,
-			    struct destServer *destination, afs_int32,
-			    struct restoreCookie *cookie);
+			    afs_int32, struct destServer *destination,
+			    afs_int32, struct restoreCookie *cookie,
+			    afs_int32);
 static afs_int32 VolDump(struct rx_call *, afs_int32, afs_int32, afs_int32);
 static afs_int32 VolRestore(struct rx_call *, afs_int32, afs_int32,
 			    struct restoreCookie *);
@@ -1256,7 +1257,47 @@ SAFSVolForward(struct rx_call *acid, afs_int32 fromTrans, afs_int32 fromDate,
     afs_int32 code;
 
     code =
-	VolForward(acid, fromTrans, fromDate, destination, destTrans, cookie);
+	VolForward(acid, fromTrans, fromDate, 0, destination, destTrans,
+		   cookie, 0);
+    osi_auditU(acid, VS_ForwardEvent, code, AUD_LONG, fromTrans, AUD_HOST,
+	       htonl(destination->destHost), AUD_LONG, destTrans, AUD_END);
+    return code;
+}
+
+/* Like SAFSVolForward, but takes VOLFORWARD_* flags; with
+ * VOLFORWARD_COMPRESS the dump is compressed on the wire.
+ */
+afs_int32
+SAFSVolForwardV2(struct rx_call *acid, afs_int32 fromTrans,
+		 afs_int32 fromDate, struct destServer *destination,
+		 afs_int32 destTrans, struct restoreCookie *cookie,
+		 afs_int32 flags)
+{
+    afs_int32 code;
+
+    code =
+	VolForward(acid, fromTrans, fromDate, 0, destination, destTrans,
+		   cookie, flags);
+    osi_auditU(acid, VS_ForwardEvent, code, AUD_LONG, fromTrans, AUD_HOST,
+	       htonl(destination->destHost), AUD_LONG, destTrans, AUD_END);
+    return code;
+}
+
+/* Like SAFSVolForward, but send the files that changed since baseTrans's
+ * volume was cloned from the volume of fromTrans as block deltas.  The
+ * destination volume must hold the contents of the base volume.
+ */
+afs_int32
+SAFSVolForwardDelta(struct rx_call *acid, afs_int32 fromTrans,
+		    afs_int32 fromDate, afs_int32 baseTrans,
+		    struct destServer *destination, afs_int32 destTrans,
+		    struct restoreCookie *cookie)
+{
+    afs_int32 code;
+
+    code =
+	VolForward(acid, fromTrans, fromDate, baseTrans, destination,
+		   destTrans, cookie, 0);
     osi_auditU(acid, VS_ForwardEvent, code, AUD_LONG, fromTrans, AUD_HOST,
 	       htonl(destination->destHost), AUD_LONG, destTrans, AUD_END);
     return code;
@@ -1293,10 +1334,10 @@ MakeClient(struct rx_call *acid, struct rx_securityClass **securityObject,
 
 static afs_int32
 VolForward(struct rx_call *acid, afs_int32 fromTrans, afs_int32 fromDate,
-	       struct destServer *destination, afs_int32 destTrans,
-	       struct restoreCookie *cookie)
+	   afs_int32 baseTrans, struct destServer *destination,
+	   afs_int32 destTrans, struct restoreCookie *cookie, afs_int32 flags)
 {
-    struct volser_trans *tt;
+    struct volser_trans *tt, *tb = NULL;
     afs_int32 code;
     struct rx_connection *tcon;
     struct rx_call *tcall;
@@ -1318,11 +1359,31 @@ VolForward(struct rx_call *acid, afs_int32 fromTrans, afs_int32 fromDate,
 	return ENOENT;
     }
     vp = tt->volume;
+    if (baseTrans) {
+	/* the base must be another volume of the group on the same partition */
+	tb = FindTrans(baseTrans);
+	if (!tb) {
+	    TRELE(tt);
+	    return ENOENT;
+	}
+	if ((tb->vflags & VTDeleted) || tb->volume == NULL || tb == tt
+	    || V_parentId(tb->volume) != V_parentId(vp)
+	    || tb->volume->device != vp->device) {
+	    Log("1 Volser: VolForward: volume %" AFS_VOLID_FMT " cannot be used as a delta base for volume %" AFS_VOLID_FMT "\n",
+		afs_printable_VolumeId_lu(tb->volid),
+		afs_printable_VolumeId_lu(tt->volid));
+	    TRELE(tb);
+	    TRELE(tt);
+	    return EINVAL;
+	}
+    }
     TSetRxCall(tt, NULL, "Forward");
 
     /* get auth info for the this connection (uses afs from ticket file) */
     code = MakeClient(acid, &securityObject, &securityIndex);
     if (code) {
+	if (tb)
+	    TRELE(tb);
 	TRELE(tt);
 	return code;
     }
@@ -1337,6 +1398,8 @@ VolForward(struct rx_call *acid, afs_int32 fromTrans, afs_int32 fromDate,
 
     if (!tcon) {
         TClearRxCall(tt);
+	if (tb)
+	    TRELE(tb);
 	TRELE(tt);
 	return ENOTCONN;
     }
@@ -1349,7 +1412,11 @@ VolForward(struct rx_call *acid, afs_int32 fromTrans, afs_int32 fromDate,
     }
 
     /* these next calls implictly call rx_Write when writing out data */
-    code = DumpVolume(tcall, vp, fromDate, 0);	/* last field = don't dump all dirs */
+    if (tb)
+	code = DumpVolumeDelta(tcall, vp, tb->volume, fromDate);
+    else
+	code = DumpVolume(tcall, vp, fromDate, 0,	/* don't dump all dirs */
+			  (flags & VOLFORWARD_COMPRESS) ? 1 : 0);
     if (code)
 	goto fail;
     EndAFSVolRestore(tcall);	/* probably doesn't do much */
@@ -1359,6 +1426,10 @@ VolForward(struct rx_call *acid, afs_int32 fromTrans, afs_int32 fromDate,
     tcon = NULL;
     if (code)
 	goto fail;
+    if (tb && TRELE(tb)) {
+	TRELE(tt);
+	return VOLSERTRELE_ERROR;
+    }
     if (TRELE(tt))
 	return VOLSERTRELE_ERROR;
 
@@ -1369,6 +1440,8 @@ VolForward(struct rx_call *acid, afs_int32 fromTrans, afs_int32 fromDate,
 	(void)rx_EndCall(tcall, 0);
 	rx_DestroyConnection(tcon);
     }
+    if (tb)
+	TRELE(tb);
     if (tt) {
         TClearRxCall(tt);
 	TRELE(tt);
@@ -1388,7 +1461,7 @@ VolForward(struct rx_call *acid, afs_int32 fromTrans, afs_int32 fromDate,
  */
 afs_int32
 SAFSVolForwardMultiple(struct rx_call *acid, afs_int32 fromTrans, afs_int32
-		       fromDate, manyDests *destinations, afs_int32 spare,
+		       fromDate, manyDests *destinations, afs_int32 flags,
 		       struct restoreCookie *cookie, manyResults *results)
 {
     afs_int32 securityIndex;
@@ -1471,7 +1544,8 @@ SAFSVolForwardMultiple(struct rx_call *acid, afs_int32 fromTrans, afs_int32
     RXS_Close(securityObject);
 
     /* these next calls implictly call rx_Write when writing out data */
-    code = DumpVolMulti(tcalls, i, vp, fromDate, 0, codes);
+    code = DumpVolMulti(tcalls, i, vp, fromDate, 0,
+			(flags & VOLFORWARD_COMPRESS) ? 1 : 0, codes);
 
 
   fail:
@@ -1547,7 +1621,8 @@ VolDump(struct rx_call *acid, afs_int32 fromTrans, afs_int32 fromDate,
     }
     TSetRxCall(tt, acid, "Dump");
     code = DumpVolume(acid, tt->volume, fromDate, (flags & VOLDUMPV2_OMITDIRS)
-		      ? 0 : 1);	/* squirt out the volume's data, too */
+		      ? 0 : 1,	/* squirt out the volume's data, too */
+		      (flags & VOLDUMPV2_COMPRESS) ? 1 : 0);
     if (code) {
         TClearRxCall(tt);
 	TRELE(tt);
@@ -2032,49 +2107,22 @@ typedef struct {
      &((handle)->volinfo_ptr.ext->name))
 
 /**
- * fill in appropriate type of on-wire volume metadata structure.
+ * work out the volume state reported in on-wire volume metadata.
  *
  * @param vp      pointer to volume object
- * @param handle  pointer to wire format handle object
+ * @param summary summary to fill in
  *
  * @pre vp object must contain header & pending_vol_op structurs (populate if from RPC)
- * @pre handle object must have a valid pointer and enumeration value
  *
  * @note passing a NULL value for vp means that the fileserver doesn't
  *       know about this particular volume, thus implying it is offline.
- *
- * @return operation status
- *   @retval 0 success
- *   @retval 1 failure
  */
-static int
-FillVolInfo(Volume * vp, volint_info_handle_t * handle)
+static void
+GetVolSummary(Volume * vp, struct volsummary *summary)
 {
-    unsigned int numStatBytes, now;
     struct VolumeDiskData *hdr = &(V_disk(vp));
 
-    /*read in the relevant info */
-    strcpy((char *)VOLINT_INFO_PTR(handle, name), hdr->name);
-    VOLINT_INFO_STORE(handle, status, VOK);	/*its ok */
-    VOLINT_INFO_STORE(handle, volid, hdr->id);
-    VOLINT_INFO_STORE(handle, type, hdr->type);	/*if ro volume */
-    VOLINT_INFO_STORE(handle, cloneID, hdr->cloneId);	/*if rw volume */
-    VOLINT_INFO_STORE(handle, backupID, hdr->backupId);
-    VOLINT_INFO_STORE(handle, parentID, hdr->parentId);
-    VOLINT_INFO_STORE(handle, copyDate, hdr->copyDate);
-    VOLINT_INFO_STORE(handle, size, hdr->diskused);
-    VOLINT_INFO_STORE(handle, maxquota, hdr->maxquota);
-    VOLINT_INFO_STORE(handle, filecount, hdr->filecount);
-    now = FT_ApproxTime();
-    if ((now - hdr->dayUseDate) > OneDay) {
-	VOLINT_INFO_STORE(handle, dayUse, 0);
-    } else {
-	VOLINT_INFO_STORE(handle, dayUse, hdr->dayUse);
-    }
-    VOLINT_INFO_STORE(handle, creationDate, hdr->creationDate);
-    VOLINT_INFO_STORE(handle, accessDate, hdr->accessDate);
-    VOLINT_INFO_STORE(handle, updateDate, hdr->updateDate);
-    VOLINT_INFO_STORE(handle, backupDate, hdr->backupDate);
+    summary->hdr = *hdr;
 
 #ifdef AFS_DEMAND_ATTACH_FS
     /*
@@ -2108,35 +2156,75 @@ FillVolInfo(Volume * vp, volint_info_handle_t * handle)
 		!VVolOpLeaveOnline_r(vp, vp->pending_vol_op) )
 	)
 	) {
-	VOLINT_INFO_STORE(handle, inUse, 0);
+	summary->inUse = 0;
+    } else {
+	summary->inUse = 1;
+    }
+
+    /* see comment above where we set inUse bit */
+    if (hdr->needsSalvaged ||
+	(vp && VIsErrorState(V_attachState(vp)))) {
+	summary->needsSalvaged = 1;
     } else {
-	VOLINT_INFO_STORE(handle, inUse, 1);
+	summary->needsSalvaged = 0;
     }
 #else
     /* offline status based on program type, where != fileServer enum (1) is offline */
     if (hdr->inUse == fileServer) {
-	VOLINT_INFO_STORE(handle, inUse, 1);
+	summary->inUse = 1;
     } else {
-	VOLINT_INFO_STORE(handle, inUse, 0);
+	summary->inUse = 0;
     }
+    summary->needsSalvaged = hdr->needsSalvaged;
 #endif
+}
 
+/**
+ * fill in appropriate type of on-wire volume metadata structure.
+ *
+ * @param summary volume header and state, from GetVolSummary
+ * @param handle  pointer to wire format handle object
+ *
+ * @pre handle object must have a valid pointer and enumeration value
+ *
+ * @return operation status
+ *   @retval 0 success
+ *   @retval 1 failure
+ */
+static int
+FillVolInfo(struct volsummary *summary, volint_info_handle_t * handle)
+{
+    unsigned int numStatBytes, now;
+    struct VolumeDiskData *hdr = &summary->hdr;
+
+    /*read in the relevant info */
+    strcpy((char *)VOLINT_INFO_PTR(handle, name), hdr->name);
+    VOLINT_INFO_STORE(handle, status, VOK);	/*its ok */
+    VOLINT_INFO_STORE(handle, volid, hdr->id);
+    VOLINT_INFO_STORE(handle, type, hdr->type);	/*if ro volume */
+    VOLINT_INFO_STORE(handle, cloneID, hdr->cloneId);	/*if rw volume */
+    VOLINT_INFO_STORE(handle, backupID, hdr->backupId);
+    VOLINT_INFO_STORE(handle, parentID, hdr->parentId);
+    VOLINT_INFO_STORE(handle, copyDate, hdr->copyDate);
+    VOLINT_INFO_STORE(handle, size, hdr->diskused);
+    VOLINT_INFO_STORE(handle, maxquota, hdr->maxquota);
+    VOLINT_INFO_STORE(handle, filecount, hdr->filecount);
+    now = FT_ApproxTime();
+    if ((now - hdr->dayUseDate) > OneDay) {
+	VOLINT_INFO_STORE(handle, dayUse, 0);
+    } else {
+	VOLINT_INFO_STORE(handle, dayUse, hdr->dayUse);
+    }
+    VOLINT_INFO_STORE(handle, creationDate, hdr->creationDate);
+    VOLINT_INFO_STORE(handle, accessDate, hdr->accessDate);
+    VOLINT_INFO_STORE(handle, updateDate, hdr->updateDate);
+    VOLINT_INFO_STORE(handle, backupDate, hdr->backupDate);
+    VOLINT_INFO_STORE(handle, inUse, summary->inUse);
 
     switch(handle->volinfo_type) {
 	/* NOTE: VOLINT_INFO_STORE not used in this section because values are specific to one volinfo_type */
     case VOLINT_INFO_TYPE_BASE:
-
-#ifdef AFS_DEMAND_ATTACH_FS
-	/* see comment above where we set inUse bit */
-	if (hdr->needsSalvaged ||
-	    (vp && VIsErrorState(V_attachState(vp)))) {
-	    handle->volinfo_ptr.base->needsSalvaged = 1;
-	} else {
-	    handle->volinfo_ptr.base->needsSalvaged = 0;
-	}
-#else
-	handle->volinfo_ptr.base->needsSalvaged = hdr->needsSalvaged;
-#endif
+	handle->volinfo_ptr.base->needsSalvaged = summary->needsSalvaged;
 	handle->volinfo_ptr.base->destroyMe = hdr->destroyMe;
 	handle->volinfo_ptr.base->spare0 = hdr->minquota;
 	handle->volinfo_ptr.base->spare1 =
@@ -2260,6 +2348,8 @@ GetVolInfo(afs_uint32 partId,
     Error error;
     struct volser_trans *ttc = NULL;
     struct Volume *fill_tv, *tv = NULL;
+    struct volsummary summary;
+    afs_uint32 gen = 0;
 #ifdef AFS_DEMAND_ATTACH_FS
     struct Volume fs_tv_buf, *fs_tv = &fs_tv_buf; /* Create a structure, and a pointer to that structure */
     SYNC_PROTO_BUF_DECL(fs_res_buf); /* Buffer for the pending_vol_op */
@@ -2279,6 +2369,8 @@ GetVolInfo(afs_uint32 partId,
 	VOLINT_INFO_STORE(handle, volid, volumeId);
 	goto drop;
     }
+    /* after NewTrans, which invalidates the volume's summary */
+    gen = VolSummaryGeneration();
 
     /* Get volume from volserver */
     if (mode == VOL_INFO_LIST_MULTIPLE)
@@ -2353,7 +2445,8 @@ GetVolInfo(afs_uint32 partId,
 #endif
 
     /* ok, we have all the data we need; fill in the on-wire struct */
-    code = FillVolInfo(fill_tv, handle);
+    GetVolSummary(fill_tv, &summary);
+    code = FillVolInfo(&summary, handle);
 
  drop:
     if (code == -1) {
@@ -2375,9 +2468,33 @@ GetVolInfo(afs_uint32 partId,
 	DeleteTrans(ttc, 1);
 	ttc = NULL;
     }
+    if (code == 0 && !error)
+	VolSummaryStore(partId, volumeId, gen, &summary);
     return code;
 }
 
+/**
+ * like GetVolInfo, for listing a whole partition.  Recently listed
+ * volumes are answered from the volume summary cache without attaching
+ * them again, unless a transaction is open on them; GetVolInfo then
+ * reports them busy.
+ */
+static int
+GetVolInfoCached(afs_uint32 partId,
+		 VolumeId volumeId,
+		 char * pname,
+		 char * volname,
+		 volint_info_handle_t * handle)
+{
+    struct volsummary summary;
+
+    if (VolSummaryLookup(partId, volumeId, &summary)
+	&& !TransExists(volumeId, partId))
+	return FillVolInfo(&summary, handle);
+    return GetVolInfo(partId, volumeId, pname, volname, handle,
+		      VOL_INFO_LIST_MULTIPLE);
+}
+
 
 /*return the header information about the <volid> */
 afs_int32
@@ -2623,12 +2740,11 @@ VolListVolumes(struct rx_call *acid, afs_int32 partid, afs_int32 flags,
 	    handle.volinfo_ptr.base = pntr;
 
 
-	    code = GetVolInfo(partid,
-			      volid,
-			      pname,
-			      volname,
-			      &handle,
-			      VOL_INFO_LIST_MULTIPLE);
+	    code = GetVolInfoCached(partid,
+				    volid,
+				    pname,
+				    volname,
+				    &handle);
 	    if (code == -2)	/* DESTROY_ME flag set */
 		continue;
 	} else {
@@ -2751,12 +2867,11 @@ VolXListVolumes(struct rx_call *a_rxCidP, afs_int32 a_partID,
 	    handle.volinfo_type = VOLINT_INFO_TYPE_EXT;
 	    handle.volinfo_ptr.ext = xInfoP;
 
-	    code = GetVolInfo(a_partID,
-			      volid,
-			      pname,
-			      volname,
-			      &handle,
-			      VOL_INFO_LIST_MULTIPLE);
+	    code = GetVolInfoCached(a_partID,
+				    volid,
+				    pname,
+				    volname,
+				    &handle);
 	    if (code == -2)	/* DESTROY_ME flag set */
 		continue;
 	} else {
@@ -3175,6 +3290,19 @@ SAFSVolSplitVolume(struct rx_call *acall, afs_uint32 ovid, afs_uint32 onew,
 #endif
 }
 
+/* Tell clients which optional features this volserver supports, so
+ * they can fall back for older or differently built servers.
+ */
+afs_int32
+SAFSVolGetCapabilities(struct rx_call *acid, afs_uint32 *capabilities)
+{
+    *capabilities = VOLSER_CAP_DELTA;
+#ifdef HAVE_ZLIB
+    *capabilities |= VOLSER_CAP_COMPRESS;
+#endif
+    return 0;
+}
+
 /* GetPartName - map partid (a decimal number) into pname (a string)
  * Since for NT we actually want to return the drive name, we map through the
  * partition struct.
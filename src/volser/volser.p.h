@@ -172,11 +172,13 @@ struct partList {		/*used by the backup system */
 #define RV_NOCLONE	0x080000
 #define RV_NODEL        0x100000
 #define RV_RWONLY	0x200000
+#define RV_COMPRESS	0x400000
 
 /* Values for the UV_ReleaseVolume flags parameters */
 #define REL_COMPLETE    0x000001  /* force a complete release */
 #define REL_FULLDUMPS   0x000002  /* force full dumps */
 #define REL_STAYUP      0x000004  /* dump to clones to avoid offline time */
+#define REL_COMPRESS    0x000008  /* compress dumps if all sites can */
 
 struct ubik_client;
 extern afs_uint32 vsu_GetVolumeID(char *astring, struct ubik_client *acstruct, afs_int32 *errp);
@@ -22,6 +22,7 @@ extern afs_int32 split_volume(struct rx_call *, Volume *, Volume *,
 /* voltrans.c */
 extern struct volser_trans *FindTrans(afs_int32);
 extern struct volser_trans *NewTrans(VolumeId, afs_int32);
+extern int TransExists(VolumeId, afs_int32);
 extern struct volser_trans *TransList(void);
 extern afs_int32 DeleteTrans(struct volser_trans *atrans, afs_int32 lock);
 extern afs_int32 TRELE (struct volser_trans *);
@@ -29,6 +30,20 @@ extern afs_int32 TRELE (struct volser_trans *);
 /* volprocs.c */
 extern int VPFullUnlock(void);
 
+/* volsummary.c */
+struct volsummary {
+    VolumeDiskData hdr;		/* the volume's header */
+    int inUse;			/* as reported by the list RPCs */
+    int needsSalvaged;		/* as reported by the list RPCs */
+};
+extern int volSummaryTTL;
+extern afs_uint32 VolSummaryGeneration(void);
+extern int VolSummaryLookup(afs_int32 partId, VolumeId volid,
+			    struct volsummary *summary);
+extern void VolSummaryStore(afs_int32 partId, VolumeId volid,
+			    afs_uint32 gen, struct volsummary *summary);
+extern void VolSummaryInvalidate(afs_int32 partId, VolumeId volid);
+
 /* voltrans.c */
 extern afs_int32 GCTrans(void);
 
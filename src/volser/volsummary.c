@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2026 The OpenAFS Contributors. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR `AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * A cache of the volume headers seen by ListVolumes and XListVolumes.
+ *
+ * Listing a partition with full information means attaching every volume
+ * on it, and for demand attach asking the fileserver about each one too.
+ * With many volumes per server that takes minutes.  Instead we remember
+ * the header of each volume we list, and answer later listings from it
+ * for volSummaryTTL seconds.  Whenever a transaction on a volume starts
+ * or ends, we forget that volume, so changes made through the volserver
+ * are seen at once.  Changes made by the fileserver, such as to the disk
+ * usage, are seen within volSummaryTTL seconds.  Expired headers, such as
+ * those of volumes removed behind our back, are swept out once per
+ * volSummaryTTL.
+ */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <afs/opr.h>
+#ifdef AFS_PTHREAD_ENV
+# include <opr/lock.h>
+#endif
+
+#include <rx/rx.h>
+#include <rx/rx_queue.h>
+#include <afs/afsint.h>
+#include <afs/nfs.h>
+#include <lock.h>
+#include <afs/ihandle.h>
+#include <afs/vnode.h>
+#include <afs/volume.h>
+
+#include "volint.h"
+#include "volser.h"
+#include "volser_internal.h"
+
+#define VOLSUMMARY_HASHSIZE	4096	/* must be a power of 2 */
+#define VOLSUMMARY_HASH(part, vol) \
+    (((vol) ^ ((afs_uint32)(part) << 8)) & (VOLSUMMARY_HASHSIZE - 1))
+
+struct volsummary_entry {
+    struct volsummary_entry *next;
+    afs_int32 partId;
+    VolumeId volid;
+    afs_uint32 cachedAt;	/* when the header was read */
+    struct volsummary data;
+};
+
+int volSummaryTTL = 0;		/* seconds; 0 disables the cache */
+
+static struct volsummary_entry *volSummaryHash[VOLSUMMARY_HASHSIZE];
+static afs_uint32 volSummaryGeneration = 1;
+static afs_uint32 volSummarySwept;	/* time of the last sweep */
+#ifdef AFS_PTHREAD_ENV
+static pthread_mutex_t volSummaryLock = PTHREAD_MUTEX_INITIALIZER;
+# define VOLSUMMARY_LOCK	opr_mutex_enter(&volSummaryLock)
+# define VOLSUMMARY_UNLOCK	opr_mutex_exit(&volSummaryLock)
+#else
+# define VOLSUMMARY_LOCK
+# define VOLSUMMARY_UNLOCK
+#endif
+
+static struct volsummary_entry **
+FindSummary_r(afs_int32 partId, VolumeId volid)
+{
+    struct volsummary_entry **ep;
+
+    ep = &volSummaryHash[VOLSUMMARY_HASH(partId, volid)];
+    for (; *ep; ep = &(*ep)->next) {
+	if ((*ep)->volid == volid && (*ep)->partId == partId)
+	    break;
+    }
+    return ep;
+}
+
+/* Free every expired header. */
+static void
+SweepSummaries_r(afs_uint32 now)
+{
+    struct volsummary_entry **epp, *ep;
+    int i;
+
+    for (i = 0; i < VOLSUMMARY_HASHSIZE; i++) {
+	for (epp = &volSummaryHash[i]; (ep = *epp) != NULL;) {
+	    if (now - ep->cachedAt >= volSummaryTTL) {
+		*epp = ep->next;
+		free(ep);
+	    } else {
+		epp = &ep->next;
+	    }
+	}
+    }
+    volSummarySwept = now;
+}
+
+/*
+ * Return a generation number to pass to VolSummaryStore.  A header read
+ * after this is called is only stored if no volume was changed meanwhile.
+ */
+afs_uint32
+VolSummaryGeneration(void)
+{
+    afs_uint32 gen;
+
+    VOLSUMMARY_LOCK;
+    gen = volSummaryGeneration;
+    VOLSUMMARY_UNLOCK;
+    return gen;
+}
+
+/*
+ * Copy out the cached header of a volume; returns 1 if it is fresh.  An
+ * expired header is freed.
+ */
+int
+VolSummaryLookup(afs_int32 partId, VolumeId volid,
+		 struct volsummary *summary)
+{
+    struct volsummary_entry **epp, *ep;
+    int found = 0;
+
+    if (volSummaryTTL <= 0)
+	return 0;
+    VOLSUMMARY_LOCK;
+    epp = FindSummary_r(partId, volid);
+    ep = *epp;
+    if (ep && FT_ApproxTime() - ep->cachedAt < volSummaryTTL) {
+	*summary = ep->data;
+	found = 1;
+    } else if (ep) {
+	*epp = ep->next;
+	free(ep);
+    }
+    VOLSUMMARY_UNLOCK;
+    return found;
+}
+
+void
+VolSummaryStore(afs_int32 partId, VolumeId volid, afs_uint32 gen,
+		struct volsummary *summary)
+{
+    struct volsummary_entry **epp, *ep;
+    afs_uint32 now = FT_ApproxTime();
+
+    if (volSummaryTTL <= 0)
+	return;
+    VOLSUMMARY_LOCK;
+    if (gen != volSummaryGeneration) {
+	VOLSUMMARY_UNLOCK;
+	return;
+    }
+    if (now - volSummarySwept >= volSummaryTTL)
+	SweepSummaries_r(now);
+    epp = FindSummary_r(partId, volid);
+    ep = *epp;
+    if (ep == NULL) {
+	ep = malloc(sizeof(*ep));
+	if (ep == NULL) {
+	    VOLSUMMARY_UNLOCK;
+	    return;
+	}
+	ep->next = NULL;
+	ep->partId = partId;
+	ep->volid = volid;
+	*epp = ep;
+    }
+    ep->cachedAt = now;
+    ep->data = *summary;
+    VOLSUMMARY_UNLOCK;
+}
+
+/* Forget what we know about a volume, which is being changed. */
+void
+VolSummaryInvalidate(afs_int32 partId, VolumeId volid)
+{
+    struct volsummary_entry **epp, *ep;
+
+    VOLSUMMARY_LOCK;
+    volSummaryGeneration++;
+    epp = FindSummary_r(partId, volid);
+    ep = *epp;
+    if (ep) {
+	*epp = ep->next;
+	free(ep);
+    }
+    VOLSUMMARY_UNLOCK;
+}
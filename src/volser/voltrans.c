@@ -84,9 +84,29 @@ NewTrans(VolumeId avol, afs_int32 apart)
     VTRANS_OBJ_LOCK_INIT(tt);
     allTrans = tt;
     VTRANS_UNLOCK;
+    /* the volume may change from now on; forget its listed header */
+    VolSummaryInvalidate(apart, avol);
     return tt;
 }
 
+/* return 1 if a transaction is open on the volume, and 0 otherwise */
+int
+TransExists(VolumeId avol, afs_int32 apart)
+{
+    struct volser_trans *tt;
+    int found = 0;
+
+    VTRANS_LOCK;
+    for (tt = allTrans; tt; tt = tt->next) {
+	if (tt->volid == avol && tt->partition == apart) {
+	    found = 1;
+	    break;
+	}
+    }
+    VTRANS_UNLOCK;
+    return found;
+}
+
 /* find a trans, again returning with high ref count */
 struct volser_trans *
 FindTrans(afs_int32 atrans)
@@ -125,8 +145,10 @@ DeleteTrans(struct volser_trans *atrans, afs_int32 lock)
     lt = &allTrans;
     for (tt = *lt; tt; lt = &tt->next, tt = *lt) {
 	if (tt == atrans) {
-	    if (tt->volume)
+	    if (tt->volume) {
 		VDetachVolume(&error, tt->volume);
+		VolSummaryInvalidate(tt->partition, tt->volid);
+	    }
 	    tt->volume = NULL;
 	    if (tt->rxCallPtr)
 		rxi_CallError(tt->rxCallPtr, RX_CALL_DEAD);
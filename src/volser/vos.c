@@ -2283,6 +2283,7 @@ MoveVolume(struct cmd_syndesc *as, void *arock)
 
     flags = 0;
     if (as->parms[5].items) flags |= RV_NOCLONE;
+    if (as->parms[6].items) flags |= RV_COMPRESS;
 
     /*
      * check source partition for space to clone volume
@@ -2440,6 +2441,7 @@ CopyVolume(struct cmd_syndesc *as, void *arock)
     if (as->parms[6].items) flags |= RV_OFFLINE;
     if (as->parms[7].items) flags |= RV_RDONLY;
     if (as->parms[8].items) flags |= RV_NOCLONE;
+    if (as->parms[9].items) flags |= RV_COMPRESS;
 
     MapPartIdIntoName(topart, toPartName);
     MapPartIdIntoName(frompart, fromPartName);
@@ -2900,6 +2902,8 @@ ReleaseVolume(struct cmd_syndesc *as, void *arock)
     }
     if (as->parms[3].items) /* -force-reclone */
         flags |= REL_COMPLETE;
+    if (as->parms[4].items) /* -compress */
+	flags |= REL_COMPRESS;
 
     avolid = vsu_GetVolumeID(as->parms[0].items->data, cstruct, &err);
     if (avolid == 0) {
@@ -3003,6 +3007,8 @@ DumpVolumeCmd(struct cmd_syndesc *as, void *arock)
     }
 
     flags = as->parms[6].items ? VOLDUMPV2_OMITDIRS : 0;
+    if (as->parms[7].items)
+	flags |= VOLDUMPV2_COMPRESS;
 retry_dump:
     if (as->parms[5].items) {
 	code =
@@ -3013,8 +3019,9 @@ retry_dump:
 	    UV_DumpVolume(avolid, aserver, apart, fromdate, DumpFunction,
 			  filename, flags);
     }
-    if ((code == RXGEN_OPCODE) && (as->parms[6].items)) {
-	flags &= ~VOLDUMPV2_OMITDIRS;
+    if ((code == RXGEN_OPCODE)
+	&& (flags & (VOLDUMPV2_OMITDIRS | VOLDUMPV2_COMPRESS))) {
+	flags &= ~(VOLDUMPV2_OMITDIRS | VOLDUMPV2_COMPRESS);
 	goto retry_dump;
     }
     if (code) {
@@ -6046,6 +6053,8 @@ main(int argc, char **argv)
 		"partition name on destination");
     cmd_AddParm(ts, "-live", CMD_FLAG, CMD_OPTIONAL,
 		"copy live volume without cloning");
+    cmd_AddParm(ts, "-compress", CMD_FLAG, CMD_OPTIONAL,
+		"compress the data sent between the servers");
     COMMONPARMS;
 
     ts = cmd_CreateSyntax("copy", CopyVolume, NULL, 0, "copy a volume");
@@ -6064,6 +6073,8 @@ main(int argc, char **argv)
 		"make new volume read-only");
     cmd_AddParm(ts, "-live", CMD_FLAG, CMD_OPTIONAL,
 		"copy live volume without cloning");
+    cmd_AddParm(ts, "-compress", CMD_FLAG, CMD_OPTIONAL,
+		"compress the data sent between the servers");
     COMMONPARMS;
 
     ts = cmd_CreateSyntax("shadow", ShadowVolume, NULL, 0,
@@ -6122,6 +6133,8 @@ main(int argc, char **argv)
 		"release to cloned temp vol, then clone back to repsite RO");
     cmd_AddParm(ts, "-force-reclone", CMD_FLAG, CMD_OPTIONAL,
 		"force a reclone and complete release with incremental dumps");
+    cmd_AddParm(ts, "-compress", CMD_FLAG, CMD_OPTIONAL,
+		"compress the data sent to the read-only sites");
     COMMONPARMS;
 
     ts = cmd_CreateSyntax("dump", DumpVolumeCmd, NULL, 0, "dump a volume");
@@ -6134,6 +6147,8 @@ main(int argc, char **argv)
 		"dump a clone of the volume");
     cmd_AddParm(ts, "-omitdirs", CMD_FLAG, CMD_OPTIONAL,
 		"omit unchanged directories from an incremental dump");
+    cmd_AddParm(ts, "-compress", CMD_FLAG, CMD_OPTIONAL,
+		"compress the dump");
     COMMONPARMS;
 
     ts = cmd_CreateSyntax("restore", RestoreVolumeCmd, NULL, 0,
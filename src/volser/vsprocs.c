@@ -168,6 +168,18 @@ static int GetTrans(struct nvldbentry *vldbEntryPtr, afs_int32 index,
 		    struct rx_connection **connPtr, afs_int32 * transPtr,
 		    afs_uint32 * crtimePtr, afs_uint32 * uptimePtr,
 		    afs_int32 *origflags, afs_uint32 tmpVolId);
+static double ElapsedSeconds(struct timeval *start);
+static afs_int32 ForwardIncremental(struct rx_connection *fromconn,
+				    afs_int32 fromtid, afs_int32 fromdate,
+				    afs_int32 basetid,
+				    struct rx_connection *toconn,
+				    struct destServer *destination,
+				    afs_int32 totid,
+				    struct restoreCookie *cookie,
+				    afs_int32 fwdflags);
+static int HasCapability(struct rx_connection *conn, afs_uint32 cap);
+static afs_int32 CompressFlags(struct rx_connection *fromconn,
+			       struct rx_connection **toconns, int ntoconns);
 static int SimulateForwardMultiple(struct rx_connection *fromconn,
 				   afs_int32 fromtid, afs_int32 fromdate,
 				   manyDests * tr, afs_int32 flags,
@@ -1501,7 +1513,8 @@ UV_ConvertRO(afs_uint32 server, afs_uint32 partition, afs_uint32 volid,
  * <atopart>.  The operation is almost idempotent.  The following
  * flags are recognized:
  *
- *     RV_NOCLONE - don't use a copy clone
+ *     RV_NOCLONE  - don't use a copy clone
+ *     RV_COMPRESS - compress the dumps if both servers can
  */
 
 int
@@ -1525,6 +1538,7 @@ UV_MoveVolume2(afs_uint32 afromvol, afs_uint32 afromserver, afs_int32 afrompart,
     char *volName = 0;
     char tmpName[VOLSER_MAXVOLNAME + 1];
     afs_int32 rcode;
+    afs_int32 fwdflags = 0;
     afs_int32 fromDate;
     afs_int32 tmp;
     afs_uint32 tmpVol;
@@ -1681,6 +1695,11 @@ UV_MoveVolume2(afs_uint32 afromvol, afs_uint32 afromserver, afs_int32 afrompart,
     toconn = UV_Bind(atoserver, AFSCONF_VOLUMEPORT);	/* get connections to the servers */
     fromconn = UV_Bind(afromserver, AFSCONF_VOLUMEPORT);
     totid = 0;	/* initialize to uncreated */
+    if (flags & RV_COMPRESS) {
+	struct rx_connection *tconn = toconn;
+
+	fwdflags = CompressFlags(fromconn, &tconn, 1);
+    }
 
     /* ***
      * clone the read/write volume locally.
@@ -1841,21 +1860,16 @@ UV_MoveVolume2(afs_uint32 afromvol, afs_uint32 afromserver, afs_int32 afrompart,
 	/* Copy the clone to the new volume */
 	VPRINT2("Dumping from clone %u on source to volume %u on destination ...",
 		newVol, afromvol);
-	code =
-	    AFSVolForward(fromconn, clonetid, 0, &destination, totid,
-			  &cookie);
+	if (fwdflags)
+	    code =
+		AFSVolForwardV2(fromconn, clonetid, 0, &destination, totid,
+				&cookie, fwdflags);
+	else
+	    code =
+		AFSVolForward(fromconn, clonetid, 0, &destination, totid,
+			      &cookie);
 	EGOTO1(mfail, code, "Failed to move data for the volume %u\n", volid);
 	VDONE;
-
-	VPRINT1("Ending transaction on cloned volume %u ...", newVol);
-	code = AFSVolEndTrans(fromconn, clonetid, &rcode);
-	if (!code)
-	    code = rcode;
-	clonetid = 0;
-	EGOTO1(mfail, code,
-	       "Failed to end the transaction on the cloned volume %u\n",
-	       newVol);
-	VDONE;
     }
 
     /* ***
@@ -1877,13 +1891,25 @@ UV_MoveVolume2(afs_uint32 afromvol, afs_uint32 afromserver, afs_int32 afrompart,
 	 (flags & RV_NOCLONE) ? "" : " incremental",
 	 afromvol);
     code =
-	AFSVolForward(fromconn, fromtid, fromDate, &destination, totid,
-		      &cookie);
+	ForwardIncremental(fromconn, fromtid, fromDate, clonetid, toconn,
+			   &destination, totid, &cookie, fwdflags);
     EGOTO1(mfail, code,
 	   "Failed to do the%s dump from rw volume on old site to rw volume on newsite\n",
 	  (flags & RV_NOCLONE) ? "" : " incremental");
     VDONE;
 
+    if (clonetid) {
+	VPRINT1("Ending transaction on cloned volume %u ...", newVol);
+	code = AFSVolEndTrans(fromconn, clonetid, &rcode);
+	if (!code)
+	    code = rcode;
+	clonetid = 0;
+	EGOTO1(mfail, code,
+	       "Failed to end the transaction on the cloned volume %u\n",
+	       newVol);
+	VDONE;
+    }
+
     /* now adjust the flags so that the new volume becomes official */
     VPRINT1("Setting volume flags on old source volume %u ...", afromvol);
     code = AFSVolSetFlags(fromconn, fromtid, VTOutOfService);
@@ -2314,6 +2340,7 @@ UV_MoveVolume(afs_uint32 afromvol, afs_uint32 afromserver, afs_int32 afrompart,
  *     RV_CPINCR  - do incremental dump if target exists
  *     RV_NOVLDB  - don't create/update VLDB entry
  *     RV_NOCLONE - don't use a copy clone
+ *     RV_COMPRESS - compress the dumps if both servers can
  */
 int
 UV_CopyVolume2(afs_uint32 afromvol, afs_uint32 afromserver, afs_int32 afrompart,
@@ -2332,6 +2359,7 @@ UV_CopyVolume2(afs_uint32 afromvol, afs_uint32 afromserver, afs_int32 afrompart,
 
     char vname[64];
     afs_int32 rcode;
+    afs_int32 fwdflags = 0;
     afs_int32 fromDate, cloneFromDate;
     struct restoreCookie cookie;
     afs_int32 vcode, code;
@@ -2368,6 +2396,11 @@ UV_CopyVolume2(afs_uint32 afromvol, afs_uint32 afromserver, afs_int32 afrompart,
     toconn = UV_Bind(atoserver, AFSCONF_VOLUMEPORT);	/* get connections to the servers */
     fromconn = UV_Bind(afromserver, AFSCONF_VOLUMEPORT);
     fromtid = totid = 0;	/* initialize to uncreated */
+    if (flags & RV_COMPRESS) {
+	struct rx_connection *tconn = toconn;
+
+	fwdflags = CompressFlags(fromconn, &tconn, 1);
+    }
 
     /* ***
      * clone the read/write volume locally.
@@ -2564,22 +2597,31 @@ cpincr:
 	/* Copy the clone to the new volume */
 	VPRINT2("Dumping from clone %u on source to volume %u on destination ...",
 	    cloneVol, newVol);
-	code =
-	    AFSVolForward(fromconn, clonetid, cloneFromDate, &destination,
-			  totid, &cookie);
+	if (fwdflags)
+	    code =
+		AFSVolForwardV2(fromconn, clonetid, cloneFromDate,
+				&destination, totid, &cookie, fwdflags);
+	else
+	    code =
+		AFSVolForward(fromconn, clonetid, cloneFromDate, &destination,
+			      totid, &cookie);
 	EGOTO1(mfail, code, "Failed to move data for the volume %u\n",
 	       newVol);
 	VDONE;
 
-	VPRINT1("Ending transaction on cloned volume %u ...", cloneVol);
-	code = AFSVolEndTrans(fromconn, clonetid, &rcode);
-	if (!code)
-	    code = rcode;
-	clonetid = 0;
-	EGOTO1(mfail, code,
-	       "Failed to end the transaction on the cloned volume %u\n",
-	       cloneVol);
-	VDONE;
+	/* After an incremental copy to an existing volume we can't be sure
+	 * the destination matches the clone, so don't send deltas. */
+	if (cloneFromDate) {
+	    VPRINT1("Ending transaction on cloned volume %u ...", cloneVol);
+	    code = AFSVolEndTrans(fromconn, clonetid, &rcode);
+	    if (!code)
+		code = rcode;
+	    clonetid = 0;
+	    EGOTO1(mfail, code,
+		   "Failed to end the transaction on the cloned volume %u\n",
+		   cloneVol);
+	    VDONE;
+	}
     }
 
     /* ***
@@ -2601,13 +2643,25 @@ cpincr:
 	 (flags & RV_NOCLONE) ? "" : " incremental",
 	 afromvol);
     code =
-	AFSVolForward(fromconn, fromtid, fromDate, &destination, totid,
-		      &cookie);
+	ForwardIncremental(fromconn, fromtid, fromDate, clonetid, toconn,
+			   &destination, totid, &cookie, fwdflags);
     EGOTO1(mfail, code,
 	   "Failed to do the%s dump from old site to new site\n",
 	   (flags & RV_NOCLONE) ? "" : " incremental");
     VDONE;
 
+    if (clonetid) {
+	VPRINT1("Ending transaction on cloned volume %u ...", cloneVol);
+	code = AFSVolEndTrans(fromconn, clonetid, &rcode);
+	if (!code)
+	    code = rcode;
+	clonetid = 0;
+	EGOTO1(mfail, code,
+	       "Failed to end the transaction on the cloned volume %u\n",
+	       cloneVol);
+	VDONE;
+    }
+
     VPRINT1("Setting volume flags on destination volume %u ...", newVol);
     volflag = ((flags & RV_OFFLINE) ? VTOutOfService : 0);	/* off or on-line */
     code = AFSVolSetFlags(toconn, totid, volflag);
@@ -3325,6 +3379,74 @@ SimulateForwardMultiple(struct rx_connection *fromconn, afs_int32 fromtid,
     return 0;
 }
 
+/*
+ * Forward the incremental dump of a move or copy.  If the transaction on the
+ * clone the first pass was dumped from is still open, and the servers know
+ * how to, the files that changed since the clone are sent as block deltas
+ * against it.  Otherwise the whole of each changed file is sent, compressed
+ * if fwdflags asks for it.
+ */
+static afs_int32
+ForwardIncremental(struct rx_connection *fromconn, afs_int32 fromtid,
+		   afs_int32 fromdate, afs_int32 basetid,
+		   struct rx_connection *toconn,
+		   struct destServer *destination, afs_int32 totid,
+		   struct restoreCookie *cookie, afs_int32 fwdflags)
+{
+    if (basetid && fromdate && HasCapability(fromconn, VOLSER_CAP_DELTA)
+	&& HasCapability(toconn, VOLSER_CAP_DELTA))
+	return AFSVolForwardDelta(fromconn, fromtid, fromdate, basetid,
+				  destination, totid, cookie);
+    if (fwdflags)
+	return AFSVolForwardV2(fromconn, fromtid, fromdate, destination,
+			       totid, cookie, fwdflags);
+    return AFSVolForward(fromconn, fromtid, fromdate, destination, totid,
+			 cookie);
+}
+
+/*
+ * Return 1 if the volserver on conn reports the VOLSER_CAP_* bit cap, and 0
+ * if it does not or predates GetCapabilities.
+ */
+static int
+HasCapability(struct rx_connection *conn, afs_uint32 cap)
+{
+    afs_uint32 caps = 0;
+
+    return AFSVolGetCapabilities(conn, &caps) == 0 && (caps & cap) != 0;
+}
+
+/*
+ * Return VOLFORWARD_COMPRESS if the volserver on fromconn can send
+ * compressed dumps and those on toconns can receive them, and 0 otherwise.
+ */
+static afs_int32
+CompressFlags(struct rx_connection *fromconn,
+	      struct rx_connection **toconns, int ntoconns)
+{
+    int i;
+
+    for (i = -1; i < ntoconns; i++) {
+	if (!HasCapability(i < 0 ? fromconn : toconns[i],
+			   VOLSER_CAP_COMPRESS)) {
+	    VPRINT("Not all servers can compress dumps; sending them uncompressed\n");
+	    return 0;
+	}
+    }
+    return VOLFORWARD_COMPRESS;
+}
+
+/* Seconds elapsed since start, for the timings printed with -verbose */
+static double
+ElapsedSeconds(struct timeval *start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec)
+	+ (now.tv_usec - start->tv_usec) / 1000000.0;
+}
+
 /**
  * Check if a trans has timed out, and recreate it if necessary.
  *
@@ -3466,6 +3588,7 @@ UV_ReleaseVolume(afs_uint32 afromvol, afs_uint32 afromserver,
     int islocked = 0;
     afs_int32 clonetid = 0, onlinetid;
     afs_int32 fromtid = 0;
+    afs_int32 fwdflags;
     afs_uint32 fromdate = 0;
     afs_uint32 thisdate;
     time_t tmv;
@@ -3489,6 +3612,8 @@ UV_ReleaseVolume(afs_uint32 afromvol, afs_uint32 afromserver,
     int justnewsites = 0; /* are we just trying to release to new RO sites? */
     int sites = 0; /* number of ro sites */
     int new_sites = 0; /* number of ro sites markes as new */
+    struct timeval releaseStart, stepStart;
+    double cloneTime = 0, forwardTime = 0, stepTime;
 
     typedef enum {
         CR_PARTIAL    = 0x0000, /**< just new sites added or recover from a previous failed release */
@@ -3504,6 +3629,7 @@ UV_ReleaseVolume(afs_uint32 afromvol, afs_uint32 afromserver,
     memset(remembertime, 0, sizeof(remembertime));
     memset(&results, 0, sizeof(results));
     memset(origflags, 0, sizeof(origflags));
+    gettimeofday(&releaseStart, NULL);
 
     vcode = ubik_VL_SetLock(cstruct, 0, afromvol, RWVOL, VLOP_RELEASE);
     if (vcode != VL_RERELEASE)
@@ -3829,9 +3955,11 @@ UV_ReleaseVolume(afs_uint32 afromvol, afs_uint32 afromserver,
 	    strcpy(vname, "readonly-clone-temp");
 	}
 
+	gettimeofday(&stepStart, NULL);
 	code = DoVolClone(fromconn, afromvol, afrompart, readonlyVolume,
 			  cloneVolId, roclone?"permanent RO":
 			  "temporary RO", NULL, vname, NULL, &volstatus, NULL);
+	cloneTime = ElapsedSeconds(&stepStart);
 	if (code) {
 	    error = code;
 	    goto rfail;
@@ -4104,15 +4232,26 @@ UV_ReleaseVolume(afs_uint32 afromvol, afs_uint32 afromserver,
 	/* Release the ones we have collected */
 	tr.manyDests_val = &(replicas[0]);
 	tr.manyDests_len = results.manyResults_len = volcount;
+	fwdflags = 0;
+	if (flags & REL_COMPRESS)
+	    fwdflags = CompressFlags(fromconn, toconns, volcount);
+	gettimeofday(&stepStart, NULL);
 	code =
 	    AFSVolForwardMultiple(fromconn, fromtid, fromdate, &tr,
-				  0 /*spare */ , &cookie, &results);
+				  fwdflags, &cookie, &results);
 	if (code == RXGEN_OPCODE) {	/* RPC Interface Mismatch */
 	    code =
 		SimulateForwardMultiple(fromconn, fromtid, fromdate, &tr,
-					0 /*spare */ , &cookie, &results);
+					fwdflags, &cookie, &results);
 	    nservers = 1;
 	}
+	stepTime = ElapsedSeconds(&stepStart);
+	forwardTime += stepTime;
+	if (verbose) {
+	    fprintf(STDOUT, "ForwardMulti to %d site%s took %.2f seconds.\n",
+		    volcount, volcount == 1 ? "" : "s", stepTime);
+	    fflush(STDOUT);
+	}
 
 	if (code) {
 	    PrintError("Release failed: ", code);
@@ -4232,6 +4371,15 @@ UV_ReleaseVolume(afs_uint32 afromvol, afs_uint32 afromserver,
     ONERROR(vcode, afromvol, " Could not update VLDB entry for volume %u\n");
     VDONE;
 
+    if (verbose) {
+	stepTime = ElapsedSeconds(&releaseStart);
+	fprintf(STDOUT, "Release of volume %lu took %.2f seconds "
+		"(clone %.2f, forward %.2f, other %.2f).\n",
+		(unsigned long)afromvol, stepTime, cloneTime, forwardTime,
+		stepTime - cloneTime - forwardTime);
+	fflush(STDOUT);
+    }
+
   rfail:
     if (clonetid) {
 	code = AFSVolEndTrans(fromconn, clonetid, &rcode);
@@ -4363,7 +4511,7 @@ UV_DumpVolume(afs_uint32 afromvol, afs_uint32 afromserver, afs_int32 afrompart,
     fromcall = rx_NewCall(fromconn);
 
     VEPRINT1("Starting volume dump on volume %u...", afromvol);
-    if (flags & VOLDUMPV2_OMITDIRS)
+    if (flags & (VOLDUMPV2_OMITDIRS | VOLDUMPV2_COMPRESS))
 	code = StartAFSVolDumpV2(fromcall, fromtid, fromdate, flags);
     else
 	code = StartAFSVolDump(fromcall, fromtid, fromdate);
@@ -4513,7 +4661,7 @@ UV_DumpClonedVolume(afs_uint32 afromvol, afs_uint32 afromserver,
     fromcall = rx_NewCall(fromconn);
 
     VEPRINT1("Starting volume dump from cloned volume %u...", clonevol);
-    if (flags & VOLDUMPV2_OMITDIRS)
+    if (flags & (VOLDUMPV2_OMITDIRS | VOLDUMPV2_COMPRESS))
 	code = StartAFSVolDumpV2(fromcall, clonetid, fromdate, flags);
     else
 	code = StartAFSVolDump(fromcall, clonetid, fromdate);
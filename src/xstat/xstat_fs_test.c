@@ -78,6 +78,14 @@ static char *xferOpNames[] = {
     "StoreData"
 };
 
+static char *phaseNames[] = {
+    "queue",
+    "host",
+    "volume",
+    "disk",
+    "net"
+};
+
 
 /*------------------------------------------------------------------------
  * PrintCallInfo
@@ -494,6 +502,82 @@ PrintCbCounters(void) {
 }
 
 
+/*------------------------------------------------------------------------
+ * PrintPhaseInfo
+ *
+ * Description:
+ *	Print out the AFS_XSTATSCOLL_PHASE_INFO collection we just
+ *	received.  For each RPC which has been called, show the time
+ *	its calls spent in each phase, and in none of them.
+ *
+ * Arguments:
+ *	None.
+ *
+ * Returns:
+ *	Nothing.
+ *
+ * Environment:
+ *	All the info we need is nestled into xstat_fs_Results.
+ *
+ * Side Effects:
+ *	As advertised.
+ *------------------------------------------------------------------------*/
+
+void
+PrintPhaseInfo(void)
+{
+    struct fs_stats_PhaseStats *phaseP;	/*Ptr to phase stats */
+    struct fs_stats_phaseData *opP;	/*Ptr to one RPC's phases */
+    char *printableTime;	/*Ptr to printable time string */
+    time_t probeTime = xstat_fs_Results.probeTime;
+    afs_int32 numInt32s = xstat_fs_Results.data.AFS_CollData_len;
+    static afs_int32 phaseInt32s = (sizeof(struct fs_stats_PhaseStats) >> 2);	/*Correct # int32s to rcv */
+    double total, other, t;
+    int currIdx, phase;
+
+    printableTime = ctime(&probeTime);
+    printableTime[strlen(printableTime) - 1] = '\0';
+    printf("AFS_XSTATSCOLL_PHASE_INFO (coll %d) for FS %s\n[Probe %u, %s]\n\n",
+	   xstat_fs_Results.collectionNumber,
+	   xstat_fs_Results.connP->hostName, xstat_fs_Results.probeNum,
+	   printableTime);
+
+    phaseP = (struct fs_stats_PhaseStats *)
+	xstat_fs_Results.data.AFS_CollData_val;
+    if (numInt32s != phaseInt32s
+	|| phaseP->numPhases != FS_STATS_NUM_PHASES) {
+	printf("** Data size mismatch in phase collection!\n");
+	printf("** Expecting %u, got %u\n", phaseInt32s, numInt32s);
+	return;
+    }
+
+    printf("\t%10u epoch\n", phaseP->epoch);
+    for (currIdx = 0; currIdx < FS_STATS_NUM_RPC_OPS; currIdx++) {
+	opP = &phaseP->rpcOpPhases[currIdx];
+	if (opP->numOps == 0)
+	    continue;
+	total = opP->totalTime.tv_sec + opP->totalTime.tv_usec / 1000000.0;
+	printf("%s: %u ops, time sum=%.6f\n", opNames[currIdx],
+	       opP->numOps, total);
+	other = total;
+	for (phase = 0; phase < FS_STATS_NUM_PHASES; phase++) {
+	    t = opP->sumTime[phase].tv_sec
+		+ opP->sumTime[phase].tv_usec / 1000000.0;
+	    other -= t;
+	    printf("\t%-6s sum=%.6f (%4.1f%%), max=%lu.%06lu\n",
+		   phaseNames[phase], t,
+		   total > 0 ? 100.0 * t / total : 0.0,
+		   (long)opP->maxTime[phase].tv_sec,
+		   (long)opP->maxTime[phase].tv_usec);
+	}
+	if (other < 0)
+	    other = 0;
+	printf("\t%-6s sum=%.6f (%4.1f%%)\n", "other", other,
+	       total > 0 ? 100.0 * other / total : 0.0);
+    }
+}
+
+
 /*------------------------------------------------------------------------
  * FS_Handler
  *
@@ -566,6 +650,10 @@ FS_Handler(void)
 	PrintCbCounters();
 	break;
 
+    case AFS_XSTATSCOLL_PHASE_INFO:
+	PrintPhaseInfo();
+	break;
+
     default:
 	printf("** Unknown collection: %d\n",
 	       xstat_fs_Results.collectionNumber);
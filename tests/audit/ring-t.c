@@ -0,0 +1,174 @@
+/* Tests of the ring which threaded servers queue audit events in */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <sys/wait.h>
+
+#include <tests/tap/basic.h>
+
+#include <rx/rx.h>
+#include <afs/audit.h>
+
+#define NEVENTS		20000
+#define PADSIZE		200		/* NEVENTS records fill the ring 4 times */
+#define BIGSIZE		(2 * 1024 * 1024)	/* more than the whole ring */
+#define NSTARTEVENTS	1	/* AFS_Aud_On or _Off, audited at startup */
+
+struct ring_stats {
+    unsigned long long queued;
+    unsigned long long written;
+    unsigned long long batches;
+    unsigned long long dropped;
+};
+
+/*
+ * In a child, audit nevents events to path, and then one event too big
+ * for the ring if big is set.  The statistics are written to statspath
+ * once everything has been queued; the ring is drained as the child
+ * exits.
+ */
+static int
+RunAuditor(char *path, char *statspath, int nevents, int big)
+{
+    char pad[PADSIZE];
+    char *bigstr;
+    FILE *stats;
+    pid_t pid;
+    int i, status;
+
+    pid = fork();
+    if (pid < 0)
+	sysbail("fork");
+    if (pid > 0) {
+	if (waitpid(pid, &status, 0) < 0)
+	    sysbail("waitpid");
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+
+    osi_audit_init();
+    if (osi_audit_interface("file") != 0 || osi_audit_file(path) != 0)
+	exit(1);
+    memset(pad, 'x', sizeof(pad) - 1);
+    pad[sizeof(pad) - 1] = '\0';
+    for (i = 0; i < nevents; i++)
+	osi_audit("AFS_Ring_Test", 0, AUD_INT, i, AUD_STR, pad, AUD_END);
+    if (big) {
+	bigstr = malloc(BIGSIZE);
+	if (bigstr == NULL)
+	    exit(1);
+	memset(bigstr, 'y', BIGSIZE - 1);
+	bigstr[BIGSIZE - 1] = '\0';
+	osi_audit("AFS_Ring_Big", 0, AUD_STR, bigstr, AUD_END);
+    }
+    stats = fopen(statspath, "w");
+    if (stats == NULL)
+	exit(1);
+    audit_PrintStats(stats);
+    fclose(stats);
+    exit(0);
+}
+
+static int
+ReadStats(char *statspath, struct ring_stats *rs)
+{
+    FILE *stats;
+    int n;
+
+    memset(rs, 0, sizeof(*rs));
+    stats = fopen(statspath, "r");
+    if (stats == NULL)
+	return -1;
+    n = fscanf(stats, "audit ring: %llu events queued, %llu written in %llu "
+	       "batches, %llu dropped", &rs->queued, &rs->written,
+	       &rs->batches, &rs->dropped);
+    fclose(stats);
+    return n == 4 ? 0 : -1;
+}
+
+/*
+ * Check the events in the audit log; returns the number of events seen
+ * and sets *inorder if they are the events 0, 1, 2, ... in that order.
+ */
+static int
+ReadLog(char *path, int *inorder, int *sawbig)
+{
+    FILE *log;
+    char *line, *p;
+    size_t size = 0;
+    int n = 0;
+
+    *inorder = 1;
+    *sawbig = 0;
+    log = fopen(path, "r");
+    if (log == NULL)
+	return -1;
+    line = NULL;
+    while (getline(&line, &size, log) > 0) {
+	if (strstr(line, "AFS_Ring_Big") != NULL) {
+	    *sawbig = 1;
+	    continue;
+	}
+	if (strstr(line, "AFS_Ring_Test") == NULL)
+	    continue;
+	p = strstr(line, "INT ");
+	if (p == NULL || atoi(p + 4) != n)
+	    *inorder = 0;
+	n++;
+    }
+    free(line);
+    fclose(log);
+    return n;
+}
+
+int
+main(int argc, char **argv)
+{
+    char *dirname, *path, *statspath;
+    struct ring_stats rs;
+    int n, inorder, sawbig;
+
+    plan(9);
+
+    dirname = strdup("/tmp/afs_XXXXXX");
+    if (dirname == NULL || mkdtemp(dirname) == NULL)
+	sysbail("mkdtemp");
+    if (asprintf(&path, "%s/AuditLog", dirname) < 0
+	|| asprintf(&statspath, "%s/stats", dirname) < 0)
+	sysbail("asprintf");
+
+    /* fill the ring several times over, and drain it at exit */
+    is_int(0, RunAuditor(path, statspath, NEVENTS, 0),
+	   "auditing through the ring works");
+    ok(ReadStats(statspath, &rs) == 0, "ring statistics are reported");
+    ok(rs.queued == NSTARTEVENTS + NEVENTS && rs.dropped == 0,
+       "every event is queued, even once the ring has filled");
+    n = ReadLog(path, &inorder, &sawbig);
+    is_int(NEVENTS, n, "every event is written out before exit");
+    ok(inorder, "... in the order they were made");
+
+    /* an event which cannot fit is dropped, and counted */
+    is_int(0, RunAuditor(path, statspath, 1, 1),
+	   "auditing an event bigger than the ring works");
+    ok(ReadStats(statspath, &rs) == 0 && rs.queued == NSTARTEVENTS + 1
+       && rs.dropped == 1,
+       "the big event is dropped and counted");
+    n = ReadLog(path, &inorder, &sawbig);
+    ok(n == 1 && inorder, "events before it are still written");
+    ok(!sawbig, "the big event is not written");
+
+    unlink(path);
+    unlink(statspath);
+    free(path);
+    path = NULL;
+    if (asprintf(&path, "%s/AuditLog.old", dirname) >= 0) {
+	unlink(path);
+	free(path);
+    }
+    rmdir(dirname);
+    free(statspath);
+    free(dirname);
+    return 0;
+}
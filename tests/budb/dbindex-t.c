@@ -0,0 +1,218 @@
+/* Tests of the backup database's in-memory indexes, which answer FindDump
+ * and FindLatestDump, and of their rebuilding when the database changes */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <rx/rx.h>
+#include <ubik.h>
+
+#include <afs/com_err.h>
+#include <afs/cellconfig.h>
+#include <afs/bubasics.h>
+#include <afs/budb.h>
+#include <afs/budb_errs.h>
+
+#include <tests/tap/basic.h>
+
+#include "common.h"
+
+#define VOLSET	"vsA"
+
+static int
+GetBUDBClient(struct afsconf_dir *dir, struct rx_securityClass *secClass,
+	      int secIndex, struct ubik_client **ubikClient)
+{
+    struct afsconf_cell info;
+    struct rx_connection *serverconns[MAXSERVERS];
+    int code, i;
+
+    code = afsconf_GetCellInfo(dir, NULL, NULL, &info);
+    if (code)
+	return code;
+    for (i = 0; i < info.numServers; i++) {
+	serverconns[i] = rx_NewConnection(info.hostAddr[i].sin_addr.s_addr,
+					  htons(AFSCONF_BUDBPORT),
+					  BUDB_SERVICE, secClass, secIndex);
+    }
+    serverconns[i] = NULL;
+    *ubikClient = NULL;
+    return ubik_ClientInit(serverconns, ubikClient);
+}
+
+/* Record a dump of VOLSET with one tape, holding volume volName cloned at
+ * clone.  The dump's id is also its creation date. */
+static int
+AddDump(struct ubik_client *uc, afs_uint32 id, int level, char *volName,
+	afs_int32 clone)
+{
+    struct budb_dumpEntry de;
+    struct budb_tapeEntry te;
+    struct budb_volumeEntry ve;
+    afs_int32 new;
+    int code;
+
+    memset(&de, 0, sizeof(de));
+    de.id = id;
+    de.created = id;
+    de.level = level;
+    strlcpy(de.volumeSetName, VOLSET, sizeof(de.volumeSetName));
+    strlcpy(de.dumpPath, level ? "/full/inc" : "/full", sizeof(de.dumpPath));
+    snprintf(de.name, sizeof(de.name), "%s.%s", VOLSET,
+	     level ? "inc" : "full");
+    de.flags = BUDB_DUMP_INPROGRESS;
+    code = ubik_BUDB_CreateDump(uc, 0, &de);
+    if (code)
+	return code;
+
+    memset(&te, 0, sizeof(te));
+    snprintf(te.name, sizeof(te.name), "%s.%u", VOLSET, id);
+    te.dump = id;
+    te.flags = BUDB_TAPE_BEINGWRITTEN;
+    te.written = id;
+    te.seq = 1;
+    code = ubik_BUDB_UseTape(uc, 0, &te, &new);
+    if (code)
+	return code;
+
+    memset(&ve, 0, sizeof(ve));
+    strlcpy(ve.name, volName, sizeof(ve.name));
+    ve.id = 536870912;
+    strlcpy(ve.server, "server", sizeof(ve.server));
+    ve.tapeSeq = 1;
+    ve.clone = clone;
+    ve.dump = id;
+    strlcpy(ve.tape, te.name, sizeof(ve.tape));
+    ve.position = 1;
+    code = ubik_BUDB_AddVolume(uc, 0, &ve);
+    if (code)
+	return code;
+
+    code = ubik_BUDB_FinishTape(uc, 0, &te);
+    if (code)
+	return code;
+    de.flags = 0;
+    return ubik_BUDB_FinishDump(uc, 0, &de);
+}
+
+/* Return the id of the dump FindDump picks, or the error it fails with */
+static afs_int32
+FindDump(struct ubik_client *uc, char *volName, afs_int32 beforeDate)
+{
+    struct budb_dumpEntry de;
+    int code;
+
+    memset(&de, 0, sizeof(de));
+    code = ubik_BUDB_FindDump(uc, 0, volName, beforeDate, &de);
+    return code ? code : de.id;
+}
+
+/* Return the id of the dump FindLatestDump picks, or the error */
+static afs_int32
+FindLatestDump(struct ubik_client *uc, char *level)
+{
+    struct budb_dumpEntry de;
+    int code;
+
+    memset(&de, 0, sizeof(de));
+    code = ubik_BUDB_FindLatestDump(uc, 0, VOLSET, level, &de);
+    return code ? code : de.id;
+}
+
+int
+main(int argc, char **argv)
+{
+    char *dirname;
+    struct afsconf_dir *dir;
+    int code, secIndex;
+    pid_t serverPid;
+    struct rx_securityClass *secClass;
+    struct ubik_client *uc = NULL;
+    budb_dumpsList dumps;
+
+    /* Skip all tests if the current hostname can't be resolved */
+    afstest_SkipTestsIfBadHostname();
+    /* Skip all tests if the current hostname is on the loopback network */
+    afstest_SkipTestsIfLoopbackNetIsDefault();
+
+    plan(19);
+
+    code = rx_Init(0);
+
+    dirname = afstest_BuildTestConfig();
+
+    dir = afsconf_Open(dirname);
+
+    code = afstest_AddDESKeyFile(dir);
+    if (code) {
+	afs_com_err("dbindex-t", code, "while adding test DES keyfile");
+	return 1;
+    }
+
+    code = afstest_StartBUServer(dirname, &serverPid);
+    if (code) {
+	afs_com_err("dbindex-t", code, "while starting the budb server");
+	return 1;
+    }
+
+    /* Let it figure itself out ... */
+    sleep(5);
+    code = afsconf_ClientAuthSecure(dir, &secClass, &secIndex);
+    is_int(0, code, "Successfully got security class");
+    code = GetBUDBClient(dir, secClass, secIndex, &uc);
+    is_int(0, code, "Successfully built ubik client structure");
+    if (code)
+	bail("cannot talk to the budb server");
+
+    ok(AddDump(uc, 1001, 0, "vol.a", 1000) == 0
+       && AddDump(uc, 1002, 1, "vol.a", 1100) == 0
+       && AddDump(uc, 1003, 0, "vol.a", 1200) == 0,
+       "Recorded three dumps of one volume");
+
+    /* the volume index */
+    is_int(1002, FindDump(uc, "vol.a", 1150),
+	   "FindDump finds the newest clone before a date");
+    is_int(1003, FindDump(uc, "vol.a", 5000),
+	   "FindDump finds the newest clone of all");
+    is_int(1001, FindDump(uc, "vol.a", 1001),
+	   "FindDump finds the oldest clone");
+    is_int(BUDB_NOENT, FindDump(uc, "vol.a", 1000),
+	   "FindDump finds nothing before the first clone");
+    is_int(BUDB_NOVOLUMENAME, FindDump(uc, "vol.none", 5000),
+	   "FindDump does not find an unknown volume");
+
+    /* the dump index */
+    is_int(1003, FindLatestDump(uc, "0"),
+	   "FindLatestDump finds the newest full dump");
+    is_int(1002, FindLatestDump(uc, "1"),
+	   "FindLatestDump finds the newest incremental dump");
+    is_int(BUDB_NODUMPNAME, FindLatestDump(uc, "2"),
+	   "FindLatestDump finds no dump at an unused level");
+
+    /* both are rebuilt once the database changes */
+    is_int(0, AddDump(uc, 1004, 0, "vol.a", 1300),
+	   "Recorded a newer dump");
+    is_int(1004, FindDump(uc, "vol.a", 5000),
+	   "FindDump sees the new clone");
+    is_int(1003, FindDump(uc, "vol.a", 1250),
+	   "... and still finds the older ones");
+    is_int(1004, FindLatestDump(uc, "0"),
+	   "FindLatestDump sees the new dump");
+
+    memset(&dumps, 0, sizeof(dumps));
+    is_int(0, ubik_BUDB_DeleteDump(uc, 0, 1004, 0, 0, &dumps),
+	   "Deleted the newer dump");
+    is_int(1003, FindDump(uc, "vol.a", 5000),
+	   "FindDump no longer finds the deleted clone");
+    is_int(1003, FindLatestDump(uc, "0"),
+	   "FindLatestDump no longer finds the deleted dump");
+    xdr_free((xdrproc_t) xdr_budb_dumpsList, &dumps);
+
+    code = afstest_StopServer(serverPid);
+    is_int(0, code, "Server exited cleanly");
+
+    afstest_UnlinkTestConfig(dirname);
+    return 0;
+}
@@ -19,6 +19,16 @@
 
 int
 afstest_StartVLServer(char *dirname, pid_t *serverPid)
+{
+    return afstest_StartVLServerWithOption(dirname, NULL, NULL, serverPid);
+}
+
+/* As afstest_StartVLServer, but also passing the vlserver a single extra
+ * option (and its value, if not NULL).
+ */
+int
+afstest_StartVLServerWithOption(char *dirname, char *option, char *value,
+				pid_t *serverPid)
 {
     pid_t pid;
 
@@ -42,7 +52,43 @@ afstest_StartVLServer(char *dirname, pid_t *serverPid)
 	    exit(1);
 	}
 	execl(binPath, "vlserver",
-	      "-logfile", logPath, "-database", dbPath, "-config", dirname, NULL);
+	      "-logfile", logPath, "-database", dbPath, "-config", dirname,
+	      option, value, NULL);
+	fprintf(stderr, "Running %s failed\n", binPath);
+	exit(1);
+    }
+    *serverPid = pid;
+
+    return 0;
+}
+
+/* Start up the backup database server, using the configuration in dirname,
+ * and keeping its database there too.
+ */
+int
+afstest_StartBUServer(char *dirname, pid_t *serverPid)
+{
+    pid_t pid;
+
+    pid = fork();
+    if (pid == -1) {
+	exit(1);
+    } else if (pid == 0) {
+	char *binPath, *dbPath, *build;
+
+	/* Child */
+	build = getenv("BUILD");
+
+	if (build == NULL)
+	    build = "..";
+
+	if (asprintf(&binPath, "%s/../src/tbudb/budb_server", build) < 0 ||
+	    asprintf(&dbPath, "%s/", dirname) < 0) {
+	    fprintf(stderr, "Out of memory building budb_server arguments\n");
+	    exit(1);
+	}
+	execl(binPath, "budb_server",
+	      "-database", dbPath, "-cellservdb", dirname, NULL);
 	fprintf(stderr, "Running %s failed\n", binPath);
 	exit(1);
     }
@@ -0,0 +1,301 @@
+/*
+ * Copyright 2000, International Business Machines Corporation and others.
+ * All Rights Reserved.
+ *
+ * This software has been released under the terms of the IBM Public
+ * License.  For details, see the LICENSE file in the top-level source
+ * directory or online at http://www.openafs.org/dl/license10.html
+ */
+
+/*
+ * Tests for the AES routines in hcrypto, which may use the processor's
+ * AES instructions, against the portable rijndael code they fall back to.
+ *
+ * Run as "aes-t -b" to instead time both, and the RFC3961 aes-cts-hmac
+ * enctypes, on Rx packet sized buffers.
+ */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <tests/tap/basic.h>
+
+#include <hcrypto/aes.h>
+#include "rijndael-alg-fst.h"
+#include <afs/rfc3961.h>
+
+#define PACKET_SIZE	1412	/* a full Rx packet of data */
+#define KU_TEST		1026	/* any key usage will do */
+
+/* FIPS-197 appendix C */
+static const unsigned char fips_plain[16] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+    0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+};
+static const unsigned char fips_key[32] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+    0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f
+};
+static const unsigned char fips_cipher128[16] = {
+    0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+    0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+};
+static const unsigned char fips_cipher256[16] = {
+    0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf,
+    0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89
+};
+
+static const int lengths[] = { 16, 48, 64, 80, 1408, PACKET_SIZE, 1413 };
+
+/*
+ * CBC as hcrypto does it, using only the rijndael code.  An AES_KEY holds
+ * a rijndael key schedule whichever code is in use.
+ */
+static void
+reference_cbc(const unsigned char *in, unsigned char *out, unsigned long size,
+	      const AES_KEY *key, unsigned char *iv, int encrypt)
+{
+    unsigned char tmp[16], dec[16];
+    int i, n;
+
+    while (size > 0) {
+	n = size < 16 ? size : 16;
+	if (encrypt) {
+	    memcpy(tmp, iv, 16);
+	    for (i = 0; i < n; i++)
+		tmp[i] ^= in[i];
+	    rijndaelEncrypt(key->key, key->rounds, tmp, out);
+	    memcpy(iv, out, 16);
+	} else {
+	    memcpy(tmp, in, 16);
+	    rijndaelDecrypt(key->key, key->rounds, tmp, dec);
+	    for (i = 0; i < n; i++)
+		out[i] = dec[i] ^ iv[i];
+	    memcpy(iv, tmp, 16);
+	}
+	size -= n;
+	in += 16;
+	out += 16;
+    }
+}
+
+static void
+fill(unsigned char *buf, size_t len, unsigned int seed)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+	seed = seed * 1103515245 + 12345;
+	buf[i] = seed >> 16;
+    }
+}
+
+static void
+test_blocks(void)
+{
+    AES_KEY k;
+    unsigned char out[16];
+
+    AES_set_encrypt_key(fips_key, 128, &k);
+    AES_encrypt(fips_plain, out, &k);
+    ok(memcmp(out, fips_cipher128, 16) == 0, "AES-128 encrypts a block");
+    AES_set_decrypt_key(fips_key, 128, &k);
+    AES_decrypt(fips_cipher128, out, &k);
+    ok(memcmp(out, fips_plain, 16) == 0, "AES-128 decrypts a block");
+
+    AES_set_encrypt_key(fips_key, 256, &k);
+    AES_encrypt(fips_plain, out, &k);
+    ok(memcmp(out, fips_cipher256, 16) == 0, "AES-256 encrypts a block");
+    AES_set_decrypt_key(fips_key, 256, &k);
+    AES_decrypt(fips_cipher256, out, &k);
+    ok(memcmp(out, fips_plain, 16) == 0, "AES-256 decrypts a block");
+}
+
+static void
+test_cbc(int bits)
+{
+    unsigned char key[32], iv[16], iv2[16];
+    unsigned char in[PACKET_SIZE + 16], out[PACKET_SIZE + 16];
+    unsigned char ref[PACKET_SIZE + 16];
+    AES_KEY k;
+    int i, len;
+
+    fill(key, sizeof(key), bits);
+    for (i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+	len = lengths[i];
+	fill(in, sizeof(in), len);
+
+	fill(iv, sizeof(iv), 1);
+	fill(iv2, sizeof(iv2), 1);
+	AES_set_encrypt_key(key, bits, &k);
+	AES_cbc_encrypt(in, out, len, &k, iv, AES_ENCRYPT);
+	reference_cbc(in, ref, len, &k, iv2, 1);
+	ok(memcmp(out, ref, (len + 15) & ~15) == 0 && memcmp(iv, iv2, 16) == 0,
+	   "AES-%d CBC encrypts %d bytes", bits, len);
+
+	fill(iv, sizeof(iv), 2);
+	fill(iv2, sizeof(iv2), 2);
+	AES_set_decrypt_key(key, bits, &k);
+	AES_cbc_encrypt(in, out, len, &k, iv, AES_DECRYPT);
+	reference_cbc(in, ref, len, &k, iv2, 0);
+	ok(memcmp(out, ref, len) == 0 && memcmp(iv, iv2, 16) == 0,
+	   "AES-%d CBC decrypts %d bytes", bits, len);
+    }
+
+    /* Decrypting in place works too. */
+    fill(in, sizeof(in), 3);
+    memcpy(out, in, sizeof(in));
+    fill(iv, sizeof(iv), 4);
+    fill(iv2, sizeof(iv2), 4);
+    AES_cbc_encrypt(out, out, PACKET_SIZE, &k, iv, AES_DECRYPT);
+    reference_cbc(in, ref, PACKET_SIZE, &k, iv2, 0);
+    ok(memcmp(out, ref, PACKET_SIZE) == 0,
+       "AES-%d CBC decrypts in place", bits);
+}
+
+static krb5_error_code
+make_crypto(krb5_context ctx, krb5_enctype enctype, krb5_crypto *crypto)
+{
+    krb5_keyblock kb;
+    krb5_error_code code;
+
+    code = krb5_keyblock_init(ctx, enctype, fips_key,
+			      enctype == ETYPE_AES128_CTS_HMAC_SHA1_96 ? 16 : 32,
+			      &kb);
+    if (code)
+	return code;
+    code = krb5_crypto_init(ctx, &kb, enctype, crypto);
+    krb5_free_keyblock_contents(ctx, &kb);
+    return code;
+}
+
+static void
+test_rfc3961(krb5_context ctx, krb5_enctype enctype, const char *name)
+{
+    krb5_crypto crypto;
+    krb5_data cipher, plain;
+    unsigned char in[PACKET_SIZE];
+    int good = 0;
+
+    fill(in, sizeof(in), 5);
+    if (make_crypto(ctx, enctype, &crypto) == 0) {
+	if (krb5_encrypt(ctx, crypto, KU_TEST, in, sizeof(in), &cipher) == 0) {
+	    if (krb5_decrypt(ctx, crypto, KU_TEST, cipher.data, cipher.length,
+			     &plain) == 0) {
+		good = plain.length == sizeof(in) &&
+		       memcmp(plain.data, in, sizeof(in)) == 0;
+		krb5_data_free(&plain);
+	    }
+	    krb5_data_free(&cipher);
+	}
+	krb5_crypto_destroy(ctx, crypto);
+    }
+    ok(good, "%s round trips a packet", name);
+}
+
+static double
+now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void
+report(const char *what, int npackets, double start)
+{
+    double secs = now() - start;
+
+    printf("%-40s %8.0f packets/s %8.1f MB/s\n", what, npackets / secs,
+	   npackets * (double)PACKET_SIZE / secs / (1024 * 1024));
+}
+
+static void
+benchmark(krb5_context ctx)
+{
+    unsigned char in[PACKET_SIZE + 16], out[PACKET_SIZE + 16], iv[16];
+    AES_KEY k;
+    krb5_crypto crypto;
+    krb5_data cipher, plain;
+    int n = 50000, i;
+    double start;
+
+    fill(in, sizeof(in), 6);
+    memset(iv, 0, sizeof(iv));
+
+    AES_set_encrypt_key(fips_key, 256, &k);
+    start = now();
+    for (i = 0; i < n; i++)
+	reference_cbc(in, out, PACKET_SIZE, &k, iv, 1);
+    report("rijndael AES-256 CBC encrypt", n, start);
+
+    start = now();
+    for (i = 0; i < n; i++)
+	AES_cbc_encrypt(in, out, PACKET_SIZE, &k, iv, AES_ENCRYPT);
+    report("hcrypto AES-256 CBC encrypt", n, start);
+
+    AES_set_decrypt_key(fips_key, 256, &k);
+    start = now();
+    for (i = 0; i < n; i++)
+	reference_cbc(in, out, PACKET_SIZE, &k, iv, 0);
+    report("rijndael AES-256 CBC decrypt", n, start);
+
+    start = now();
+    for (i = 0; i < n; i++)
+	AES_cbc_encrypt(in, out, PACKET_SIZE, &k, iv, AES_DECRYPT);
+    report("hcrypto AES-256 CBC decrypt", n, start);
+
+    if (make_crypto(ctx, ETYPE_AES256_CTS_HMAC_SHA1_96, &crypto) != 0)
+	return;
+    start = now();
+    for (i = 0; i < n; i++) {
+	krb5_encrypt(ctx, crypto, KU_TEST, in, PACKET_SIZE, &cipher);
+	krb5_decrypt(ctx, crypto, KU_TEST, cipher.data, cipher.length, &plain);
+	krb5_data_free(&cipher);
+	krb5_data_free(&plain);
+    }
+    report("aes256-cts-hmac-sha1-96 seal+open", n, start);
+    krb5_crypto_destroy(ctx, crypto);
+
+    start = now();
+    for (i = 0; i < n; i++) {
+	make_crypto(ctx, ETYPE_AES256_CTS_HMAC_SHA1_96, &crypto);
+	krb5_encrypt(ctx, crypto, KU_TEST, in, PACKET_SIZE, &cipher);
+	krb5_decrypt(ctx, crypto, KU_TEST, cipher.data, cipher.length, &plain);
+	krb5_data_free(&cipher);
+	krb5_data_free(&plain);
+	krb5_crypto_destroy(ctx, crypto);
+    }
+    report("  ... with a new context per packet", n, start);
+}
+
+int
+main(int argc, char **argv)
+{
+    krb5_context ctx;
+
+    if (krb5_init_context(&ctx) != 0)
+	bail("krb5_init_context failed");
+
+    if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+	benchmark(ctx);
+	krb5_free_context(ctx);
+	return 0;
+    }
+
+    plan(4 + 2 * (2 * 7 + 1) + 2);
+
+    test_blocks();
+    test_cbc(128);
+    test_cbc(256);
+    test_rfc3961(ctx, ETYPE_AES128_CTS_HMAC_SHA1_96, "aes128-cts-hmac-sha1-96");
+    test_rfc3961(ctx, ETYPE_AES256_CTS_HMAC_SHA1_96, "aes256-cts-hmac-sha1-96");
+
+    krb5_free_context(ctx);
+    return 0;
+}
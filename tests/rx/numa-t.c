@@ -0,0 +1,134 @@
+/* Tests of the per NUMA node global free packet queues */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <tests/tap/basic.h>
+
+#include <rx/rx.h>
+#include <rx/rx_packet.h>
+#include <rx/rx_globals.h>
+
+#define NPKTS	8
+#define NOTHER	4	/* how many of them to pretend are another node's */
+
+static int
+CrossNodeFrees(void)
+{
+    struct rx_statistics *s;
+    int n;
+
+    s = rx_GetStatistics();
+    n = s->crossNodeFrees;
+    rx_FreeStatistics(&s);
+    return n;
+}
+
+/* Count the packets of pkts on the given node's global free queue */
+static int
+CountOnNode(int node, struct rx_packet **pkts, int npkts)
+{
+    struct opr_queue *cursor;
+    int i, n = 0;
+
+    for (opr_queue_Scan(&rx_nodeFreePacketQueue[node], cursor)) {
+	for (i = 0; i < npkts; i++)
+	    if (cursor == &pkts[i]->entry)
+		n++;
+    }
+    return n;
+}
+
+/* Check the node queues add up to rx_nFreePackets */
+static int
+NodesAddUp(void)
+{
+    int node, total = 0;
+
+    for (node = 0; node < RX_MAXNODES; node++)
+	total += rx_nNodeFreePackets[node];
+    return total == rx_nFreePackets;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct rx_packet *pkts[NPKTS];
+    struct opr_queue q, *cursor;
+    int home, other, i, n, nhome, frees, allhome, inorder;
+
+    plan(12);
+
+    if (rx_Init(0) != 0)
+	bail("rx_Init failed");
+
+    home = rxi_PacketNode();
+    other = (home + 1) % RX_MAXNODES;
+    ok(home >= 0 && home < RX_MAXNODES, "the current node is in range");
+
+    /* alloc */
+    allhome = 1;
+    for (i = 0; i < NPKTS; i++) {
+	pkts[i] = rxi_AllocPacket(RX_PACKET_CLASS_SEND);
+	if (pkts[i] == NULL)
+	    bail("rxi_AllocPacket failed");
+	if (pkts[i]->node != home)
+	    allhome = 0;
+    }
+    ok(allhome, "packets made by this thread belong to its node");
+
+    /* free, with some of them standing in for another node's packets */
+    for (i = 0; i < NOTHER; i++)
+	pkts[i]->node = other;
+    frees = CrossNodeFrees();
+    for (i = 0; i < NPKTS; i++)
+	rxi_FreePacket(pkts[i]);
+    is_int(NOTHER, CrossNodeFrees() - frees,
+	   "freeing another node's packets is counted");
+
+    /* and flushed to the global queues */
+    rxi_FlushLocalPacketsTSFPQ();
+    MUTEX_ENTER(&rx_freePktQ_lock);
+    is_int(NOTHER, rx_nNodeFreePackets[other],
+	   "another node's packets go back to its queue");
+    is_int(NOTHER, CountOnNode(other, pkts, NPKTS), "... all of them");
+    is_int(NPKTS - NOTHER, CountOnNode(home, pkts + NOTHER, NPKTS - NOTHER),
+	   "this node's packets go back to its own queue");
+    ok(NodesAddUp(), "the node queues add up to the free packet count");
+
+    /* alloc from the global queues prefers the thread's own node */
+    nhome = rx_nNodeFreePackets[home];
+    opr_queue_Init(&q);
+    n = rxi_GetNodeFreePackets(home, nhome, &q);
+    is_int(nhome, n, "a thread can take all of its node's packets");
+    allhome = 1;
+    for (opr_queue_Scan(&q, cursor))
+	if (opr_queue_Entry(cursor, struct rx_packet, entry)->node != home)
+	    allhome = 0;
+    ok(allhome, "... and takes none from other nodes while it has them");
+    n += rxi_GetNodeFreePackets(home, NOTHER, &q);
+    is_int(nhome + NOTHER, n, "then it takes other nodes' packets");
+    inorder = 1;
+    i = 0;
+    for (opr_queue_Scan(&q, cursor)) {
+	if (i++ >= nhome
+	    && opr_queue_Entry(cursor, struct rx_packet, entry)->node != other)
+	    inorder = 0;
+    }
+    ok(inorder, "... after its own");
+
+    /* and give them all back */
+    rx_nFreePackets -= n;
+    MUTEX_EXIT(&rx_freePktQ_lock);
+    rxi_FreePackets(0, &q);
+    rxi_FlushLocalPacketsTSFPQ();
+    MUTEX_ENTER(&rx_freePktQ_lock);
+    ok(NodesAddUp() && rx_nNodeFreePackets[other] == NOTHER,
+       "freed packets return to their own nodes' queues");
+    MUTEX_EXIT(&rx_freePktQ_lock);
+
+    rx_Finalize();
+    return 0;
+}
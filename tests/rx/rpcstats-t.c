@@ -0,0 +1,132 @@
+/* Tests of the per-process rx rpc statistics, kept by each thread */
+
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+#include <pthread.h>
+
+#include <tests/tap/basic.h>
+
+#include <rx/rx.h>
+
+#define NTHREADS	4
+#define NCALLS		1000
+#define INTERFACE	1234
+#define NFUNCS		3
+
+/* words in a marshalled rx_function_entry_v1, and in a histogram */
+#define V1_WORDS	(sizeof(rx_function_entry_v1_t) / sizeof(afs_uint32))
+#define HIST_WORDS	(sizeof(rx_function_hist_t) / sizeof(afs_uint32))
+
+static void *
+caller(void *arg)
+{
+    struct clock queue = { 0, 0 };
+    struct clock fast = { 0, 5 };	/* bucket 3 */
+    struct clock slow = { 0, 3000 };	/* bucket 12 */
+    afs_hyper_t sent, rcvd;
+    int i;
+
+    hset64(sent, 0, 100);
+    hset64(rcvd, 0, 10);
+    for (i = 0; i < NCALLS; i++) {
+	rx_IncrementTimeAndCount(NULL, INTERFACE, 1, NFUNCS, &queue,
+				 (i & 1) ? &slow : &fast, &sent, &rcvd, 1);
+    }
+    return NULL;
+}
+
+static afs_uint64
+get64(afs_uint32 *p)
+{
+    return ((afs_uint64)p[0] << 32) + p[1];
+}
+
+int
+main(int argc, char **argv)
+{
+    pthread_t threads[NTHREADS];
+    afs_uint32 version, sec, usec, count, *stats, *rec, *hist;
+    size_t size;
+    int i, code;
+
+    plan(14);
+
+    code = rx_Init(0);
+    is_int(0, code, "rx_Init works");
+    rx_enableProcessRPCStats();
+
+    for (i = 0; i < NTHREADS; i++)
+	pthread_create(&threads[i], NULL, caller, NULL);
+    for (i = 0; i < NTHREADS; i++)
+	pthread_join(threads[i], NULL);
+
+    code = rx_RetrieveProcessRPCStats(RX_STATS_RETRIEVAL_FIRST_EDITION,
+				      &version, &sec, &usec, &size, &count,
+				      &stats);
+    ok(code == 0 && count == NFUNCS
+       && size == NFUNCS * sizeof(rx_function_entry_v1_t),
+       "first edition stats have one entry per function");
+    is_int(RX_STATS_RETRIEVAL_VERSION, version, "... and our version");
+    rx_FreeRPCStats(stats, size);
+
+    code = rx_RetrieveProcessRPCStats(RX_STATS_RETRIEVAL_HISTOGRAM_EDITION,
+				      &version, &sec, &usec, &size, &count,
+				      &stats);
+    ok(code == 0 && count == NFUNCS
+       && size == NFUNCS * (V1_WORDS + HIST_WORDS) * sizeof(afs_uint32),
+       "histogram edition stats have one entry per function");
+
+    rec = stats + (V1_WORDS + HIST_WORDS) * 1;
+    hist = rec + V1_WORDS;
+    is_int(1, rec[5], "second entry is for function 1");
+    is_int(NTHREADS * NCALLS, get64(&rec[6]),
+	   "invocations from all threads are counted");
+    is_int(NTHREADS * NCALLS * 100, get64(&rec[8]), "bytes sent are added up");
+    ok(rec[24] == 0 && rec[25] == 5 && rec[26] == 0 && rec[27] == 3000,
+       "minimum and maximum execution times are kept");
+    is_int(NTHREADS * NCALLS, get64(&hist[0]), "queue times are in bucket 0");
+    ok(get64(&hist[2 * RX_STATS_HIST_BUCKETS + 2 * 3]) == NTHREADS * NCALLS / 2
+       && get64(&hist[2 * RX_STATS_HIST_BUCKETS + 2 * 12])
+	  == NTHREADS * NCALLS / 2,
+       "execution times are in buckets 3 and 12");
+    is_int(0, get64(&stats[6]), "other functions are not counted");
+    rx_FreeRPCStats(stats, size);
+
+    /* the threads above have exited; their counts must outlive them, and
+     * be carried on by the threads which take over their statistics */
+    for (i = 0; i < NTHREADS; i++)
+	pthread_create(&threads[i], NULL, caller, NULL);
+    for (i = 0; i < NTHREADS; i++)
+	pthread_join(threads[i], NULL);
+    code = rx_RetrieveProcessRPCStats(RX_STATS_RETRIEVAL_HISTOGRAM_EDITION,
+				      &version, &sec, &usec, &size, &count,
+				      &stats);
+    rec = stats + (V1_WORDS + HIST_WORDS) * 1;
+    ok(code == 0 && count == NFUNCS
+       && get64(&rec[6]) == 2 * NTHREADS * NCALLS,
+       "counts of exited threads are kept");
+    rx_FreeRPCStats(stats, size);
+
+    rx_clearProcessRPCStats(AFS_RX_STATS_CLEAR_ALL);
+    code = rx_RetrieveProcessRPCStats(RX_STATS_RETRIEVAL_HISTOGRAM_EDITION,
+				      &version, &sec, &usec, &size, &count,
+				      &stats);
+    rec = stats + (V1_WORDS + HIST_WORDS) * 1;
+    hist = rec + V1_WORDS;
+    ok(code == 0 && count == NFUNCS && get64(&rec[6]) == 0
+       && get64(&hist[0]) == 0,
+       "clearing the stats clears every thread's");
+    rx_FreeRPCStats(stats, size);
+
+    rx_disableProcessRPCStats();
+    code = rx_RetrieveProcessRPCStats(RX_STATS_RETRIEVAL_HISTOGRAM_EDITION,
+				      &version, &sec, &usec, &size, &count,
+				      &stats);
+    ok(code == 0 && count == 0 && stats == NULL,
+       "nothing is returned once the stats are disabled");
+
+    rx_Finalize();
+    return 0;
+}
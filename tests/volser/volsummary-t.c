@@ -0,0 +1,125 @@
+#include <afsconfig.h>
+#include <afs/param.h>
+
+#include <roken.h>
+
+#include <rx/rx.h>
+#include <rx/rx_queue.h>
+#include <afs/afsint.h>
+#include <afs/nfs.h>
+#include <lock.h>
+#include <afs/ihandle.h>
+#include <afs/vnode.h>
+#include <afs/volume.h>
+
+#include <tests/tap/basic.h>
+
+#include "volint.h"
+#include "volser.h"
+#include "volser_internal.h"
+
+#define PART	0
+#define VOLA	536870915
+#define VOLB	536870918
+
+/*
+ * These follow the volume summary cache the way the list RPCs and the
+ * transaction code use it.  A listing takes a generation before reading
+ * a header and stores the header afterwards; creating, deleting and
+ * renaming a volume all open a transaction on it, which invalidates it.
+ */
+
+/* List one volume; returns 1 if the answer came from the cache. */
+static int
+ListVolume(VolumeId volid, char *name, char *listed)
+{
+    struct volsummary summary;
+    afs_uint32 gen;
+
+    if (VolSummaryLookup(PART, volid, &summary)) {
+	strlcpy(listed, summary.hdr.name, VNAMESIZE);
+	return 1;
+    }
+    gen = VolSummaryGeneration();
+    memset(&summary, 0, sizeof(summary));
+    summary.hdr.id = volid;
+    strlcpy(summary.hdr.name, name, sizeof(summary.hdr.name));
+    VolSummaryStore(PART, volid, gen, &summary);
+    strlcpy(listed, name, VNAMESIZE);
+    return 0;
+}
+
+/* What NewTrans does when a volume is created, deleted or renamed. */
+static void
+ChangeVolume(VolumeId volid)
+{
+    VolSummaryInvalidate(PART, volid);
+}
+
+int
+main(int argc, char **argv)
+{
+    struct volsummary summary;
+    char listed[VNAMESIZE];
+    afs_uint32 gen;
+
+    plan(16);
+
+    /* The cache is off unless -list-cache-ttl is given. */
+    is_int(0, volSummaryTTL, "the cache is disabled by default");
+    ListVolume(VOLA, "vol.a", listed);
+    ok(!ListVolume(VOLA, "vol.a", listed),
+       "with the cache disabled, nothing is answered from it");
+
+    volSummaryTTL = 60;
+
+    /* create */
+    ok(!VolSummaryLookup(PART, VOLB, &summary),
+       "a volume never listed is not cached");
+    ListVolume(VOLA, "vol.a", listed);
+    ok(ListVolume(VOLA, "vol.a", listed), "a listed volume is cached");
+    ChangeVolume(VOLB);
+    ok(!ListVolume(VOLB, "vol.b", listed),
+       "a listing after a create reads the new volume");
+    is_string("vol.b", listed, "... and shows it");
+    ok(ListVolume(VOLA, "vol.a", listed),
+       "creating a volume leaves the others cached");
+
+    /* rename */
+    ChangeVolume(VOLA);
+    ok(!ListVolume(VOLA, "vol.renamed", listed),
+       "a listing after a rename rereads the volume");
+    is_string("vol.renamed", listed, "... and shows the new name");
+    ok(ListVolume(VOLA, "vol.renamed", listed),
+       "the new name is cached");
+    is_string("vol.renamed", listed, "... and listed from the cache");
+
+    /* a rename racing with a listing */
+    ChangeVolume(VOLA);
+    gen = VolSummaryGeneration();
+    memset(&summary, 0, sizeof(summary));
+    strlcpy(summary.hdr.name, "vol.stale", sizeof(summary.hdr.name));
+    ChangeVolume(VOLA);
+    VolSummaryStore(PART, VOLA, gen, &summary);
+    ok(!VolSummaryLookup(PART, VOLA, &summary),
+       "a header read before a rename finished is not cached");
+
+    /* delete */
+    ListVolume(VOLB, "vol.b", listed);
+    ChangeVolume(VOLB);
+    ok(!VolSummaryLookup(PART, VOLB, &summary),
+       "a listing after a delete does not find the volume in the cache");
+
+    /* changes made behind our back are seen once the header expires */
+    volSummaryTTL = 1;
+    ListVolume(VOLA, "vol.a", listed);
+    ok(ListVolume(VOLA, "vol.a", listed), "a fresh header is cached");
+    sleep(2);
+    ok(!ListVolume(VOLA, "vol.a", listed), "an expired header is reread");
+
+    volSummaryTTL = 0;
+    ok(!VolSummaryLookup(PART, VOLA, &summary),
+       "disabling the cache stops answering from it");
+
+    return 0;
+}
@@ -10,6 +10,7 @@
 
 #include <afs/com_err.h>
 #include <afs/vldbint.h>
+#include <afs/vlserver.h>
 #include <afs/cellconfig.h>
 
 #include <tests/tap/basic.h>
@@ -90,6 +91,185 @@ TestListAddrs(struct ubik_client *client, char *dirname)
     free(buffer);
 }
 
+static int
+CreateTestEntry(struct ubik_client *client, char *name, afs_uint32 volid,
+		afs_uint32 server, afs_int32 partition)
+{
+    struct nvldbentry entry;
+
+    memset(&entry, 0, sizeof(entry));
+    strlcpy(entry.name, name, sizeof(entry.name));
+    entry.nServers = 1;
+    entry.serverNumber[0] = server;
+    entry.serverPartition[0] = partition;
+    entry.serverFlags[0] = VLSF_RWVOL;
+    entry.volumeId[RWVOL] = volid;
+    entry.flags = VLF_RWEXISTS;
+
+    return ubik_VL_CreateEntryN(client, 0, &entry);
+}
+
+static afs_int32
+CountByAttributes(struct ubik_client *client, afs_int32 mask,
+		  afs_uint32 server, afs_int32 partition)
+{
+    struct VldbListByAttributes attrs;
+    nbulkentries entries;
+    afs_int32 nentries = 0;
+    int code;
+
+    memset(&attrs, 0, sizeof(attrs));
+    memset(&entries, 0, sizeof(entries));
+    attrs.Mask = mask;
+    attrs.server = server;
+    attrs.partition = partition;
+
+    code = ubik_VL_ListAttributesN(client, 0, &attrs, &nentries, &entries);
+    xdr_free((xdrproc_t) xdr_nbulkentries, &entries);
+    if (code)
+	return -1;
+    return nentries;
+}
+
+/* The vlserver answers by-server and by-partition queries from an in-memory
+ * index.  Make sure it returns the same entries a full scan would, and that
+ * it notices entries being added and removed.
+ */
+void
+TestListAttributes(struct ubik_client *client)
+{
+    afs_uint32 serverA = 0x0a010001, serverB = 0x0a010002;
+    int code;
+
+    code = CreateTestEntry(client, "test.a0", 536870912, serverA, 0);
+    is_int(0, code, "Created volume on first server, partition a");
+    code = CreateTestEntry(client, "test.a1", 536870915, serverA, 1);
+    is_int(0, code, "Created volume on first server, partition b");
+    code = CreateTestEntry(client, "test.b0", 536870918, serverB, 0);
+    is_int(0, code, "Created volume on second server, partition a");
+
+    is_int(2, CountByAttributes(client, VLLIST_SERVER, serverA, 0),
+	   "Two volumes listed on first server");
+    is_int(1, CountByAttributes(client, VLLIST_SERVER, serverB, 0),
+	   "One volume listed on second server");
+    is_int(2, CountByAttributes(client, VLLIST_PARTITION, 0, 0),
+	   "Two volumes listed on partition a");
+    is_int(1, CountByAttributes(client, VLLIST_SERVER | VLLIST_PARTITION,
+				serverA, 1),
+	   "One volume listed on first server, partition b");
+    is_int(0, CountByAttributes(client, VLLIST_SERVER, 0x0a010003, 0),
+	   "No volumes listed on unknown server");
+
+    code = CreateTestEntry(client, "test.b1", 536870921, serverB, 1);
+    is_int(0, code, "Created another volume on second server");
+    is_int(2, CountByAttributes(client, VLLIST_SERVER, serverB, 0),
+	   "New volume is listed on second server");
+
+    code = ubik_VL_DeleteEntry(client, 0, 536870912, RWVOL);
+    is_int(0, code, "Deleted volume on first server");
+    is_int(1, CountByAttributes(client, VLLIST_SERVER, serverA, 0),
+	   "Deleted volume is no longer listed on first server");
+}
+
+/* Run a vos command against the test cell, returning its exit status */
+static int
+RunVos(char *dirname, char *args)
+{
+    char *build, *cmd;
+    int status;
+
+    build = getenv("BUILD");
+    if (build == NULL)
+	build = "..";
+    if (asprintf(&cmd, "%s/../src/volser/vos %s -config %s >/dev/null",
+		 build, args, dirname) < 0) {
+	fprintf(stderr, "Out of memory building vos command\n");
+	exit(1);
+    }
+    status = system(cmd);
+    free(cmd);
+    if (status == -1 || !WIFEXITED(status))
+	return -1;
+    return WEXITSTATUS(status);
+}
+
+/* Run vldb_check over the test database */
+static int
+CheckVLDB(char *dirname)
+{
+    char *build, *cmd;
+    int status;
+
+    build = getenv("BUILD");
+    if (build == NULL)
+	build = "..";
+    if (asprintf(&cmd, "%s/../src/vlserver/vldb_check -database %s/vldb.DB0"
+		 " -quiet", build, dirname) < 0) {
+	fprintf(stderr, "Out of memory building vldb_check command\n");
+	exit(1);
+    }
+    status = system(cmd);
+    free(cmd);
+    if (status == -1 || !WIFEXITED(status))
+	return -1;
+    return WEXITSTATUS(status);
+}
+
+/* Restart the vlserver asking for larger hash tables.  The database is
+ * converted by the first write, after which the entries made with the old
+ * tables must still be found, and vldb_check must be happy with the result.
+ * Resizing again must put the first extended table back on the free list
+ * rather than leave it behind as unused space.
+ */
+void
+TestResizeHashTables(char *dirname)
+{
+    pid_t serverPid;
+    int code;
+
+    code = afstest_StartVLServerWithOption(dirname, "-hashsize", "10000",
+					   &serverPid);
+    if (code) {
+	afs_com_err("vos-t", code, "while restarting the vlserver");
+	exit(1);
+    }
+    sleep(5);
+
+    is_int(0, RunVos(dirname, "lock -id test.a1 -localauth"),
+	   "Locked volume after asking for larger hash tables");
+    is_int(0, RunVos(dirname, "listvldb -name test.b1 -noauth"),
+	   "Old volume found by name in the resized tables");
+    is_int(0, RunVos(dirname, "listvldb -name 536870918 -noauth"),
+	   "Old volume found by id in the resized tables");
+    is_int(0, RunVos(dirname, "unlock -id 536870915 -localauth"),
+	   "Unlocked volume by id in the resized tables");
+
+    code = afstest_StopServer(serverPid);
+    is_int(0, code, "Server exited cleanly");
+    is_int(0, CheckVLDB(dirname),
+	   "vldb_check finds no problems with the resized database");
+
+    code = afstest_StartVLServerWithOption(dirname, "-hashsize", "20000",
+					   &serverPid);
+    if (code) {
+	afs_com_err("vos-t", code, "while restarting the vlserver");
+	exit(1);
+    }
+    sleep(5);
+
+    is_int(0, RunVos(dirname, "lock -id test.a1 -localauth"),
+	   "Locked volume after resizing the hash tables again");
+    is_int(0, RunVos(dirname, "listvldb -name test.b1 -noauth"),
+	   "Old volume found by name after resizing again");
+    is_int(0, RunVos(dirname, "unlock -id test.a1 -localauth"),
+	   "Unlocked volume after resizing again");
+
+    code = afstest_StopServer(serverPid);
+    is_int(0, code, "Server exited cleanly");
+    is_int(0, CheckVLDB(dirname),
+	   "vldb_check finds no unused hash table block after resizing again");
+}
+
 int
 main(int argc, char **argv)
 {
@@ -106,7 +286,7 @@ main(int argc, char **argv)
     /* Skip all tests if the current hostname is on the loopback network */
     afstest_SkipTestsIfLoopbackNetIsDefault();
 
-    plan(6);
+    plan(29);
 
     code = rx_Init(0);
 
@@ -148,10 +328,13 @@ main(int argc, char **argv)
     }
 
     TestListAddrs(ubikClient, dirname);
+    TestListAttributes(ubikClient);
 
     code = afstest_StopServer(serverPid);
     is_int(0, code, "Server exited cleanly");
 
+    TestResizeHashTables(dirname);
+
 out:
     afstest_UnlinkTestConfig(dirname);
     return ret;